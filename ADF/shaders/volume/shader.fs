@@ -10,6 +10,24 @@ varying vec4 vPosition;
 uniform bool uSmoothVolume;
 uniform int uSmoothingLevel;
 
+// one texel per brick of the volume, zero where the brick or its neighbours are occupied,
+// otherwise the radius in bricks of the cube of empty bricks around it, divided by 255
+uniform sampler3D uOccupancy;
+uniform vec3 uOccupancySize;
+uniform vec3 uOccupancyScale;
+uniform bool uSkipEmptySpace;
+
+// bounds of the marched bricks in texture coordinates, computed on the CPU as the volume is
+// drilled
+uniform bool uClipToOccupied;
+uniform vec3 uOccupiedMin;
+uniform vec3 uOccupiedMax;
+
+// colors of the labels when the volume holds a label and a density per voxel
+uniform sampler2D uPalette;
+uniform vec3 uVolumeSize;
+uniform bool uUseLabels;
+
 vec3 dx = vec3(uGradientDelta.x, 0.0, 0.0);
 vec3 dy = vec3(0.0, uGradientDelta.y, 0.0);
 vec3 dz = vec3(0.0, 0.0, uGradientDelta.z);
@@ -32,10 +50,44 @@ float entry(vec3 e1, vec3 d)
 }
 
 
+//----------------------------------------------------------------------
+// Returns the number of ray steps that stay inside the cube of empty
+// macro-cells centered on the one containing tc, and 0.0 if that one
+// must be marched.
+//----------------------------------------------------------------------
+
+float emptySteps(vec3 tc, vec3 tc_step)
+{
+    vec3 oc = tc * uOccupancyScale;
+    float radius = floor(texture3D(uOccupancy, oc).r * 255.0 + 0.5);
+    if (radius < 1.0) return 0.0;
+
+    // position and step in macro-cell units
+    vec3 p = oc * uOccupancySize;
+    vec3 d = tc_step * uOccupancyScale * uOccupancySize;
+    vec3 border = floor(p) + step(0.0, d) + sign(d) * (radius - 1.0);
+    vec3 s = abs(border - p) / max(abs(d), vec3(1e-6));
+
+    return floor(min(s.x, min(s.y, s.z)));
+}
+
+
 float isoValue(vec3 tc){
   return texture3D(uVolume, tc).a;
 }
 
+//----------------------------------------------------------------------
+// Color of the volume at tc. The label of the nearest voxel is looked
+// up in the palette, two labels must never be interpolated.
+//----------------------------------------------------------------------
+
+vec3 voxelColor(vec3 tc){
+  if (!uUseLabels) return texture3D(uVolume, tc).rgb;
+  vec3 center = (floor(tc * uVolumeSize) + 0.5) / uVolumeSize;
+  float label = floor(texture3D(uVolume, center).r * 255.0 + 0.5);
+  return texture2D(uPalette, vec2((label + 0.5) / 256.0, 0.5)).rgb;
+}
+
 //----------------------------------------------------------------------
 // Estimates the intensity gradient of the volume in model space
 //----------------------------------------------------------------------
@@ -112,8 +164,35 @@ void main(void)
     vec4 sum = vec4(0.0);
     vec3 tc = gl_TexCoord[0].stp + t_entry * tc_step / t_step;
 
-    for (float t = t_entry; t < 0.0; t += t_step, tc += tc_step)
+    // only march the part of the ray inside the bounds of the marched bricks
+    float t_exit = 0.0;
+    if (uClipToOccupied)
     {
+        vec3 tc_dir = tc_step / t_step;
+        tc_dir += vec3(1e-9) * (1.0 - abs(sign(tc_dir)));
+        vec3 a = (uOccupiedMin - gl_TexCoord[0].stp) / tc_dir;
+        vec3 b = (uOccupiedMax - gl_TexCoord[0].stp) / tc_dir;
+        vec3 u = min(a, b);
+        vec3 v = max(a, b);
+        t_entry = max(t_entry, max(u.x, max(u.y, u.z)));
+        t_exit = min(t_exit, min(v.x, min(v.y, v.z)));
+        tc = gl_TexCoord[0].stp + t_entry * tc_dir;
+    }
+
+    for (float t = t_entry; t < t_exit; t += t_step, tc += tc_step)
+    {
+        // jump over the empty macro-cells, the next sample is the first one past the cell
+        if (uSkipEmptySpace)
+        {
+            float n = emptySteps(tc, tc_step);
+            if (n > 0.0)
+            {
+                t += n * t_step;
+                tc += n * tc_step;
+                continue;
+            }
+        }
+
         // sample the volume for intensity (red channel)
         float intensity = isoValue(tc);
         vec3 nabla;
@@ -147,7 +226,7 @@ void main(void)
             vec3 position = vPosition.xyz + (t - dt * t_step) * raydir;
             vec3 normal = -normalize(nabla);
             vec3 view = -raydir;
-            vec3 colour = shade(position, view, normal) * texture3D(uVolume, tcr).rgb / uIsosurface;
+            vec3 colour = shade(position, view, normal) * voxelColor(tcr) / uIsosurface;
             sum = vec4(colour, 1.0);
 
             // calculate fragment depth
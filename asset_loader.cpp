@@ -0,0 +1,174 @@
+#include "asset_loader.h"
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+using namespace chai3d;
+
+StartupTimeline::StartupTimeline(){
+    m_start = chrono::steady_clock::now();
+}
+
+void StartupTimeline::start(){
+    lock_guard<mutex> lock(m_mutex);
+    m_start = chrono::steady_clock::now();
+    m_events.clear();
+}
+
+void StartupTimeline::mark(const string &a_event){
+    lock_guard<mutex> lock(m_mutex);
+    double time = chrono::duration<double, milli>(chrono::steady_clock::now() - m_start).count();
+    m_events.push_back(make_pair(time, a_event));
+}
+
+void StartupTimeline::print(){
+    lock_guard<mutex> lock(m_mutex);
+    // the background threads mark their events out of order with the others
+    stable_sort(m_events.begin(), m_events.end(),
+                [](const pair<double, string>& a, const pair<double, string>& b){return a.first < b.first;});
+    cerr << "INFO! STARTUP TIMELINE:" << endl;
+    double previous = 0.0;
+    for (size_t i = 0 ; i < m_events.size() ; i++){
+        char line[160];
+        snprintf(line, sizeof(line), "  %9.1f ms (+%8.1f ms)  %s", m_events[i].first, m_events[i].first - previous, m_events[i].second.c_str());
+        cerr << line << endl;
+        previous = m_events[i].first;
+    }
+}
+
+AssetLoader::AssetLoader(){
+    m_pendingCount = 0;
+    m_timeline = nullptr;
+}
+
+AssetLoader::~AssetLoader(){
+    for (size_t i = 0 ; i < m_assets.size() ; i++){
+        Asset* asset = m_assets[i].get();
+        if (asset->m_thread.joinable()){
+            asset->m_thread.join();
+        }
+        if (!asset->m_taken){
+            delete asset->m_audio;
+        }
+    }
+}
+
+int AssetLoader::loadTexture(const string &a_name, const string &a_filepath){
+    return startAsset(ASSET_TEXTURE, a_name, a_filepath);
+}
+
+int AssetLoader::loadAudio(const string &a_name, const string &a_filepath){
+    return startAsset(ASSET_AUDIO, a_name, a_filepath);
+}
+
+int AssetLoader::loadFont(const string &a_name){
+    return startAsset(ASSET_FONT, a_name, "");
+}
+
+int AssetLoader::startAsset(AssetType a_type, const string &a_name, const string &a_filepath){
+    unique_ptr<Asset> asset(new Asset());
+    asset->m_type = a_type;
+    asset->m_name = a_name;
+    asset->m_filepath = a_filepath;
+    asset->m_thread = thread(&AssetLoader::loadAsset, this, asset.get());
+    m_assets.push_back(move(asset));
+    m_pendingCount++;
+    return int(m_assets.size()) - 1;
+}
+
+///
+/// \brief This method runs on the thread of an asset. It only touches the asset, which the
+/// other threads don't read before it's marked ready
+///
+void AssetLoader::loadAsset(Asset *a_asset){
+    bool loaded = false;
+    switch (a_asset->m_type){
+    case ASSET_TEXTURE:
+        a_asset->m_texture = cTexture2d::create();
+        loaded = a_asset->m_texture->loadFromFile(a_asset->m_filepath);
+        if (!loaded){
+            a_asset->m_texture = nullptr;
+        }
+        break;
+    case ASSET_AUDIO:
+        a_asset->m_audio = new cAudioBuffer();
+        loaded = a_asset->m_audio->loadFromFile(a_asset->m_filepath);
+        if (!loaded){
+            delete a_asset->m_audio;
+            a_asset->m_audio = nullptr;
+        }
+        break;
+    case ASSET_FONT:
+        a_asset->m_font = NEW_CFONTCALIBRI40();
+        loaded = a_asset->m_font != nullptr;
+        break;
+    }
+
+    if (m_timeline){
+        m_timeline->mark(a_asset->m_name + (loaded ? " loaded" : " failed to load") + " in the background");
+    }
+    a_asset->m_ready.store(true, memory_order_release);
+}
+
+bool AssetLoader::finishAsset(int a_idx){
+    Asset* asset = m_assets[a_idx].get();
+    if (asset->m_taken || !asset->m_ready.load(memory_order_acquire)){
+        return false;
+    }
+    if (asset->m_thread.joinable()){
+        asset->m_thread.join();
+    }
+    asset->m_taken = true;
+    m_pendingCount--;
+
+    bool loaded = asset->m_texture || asset->m_audio || asset->m_font;
+    if (loaded){
+        cerr << "INFO! LOADED " << asset->m_name;
+    }
+    else{
+        cerr << "WARNING! FAILED TO LOAD " << asset->m_name;
+    }
+    if (!asset->m_filepath.empty()){
+        cerr << " FROM " << asset->m_filepath;
+    }
+    cerr << endl;
+    return true;
+}
+
+bool AssetLoader::takeTexture(int a_idx, cTexture2dPtr &a_texture){
+    if (!finishAsset(a_idx)){
+        return false;
+    }
+    a_texture = m_assets[a_idx]->m_texture;
+    m_assets[a_idx]->m_texture = nullptr;
+    return true;
+}
+
+bool AssetLoader::takeAudio(int a_idx, cAudioBuffer *&a_buffer){
+    if (!finishAsset(a_idx)){
+        return false;
+    }
+    a_buffer = m_assets[a_idx]->m_audio;
+    m_assets[a_idx]->m_audio = nullptr;
+    return true;
+}
+
+cFontPtr AssetLoader::waitFont(int a_idx){
+    Asset* asset = m_assets[a_idx].get();
+    if (!asset->m_taken){
+        if (asset->m_thread.joinable()){
+            asset->m_thread.join();
+        }
+        finishAsset(a_idx);
+    }
+    return asset->m_font;
+}
+
+cTexture2dPtr AssetLoader::createPlaceholderTexture(const cColorb &a_color){
+    cTexture2dPtr texture = cTexture2d::create();
+    cImagePtr image = cImage::create();
+    image->allocate(1, 1, GL_RGBA);
+    image->setPixelColor(0, 0, a_color);
+    texture->setImage(image);
+    return texture;
+}
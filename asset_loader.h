@@ -0,0 +1,99 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <chai3d.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+///
+/// \brief The milestones of the startup of the plugin, in milliseconds since init started,
+/// to see what the time to the first frame is spent on. Events may be marked from any thread
+///
+class StartupTimeline{
+public:
+    StartupTimeline();
+
+    void start();
+
+    // Records a_event at the current time
+    void mark(const std::string& a_event);
+
+    // Prints the events in the order of their times
+    void print();
+
+private:
+    std::mutex m_mutex;
+    std::chrono::steady_clock::time_point m_start;
+    std::vector<std::pair<double, std::string> > m_events;
+};
+
+///
+/// \brief Loads the textures, sounds and fonts of the plugin on background threads, one per
+/// asset, so that a slow resource directory doesn't delay the first frame. The threads only
+/// decode the files, the loaded assets are taken by the graphics thread, which puts them in
+/// the scene in place of their placeholders.
+///
+class AssetLoader{
+public:
+    AssetLoader();
+    ~AssetLoader();
+
+    // Each call starts a thread and returns the index of the asset. A failure is reported once
+    // the asset is taken, with its name
+    int loadTexture(const std::string& a_name, const std::string& a_filepath);
+    // The buffer needs the context of an audio device, which must be created first
+    int loadAudio(const std::string& a_name, const std::string& a_filepath);
+    int loadFont(const std::string& a_name);
+
+    // Returns true once the asset finished loading, only once per asset. The asset is null
+    // if it failed to load, the caller takes the ownership of the audio buffer
+    bool takeTexture(int a_idx, chai3d::cTexture2dPtr& a_texture);
+    bool takeAudio(int a_idx, chai3d::cAudioBuffer*& a_buffer);
+
+    // Waits for the font, for the overlays that can't be built without it
+    chai3d::cFontPtr waitFont(int a_idx);
+
+    // True once all the assets are taken
+    bool isDone() const {return m_pendingCount == 0;}
+
+    void setTimeline(StartupTimeline* a_timeline) {m_timeline = a_timeline;}
+
+    // A 1x1 texture of a_color shown until the loaded one is swapped in
+    static chai3d::cTexture2dPtr createPlaceholderTexture(const chai3d::cColorb& a_color);
+
+private:
+    enum AssetType{
+        ASSET_TEXTURE,
+        ASSET_AUDIO,
+        ASSET_FONT
+    };
+
+    struct Asset{
+        AssetType m_type;
+        std::string m_name;
+        std::string m_filepath;
+        chai3d::cTexture2dPtr m_texture;
+        chai3d::cAudioBuffer* m_audio = nullptr;
+        chai3d::cFontPtr m_font;
+        std::atomic<bool> m_ready{false};
+        bool m_taken = false;
+        std::thread m_thread;
+    };
+
+    int startAsset(AssetType a_type, const std::string& a_name, const std::string& a_filepath);
+    void loadAsset(Asset* a_asset);
+    // Joins the thread of a ready asset and reports it, returns false if it isn't ready
+    bool finishAsset(int a_idx);
+
+    std::vector<std::unique_ptr<Asset> > m_assets;
+    int m_pendingCount;
+    StartupTimeline* m_timeline;
+};
+
+#endif // ASSET_LOADER_H
@@ -0,0 +1,198 @@
+#include "brick_occupancy.h"
+#include <cstring>
+#include <utility>
+
+using namespace std;
+
+BrickOccupancy::BrickOccupancy(){
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = 0;
+        m_brickCount[i] = 0;
+    }
+    m_brickShift = 4;
+    m_brickMask = 15;
+    m_brickWords = 0;
+    m_emptyBrick = NULL;
+    m_allocatedBricks = 0;
+}
+
+BrickOccupancy::~BrickOccupancy(){
+    releaseAll();
+    for (size_t i = 0 ; i < m_pool.size() ; i++){
+        delete[] m_pool[i];
+    }
+    delete[] m_emptyBrick;
+}
+
+bool BrickOccupancy::init(int a_voxelCountX, int a_voxelCountY, int a_voxelCountZ, int a_brickSize){
+    if (a_brickSize <= 0 || (a_brickSize & (a_brickSize - 1)) != 0){
+        return false;
+    }
+
+    releaseAll();
+    for (size_t i = 0 ; i < m_pool.size() ; i++){
+        delete[] m_pool[i];
+    }
+    m_pool.clear();
+    m_pool.reserve(MAX_POOLED_BRICKS);
+    delete[] m_emptyBrick;
+
+    m_brickShift = 0;
+    while ((1 << m_brickShift) < a_brickSize){
+        m_brickShift++;
+    }
+    m_brickMask = a_brickSize - 1;
+    m_brickWords = (size_t(a_brickSize) * a_brickSize * a_brickSize + 63) / 64;
+
+    m_voxelCount[0] = a_voxelCountX;
+    m_voxelCount[1] = a_voxelCountY;
+    m_voxelCount[2] = a_voxelCountZ;
+    for (int i = 0 ; i < 3 ; i++){
+        m_brickCount[i] = (m_voxelCount[i] + a_brickSize - 1) / a_brickSize;
+    }
+
+    m_emptyBrick = new uint64_t[m_brickWords];
+    memset(m_emptyBrick, 0, m_brickWords * sizeof(uint64_t));
+
+    size_t numBricks = size_t(m_brickCount[0]) * m_brickCount[1] * m_brickCount[2];
+    m_bricks.assign(numBricks, m_emptyBrick);
+    m_counts.reset(new atomic<int>[numBricks]);
+    for (size_t i = 0 ; i < numBricks ; i++){
+        m_counts[i].store(0, memory_order_relaxed);
+    }
+    m_allocatedBricks = 0;
+    return true;
+}
+
+void BrickOccupancy::build(const unsigned char *a_data, int a_bytesPerVoxel){
+    releaseAll();
+
+    size_t idx = 0;
+    for (int z = 0 ; z < m_voxelCount[2] ; z++){
+        for (int y = 0 ; y < m_voxelCount[1] ; y++){
+            for (int x = 0 ; x < m_voxelCount[0] ; x++, idx += a_bytesPerVoxel){
+                bool occupied = false;
+                for (int b = 0 ; b < a_bytesPerVoxel ; b++){
+                    occupied |= a_data[idx + b] != 0;
+                }
+                if (occupied){
+                    setOccupied(x, y, z);
+                }
+            }
+        }
+    }
+}
+
+void BrickOccupancy::swap(BrickOccupancy &a_other){
+    for (int i = 0 ; i < 3 ; i++){
+        std::swap(m_voxelCount[i], a_other.m_voxelCount[i]);
+        std::swap(m_brickCount[i], a_other.m_brickCount[i]);
+    }
+    std::swap(m_brickShift, a_other.m_brickShift);
+    std::swap(m_brickMask, a_other.m_brickMask);
+    std::swap(m_brickWords, a_other.m_brickWords);
+    m_bricks.swap(a_other.m_bricks);
+    m_counts.swap(a_other.m_counts);
+    std::swap(m_emptyBrick, a_other.m_emptyBrick);
+    m_pool.swap(a_other.m_pool);
+    std::swap(m_allocatedBricks, a_other.m_allocatedBricks);
+}
+
+void BrickOccupancy::setOccupied(int a_x, int a_y, int a_z){
+    size_t brickIdx = getBrickIndex(a_x >> m_brickShift, a_y >> m_brickShift, a_z >> m_brickShift);
+    uint64_t* brick = m_bricks[brickIdx];
+    if (brick == m_emptyBrick){
+        brick = allocateBrick();
+        m_bricks[brickIdx] = brick;
+    }
+
+    size_t bit = getBitIndex(a_x, a_y, a_z);
+    uint64_t mask = uint64_t(1) << (bit & 63);
+    if (!(brick[bit >> 6] & mask)){
+        brick[bit >> 6] |= mask;
+        m_counts[brickIdx].store(m_counts[brickIdx].load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+}
+
+bool BrickOccupancy::clearOccupied(int a_x, int a_y, int a_z){
+    size_t brickIdx = getBrickIndex(a_x >> m_brickShift, a_y >> m_brickShift, a_z >> m_brickShift);
+    uint64_t* brick = m_bricks[brickIdx];
+    if (brick == m_emptyBrick){
+        return false;
+    }
+
+    size_t bit = getBitIndex(a_x, a_y, a_z);
+    uint64_t mask = uint64_t(1) << (bit & 63);
+    if (brick[bit >> 6] & mask){
+        brick[bit >> 6] &= ~mask;
+        int count = m_counts[brickIdx].load(memory_order_relaxed) - 1;
+        m_counts[brickIdx].store(count, memory_order_relaxed);
+        if (count == 0){
+            releaseBrick(brickIdx);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BrickOccupancy::isBoxEmpty(const int a_min[3], const int a_max[3]) const{
+    int brickMin[3], brickMax[3];
+    for (int i = 0 ; i < 3 ; i++){
+        int lo = a_min[i] < 0 ? 0 : a_min[i];
+        int hi = a_max[i] > m_voxelCount[i] ? m_voxelCount[i] : a_max[i];
+        if (lo >= hi){
+            return true;
+        }
+        brickMin[i] = lo >> m_brickShift;
+        brickMax[i] = (hi - 1) >> m_brickShift;
+    }
+
+    for (int bz = brickMin[2] ; bz <= brickMax[2] ; bz++){
+        for (int by = brickMin[1] ; by <= brickMax[1] ; by++){
+            for (int bx = brickMin[0] ; bx <= brickMax[0] ; bx++){
+                if (m_bricks[getBrickIndex(bx, by, bz)] != m_emptyBrick){
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+size_t BrickOccupancy::getMemoryUsage() const{
+    return (m_allocatedBricks + m_pool.size()) * m_brickWords * sizeof(uint64_t);
+}
+
+uint64_t* BrickOccupancy::allocateBrick(){
+    uint64_t* brick;
+    if (!m_pool.empty()){
+        brick = m_pool.back();
+        m_pool.pop_back();
+    }
+    else{
+        brick = new uint64_t[m_brickWords];
+    }
+    memset(brick, 0, m_brickWords * sizeof(uint64_t));
+    m_allocatedBricks++;
+    return brick;
+}
+
+void BrickOccupancy::releaseBrick(size_t a_brickIdx){
+    if (m_pool.size() < MAX_POOLED_BRICKS){
+        m_pool.push_back(m_bricks[a_brickIdx]);
+    }
+    else{
+        delete[] m_bricks[a_brickIdx];
+    }
+    m_bricks[a_brickIdx] = m_emptyBrick;
+    m_counts[a_brickIdx].store(0, memory_order_relaxed);
+    m_allocatedBricks--;
+}
+
+void BrickOccupancy::releaseAll(){
+    for (size_t i = 0 ; i < m_bricks.size() ; i++){
+        if (m_bricks[i] != m_emptyBrick){
+            releaseBrick(i);
+        }
+    }
+}
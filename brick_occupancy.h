@@ -0,0 +1,103 @@
+#ifndef BRICK_OCCUPANCY_H
+#define BRICK_OCCUPANCY_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+///
+/// \brief Sparse, bricked occupancy of a volume, one bit per voxel, kept besides the dense
+/// image of the volume to skip its empty regions. Bricks without any occupied voxel all point
+/// to a shared empty sentinel, a brick is allocated when a voxel in it is first set, and it is
+/// released when its last voxel is cleared. Up to MAX_POOLED_BRICKS released bricks are kept for
+/// reuse, the others are freed, so the memory of the occupancy, not of the dense image, shrinks
+/// as the volume is drilled.
+///
+class BrickOccupancy{
+public:
+    // Released bricks kept for reuse, the pool is reserved up front so releasing a brick never
+    // allocates
+    static const size_t MAX_POOLED_BRICKS = 256;
+
+    BrickOccupancy();
+    ~BrickOccupancy();
+
+    // The brick size must be a power of two
+    bool init(int a_voxelCountX, int a_voxelCountY, int a_voxelCountZ, int a_brickSize = 16);
+
+    // Rebuilds the occupancy from a dense image, a voxel is occupied if any of its bytes is non-zero
+    void build(const unsigned char* a_data, int a_bytesPerVoxel);
+
+    // Exchanges the bricks with an occupancy of the same size, e.g. one built on another thread.
+    // Doesn't allocate
+    void swap(BrickOccupancy& a_other);
+
+    inline bool isOccupied(int a_x, int a_y, int a_z) const{
+        const uint64_t* brick = m_bricks[getBrickIndex(a_x >> m_brickShift, a_y >> m_brickShift, a_z >> m_brickShift)];
+        size_t bit = getBitIndex(a_x, a_y, a_z);
+        return (brick[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    void setOccupied(int a_x, int a_y, int a_z);
+
+    // Clears a voxel, returns true if its brick became empty and was released
+    bool clearOccupied(int a_x, int a_y, int a_z);
+
+    inline bool isBrickEmpty(int a_bx, int a_by, int a_bz) const{
+        return m_bricks[getBrickIndex(a_bx, a_by, a_bz)] == m_emptyBrick;
+    }
+
+    // Returns true if no brick overlapping the box of voxels [a_min, a_max) holds an occupied
+    // voxel. The box is clamped to the volume
+    bool isBoxEmpty(const int a_min[3], const int a_max[3]) const;
+
+    // Number of occupied voxels in a brick. Only the thread modifying the occupancy writes
+    // the counts, other threads may read them, e.g. to update the empty space skipping texture
+    inline int getBrickCount(int a_bx, int a_by, int a_bz) const{
+        return m_counts[getBrickIndex(a_bx, a_by, a_bz)].load(std::memory_order_relaxed);
+    }
+
+    int getBrickSize() const {return 1 << m_brickShift;}
+
+    int getNumBricks(int a_axis) const {return m_brickCount[a_axis];}
+
+    int getVoxelCount(int a_axis) const {return m_voxelCount[a_axis];}
+
+    size_t getAllocatedBrickCount() const {return m_allocatedBricks;}
+
+    size_t getTotalBrickCount() const {return m_bricks.size();}
+
+    // Memory held by the allocated and pooled bricks, in bytes. The dense image isn't counted
+    size_t getMemoryUsage() const;
+
+private:
+    inline size_t getBrickIndex(int a_bx, int a_by, int a_bz) const{
+        return (size_t(a_bz) * m_brickCount[1] + a_by) * m_brickCount[0] + a_bx;
+    }
+
+    inline size_t getBitIndex(int a_x, int a_y, int a_z) const{
+        return (((size_t(a_z) & m_brickMask) << m_brickShift | (a_y & m_brickMask)) << m_brickShift) | (a_x & m_brickMask);
+    }
+
+    uint64_t* allocateBrick();
+    void releaseBrick(size_t a_brickIdx);
+    void releaseAll();
+
+    int m_voxelCount[3];
+    int m_brickCount[3];
+    int m_brickShift;
+    int m_brickMask;
+    // Number of 64 bit words per brick
+    size_t m_brickWords;
+
+    std::vector<uint64_t*> m_bricks;
+    std::unique_ptr<std::atomic<int>[]> m_counts;
+    // Shared, never written, brick of all the empty bricks
+    uint64_t* m_emptyBrick;
+    std::vector<uint64_t*> m_pool;
+    size_t m_allocatedBricks;
+};
+
+#endif // BRICK_OCCUPANCY_H
@@ -0,0 +1,52 @@
+#include "broad_phase.h"
+#include <cmath>
+
+static double pointBoxDistanceSq(const double a_p[3], const double a_boxMin[3], const double a_boxMax[3]){
+    double distSq = 0.0;
+    for (int i = 0 ; i < 3 ; i++){
+        double d = 0.0;
+        if (a_p[i] < a_boxMin[i]){
+            d = a_boxMin[i] - a_p[i];
+        }
+        else if (a_p[i] > a_boxMax[i]){
+            d = a_p[i] - a_boxMax[i];
+        }
+        distSq += d * d;
+    }
+    return distSq;
+}
+
+double computePointBoxDistance(const double a_p[3], const double a_boxMin[3], const double a_boxMax[3]){
+    return sqrt(pointBoxDistanceSq(a_p, a_boxMin, a_boxMax));
+}
+
+double computeSegmentBoxDistance(const double a_p0[3], const double a_p1[3], const double a_boxMin[3], const double a_boxMax[3]){
+    // The squared distance to a convex box is convex along the segment, so a ternary search
+    // converges to its minimum. 40 iterations shrink the interval below 1e-7 of the segment
+    double lo = 0.0, hi = 1.0;
+    double p[3];
+    for (int it = 0 ; it < 40 ; it++){
+        double t0 = lo + (hi - lo) / 3.0;
+        double t1 = hi - (hi - lo) / 3.0;
+        for (int i = 0 ; i < 3 ; i++){
+            p[i] = a_p0[i] + t0 * (a_p1[i] - a_p0[i]);
+        }
+        double d0 = pointBoxDistanceSq(p, a_boxMin, a_boxMax);
+        for (int i = 0 ; i < 3 ; i++){
+            p[i] = a_p0[i] + t1 * (a_p1[i] - a_p0[i]);
+        }
+        double d1 = pointBoxDistanceSq(p, a_boxMin, a_boxMax);
+        if (d0 < d1){
+            hi = t1;
+        }
+        else{
+            lo = t0;
+        }
+    }
+
+    double t = 0.5 * (lo + hi);
+    for (int i = 0 ; i < 3 ; i++){
+        p[i] = a_p0[i] + t * (a_p1[i] - a_p0[i]);
+    }
+    return sqrt(pointBoxDistanceSq(p, a_boxMin, a_boxMax));
+}
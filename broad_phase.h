@@ -0,0 +1,15 @@
+#ifndef BROAD_PHASE_H
+#define BROAD_PHASE_H
+
+///
+/// \brief Distance between the segment [a_p0, a_p1] and an axis aligned box, 0 if they
+/// intersect. A capsule of radius r around the segment overlaps the box if this is <= r.
+///
+double computeSegmentBoxDistance(const double a_p0[3], const double a_p1[3], const double a_boxMin[3], const double a_boxMax[3]);
+
+///
+/// \brief Distance between a point and an axis aligned box, 0 if the point is inside it
+///
+double computePointBoxDistance(const double a_p[3], const double a_boxMin[3], const double a_boxMax[3]);
+
+#endif // BROAD_PHASE_H
@@ -0,0 +1,48 @@
+#include "burr_stencil.h"
+#include <cmath>
+
+using namespace std;
+
+BurrStencil::BurrStencil(){
+    m_extent[0] = m_extent[1] = m_extent[2] = 0;
+    m_radius[0] = m_radius[1] = m_radius[2] = 0.0;
+}
+
+void BurrStencil::build(double a_radiusX, double a_radiusY, double a_radiusZ){
+    m_offsets.clear();
+    m_rows.clear();
+    m_radius[0] = a_radiusX;
+    m_radius[1] = a_radiusY;
+    m_radius[2] = a_radiusZ;
+    if (a_radiusX <= 0.0 || a_radiusY <= 0.0 || a_radiusZ <= 0.0){
+        m_extent[0] = m_extent[1] = m_extent[2] = 0;
+        return;
+    }
+
+    m_extent[0] = int(floor(a_radiusX));
+    m_extent[1] = int(floor(a_radiusY));
+    m_extent[2] = int(floor(a_radiusZ));
+
+    // Ordered z-y-x so that consecutive offsets touch neighbouring memory in the volume image
+    for (int z = -m_extent[2] ; z <= m_extent[2] ; z++){
+        double nz = z / a_radiusZ;
+        for (int y = -m_extent[1] ; y <= m_extent[1] ; y++){
+            double ny = y / a_radiusY;
+            BurrStencilRow row = {y, z, 0, -1};
+            for (int x = -m_extent[0] ; x <= m_extent[0] ; x++){
+                double nx = x / a_radiusX;
+                if (nx * nx + ny * ny + nz * nz <= 1.0){
+                    VoxelOffset offset = {x, y, z};
+                    m_offsets.push_back(offset);
+                    if (row.m_xMin > row.m_xMax){
+                        row.m_xMin = x;
+                    }
+                    row.m_xMax = x;
+                }
+            }
+            if (row.m_xMin <= row.m_xMax){
+                m_rows.push_back(row);
+            }
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef BURR_STENCIL_H
+#define BURR_STENCIL_H
+
+#include <vector>
+
+///
+/// \brief Integer offset of a voxel from the voxel at the center of the burr.
+///
+struct VoxelOffset{
+    int x, y, z;
+};
+
+///
+/// \brief A run of offsets of a stencil along x, from m_xMin to m_xMax included
+///
+struct BurrStencilRow{
+    int m_y, m_z;
+    int m_xMin, m_xMax;
+};
+
+///
+/// \brief The set of voxel offsets that lie inside a drill burr. Precomputed once
+/// per burr size so that the removal loop only has to walk a flat list.
+///
+class BurrStencil{
+public:
+    BurrStencil();
+
+    // Builds the stencil of an ellipsoid with the given radii, in voxels, along each axis.
+    // The radii differ when the voxels are not cubic.
+    void build(double a_radiusX, double a_radiusY, double a_radiusZ);
+
+    const std::vector<VoxelOffset>& getOffsets() const {return m_offsets;}
+
+    // The offsets as runs along x, the ellipsoid is convex so each row of y and z holds one run.
+    // The removal walks the runs, which are contiguous in the volume image
+    const std::vector<BurrStencilRow>& getRows() const {return m_rows;}
+
+    // Largest offset along each axis
+    int getExtent(int a_axis) const {return m_extent[a_axis];}
+
+    // Radius of the ellipsoid along each axis, in voxels
+    double getRadius(int a_axis) const {return m_radius[a_axis];}
+
+    bool isEmpty() const {return m_offsets.empty();}
+
+private:
+    std::vector<VoxelOffset> m_offsets;
+    std::vector<BurrStencilRow> m_rows;
+    int m_extent[3];
+    double m_radius[3];
+};
+
+#endif // BURR_STENCIL_H
@@ -1,44 +1,84 @@
 #include "collision_publisher.h"
 #include <ambf_server/RosComBase.h>
+#include <chrono>
 
 using namespace std;
 
-DrillingPublisher::DrillingPublisher(string a_namespace, string a_plugin){
+DrillingPublisher::DrillingPublisher(string a_namespace, string a_plugin, bool a_perVoxelTopic, size_t a_queueCapacity): m_queue(a_queueCapacity){
+    m_perVoxelTopic = a_perVoxelTopic;
+    m_droppedCount = 0;
+    m_droppedCountPublished = 0;
     init(a_namespace, a_plugin);
+
+    m_running = true;
+    m_publisherThread = thread(&DrillingPublisher::publisherLoop, this);
 }
 
 DrillingPublisher::~DrillingPublisher(){
+    close();
     m_voxelsRemovedPub.shutdown();
+    m_voxelsRemovedBatchPub.shutdown();
     m_burrChangePub.shutdown();
     m_volumePropPub.shutdown();
+    m_droppedPub.shutdown();
+    m_perfPub.shutdown();
+    m_removalStatsPub.shutdown();
 }
 
 void DrillingPublisher::init(string a_namespace, string a_plugin){
     m_rosNode = afROSNode::getNode();
 
-    m_voxelsRemovedPub = m_rosNode-> advertise<vdrilling_msgs::points>(a_namespace + "/" + a_plugin + "/voxels_removed", 1);
+    if (m_perVoxelTopic){
+        m_voxelsRemovedPub = m_rosNode-> advertise<vdrilling_msgs::points>(a_namespace + "/" + a_plugin + "/voxels_removed", 1);
+    }
+    m_voxelsRemovedBatchPub = m_rosNode-> advertise<vdrilling_msgs::VoxelsRemoved>(a_namespace + "/" + a_plugin + "/voxels_removed_batch", 10);
     m_burrChangePub = m_rosNode -> advertise<vdrilling_msgs::UInt8Stamped>(a_namespace + "/" + a_plugin + "/burr_change", 1, true);
     m_volumePropPub = m_rosNode -> advertise<vdrilling_msgs::VolumeProp>(a_namespace + "/" + a_plugin + "/volume_prop", 1, true);
+    m_droppedPub = m_rosNode -> advertise<std_msgs::UInt64>(a_namespace + "/" + a_plugin + "/publisher_dropped", 1, true);
+    m_perfPub = m_rosNode -> advertise<vdrilling_msgs::PerfStats>(a_namespace + "/" + a_plugin + "/perf", 1);
+    m_removalStatsPub = m_rosNode -> advertise<vdrilling_msgs::RemovalStats>(a_namespace + "/" + a_plugin + "/removal_stats", 1, true);
 }
 
-void DrillingPublisher::voxelsRemoved(double vray[3], float vcolor[4], double time){
-    voxel_msg.header.stamp.fromSec(time);
+void DrillingPublisher::close(){
+    if (m_publisherThread.joinable()){
+        m_running = false;
+        m_publisherThread.join();
+    }
+}
 
-    std::vector<float> vec(vcolor, vcolor + 4);
-    voxel_msg.voxel_color = vec;
+void DrillingPublisher::enqueue(const DrillingEvent &a_event){
+    if (!m_queue.push(a_event)){
+        m_droppedCount.fetch_add(1, memory_order_relaxed);
+    }
+}
 
-    voxel_msg.voxel_removed.x = vray[0];
-    voxel_msg.voxel_removed.y = vray[1];
-    voxel_msg.voxel_removed.z = vray[2];
+void DrillingPublisher::voxelRemoved(double vray[3], float vcolor[4], int label, double time){
+    DrillingEvent event;
+    event.m_type = DrillingEvent::VOXEL_REMOVED;
+    event.m_time = time;
+    for (int i = 0 ; i < 3 ; i++){
+        event.m_voxelIndex[i] = vray[i];
+    }
+    for (int i = 0 ; i < 4 ; i++){
+        event.m_color[i] = vcolor[i];
+    }
+    event.m_label = label;
+    enqueue(event);
+}
 
-    m_voxelsRemovedPub.publish(voxel_msg);
+void DrillingPublisher::publishVoxelsRemoved(double time){
+    DrillingEvent event;
+    event.m_type = DrillingEvent::TICK_END;
+    event.m_time = time;
+    enqueue(event);
 }
 
 void DrillingPublisher::burrChange(int burrSize, double time){
-    burr_msg.header.stamp.fromSec(time);
-    burr_msg.number.data = burrSize;
-
-    m_burrChangePub.publish(burr_msg);
+    DrillingEvent event;
+    event.m_type = DrillingEvent::BURR_CHANGE;
+    event.m_time = time;
+    event.m_burrSize = burrSize;
+    enqueue(event);
 }
 
 void DrillingPublisher::volumeProp(float dimensions[3], int voxelCount[3]){
@@ -50,3 +90,124 @@ void DrillingPublisher::volumeProp(float dimensions[3], int voxelCount[3]){
 
     m_volumePropPub.publish(volume_msg);
 }
+
+void DrillingPublisher::perfStats(const std::vector<PerfStageStats> &a_stats, uint64_t a_uploadBytes, double a_uploadBytesPerSecond, double time){
+    perf_msg.header.stamp.fromSec(time);
+    perf_msg.stage.resize(a_stats.size());
+    perf_msg.count.resize(a_stats.size());
+    perf_msg.p50_us.resize(a_stats.size());
+    perf_msg.p99_us.resize(a_stats.size());
+    perf_msg.max_us.resize(a_stats.size());
+    for (size_t i = 0 ; i < a_stats.size() ; i++){
+        perf_msg.stage[i] = a_stats[i].m_name;
+        perf_msg.count[i] = a_stats[i].m_count;
+        perf_msg.p50_us[i] = a_stats[i].m_p50;
+        perf_msg.p99_us[i] = a_stats[i].m_p99;
+        perf_msg.max_us[i] = a_stats[i].m_max;
+    }
+    perf_msg.texture_upload_bytes = a_uploadBytes;
+    perf_msg.texture_upload_bytes_per_s = a_uploadBytesPerSecond;
+
+    m_perfPub.publish(perf_msg);
+}
+
+void DrillingPublisher::removalStats(const RemovalSummary &a_summary, double time){
+    removal_stats_msg.header.stamp.fromSec(time);
+    removal_stats_msg.label = a_summary.m_labels;
+    removal_stats_msg.color.resize(a_summary.m_labels.size());
+    for (size_t i = 0 ; i < a_summary.m_labels.size() ; i++){
+        const uint8_t* rgba = &a_summary.m_colors[4 * i];
+        removal_stats_msg.color[i].r = rgba[0] / 255.0f;
+        removal_stats_msg.color[i].g = rgba[1] / 255.0f;
+        removal_stats_msg.color[i].b = rgba[2] / 255.0f;
+        removal_stats_msg.color[i].a = rgba[3] / 255.0f;
+    }
+    removal_stats_msg.removed = a_summary.m_removed;
+    removal_stats_msg.total_removed = a_summary.m_totalRemoved;
+    removal_stats_msg.removal_rate = a_summary.m_removalRate;
+    removal_stats_msg.critical_contact_time = a_summary.m_criticalContactTime;
+
+    m_removalStatsPub.publish(removal_stats_msg);
+}
+
+///
+/// \brief Runs on the publisher thread. Drains the queue and publishes the events.
+/// After close() is called, the remaining events are flushed before returning.
+///
+void DrillingPublisher::publisherLoop(){
+    DrillingEvent event;
+    while (true){
+        // Read the flag before draining so that no event enqueued before close() is missed
+        bool running = m_running;
+        while (m_queue.pop(event)){
+            processEvent(event);
+        }
+
+        unsigned long long dropped = m_droppedCount.load(memory_order_relaxed);
+        if (dropped != m_droppedCountPublished){
+            m_droppedCountPublished = dropped;
+            dropped_msg.data = dropped;
+            m_droppedPub.publish(dropped_msg);
+        }
+
+        if (!running){
+            break;
+        }
+        this_thread::sleep_for(chrono::microseconds(500));
+    }
+
+    // Publish the voxels of a tick that didn't get its end marker
+    if (!voxel_batch_msg.voxel_removed.empty()){
+        voxel_batch_msg.header.stamp = voxel_msg.header.stamp;
+        m_voxelsRemovedBatchPub.publish(voxel_batch_msg);
+    }
+}
+
+void DrillingPublisher::processEvent(const DrillingEvent &a_event){
+    switch (a_event.m_type) {
+    case DrillingEvent::VOXEL_REMOVED:{
+        geometry_msgs::Point voxel;
+        voxel.x = a_event.m_voxelIndex[0];
+        voxel.y = a_event.m_voxelIndex[1];
+        voxel.z = a_event.m_voxelIndex[2];
+
+        std_msgs::ColorRGBA color;
+        color.r = a_event.m_color[0];
+        color.g = a_event.m_color[1];
+        color.b = a_event.m_color[2];
+        color.a = a_event.m_color[3];
+
+        voxel_batch_msg.voxel_removed.push_back(voxel);
+        voxel_batch_msg.voxel_color.push_back(color);
+        voxel_batch_msg.voxel_label.push_back(uint8_t(a_event.m_label));
+
+        voxel_msg.header.stamp.fromSec(a_event.m_time);
+        if (m_perVoxelTopic){
+            voxel_msg.voxel_color.assign(a_event.m_color, a_event.m_color + 4);
+            voxel_msg.voxel_removed = voxel;
+
+            m_voxelsRemovedPub.publish(voxel_msg);
+        }
+        break;
+    }
+    case DrillingEvent::TICK_END:
+        if (!voxel_batch_msg.voxel_removed.empty()){
+            voxel_batch_msg.header.stamp.fromSec(a_event.m_time);
+            m_voxelsRemovedBatchPub.publish(voxel_batch_msg);
+
+            // clear() keeps the capacity, so steady-state drilling doesn't reallocate every tick
+            voxel_batch_msg.voxel_removed.clear();
+            voxel_batch_msg.voxel_color.clear();
+            voxel_batch_msg.voxel_label.clear();
+        }
+        break;
+    case DrillingEvent::BURR_CHANGE:
+        burr_msg.header.stamp.fromSec(a_event.m_time);
+        burr_msg.number.data = a_event.m_burrSize;
+
+        m_burrChangePub.publish(burr_msg);
+        break;
+    default:
+        break;
+    }
+}
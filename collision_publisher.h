@@ -2,30 +2,96 @@
 #define COLLISION_PUBLISHER_H
 
 #include "ros/ros.h"
+#include <atomic>
 #include <string>
+#include <thread>
+#include <std_msgs/UInt64.h>
+#include <vdrilling_msgs/PerfStats.h>
 #include <vdrilling_msgs/points.h>
+#include <vdrilling_msgs/RemovalStats.h>
 #include <vdrilling_msgs/UInt8Stamped.h>
 #include <vdrilling_msgs/VolumeProp.h>
+#include <vdrilling_msgs/VoxelsRemoved.h>
+#include "spsc_ring_buffer.h"
+#include "perf_profiler.h"
+#include "removal_statistics.h"
+
+
+///
+/// \brief A plain record handed from the physics thread to the publisher thread.
+///
+struct DrillingEvent{
+    enum Type{
+        VOXEL_REMOVED,
+        // Marks the end of a physics tick, the voxels collected so far are published
+        TICK_END,
+        BURR_CHANGE
+    };
+
+    Type m_type;
+    double m_time;
+    int m_voxelIndex[3];
+    float m_color[4];
+    // label of the voxel in a labeled volume, 0 otherwise
+    int m_label;
+    int m_burrSize;
+};
 
 
 class DrillingPublisher{
 public:
-    DrillingPublisher(std::string a_namespace, std::string a_plugin);
+    DrillingPublisher(std::string a_namespace, std::string a_plugin, bool a_perVoxelTopic = false, size_t a_queueCapacity = 262144);
     ~DrillingPublisher();
     void init(std::string a_namespace, std::string a_plugin);
+    // Publishes all the queued events and stops the publisher thread
+    void close();
     ros::NodeHandle* m_rosNode;
 
-    void voxelsRemoved(double ray[3], float vcolor[4], double time);
+    // The following methods only enqueue and are safe to call from the physics thread.
+    // Adds a removed voxel to the batch of the current tick
+    void voxelRemoved(double ray[3], float vcolor[4], int label, double time);
+    // Publishes all the voxels removed since the last call as one message
+    void publishVoxelsRemoved(double time);
     void burrChange(int burrSize, double time);
+
     void volumeProp(float dimensions[3], int voxelCount[3]);
+
+    // Publishes the latency statistics of the timed stages and the texture upload, call from
+    // a single thread
+    void perfStats(const std::vector<PerfStageStats>& a_stats, uint64_t a_uploadBytes, double a_uploadBytesPerSecond, double time);
+
+    // Publishes the per label summary of the removed voxels, call from a single thread
+    void removalStats(const RemovalSummary& a_summary, double time);
+
+    // Number of events dropped because the queue was full
+    unsigned long long getDroppedCount() const {return m_droppedCount.load();}
 private:
+    void enqueue(const DrillingEvent& a_event);
+    void publisherLoop();
+    void processEvent(const DrillingEvent& a_event);
+
+    // Also publish every removed voxel individually on the legacy voxels_removed topic
+    bool m_perVoxelTopic;
     ros::Publisher m_voxelsRemovedPub;
+    ros::Publisher m_voxelsRemovedBatchPub;
     ros::Publisher m_burrChangePub;
     ros::Publisher m_volumePropPub;
+    ros::Publisher m_droppedPub;
+    ros::Publisher m_perfPub;
+    ros::Publisher m_removalStatsPub;
     vdrilling_msgs::points voxel_msg;
+    vdrilling_msgs::VoxelsRemoved voxel_batch_msg;
     vdrilling_msgs::UInt8Stamped burr_msg;
     vdrilling_msgs::VolumeProp volume_msg;
+    std_msgs::UInt64 dropped_msg;
+    vdrilling_msgs::PerfStats perf_msg;
+    vdrilling_msgs::RemovalStats removal_stats_msg;
 
+    SPSCRingBuffer<DrillingEvent> m_queue;
+    std::atomic<unsigned long long> m_droppedCount;
+    unsigned long long m_droppedCountPublished;
+    std::atomic<bool> m_running;
+    std::thread m_publisherThread;
 };
 
 #endif //VOLUMETRIC_PLUGIN_COLLISION_PUBLISHER_H
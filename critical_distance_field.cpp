@@ -0,0 +1,334 @@
+#include "critical_distance_field.h"
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include "worker_pool.h"
+
+using namespace std;
+
+static const char CRITICAL_DISTANCE_MAGIC[8] = {'V', 'D', 'C', 'R', 'I', 'T', 'D', 'F'};
+static const uint32_t CRITICAL_DISTANCE_VERSION = 1;
+
+// stored value of the maximum distance, every distance is clamped to it
+static const uint16_t FAR_VALUE = 65534;
+
+///
+/// \brief Buffers of the transform of one line, kept by each thread running the passes so that
+/// they are only allocated when a longer line comes.
+///
+struct DistanceLineBuffers{
+    vector<double> m_f;
+    vector<double> m_envelope;
+    vector<int> m_parabolas;
+};
+
+///
+/// \brief One pass of the distance transform along an axis of a grid of stored distances, run
+/// for each slice of the grid. The pass along x first fills its rows from the voxels: 0 for the
+/// critical voxels, the maximum distance for the others.
+///
+class DistancePassTask: public ParallelTask{
+public:
+    virtual void run(size_t a_index) override{
+        int axis = m_axis;
+        int n = m_dims[axis];
+        static thread_local DistanceLineBuffers s_buffers;
+        if (s_buffers.m_f.size() < size_t(n)){
+            s_buffers.m_f.resize(n);
+            s_buffers.m_envelope.resize(n + 1);
+            s_buffers.m_parabolas.resize(n);
+        }
+        vector<double>& f = s_buffers.m_f;
+        vector<double>& envelope = s_buffers.m_envelope;
+        vector<int>& parabolas = s_buffers.m_parabolas;
+        size_t dx = size_t(m_dims[0]), dxy = dx * m_dims[1];
+
+        if (axis == 0){
+            size_t z = a_index;
+            for (int y = 0 ; y < m_dims[1] ; y++){
+                uint16_t* line = m_grid + z * dxy + y * dx;
+                if (m_source){
+                    fillRow(line, y, int(z));
+                }
+                transformLine(line, 1, n, f, envelope, parabolas);
+            }
+        }
+        else if (axis == 1){
+            size_t z = a_index;
+            for (int x = 0 ; x < m_dims[0] ; x++){
+                transformLine(m_grid + z * dxy + x, dx, n, f, envelope, parabolas);
+            }
+        }
+        else{
+            size_t y = a_index;
+            for (int x = 0 ; x < m_dims[0] ; x++){
+                transformLine(m_grid + y * dx + x, dxy, n, f, envelope, parabolas);
+            }
+        }
+    }
+
+    // grid of a_dims voxels, starting at voxel m_origin of the volume
+    uint16_t* m_grid;
+    int m_dims[3];
+    int m_origin[3];
+    int m_axis;
+    double m_step;
+    double m_weights[3];
+
+    const unsigned char* m_source;
+    int m_volumeCount[3];
+    int m_bytesPerVoxel;
+    const unsigned char* m_boneColor;
+    atomic<size_t> m_criticalCount;
+
+private:
+    void fillRow(uint16_t* a_line, int a_y, int a_z){
+        const unsigned char* voxel = m_source + ((size_t(m_origin[2] + a_z) * m_volumeCount[1] + m_origin[1] + a_y) * m_volumeCount[0] + m_origin[0]) * m_bytesPerVoxel;
+        size_t count = 0;
+        for (int x = 0 ; x < m_dims[0] ; x++, voxel += m_bytesPerVoxel){
+            bool occupied = false, bone = true;
+            for (int b = 0 ; b < m_bytesPerVoxel ; b++){
+                occupied |= voxel[b] != 0;
+                bone &= voxel[b] == m_boneColor[b];
+            }
+            bool critical = occupied && !bone;
+            a_line[x] = critical ? 0 : FAR_VALUE;
+            count += critical;
+        }
+        m_criticalCount.fetch_add(count, memory_order_relaxed);
+    }
+
+    // squared distances of a line, the minimum over its voxels q of (p - q)^2 + f(q)
+    void transformLine(uint16_t* a_line, size_t a_stride, int a_n, vector<double>& a_f, vector<double>& a_envelope, vector<int>& a_parabolas){
+        // a line without any distance below the maximum stays at the maximum
+        bool far = true;
+        for (int i = 0 ; i < a_n ; i++){
+            uint16_t value = a_line[i * a_stride];
+            far &= value == FAR_VALUE;
+            double distance = value * m_step;
+            a_f[i] = distance * distance;
+        }
+        if (far || a_n == 1){
+            return;
+        }
+
+        double w = m_weights[m_axis];
+        int k = 0;
+        a_parabolas[0] = 0;
+        a_envelope[0] = -numeric_limits<double>::infinity();
+        a_envelope[1] = numeric_limits<double>::infinity();
+        for (int q = 1 ; q < a_n ; q++){
+            double pq = q * w;
+            double s;
+            while (true){
+                double pv = a_parabolas[k] * w;
+                s = ((a_f[q] + pq * pq) - (a_f[a_parabolas[k]] + pv * pv)) / (2.0 * (pq - pv));
+                if (s > a_envelope[k]){
+                    break;
+                }
+                k--;
+            }
+            k++;
+            a_parabolas[k] = q;
+            a_envelope[k] = s;
+            a_envelope[k + 1] = numeric_limits<double>::infinity();
+        }
+
+        k = 0;
+        for (int q = 0 ; q < a_n ; q++){
+            double pq = q * w;
+            while (a_envelope[k + 1] < pq){
+                k++;
+            }
+            double offset = pq - a_parabolas[k] * w;
+            double distance = sqrt(offset * offset + a_f[a_parabolas[k]]) / m_step;
+            a_line[q * a_stride] = uint16_t(min(distance + 0.5, double(FAR_VALUE)));
+        }
+    }
+};
+
+CriticalDistanceField::CriticalDistanceField(){
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = 0;
+        m_voxelSize[i] = 1.0;
+    }
+    m_maxDistance = 0.0;
+    m_step = 1.0;
+    m_bytesPerVoxel = 4;
+    memset(m_boneColor, 0, sizeof(m_boneColor));
+}
+
+void CriticalDistanceField::init(const int a_voxelCount[3], const double a_voxelSize[3], double a_maxDistance, int a_bytesPerVoxel, const unsigned char a_boneColor[4]){
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = a_voxelCount[i];
+        m_voxelSize[i] = a_voxelSize[i];
+    }
+    m_maxDistance = a_maxDistance;
+    m_step = m_maxDistance / FAR_VALUE;
+    m_bytesPerVoxel = min(a_bytesPerVoxel, 4);
+    memcpy(m_boneColor, a_boneColor, sizeof(m_boneColor));
+    m_field.clear();
+}
+
+size_t CriticalDistanceField::build(const unsigned char *a_data, int a_numWorkers){
+    m_field.assign(size_t(m_voxelCount[0]) * m_voxelCount[1] * m_voxelCount[2], FAR_VALUE);
+
+    DistancePassTask task;
+    task.m_grid = m_field.data();
+    task.m_step = m_step;
+    task.m_source = a_data;
+    task.m_bytesPerVoxel = m_bytesPerVoxel;
+    task.m_boneColor = m_boneColor;
+    task.m_criticalCount.store(0);
+    for (int i = 0 ; i < 3 ; i++){
+        task.m_dims[i] = m_voxelCount[i];
+        task.m_volumeCount[i] = m_voxelCount[i];
+        task.m_origin[i] = 0;
+        task.m_weights[i] = m_voxelSize[i];
+    }
+
+    ParallelForPool pool;
+    pool.start(a_numWorkers);
+    // the passes along x and y work on z slices, the pass along z on y slices
+    for (int axis = 0 ; axis < 3 ; axis++){
+        task.m_axis = axis;
+        pool.run(task, size_t(m_voxelCount[axis == 2 ? 1 : 2]));
+        task.m_source = NULL;
+    }
+    pool.stop();
+    return task.m_criticalCount.load();
+}
+
+///
+/// \brief This method recomputes the distances around a modified box. Only the voxels within
+/// the maximum distance of the box can change, and their nearest critical voxel is within the
+/// maximum distance of them, so the transform runs on the box grown twice by that distance and
+/// the distances of the box grown once are copied back. The slices of each pass are spread over
+/// the workers of the pool, if any, and nothing is allocated once the grid and the line buffers
+/// have grown to the size of the largest box.
+///
+void CriticalDistanceField::update(const unsigned char *a_data, const VoxelBox &a_box, ParallelForPool *a_pool){
+    if (!isValid()){
+        return;
+    }
+
+    int changedMin[3], changedMax[3], gridMin[3], gridMax[3];
+    for (int i = 0 ; i < 3 ; i++){
+        int margin = int(ceil(m_maxDistance / m_voxelSize[i])) + 1;
+        changedMin[i] = max(a_box.m_min[i] - margin, 0);
+        changedMax[i] = min(a_box.m_max[i] + margin, m_voxelCount[i]);
+        gridMin[i] = max(changedMin[i] - margin, 0);
+        gridMax[i] = min(changedMax[i] + margin, m_voxelCount[i]);
+        if (changedMax[i] <= changedMin[i]){
+            return;
+        }
+    }
+
+    DistancePassTask task;
+    task.m_step = m_step;
+    task.m_source = a_data;
+    task.m_bytesPerVoxel = m_bytesPerVoxel;
+    task.m_boneColor = m_boneColor;
+    task.m_criticalCount.store(0);
+    for (int i = 0 ; i < 3 ; i++){
+        task.m_dims[i] = gridMax[i] - gridMin[i];
+        task.m_volumeCount[i] = m_voxelCount[i];
+        task.m_origin[i] = gridMin[i];
+        task.m_weights[i] = m_voxelSize[i];
+    }
+    // the pass along x fills every voxel of the grid from the volume
+    size_t gridSize = size_t(task.m_dims[0]) * task.m_dims[1] * task.m_dims[2];
+    if (m_updateGrid.size() < gridSize){
+        m_updateGrid.resize(gridSize);
+    }
+    task.m_grid = m_updateGrid.data();
+
+    for (int axis = 0 ; axis < 3 ; axis++){
+        task.m_axis = axis;
+        int numSlices = task.m_dims[axis == 2 ? 1 : 2];
+        if (a_pool){
+            a_pool->run(task, size_t(numSlices));
+        }
+        else{
+            for (int s = 0 ; s < numSlices ; s++){
+                task.run(size_t(s));
+            }
+        }
+        task.m_source = NULL;
+    }
+
+    int rowLength = changedMax[0] - changedMin[0];
+    for (int z = changedMin[2] ; z < changedMax[2] ; z++){
+        for (int y = changedMin[1] ; y < changedMax[1] ; y++){
+            const uint16_t* src = &m_updateGrid[(size_t(z - gridMin[2]) * task.m_dims[1] + (y - gridMin[1])) * task.m_dims[0] + (changedMin[0] - gridMin[0])];
+            memcpy(&m_field[getIndex(changedMin[0], y, z)], src, rowLength * sizeof(uint16_t));
+        }
+    }
+}
+
+void CriticalDistanceField::getGradient(int a_x, int a_y, int a_z, double a_gradient[3]) const{
+    a_gradient[0] = (getDistance(a_x + 1, a_y, a_z) - getDistance(a_x - 1, a_y, a_z)) / (2.0 * m_voxelSize[0]);
+    a_gradient[1] = (getDistance(a_x, a_y + 1, a_z) - getDistance(a_x, a_y - 1, a_z)) / (2.0 * m_voxelSize[1]);
+    a_gradient[2] = (getDistance(a_x, a_y, a_z + 1) - getDistance(a_x, a_y, a_z - 1)) / (2.0 * m_voxelSize[2]);
+    double length = sqrt(a_gradient[0] * a_gradient[0] + a_gradient[1] * a_gradient[1] + a_gradient[2] * a_gradient[2]);
+    for (int i = 0 ; i < 3 ; i++){
+        a_gradient[i] = length > 1e-9 ? a_gradient[i] / length : 0.0;
+    }
+}
+
+void CriticalDistanceField::computeHeader(CriticalDistanceHeader &a_header, uint64_t a_sourceHash) const{
+    memset(&a_header, 0, sizeof(a_header));
+    memcpy(a_header.m_magic, CRITICAL_DISTANCE_MAGIC, sizeof(a_header.m_magic));
+    a_header.m_version = CRITICAL_DISTANCE_VERSION;
+    for (int i = 0 ; i < 3 ; i++){
+        a_header.m_voxelCount[i] = uint32_t(m_voxelCount[i]);
+        a_header.m_voxelSize[i] = m_voxelSize[i];
+    }
+    a_header.m_bytesPerVoxel = uint32_t(m_bytesPerVoxel);
+    memcpy(a_header.m_boneColor, m_boneColor, sizeof(a_header.m_boneColor));
+    a_header.m_maxDistance = m_maxDistance;
+    a_header.m_sourceHash = a_sourceHash;
+}
+
+bool CriticalDistanceField::load(const string &a_filepath, uint64_t a_sourceHash){
+    FILE* file = fopen(a_filepath.c_str(), "rb");
+    if (!file){
+        return false;
+    }
+
+    CriticalDistanceHeader expected, header;
+    computeHeader(expected, a_sourceHash);
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(&header, &expected, sizeof(header)) == 0;
+    if (valid){
+        m_field.resize(size_t(m_voxelCount[0]) * m_voxelCount[1] * m_voxelCount[2]);
+        valid = fread(m_field.data(), sizeof(uint16_t), m_field.size(), file) == m_field.size();
+        if (!valid){
+            m_field.clear();
+        }
+    }
+    fclose(file);
+    return valid;
+}
+
+bool CriticalDistanceField::save(const string &a_filepath, uint64_t a_sourceHash) const{
+    // written to a temporary file first, like the volume cache, so a reader never sees a partial file
+    string tmpFilepath = a_filepath + ".tmp";
+    FILE* file = fopen(tmpFilepath.c_str(), "wb");
+    if (!file){
+        return false;
+    }
+
+    CriticalDistanceHeader header;
+    computeHeader(header, a_sourceHash);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(m_field.data(), sizeof(uint16_t), m_field.size(), file) == m_field.size();
+    written &= fclose(file) == 0;
+    if (!written || rename(tmpFilepath.c_str(), a_filepath.c_str()) != 0){
+        remove(tmpFilepath.c_str());
+        return false;
+    }
+    return true;
+}
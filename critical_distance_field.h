@@ -0,0 +1,102 @@
+#ifndef CRITICAL_DISTANCE_FIELD_H
+#define CRITICAL_DISTANCE_FIELD_H
+
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "dirty_bricks.h"
+
+class ParallelForPool;
+
+///
+/// \brief Header at the start of a distance field cache file, followed by the distances.
+///
+struct CriticalDistanceHeader{
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_voxelCount[3];
+    uint32_t m_bytesPerVoxel;
+    unsigned char m_boneColor[4];
+    double m_voxelSize[3];
+    double m_maxDistance;
+    // Hash of the source slices, the same as the one of the volume cache
+    uint64_t m_sourceHash;
+};
+
+///
+/// \brief Distance from every voxel to the nearest critical voxel, i.e. an occupied voxel that
+/// isn't bone, so that the proximity of the burr to the critical structures is a single lookup.
+/// The exact Euclidean distance transform is computed separably, one pass per axis, with the
+/// lower envelope of parabolas of Felzenszwalb and Huttenlocher, and the lines of each pass are
+/// spread over a pool of workers. Distances take the voxel size of each axis into account and
+/// are clamped to a maximum distance, stored as 16 bits per voxel.
+///
+/// Removing or restoring a critical voxel only changes the distances within the maximum
+/// distance of it, so update() recomputes a box grown by that distance, in a grid and line
+/// buffers that are kept from one update to the next. The distances may be read by another
+/// thread while a box is updated, a read then returns the old or the new value.
+///
+class CriticalDistanceField{
+public:
+    CriticalDistanceField();
+
+    // a_voxelSize is the size of a voxel along each axis and a_maxDistance the distance beyond
+    // which the voxels are only known to be far, both in world units
+    void init(const int a_voxelCount[3], const double a_voxelSize[3], double a_maxDistance, int a_bytesPerVoxel, const unsigned char a_boneColor[4]);
+
+    // Computes the field of the whole volume on a_numWorkers threads besides the calling one.
+    // Returns the number of critical voxels
+    size_t build(const unsigned char* a_data, int a_numWorkers);
+
+    // Recomputes the distances that can change when the voxels of the box are modified, on the
+    // workers of a_pool and the calling thread, or only the calling thread if a_pool is null
+    void update(const unsigned char* a_data, const VoxelBox& a_box, ParallelForPool* a_pool = NULL);
+
+    // Reads a field written by save() for the same volume and parameters
+    bool load(const std::string& a_filepath, uint64_t a_sourceHash);
+
+    bool save(const std::string& a_filepath, uint64_t a_sourceHash) const;
+
+    bool isValid() const {return !m_field.empty();}
+
+    // Distance from the center of the voxel to the center of the nearest critical voxel,
+    // clamped to the maximum distance. The coordinates are clamped to the volume
+    inline double getDistance(int a_x, int a_y, int a_z) const{
+        return m_field[getIndex(a_x, a_y, a_z)] * m_step;
+    }
+
+    // Direction of increasing distance at a voxel, by central differences in the local frame
+    // of the volume. Zero far from the structures and inside them
+    void getGradient(int a_x, int a_y, int a_z, double a_gradient[3]) const;
+
+    double getMaxDistance() const {return m_maxDistance;}
+
+    size_t getMemoryUsage() const {return m_field.size() * sizeof(uint16_t);}
+
+private:
+    inline size_t getIndex(int a_x, int a_y, int a_z) const{
+        a_x = std::min(std::max(a_x, 0), m_voxelCount[0] - 1);
+        a_y = std::min(std::max(a_y, 0), m_voxelCount[1] - 1);
+        a_z = std::min(std::max(a_z, 0), m_voxelCount[2] - 1);
+        return (size_t(a_z) * m_voxelCount[1] + a_y) * m_voxelCount[0] + a_x;
+    }
+
+    void computeHeader(CriticalDistanceHeader& a_header, uint64_t a_sourceHash) const;
+
+    int m_voxelCount[3];
+    double m_voxelSize[3];
+    double m_maxDistance;
+    // distance of one step of the stored values
+    double m_step;
+    int m_bytesPerVoxel;
+    unsigned char m_boneColor[4];
+
+    std::vector<uint16_t> m_field;
+
+    // grid of the last update, only grows
+    std::vector<uint16_t> m_updateGrid;
+};
+
+#endif // CRITICAL_DISTANCE_FIELD_H
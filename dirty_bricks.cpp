@@ -0,0 +1,160 @@
+#include "dirty_bricks.h"
+#include <algorithm>
+
+using namespace std;
+
+DirtyBrickSet::DirtyBrickSet(){
+    m_brickSize = 16;
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = 0;
+        m_brickCount[i] = 0;
+    }
+    m_empty = true;
+}
+
+void DirtyBrickSet::init(int a_voxelCountX, int a_voxelCountY, int a_voxelCountZ, int a_brickSize){
+    m_brickSize = max(a_brickSize, 1);
+    m_voxelCount[0] = a_voxelCountX;
+    m_voxelCount[1] = a_voxelCountY;
+    m_voxelCount[2] = a_voxelCountZ;
+    for (int i = 0 ; i < 3 ; i++){
+        m_brickCount[i] = (m_voxelCount[i] + m_brickSize - 1) / m_brickSize;
+    }
+    size_t numBricks = size_t(m_brickCount[0]) * m_brickCount[1] * m_brickCount[2];
+    m_bits.assign((numBricks + 63) / 64, 0);
+    m_touchedWords.clear();
+    m_empty = true;
+}
+
+void DirtyBrickSet::markBox(const VoxelBox &a_box){
+    int bmin[3], bmax[3];
+    for (int i = 0 ; i < 3 ; i++){
+        bmin[i] = max(a_box.m_min[i], 0) / m_brickSize;
+        bmax[i] = min((a_box.m_max[i] - 1) / m_brickSize, m_brickCount[i] - 1);
+        if (a_box.m_max[i] <= a_box.m_min[i] || bmax[i] < bmin[i]){
+            return;
+        }
+    }
+    for (int bz = bmin[2] ; bz <= bmax[2] ; bz++){
+        for (int by = bmin[1] ; by <= bmax[1] ; by++){
+            for (int bx = bmin[0] ; bx <= bmax[0] ; bx++){
+                markBrick(bx, by, bz);
+            }
+        }
+    }
+}
+
+void DirtyBrickSet::markAll(){
+    VoxelBox box = {{0, 0, 0}, {m_voxelCount[0], m_voxelCount[1], m_voxelCount[2]}};
+    markBox(box);
+}
+
+void DirtyBrickSet::clear(){
+    fill(m_bits.begin(), m_bits.end(), 0);
+    m_touchedWords.clear();
+    m_empty = true;
+}
+
+void DirtyBrickSet::publish(DirtyBrickExchange &a_exchange){
+    for (size_t i = 0 ; i < m_touchedWords.size() ; i++){
+        size_t w = m_touchedWords[i];
+        if (m_bits[w] != 0){
+            a_exchange[w].fetch_or(m_bits[w], memory_order_release);
+            m_bits[w] = 0;
+        }
+    }
+    m_touchedWords.clear();
+    m_empty = true;
+}
+
+void DirtyBrickSet::collect(DirtyBrickExchange &a_exchange){
+    for (size_t w = 0 ; w < m_bits.size() ; w++){
+        if (a_exchange[w].load(memory_order_relaxed) == 0){
+            continue;
+        }
+        uint64_t bits = a_exchange[w].exchange(0, memory_order_acquire);
+        if (bits != 0){
+            if (m_bits[w] == 0){
+                m_touchedWords.push_back(w);
+            }
+            m_bits[w] |= bits;
+            m_empty = false;
+        }
+    }
+}
+
+///
+/// \brief Greedy coalescing: starting from the first dirty brick in z-y-x order, the box
+/// is grown along x while the bricks are dirty, then along y and z while the whole
+/// face of the box is dirty. This keeps the boxes tight, i.e. clean bricks are never uploaded.
+///
+void DirtyBrickSet::extractBoxes(vector<VoxelBox> &a_boxes, size_t a_maxVoxels){
+    a_boxes.clear();
+    if (m_empty){
+        return;
+    }
+
+    size_t voxels = 0;
+    bool budgetReached = false;
+    for (int bz = 0 ; bz < m_brickCount[2] && !budgetReached ; bz++){
+        for (int by = 0 ; by < m_brickCount[1] && !budgetReached ; by++){
+            for (int bx = 0 ; bx < m_brickCount[0] && !budgetReached ; bx++){
+                if (!isBrickDirty(bx, by, bz)){
+                    continue;
+                }
+
+                int ex = bx + 1;
+                while (ex < m_brickCount[0] && isBrickDirty(ex, by, bz)){
+                    ex++;
+                }
+
+                int ey = by + 1;
+                for (bool grow = true ; grow && ey < m_brickCount[1] ; ){
+                    for (int x = bx ; x < ex && grow ; x++){
+                        grow = isBrickDirty(x, ey, bz);
+                    }
+                    if (grow){
+                        ey++;
+                    }
+                }
+
+                int ez = bz + 1;
+                for (bool grow = true ; grow && ez < m_brickCount[2] ; ){
+                    for (int y = by ; y < ey && grow ; y++){
+                        for (int x = bx ; x < ex && grow ; x++){
+                            grow = isBrickDirty(x, y, ez);
+                        }
+                    }
+                    if (grow){
+                        ez++;
+                    }
+                }
+
+                for (int z = bz ; z < ez ; z++){
+                    for (int y = by ; y < ey ; y++){
+                        for (int x = bx ; x < ex ; x++){
+                            clearBrick(x, y, z);
+                        }
+                    }
+                }
+
+                VoxelBox box;
+                box.m_min[0] = bx * m_brickSize;
+                box.m_min[1] = by * m_brickSize;
+                box.m_min[2] = bz * m_brickSize;
+                box.m_max[0] = min(ex * m_brickSize, m_voxelCount[0]);
+                box.m_max[1] = min(ey * m_brickSize, m_voxelCount[1]);
+                box.m_max[2] = min(ez * m_brickSize, m_voxelCount[2]);
+                a_boxes.push_back(box);
+
+                voxels += box.getVoxelCount();
+                budgetReached = a_maxVoxels > 0 && voxels >= a_maxVoxels;
+            }
+        }
+    }
+
+    if (!budgetReached){
+        m_touchedWords.clear();
+        m_empty = true;
+    }
+}
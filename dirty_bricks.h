@@ -0,0 +1,124 @@
+#ifndef DIRTY_BRICKS_H
+#define DIRTY_BRICKS_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+///
+/// \brief An axis aligned box of voxels. Min is inclusive and max is exclusive.
+///
+struct VoxelBox{
+    int m_min[3];
+    int m_max[3];
+
+    size_t getVoxelCount() const{
+        return size_t(m_max[0] - m_min[0]) * size_t(m_max[1] - m_min[1]) * size_t(m_max[2] - m_min[2]);
+    }
+};
+
+///
+/// \brief Lock-free hand-off of dirty bricks between two threads. The producer ORs its
+/// bits in, the consumer swaps them out. Both sides use a DirtyBrickSet of the same size.
+///
+class DirtyBrickExchange{
+public:
+    DirtyBrickExchange(): m_size(0) {}
+
+    void init(size_t a_numWords){
+        m_words.reset(new std::atomic<uint64_t>[a_numWords]);
+        m_size = a_numWords;
+        for (size_t i = 0 ; i < m_size ; i++){
+            m_words[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    size_t size() const {return m_size;}
+
+    std::atomic<uint64_t>& operator[](size_t a_idx) {return m_words[a_idx];}
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> m_words;
+    size_t m_size;
+};
+
+///
+/// \brief Tracks which bricks (cubes of voxels) of a volume have been modified,
+/// one bit per brick, so that only the modified parts of the volume texture are uploaded.
+///
+class DirtyBrickSet{
+public:
+    DirtyBrickSet();
+
+    void init(int a_voxelCountX, int a_voxelCountY, int a_voxelCountZ, int a_brickSize = 16);
+
+    // Marks the brick containing the voxel (x, y, z)
+    inline void markVoxel(int a_x, int a_y, int a_z){
+        markBrick(a_x / m_brickSize, a_y / m_brickSize, a_z / m_brickSize);
+    }
+
+    inline void markBrick(int a_bx, int a_by, int a_bz){
+        size_t idx = getBrickIndex(a_bx, a_by, a_bz);
+        uint64_t& word = m_bits[idx >> 6];
+        if (word == 0){
+            m_touchedWords.push_back(idx >> 6);
+        }
+        word |= (uint64_t(1) << (idx & 63));
+        m_empty = false;
+    }
+
+    // Marks all the bricks that intersect the voxel box
+    void markBox(const VoxelBox& a_box);
+
+    void markAll();
+
+    void clear();
+
+    bool isEmpty() const {return m_empty;}
+
+    // Coalesces the dirty bricks into boxes and clears them. Extraction stops once the
+    // boxes cover more than a_maxVoxels voxels (0 = no limit). At least one box is
+    // returned if any brick is dirty. The bricks not extracted remain dirty.
+    void extractBoxes(std::vector<VoxelBox>& a_boxes, size_t a_maxVoxels = 0);
+
+    // Hands the dirty bricks over to the exchange and clears this set.
+    // Only the words touched since the last call are visited.
+    void publish(DirtyBrickExchange& a_exchange);
+
+    // Moves the bricks published to the exchange into this set
+    void collect(DirtyBrickExchange& a_exchange);
+
+    // Initializes an exchange matching the size of this set
+    void initExchange(DirtyBrickExchange& a_exchange) const {a_exchange.init(m_bits.size());}
+
+    int getBrickSize() const {return m_brickSize;}
+
+    int getBrickCount(int a_axis) const {return m_brickCount[a_axis];}
+
+    size_t getBrickIndex(int a_bx, int a_by, int a_bz) const{
+        return (size_t(a_bz) * m_brickCount[1] + a_by) * m_brickCount[0] + a_bx;
+    }
+
+    bool isBrickDirty(int a_bx, int a_by, int a_bz) const{
+        size_t idx = getBrickIndex(a_bx, a_by, a_bz);
+        return (m_bits[idx >> 6] >> (idx & 63)) & 1;
+    }
+
+private:
+    void clearBrick(int a_bx, int a_by, int a_bz){
+        size_t idx = getBrickIndex(a_bx, a_by, a_bz);
+        m_bits[idx >> 6] &= ~(uint64_t(1) << (idx & 63));
+    }
+
+    int m_voxelCount[3];
+    int m_brickCount[3];
+    int m_brickSize;
+    std::vector<uint64_t> m_bits;
+    // Indices of the words that went from zero to non-zero. May hold words cleared since.
+    std::vector<size_t> m_touchedWords;
+    bool m_empty;
+};
+
+#endif // DIRTY_BRICKS_H
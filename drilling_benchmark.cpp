@@ -0,0 +1,566 @@
+//==============================================================================
+/*
+    Software License Agreement (BSD License)
+    Copyright (c) 2019-2021, AMBF
+    (https://github.com/WPI-AIM/ambf)
+
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+    copyright notice, this list of conditions and the following
+    disclaimer in the documentation and/or other materials provided
+    with the distribution.
+
+    * Neither the name of authors nor the names of its contributors may
+    be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+//==============================================================================
+
+// A headless benchmark of the drilling core. It loads a volume without any window or
+// haptic device, replays a drill trajectory through the voxel removal and the tool cursor
+// force computation of the plugin, and reports the throughput, the latencies and a
+// checksum of the drilled volume. The replay is deterministic, so two builds that compute
+// the same results print the same checksum.
+
+#include <chai3d.h>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "drilling_core.h"
+#include "input_recorder.h"
+#include "perf_profiler.h"
+#include "slice_loader.h"
+#include "volume_source.h"
+
+using namespace std;
+using namespace chai3d;
+
+///
+/// \brief The commanded pose of the drill tip and the active burr for one tick,
+/// in the frame of the volume
+///
+struct TrajectorySample{
+    cVector3d m_pos;
+    cMatrix3d m_rot;
+    int m_burrIdx;
+};
+
+///
+/// \brief Counts the removed voxels and the ones that aren't bone, like the warning of the plugin
+///
+class RemovalCounter: public DrillingEventListener{
+public:
+    virtual void voxelRemoved(int a_x, int a_y, int a_z, const cColorb& a_color, int a_label) override{
+        m_removedCount++;
+        if (m_useLabels ? a_label != m_boneLabel : a_color != m_boneColor){
+            m_criticalCount++;
+        }
+    }
+
+    cColorb m_boneColor = cColorb(255, 249, 219, 255);
+    bool m_useLabels = false;
+    int m_boneLabel = 0;
+    unsigned long long m_removedCount = 0;
+    unsigned long long m_criticalCount = 0;
+};
+
+///
+/// \brief Reads a trajectory with one tick per line: x y z roll pitch yaw burr_index.
+/// Empty lines and lines starting with # are skipped
+///
+static bool loadTrajectory(const string& a_filepath, vector<TrajectorySample>& a_samples){
+    ifstream file(a_filepath.c_str());
+    if (!file.is_open()){
+        cerr << "ERROR! FAILED TO OPEN TRAJECTORY FILE " << a_filepath << endl;
+        return false;
+    }
+
+    string line;
+    int lineNumber = 0;
+    while (getline(file, line)){
+        lineNumber++;
+        if (line.empty() || line[0] == '#'){
+            continue;
+        }
+        stringstream ss(line);
+        double x, y, z, roll, pitch, yaw;
+        TrajectorySample sample;
+        if (!(ss >> x >> y >> z >> roll >> pitch >> yaw >> sample.m_burrIdx)){
+            cerr << "ERROR! INVALID TRAJECTORY SAMPLE AT LINE " << lineNumber << " OF " << a_filepath << endl;
+            return false;
+        }
+        if (sample.m_burrIdx < 0 || sample.m_burrIdx > 2){
+            cerr << "ERROR! DRILL BURR AT INDEX " << sample.m_burrIdx << " DOES NOT EXIST, LINE " << lineNumber << " OF " << a_filepath << endl;
+            return false;
+        }
+        sample.m_pos.set(x, y, z);
+        sample.m_rot.setExtrinsicEulerRotationRad(roll, pitch, yaw, C_EULER_ORDER_XYZ);
+        a_samples.push_back(sample);
+    }
+    return !a_samples.empty();
+}
+
+///
+/// \brief Reads the drill poses and burrs of a recording of the plugin. The poses are recorded
+/// in the world frame and are moved to the frame of the recorded volume
+///
+static bool loadRecording(const string& a_filepath, vector<TrajectorySample>& a_samples){
+    InputRecordHeader header;
+    vector<InputRecord> records;
+    if (!InputRecorder::load(a_filepath, header, records)){
+        return false;
+    }
+
+    cVector3d volumePos(header.m_volumePos[0], header.m_volumePos[1], header.m_volumePos[2]);
+    cMatrix3d volumeRot;
+    for (int i = 0 ; i < 3 ; i++){
+        for (int j = 0 ; j < 3 ; j++){
+            volumeRot(i, j) = header.m_volumeRot[3 * i + j];
+        }
+    }
+    cMatrix3d volumeRotT = cTranspose(volumeRot);
+
+    for (size_t ri = 0 ; ri < records.size() ; ri++){
+        const InputRecord& record = records[ri];
+        if (record.m_burrIdx < 0 || record.m_burrIdx > 2){
+            cerr << "ERROR! DRILL BURR AT INDEX " << int(record.m_burrIdx) << " DOES NOT EXIST, RECORD " << ri << " OF " << a_filepath << endl;
+            return false;
+        }
+        TrajectorySample sample;
+        cMatrix3d rot;
+        for (int i = 0 ; i < 3 ; i++){
+            for (int j = 0 ; j < 3 ; j++){
+                rot(i, j) = record.m_drillRot[3 * i + j];
+            }
+        }
+        cVector3d pos(record.m_drillPos[0], record.m_drillPos[1], record.m_drillPos[2]);
+        sample.m_pos = volumeRotT * (pos - volumePos);
+        sample.m_rot = volumeRotT * rot;
+        sample.m_burrIdx = record.m_burrIdx;
+        a_samples.push_back(sample);
+    }
+    return !a_samples.empty();
+}
+
+///
+/// \brief True if the file starts like a recording of the plugin
+///
+static bool isRecordingFile(const string& a_filepath){
+    char magic[8] = {0};
+    FILE* file = fopen(a_filepath.c_str(), "rb");
+    if (!file){
+        return false;
+    }
+    bool isRecording = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, InputRecorder::s_magic, sizeof(magic)) == 0;
+    fclose(file);
+    return isRecording;
+}
+
+///
+/// \brief Generates a trajectory that enters the volume from the top and spirals down,
+/// with the shaft pointing up and the burr changing every third of the ticks
+///
+static void generateTrajectory(int a_ticks, const double a_dimensions[3], vector<TrajectorySample>& a_samples){
+    cMatrix3d rot;
+    // the shaft extends along the x axis of the drill, point it up the z axis of the volume
+    rot.setExtrinsicEulerRotationRad(0.0, -C_PI / 2.0, 0.0, C_EULER_ORDER_XYZ);
+
+    const double loops = 6.0;
+    for (int i = 0 ; i < a_ticks ; i++){
+        double t = double(i) / a_ticks;
+        double angle = 2.0 * C_PI * loops * t;
+        double radius = 0.3 * t;
+        TrajectorySample sample;
+        sample.m_pos.set(radius * cos(angle) * a_dimensions[0],
+                         radius * sin(angle) * a_dimensions[1],
+                         (0.45 - 0.4 * t) * a_dimensions[2]);
+        sample.m_rot = rot;
+        sample.m_burrIdx = min(int(3 * t), 2);
+        a_samples.push_back(sample);
+    }
+}
+
+///
+/// \brief Generates a sphere of bone around a smaller sphere of another color, standing for
+/// a critical structure, in RGBA voxels
+///
+static void generateVolume(int a_size, vector<unsigned char>& a_data){
+    const cColorb bone(255, 249, 219, 255);
+    const cColorb critical(200, 40, 40, 255);
+    a_data.assign(size_t(a_size) * a_size * a_size * 4, 0);
+
+    double center = 0.5 * a_size;
+    for (int z = 0 ; z < a_size ; z++){
+        for (int y = 0 ; y < a_size ; y++){
+            for (int x = 0 ; x < a_size ; x++){
+                double dx = x + 0.5 - center, dy = y + 0.5 - center, dz = z + 0.5 - center;
+                double r = sqrt(dx * dx + dy * dy + dz * dz) / a_size;
+                const cColorb* color = r < 0.1 ? &critical : (r < 0.4 ? &bone : NULL);
+                if (color){
+                    memcpy(&a_data[((size_t(z) * a_size + y) * a_size + x) * 4], color->m_color, 4);
+                }
+            }
+        }
+    }
+}
+
+// 64 bit FNV-1a
+static uint64_t computeChecksum(const unsigned char* a_data, size_t a_size){
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0 ; i < a_size ; i++){
+        hash ^= a_data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Checksum of the RGBA colors of the volume, the same for a volume stored as labels
+static uint64_t computeVolumeChecksum(const cImagePtr& a_image, const VoxelPalette& a_palette){
+    if (a_palette.isEmpty()){
+        return computeChecksum(a_image->getData(), a_image->getSizeInBytes());
+    }
+    uint64_t hash = 14695981039346656037ULL;
+    const unsigned char* voxel = a_image->getData();
+    size_t voxelCount = a_image->getSizeInBytes() / 2;
+    for (size_t i = 0 ; i < voxelCount ; i++, voxel += 2){
+        unsigned char rgba[4];
+        a_palette.toRGBA(voxel, rgba);
+        for (int c = 0 ; c < 4 ; c++){
+            hash ^= rgba[c];
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+int main(int argc, char** argv){
+    namespace p_opt = boost::program_options;
+    p_opt::options_description cmd_opts("volumetric_drilling_benchmark Command Line Options");
+    cmd_opts.add_options()
+            ("help,h", "Show Info")
+            ("adf", p_opt::value<string>()->default_value(""), "Volume ADF to load, a synthetic volume is generated if empty. Default empty")
+            ("size", p_opt::value<int>()->default_value(128), "Number of voxels along each axis of the synthetic volume. Default 128")
+            ("trajectory", p_opt::value<string>()->default_value(""), "Trajectory to replay, one 'x y z roll pitch yaw burr' line per tick in the volume frame, or a recording of the plugin. A spiral is generated if empty. Default empty")
+            ("ticks", p_opt::value<int>()->default_value(10000), "Number of ticks of the generated trajectory. Default 10000")
+            ("nt", p_opt::value<int>()->default_value(8), "Number Tool Cursors to Load. Default 8")
+            ("ds", p_opt::value<float>()->default_value(0.026), "Offset between shaft tool cursors. Default 0.026")
+            ("fcw", p_opt::value<int>()->default_value(0), "Worker threads running the broad-phase of the shaft tool cursors, 0 to run it on the main thread, -1 for one per core. The forces are always computed on the main thread. Default 0")
+            ("bs", p_opt::value<int>()->default_value(16), "Size of the bricks used to track modified voxels. Default 16")
+            ("bpc", p_opt::value<bool>()->default_value(true), "Skip the force computation of the shaft tool cursors that can't touch the volume. Default true")
+            ("stiffness", p_opt::value<float>()->default_value(2000.0), "Stiffness of the volume. Default 2000")
+            ("journal", p_opt::value<bool>()->default_value(false), "Journal the removed voxels, then roll the volume back to its initial state and check it. Default false")
+            ("labels", p_opt::value<bool>()->default_value(false), "Store the volume as an 8 bit label and an 8 bit density per voxel, the checksum is the one of its RGBA colors. Default false")
+            ("lod", p_opt::value<int>()->default_value(1), "Fine voxels per axis in each voxel of the coarse level the tool cursors collide with, 1 to collide with the volume. Default 1")
+            ("expect", p_opt::value<string>()->default_value(""), "Expected checksum of the drilled volume, the benchmark fails if it differs. Default empty");
+
+    p_opt::variables_map var_map;
+    p_opt::store(p_opt::command_line_parser(argc, argv).options(cmd_opts).run(), var_map);
+    p_opt::notify(var_map);
+
+    if(var_map.count("help")){
+        std::cout<< cmd_opts << std::endl;
+        return 0;
+    }
+
+    string adf_filepath = var_map["adf"].as<string>();
+    int volume_size = var_map["size"].as<int>();
+    string trajectory_filepath = var_map["trajectory"].as<string>();
+    int ticks = var_map["ticks"].as<int>();
+    int nt = var_map["nt"].as<int>();
+    double ds = var_map["ds"].as<float>();
+    int force_workers = var_map["fcw"].as<int>();
+    int brick_size = var_map["bs"].as<int>();
+    bool tool_cursor_culling = var_map["bpc"].as<bool>();
+    double stiffness = var_map["stiffness"].as<float>();
+    bool use_journal = var_map["journal"].as<bool>();
+    bool use_labels = var_map["labels"].as<bool>();
+    int haptic_lod = var_map["lod"].as<int>();
+    string expected_checksum = var_map["expect"].as<string>();
+
+    if (nt <= 0 || nt > 32){
+        cerr << "ERROR! VALID NUMBER OF TOOL CURSORS ARE BETWEEN 1 - 32. Specified value = " << nt << endl;
+        return 1;
+    }
+
+    if (haptic_lod < 1){
+        cerr << "ERROR! THE HAPTIC LEVEL OF DETAIL MUST BE AT LEAST 1. Specified value = " << haptic_lod << endl;
+        return 1;
+    }
+
+    if (brick_size <= 0 || (brick_size & (brick_size - 1)) != 0){
+        cerr << "ERROR! BRICK SIZE MUST BE A POWER OF TWO. Specified value = " << brick_size << endl;
+        return 1;
+    }
+
+    // The same burrs and shaft cursor radii as the plugin
+    const vector<double> burrRadii{0.02014, 0.04030, 0.06041};
+    const vector<double> toolCursorRadii{0.02, 0.013, 0.015, 0.017, 0.019, 0.021, 0.023, 0.025};
+
+    // Volume
+    vector<unsigned char> data;
+    uint32_t voxelCount[3];
+    double dimensions[3] = {1.0, 1.0, 1.0};
+    if (!adf_filepath.empty()){
+        VolumeImageSource source;
+        if (!source.loadFromADF(adf_filepath)){
+            cerr << "ERROR! FAILED TO LOAD THE VOLUME OF " << adf_filepath << endl;
+            return 1;
+        }
+        VolumeSliceLoader loader(source.m_loaderWorkers);
+        if (!loader.load(source, data, voxelCount[0], voxelCount[1])){
+            return 1;
+        }
+        loader.printStats(source.m_name);
+        voxelCount[2] = source.m_count;
+        for (int i = 0 ; i < 3 ; i++){
+            dimensions[i] = source.m_dimensions[i];
+        }
+    }
+    else{
+        if (volume_size <= 0){
+            cerr << "ERROR! SYNTHETIC VOLUME SIZE MUST BE POSITIVE. Specified value = " << volume_size << endl;
+            return 1;
+        }
+        generateVolume(volume_size, data);
+        voxelCount[0] = voxelCount[1] = voxelCount[2] = volume_size;
+    }
+
+    // Trajectory
+    vector<TrajectorySample> trajectory;
+    if (!trajectory_filepath.empty()){
+        bool loaded = isRecordingFile(trajectory_filepath) ? loadRecording(trajectory_filepath, trajectory)
+                                                           : loadTrajectory(trajectory_filepath, trajectory);
+        if (!loaded){
+            return 1;
+        }
+    }
+    else{
+        if (ticks <= 0){
+            cerr << "ERROR! NUMBER OF TICKS MUST BE POSITIVE. Specified value = " << ticks << endl;
+            return 1;
+        }
+        generateTrajectory(ticks, dimensions, trajectory);
+    }
+
+    // World with the voxel object centered at the origin
+    cWorld* world = new cWorld();
+
+    cMultiImagePtr image = cMultiImage::create();
+    VoxelPalette palette;
+    if (use_labels){
+        image->allocate(voxelCount[0], voxelCount[1], voxelCount[2], GL_LUMINANCE_ALPHA);
+        if (!palette.convert(data.data(), data.size() / 4, image->getData()) || palette.isEmpty()){
+            cerr << "ERROR! THE VOLUME MUST HAVE BETWEEN 1 AND " << VoxelPalette::MAX_LABELS - 1 << " COLORS TO BE STORED AS LABELS" << endl;
+            return 1;
+        }
+        cerr << "INFO! STORING THE VOLUME AS THE LABELS OF " << palette.getLabelCount() << " COLORS" << endl;
+    }
+    else{
+        image->allocate(voxelCount[0], voxelCount[1], voxelCount[2], GL_RGBA);
+        memcpy(image->getData(), data.data(), data.size());
+    }
+    data.clear();
+    data.shrink_to_fit();
+
+    cVoxelObject* voxelObj = new cVoxelObject();
+    voxelObj->m_minCorner.set(-0.5 * dimensions[0], -0.5 * dimensions[1], -0.5 * dimensions[2]);
+    voxelObj->m_maxCorner.set(0.5 * dimensions[0], 0.5 * dimensions[1], 0.5 * dimensions[2]);
+    voxelObj->m_minTextureCoord.set(0.0, 0.0, 0.0);
+    voxelObj->m_maxTextureCoord.set(1.0, 1.0, 1.0);
+    cTexture3dPtr texture = cTexture3d::create();
+    texture->setImage(image);
+    voxelObj->setTexture(texture);
+    voxelObj->m_material->setStiffness(stiffness);
+    voxelObj->m_material->setDamping(0.0);
+    voxelObj->m_material->setDynamicFriction(0.0);
+    voxelObj->setUseMaterial(true);
+    world->addChild(voxelObj);
+
+    int voxelCountInt[3] = {int(voxelCount[0]), int(voxelCount[1]), int(voxelCount[2])};
+    DirtyBrickExchange dirtyBrickExchange;
+    RemovalCounter removalCounter;
+    DrillingCore core;
+    core.initVolume(voxelObj, voxelCountInt, brick_size, &dirtyBrickExchange);
+
+    // the coarse level covers the voxel count rounded up to the factor
+    if (haptic_lod > 1){
+        cMultiImagePtr coarseImage = cMultiImage::create();
+        coarseImage->allocate((voxelCount[0] + haptic_lod - 1) / haptic_lod, (voxelCount[1] + haptic_lod - 1) / haptic_lod,
+                (voxelCount[2] + haptic_lod - 1) / haptic_lod, image->getFormat());
+        cTexture3dPtr coarseTexture = cTexture3d::create();
+        coarseTexture->setImage(coarseImage);
+        cVoxelObject* coarseObj = new cVoxelObject();
+        coarseObj->m_minCorner = voxelObj->m_minCorner;
+        coarseObj->m_maxCorner = voxelObj->m_maxCorner;
+        for (int i = 0 ; i < 3 ; i++){
+            coarseObj->m_minTextureCoord(i) = 0.0;
+            coarseObj->m_maxTextureCoord(i) = double(voxelCount[i]) / (((voxelCount[i] + haptic_lod - 1) / haptic_lod) * haptic_lod);
+        }
+        coarseObj->setTexture(coarseTexture);
+        coarseObj->m_material = voxelObj->m_material;
+        coarseObj->setUseMaterial(true);
+        voxelObj->addChild(coarseObj);
+        core.setHapticLevel(coarseObj, haptic_lod);
+        cerr << "INFO! TOOL CURSORS COLLIDE WITH A LEVEL " << haptic_lod << " TIMES COARSER THAN THE VOLUME" << endl;
+    }
+    core.setBurrs(burrRadii, trajectory[0].m_burrIdx);
+    core.setListener(&removalCounter);
+    if (use_labels){
+        core.setPalette(&palette);
+        removalCounter.m_useLabels = true;
+        removalCounter.m_boneLabel = palette.findLabel(removalCounter.m_boneColor.m_color);
+    }
+    core.setCulling(tool_cursor_culling);
+
+    // the journal may hold every voxel of the volume
+    VoxelJournal journal;
+    uint64_t initialChecksum = 0;
+    if (use_journal){
+        if (!journal.init(voxelCountInt, image->getSizeInBytes() / image->getBytesPerPixel() * sizeof(JournalEntry) * 2)){
+            return 1;
+        }
+        core.setJournal(&journal);
+        initialChecksum = computeChecksum(image->getData(), image->getSizeInBytes());
+    }
+
+    // Tool cursors, without a haptic device the cursors only follow their commanded pose
+    vector<cToolCursor*> toolCursors(nt);
+    for (int i = 0 ; i < nt ; i++){
+        toolCursors[i] = new cToolCursor(world);
+        world->addChild(toolCursors[i]);
+        toolCursors[i]->setRadius(i == 0 ? burrRadii[trajectory[0].m_burrIdx] : toolCursorRadii[min(size_t(i), toolCursorRadii.size() - 1)]);
+    }
+    core.setToolCursors(toolCursors, toolCursorRadii, ds);
+
+    cTransform pose;
+    pose.setLocalPos(trajectory[0].m_pos);
+    pose.setLocalRot(trajectory[0].m_rot);
+    core.toolCursorsPosUpdate(pose);
+    world->computeGlobalPositions(true);
+    core.toolCursorsInitialize();
+
+    if (force_workers < 0){
+        force_workers = max(int(std::thread::hardware_concurrency()) - 1, 0);
+    }
+    force_workers = min(force_workers, max(nt - 2, 0));
+    core.startForceWorkers(force_workers);
+
+    cerr << "INFO! REPLAYING " << trajectory.size() << " TICKS ON A " << voxelCount[0] << "x" << voxelCount[1] << "x" << voxelCount[2]
+         << " VOLUME WITH " << nt << " TOOL CURSORS AND " << force_workers << " BROAD-PHASE WORKERS" << endl;
+
+    PerfProfiler perf;
+    perf.init(true);
+    unsigned long long contactTicks = 0;
+    unsigned long long culledToolCursors = 0;
+
+    // The same steps and order as one tick of the haptic loop of the plugin
+    PerfProfiler::Clock::time_point startTime = PerfProfiler::Clock::now();
+    for (size_t ti = 0 ; ti < trajectory.size() ; ti++){
+        PerfScope tickScope(perf, PERF_HAPTIC_TICK);
+        const TrajectorySample& sample = trajectory[ti];
+
+        {
+            PerfScope poseScope(perf, PERF_POSE_UPDATE);
+            world->computeGlobalPositions(true);
+            if (sample.m_burrIdx != core.getActiveBurrIdx()){
+                core.setBurr(sample.m_burrIdx);
+            }
+            pose.setLocalPos(sample.m_pos);
+            pose.setLocalRot(sample.m_rot);
+            core.toolCursorsPosUpdate(pose);
+        }
+
+        {
+            PerfScope collisionScope(perf, PERF_SHAFT_COLLISION);
+            core.checkShaftCollision();
+        }
+
+        if (core.isTipDrilling()){
+            PerfScope removalScope(perf, PERF_VOXEL_REMOVAL);
+            contactTicks++;
+            core.removeVoxelsInBurr(ti * 0.001);
+        }
+
+        {
+            PerfScope forceScope(perf, PERF_FORCE_COMPUTATION);
+            core.computeForces();
+            culledToolCursors += core.getCulledToolCursorCount();
+        }
+    }
+    double elapsed = chrono::duration<double>(PerfProfiler::Clock::now() - startTime).count();
+    core.stop();
+    for (int i = 0 ; i < nt ; i++){
+        toolCursors[i]->stop();
+    }
+
+    vector<PerfStageStats> stats;
+    perf.collect(stats);
+
+    uint64_t checksum = computeVolumeChecksum(image, palette);
+    char checksumText[32];
+    snprintf(checksumText, sizeof(checksumText), "%016llx", (unsigned long long)checksum);
+
+    printf("ticks:            %zu\n", trajectory.size());
+    printf("wall time:        %.3f s\n", elapsed);
+    printf("ticks/s:          %.1f\n", trajectory.size() / elapsed);
+    printf("contact ticks:    %llu\n", contactTicks);
+    printf("voxels removed:   %llu (%llu not bone)\n", removalCounter.m_removedCount, removalCounter.m_criticalCount);
+    printf("voxels/s:         %.1f\n", removalCounter.m_removedCount / elapsed);
+    if (nt > 1){
+        printf("culled cursors:   %.1f%%\n", 100.0 * culledToolCursors / (double(trajectory.size()) * (nt - 1)));
+    }
+    printf("%-18s %10s %10s %10s %10s\n", "stage", "count", "p50 us", "p99 us", "max us");
+    for (size_t i = 0 ; i < stats.size() ; i++){
+        if (stats[i].m_count > 0){
+            printf("%-18s %10llu %10.1f %10.1f %10.1f\n", stats[i].m_name.c_str(), (unsigned long long)stats[i].m_count,
+                   stats[i].m_p50, stats[i].m_p99, stats[i].m_max);
+        }
+    }
+    printf("checksum:         %s\n", checksumText);
+
+    if (!expected_checksum.empty() && expected_checksum != checksumText){
+        cerr << "ERROR! CHECKSUM " << checksumText << " DOES NOT MATCH THE EXPECTED " << expected_checksum << endl;
+        return 2;
+    }
+
+    if (use_journal){
+        size_t journalBytes = journal.getMemoryUsage();
+        PerfProfiler::Clock::time_point rollbackStart = PerfProfiler::Clock::now();
+        size_t restoredCount = core.rollbackTo(journal.getOldestPosition());
+        double rollbackTime = chrono::duration<double>(PerfProfiler::Clock::now() - rollbackStart).count();
+        printf("journal:          %zu KB\n", journalBytes / 1024);
+        printf("rollback:         %zu voxels in %.3f ms\n", restoredCount, rollbackTime * 1000.0);
+        if (computeChecksum(image->getData(), image->getSizeInBytes()) != initialChecksum){
+            cerr << "ERROR! THE ROLLED BACK VOLUME DOES NOT MATCH THE INITIAL VOLUME" << endl;
+            return 2;
+        }
+    }
+
+    // the voxel object and the tool cursors are children of the world
+    delete world;
+    return 0;
+}
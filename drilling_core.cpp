@@ -0,0 +1,409 @@
+#include "drilling_core.h"
+#include "broad_phase.h"
+
+using namespace std;
+using namespace chai3d;
+
+///
+/// \brief Goals of the tool cursors, a_step apart along the drill axis from the tip. N is the
+/// number of cursors, 0 for a number only known at runtime.
+///
+template <int N>
+static void computeToolCursorGoals(const cVector3d& a_origin, const cVector3d& a_step, cVector3d* a_goals, int a_count){
+    const int count = N > 0 ? N : a_count;
+    for (int i = 0 ; i < count ; i++){
+        a_goals[i] = a_origin + a_step * double(i);
+    }
+}
+
+///
+/// \brief Index of the tool cursor the furthest from its goal, 0 if none is, N as above.
+///
+template <int N>
+static int selectTargetToolCursor(const double* a_errors, int a_count){
+    const int count = N > 0 ? N : a_count;
+    double maxError = 0;
+    int target = 0;
+    for (int i = 0 ; i < count ; i++){
+        if (abs(a_errors[i]) > abs(maxError + 0.00001)){
+            maxError = a_errors[i];
+            target = i;
+        }
+    }
+    return target;
+}
+
+DrillingCore::DrillingCore(){
+    m_voxelObj = NULL;
+    m_hapticVoxelObj = NULL;
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = 0;
+    }
+    m_dirtyBrickExchange = NULL;
+    m_activeBurrIdx = 0;
+    m_spacing = 0.0;
+    m_targetToolCursorIdx = 0;
+    m_culling = true;
+    m_culledToolCursorCount = 0;
+    m_listener = NULL;
+    m_journal = NULL;
+    m_nearVolume = false;
+    m_toolCursorCullTask.m_core = this;
+    m_goalKernel = &computeToolCursorGoals<0>;
+    m_targetKernel = &selectTargetToolCursor<0>;
+}
+
+DrillingCore::~DrillingCore(){
+    stop();
+}
+
+void DrillingCore::initVolume(cVoxelObject *a_voxelObj, const int a_voxelCount[3], int a_brickSize, DirtyBrickExchange *a_dirtyBrickExchange){
+    m_voxelObj = a_voxelObj;
+    m_hapticVoxelObj = a_voxelObj;
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = a_voxelCount[i];
+    }
+
+    m_tickDirtyBricks.init(m_voxelCount[0], m_voxelCount[1], m_voxelCount[2], a_brickSize);
+    m_dirtyBrickExchange = a_dirtyBrickExchange;
+    if (m_dirtyBrickExchange){
+        m_tickDirtyBricks.initExchange(*m_dirtyBrickExchange);
+    }
+
+    m_occupancy.init(m_voxelCount[0], m_voxelCount[1], m_voxelCount[2], a_brickSize);
+    rebuildOccupancy();
+    m_voxelRemover.init(m_voxelObj, m_voxelCount, &m_occupancy, &m_tickDirtyBricks);
+}
+
+void DrillingCore::rebuildOccupancy(){
+    cImagePtr image = m_voxelObj->m_texture->m_image;
+    m_occupancy.build(image->getData(), image->getBytesPerPixel());
+    if (m_lod.isEnabled()){
+        m_lod.build(image->getData(), m_hapticVoxelObj->m_texture->m_image->getData());
+    }
+    VoxelBox box;
+    m_voxelRemover.takeModifiedBox(box);
+}
+
+void DrillingCore::swapOccupancy(BrickOccupancy &a_occupancy){
+    m_occupancy.swap(a_occupancy);
+    if (m_lod.isEnabled()){
+        m_lod.build(m_voxelObj->m_texture->m_image->getData(), m_hapticVoxelObj->m_texture->m_image->getData());
+    }
+    VoxelBox box;
+    m_voxelRemover.takeModifiedBox(box);
+}
+
+///
+/// \brief This method moves the haptics to a coarse level of the volume. The tool cursors
+/// collide with every haptic object of the world, so the fine level stops being one.
+///
+void DrillingCore::setHapticLevel(cVoxelObject *a_coarseObj, int a_factor){
+    cImagePtr image = m_voxelObj->m_texture->m_image;
+    m_lod.init(m_voxelCount, min(int(image->getBytesPerPixel()), 4), a_factor);
+    m_hapticVoxelObj = a_coarseObj;
+    m_voxelObj->setHapticEnabled(false, false);
+    m_hapticVoxelObj->setHapticEnabled(true, false);
+    m_voxelRemover.setStencilPadding(double(m_lod.getFactor()));
+    m_lod.build(image->getData(), m_hapticVoxelObj->m_texture->m_image->getData());
+}
+
+void DrillingCore::updateHapticLevel(){
+    VoxelBox box;
+    if (m_voxelRemover.takeModifiedBox(box) && m_lod.isEnabled()){
+        m_lod.update(m_voxelObj->m_texture->m_image->getData(), m_hapticVoxelObj->m_texture->m_image->getData(), box);
+    }
+}
+
+void DrillingCore::setBurrs(const vector<double> &a_radii, int a_activeBurrIdx){
+    m_burrRadii = a_radii;
+    m_burrStencils.resize(m_burrRadii.size());
+    for (size_t i = 0 ; i < m_burrRadii.size() ; i++){
+        m_voxelRemover.buildStencil(m_burrRadii[i], m_burrStencils[i]);
+    }
+    m_activeBurrIdx = a_activeBurrIdx;
+}
+
+void DrillingCore::setToolCursors(const vector<cToolCursor *> &a_toolCursors, const vector<double> &a_shaftRadii, double a_spacing){
+    m_toolCursors = a_toolCursors;
+    m_shaftRadii = a_shaftRadii;
+    m_spacing = a_spacing;
+    m_toolCursorErrors.assign(m_toolCursors.size(), 0.0);
+    m_toolCursorGoals.resize(m_toolCursors.size());
+    m_cullGoals.resize(m_toolCursors.size());
+    m_toolCursorCulled.assign(m_toolCursors.size(), 0);
+    m_activeToolCursors.reserve(m_toolCursors.size());
+    m_targetToolCursorIdx = 0;
+
+    // the kernels are unrolled for 1 to 8 cursors, the larger counts --nt accepts, up to 32,
+    // take the generic kernels
+    switch (m_toolCursors.size()) {
+    case 1: m_goalKernel = &computeToolCursorGoals<1>; m_targetKernel = &selectTargetToolCursor<1>; break;
+    case 2: m_goalKernel = &computeToolCursorGoals<2>; m_targetKernel = &selectTargetToolCursor<2>; break;
+    case 3: m_goalKernel = &computeToolCursorGoals<3>; m_targetKernel = &selectTargetToolCursor<3>; break;
+    case 4: m_goalKernel = &computeToolCursorGoals<4>; m_targetKernel = &selectTargetToolCursor<4>; break;
+    case 5: m_goalKernel = &computeToolCursorGoals<5>; m_targetKernel = &selectTargetToolCursor<5>; break;
+    case 6: m_goalKernel = &computeToolCursorGoals<6>; m_targetKernel = &selectTargetToolCursor<6>; break;
+    case 7: m_goalKernel = &computeToolCursorGoals<7>; m_targetKernel = &selectTargetToolCursor<7>; break;
+    case 8: m_goalKernel = &computeToolCursorGoals<8>; m_targetKernel = &selectTargetToolCursor<8>; break;
+    default: m_goalKernel = &computeToolCursorGoals<0>; m_targetKernel = &selectTargetToolCursor<0>; break;
+    }
+}
+
+void DrillingCore::startForceWorkers(int a_numWorkers){
+    if (a_numWorkers > 0){
+        m_toolCursorPool.start(a_numWorkers);
+    }
+}
+
+void DrillingCore::stop(){
+    m_toolCursorPool.stop();
+}
+
+void DrillingCore::setBurr(int a_burrIdx){
+    m_activeBurrIdx = a_burrIdx;
+    m_toolCursors[0]->setRadius(m_burrRadii[a_burrIdx]);
+    if (m_listener){
+        m_listener->burrChanged(a_burrIdx, m_burrRadii[a_burrIdx]);
+    }
+}
+
+///
+/// \brief This method updates the position of the shaft tool cursors
+/// which eventually updates the position of the whole tool.
+///
+void DrillingCore::toolCursorsPosUpdate(const cTransform &a_targetPose){
+    if (m_toolCursors.empty()){
+        return;
+    }
+    cVector3d n_x = a_targetPose.getLocalRot().getCol0() * m_spacing;
+    m_goalKernel(a_targetPose.getLocalPos(), n_x, &m_toolCursorGoals[0], int(m_toolCursors.size()));
+    for (size_t i = 0 ; i < m_toolCursors.size() ; i++){
+        m_toolCursors[i]->setDeviceLocalPos(m_toolCursorGoals[i]);
+        m_toolCursors[i]->setDeviceLocalRot(a_targetPose.getLocalRot());
+    }
+}
+
+void DrillingCore::toolCursorsInitialize(){
+    for (size_t i = 0 ; i < m_toolCursors.size() ; i++){
+        m_toolCursors[i]->initialize();
+        m_toolCursorErrors[i] = cDistance(m_toolCursors[i]->m_hapticPoint->getLocalPosProxy(), m_toolCursors[i]->m_hapticPoint->getLocalPosGoal());
+    }
+}
+
+///
+/// \brief This method checks for collision between the tool shaft and the volume.
+/// The error between the proxy and goal position of each of the shaft tool cursors is constantly
+/// computed. The shaft tool cursor having the maximum error is set as the target tool cursor, which
+/// the drill mesh follows. If there's no collision, the tip tool cursor is the target.
+///
+void DrillingCore::checkShaftCollision(){
+    // the errors were stored per cursor during the last force computation, the scan in index
+    // order keeps the selection identical to a serial computation
+    m_targetToolCursorIdx = m_toolCursors.empty() ? 0 : m_targetKernel(&m_toolCursorErrors[0], int(m_toolCursors.size()));
+}
+
+bool DrillingCore::isTipDrilling() const{
+    return m_targetToolCursorIdx == 0 && m_toolCursors[0]->isInContact(m_hapticVoxelObj);
+}
+
+///
+/// \brief This method removes every occupied voxel inside the drill burr in one pass.
+/// The burr is centered at the proxy of the tip tool cursor, which rests on the surface of
+/// the volume, and the precomputed stencil of the active burr is walked around it.
+///
+size_t DrillingCore::removeVoxelsInBurr(double a_time){
+    size_t removedCount = m_voxelRemover.removeVoxels(m_burrStencils[m_activeBurrIdx],
+                                                      m_toolCursors[0]->m_hapticPoint->getGlobalPosProxy(), m_listener);
+
+    if (removedCount > 0){
+        updateHapticLevel();
+        if (m_journal){
+            m_journal->commitTick(a_time);
+        }
+        if (m_dirtyBrickExchange){
+            m_tickDirtyBricks.publish(*m_dirtyBrickExchange);
+        }
+        if (m_listener){
+            m_listener->voxelsRemoved(removedCount);
+        }
+    }
+    return removedCount;
+}
+
+///
+/// \brief This method removes a list of voxels given by their linear index, in their order,
+/// and ends the tick like removeVoxelsInBurr().
+///
+size_t DrillingCore::applyRemovedVoxels(const vector<JournalEntry> &a_voxels, double a_time, DirtyBrickExchange *a_exchange){
+    size_t removedCount = 0;
+    for (size_t i = 0 ; i < a_voxels.size() ; i++){
+        uint32_t idx = a_voxels[i].m_voxelIdx;
+        int x = int(idx % uint32_t(m_voxelCount[0]));
+        idx /= uint32_t(m_voxelCount[0]);
+        int y = int(idx % uint32_t(m_voxelCount[1]));
+        int z = int(idx / uint32_t(m_voxelCount[1]));
+        if (z < m_voxelCount[2] && m_voxelRemover.removeVoxel(x, y, z, m_listener)){
+            removedCount++;
+        }
+    }
+
+    if (removedCount > 0){
+        updateHapticLevel();
+        if (m_journal){
+            m_journal->commitTick(a_time);
+        }
+        DirtyBrickExchange* exchange = a_exchange ? a_exchange : m_dirtyBrickExchange;
+        if (exchange){
+            m_tickDirtyBricks.publish(*exchange);
+        }
+        if (m_listener){
+            m_listener->voxelsRemoved(removedCount);
+        }
+    }
+    return removedCount;
+}
+
+void DrillingCore::setJournal(VoxelJournal *a_journal){
+    m_journal = a_journal && a_journal->isEnabled() ? a_journal : NULL;
+    m_voxelRemover.setJournal(m_journal);
+}
+
+///
+/// \brief This method restores the voxels removed since a position of the journal, the most
+/// recent first. Only the restored voxels are touched, and their bricks are published like the
+/// removed ones so that the texture, the empty space skipping and the surface are updated the
+/// same way.
+///
+size_t DrillingCore::rollbackTo(uint64_t a_position){
+    if (!m_journal){
+        return 0;
+    }
+
+    cColorb color;
+    size_t restoredCount = m_journal->rollback(a_position, [&](int a_x, int a_y, int a_z, const unsigned char a_bytes[4]){
+        m_voxelRemover.restoreVoxel(a_x, a_y, a_z, a_bytes);
+        if (m_listener){
+            m_voxelRemover.decodeVoxel(a_bytes, color);
+            m_listener->voxelRestored(a_x, a_y, a_z, color, m_voxelRemover.getLabel(a_bytes));
+        }
+    });
+
+    if (restoredCount > 0){
+        updateHapticLevel();
+        if (m_dirtyBrickExchange){
+            m_tickDirtyBricks.publish(*m_dirtyBrickExchange);
+        }
+        if (m_listener){
+            m_listener->voxelsRestored(restoredCount);
+        }
+    }
+    return restoredCount;
+}
+
+///
+/// \brief This method computes the interaction forces of the tool cursors that may be in contact,
+/// in index order on the calling thread. The cursors share the world of the volume, whose objects
+/// CHAI3D writes the interaction state of while computing the forces of a cursor, so only the
+/// broad-phase runs on the workers.
+///
+void DrillingCore::computeForces(){
+    cullToolCursors();
+    for (size_t i = 0 ; i < m_activeToolCursors.size() ; i++){
+        int idx = m_activeToolCursors[i];
+        cToolCursor* toolCursor = m_toolCursors[idx];
+        toolCursor->computeInteractionForces();
+        m_toolCursorErrors[idx] = cDistance(toolCursor->m_hapticPoint->getLocalPosProxy(), toolCursor->m_hapticPoint->getLocalPosGoal());
+    }
+}
+
+void ToolCursorCullTask::run(size_t a_index){
+    m_core->testToolCursor(a_index + 1);
+}
+
+///
+/// \brief This method is the broad-phase of the shaft tool cursors. A shaft cursor whose proxy
+/// rests on its goal can only come into contact if the sphere swept from its proxy to its new
+/// goal reaches an occupied brick. When the capsule around the whole shaft doesn't even reach
+/// the bounds of the volume, no brick is looked up at all. The skipped cursors are moved to
+/// their goal with zero force, as the proxy algorithm would do in free space.
+///
+void DrillingCore::cullToolCursors(){
+    m_activeToolCursors.clear();
+    m_activeToolCursors.push_back(0);
+    m_culledToolCursorCount = 0;
+
+    size_t numCursors = m_toolCursors.size();
+    if (!m_culling || numCursors < 2){
+        for (size_t i = 1 ; i < numCursors ; i++){
+            m_activeToolCursors.push_back(i);
+        }
+        return;
+    }
+
+    double maxRadius = m_burrRadii[m_activeBurrIdx];
+    for (size_t i = 1 ; i < numCursors ; i++){
+        maxRadius = max(maxRadius, getShaftRadius(i));
+    }
+
+    // capsule of the shaft in the local frame of the volume, grown by the motion since the last tick
+    cToolCursor* tip = m_toolCursors[0];
+    cToolCursor* last = m_toolCursors[numCursors - 1];
+    cVector3d tipGoal = tip->getGlobalPos() + tip->getGlobalRot() * tip->getDeviceLocalPos();
+    cVector3d lastGoal = last->getGlobalPos() + last->getGlobalRot() * last->getDeviceLocalPos();
+    double motion = (tipGoal - m_lastTipGoalPos).length();
+    m_lastTipGoalPos = tipGoal;
+
+    cMatrix3d volumeRotT = cTranspose(m_voxelObj->getGlobalRot());
+    cVector3d p0 = volumeRotT * (tipGoal - m_voxelObj->getGlobalPos());
+    cVector3d p1 = volumeRotT * (lastGoal - m_voxelObj->getGlobalPos());
+    double seg0[3] = {p0(0), p0(1), p0(2)};
+    double seg1[3] = {p1(0), p1(1), p1(2)};
+    double boxMin[3], boxMax[3];
+    for (int i = 0 ; i < 3 ; i++){
+        boxMin[i] = m_voxelObj->m_minCorner(i);
+        boxMax[i] = m_voxelObj->m_maxCorner(i);
+    }
+    m_nearVolume = computeSegmentBoxDistance(seg0, seg1, boxMin, boxMax) <= maxRadius + motion;
+
+    // the tests only read, the culled cursors are then moved on this thread
+    m_toolCursorPool.run(m_toolCursorCullTask, numCursors - 1);
+
+    for (size_t i = 1 ; i < numCursors ; i++){
+        if (m_toolCursorCulled[i]){
+            cToolCursor* toolCursor = m_toolCursors[i];
+            toolCursor->m_hapticPoint->initialize(m_cullGoals[i]);
+            toolCursor->setDeviceLocalForce(0.0, 0.0, 0.0);
+            m_toolCursorErrors[i] = 0.0;
+            m_culledToolCursorCount++;
+        }
+        else{
+            m_activeToolCursors.push_back(int(i));
+        }
+    }
+}
+
+void DrillingCore::testToolCursor(size_t a_idx){
+    cToolCursor* toolCursor = m_toolCursors[a_idx];
+
+    // a proxy held back by the volume must be computed until it catches up with its goal
+    bool culled = m_toolCursorErrors[a_idx] <= 0.00001;
+    cVector3d goal = toolCursor->getGlobalPos() + toolCursor->getGlobalRot() * toolCursor->getDeviceLocalPos();
+
+    if (culled && m_nearVolume){
+        double radius = getShaftRadius(a_idx);
+        cVector3d proxyVoxel = m_voxelRemover.getVoxelCoordinates(toolCursor->m_hapticPoint->getGlobalPosProxy());
+        cVector3d goalVoxel = m_voxelRemover.getVoxelCoordinates(goal);
+        int sweptMin[3], sweptMax[3];
+        for (int a = 0 ; a < 3 ; a++){
+            // a proxy resting on the haptic level may be a coarse voxel away from the fine surface
+            double radiusInVoxels = radius / m_voxelRemover.getVoxelSize(a) + double(m_lod.getFactor());
+            sweptMin[a] = int(floor(min(proxyVoxel(a), goalVoxel(a)) - radiusInVoxels));
+            sweptMax[a] = int(floor(max(proxyVoxel(a), goalVoxel(a)) + radiusInVoxels)) + 1;
+        }
+        culled = m_occupancy.isBoxEmpty(sweptMin, sweptMax);
+    }
+
+    m_cullGoals[a_idx] = goal;
+    m_toolCursorCulled[a_idx] = culled;
+}
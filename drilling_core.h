@@ -0,0 +1,227 @@
+#ifndef DRILLING_CORE_H
+#define DRILLING_CORE_H
+
+#include <algorithm>
+#include <chai3d.h>
+#include <vector>
+#include "brick_occupancy.h"
+#include "burr_stencil.h"
+#include "dirty_bricks.h"
+#include "tool_cursor_forces.h"
+#include "volume_lod.h"
+#include "voxel_journal.h"
+#include "voxel_remover.h"
+#include "worker_pool.h"
+
+///
+/// \brief Receives the events of a DrillingCore, on the thread that runs its tick
+///
+class DrillingEventListener: public VoxelRemovalListener{
+public:
+    // called once per tick that removed voxels, after their bricks were handed to the exchange
+    virtual void voxelsRemoved(size_t a_count){}
+
+    virtual void burrChanged(int a_burrIdx, double a_radius){}
+
+    // called for each voxel restored by a rollback, with the color and label it was restored to
+    virtual void voxelRestored(int a_x, int a_y, int a_z, const chai3d::cColorb& a_color, int a_label){}
+
+    // called after a rollback restored voxels, once their bricks were handed to the exchange
+    virtual void voxelsRestored(size_t a_count){}
+};
+
+///
+/// \brief The drilling logic of one drill and one volume, without any rendering, audio or input
+/// state: the pose update of the tool cursor array, the selection of the cursor that holds the
+/// drill, the broad-phase and the forces of the cursors, and the removal of the voxels with the
+/// burr stencils. It is used by the plugin, the benchmark and any other headless executable. The
+/// steps are called by the owner in the order of a haptic tick:
+///     toolCursorsPosUpdate(), checkShaftCollision(), removeVoxelsInBurr() if isTipDrilling(),
+///     computeForces()
+/// The tool cursors, the voxel object and the optional journal are created and owned by the caller.
+///
+class DrillingCore{
+public:
+    DrillingCore();
+    ~DrillingCore();
+
+    // Builds the occupancy of the loaded volume image. The bricks modified in a tick are published
+    // to a_dirtyBrickExchange, which is initialized here, if it isn't null
+    void initVolume(chai3d::cVoxelObject* a_voxelObj, const int a_voxelCount[3], int a_brickSize, DirtyBrickExchange* a_dirtyBrickExchange);
+
+    // Rebuilds the occupancy, and the haptic level if any, after the volume image was restored
+    void rebuildOccupancy();
+
+    // Same as rebuildOccupancy, with an occupancy already built from the restored image, e.g.
+    // on another thread. a_occupancy gets the previous one
+    void swapOccupancy(BrickOccupancy& a_occupancy);
+
+    // Makes the tool cursors rest on a coarse level of the volume, a_factor fine voxels per
+    // axis in each of its voxels. The coarse object must have a texture whose image is
+    // allocated with the coarse voxel count of a VolumeLod and the format of the volume, and
+    // cover the same box. It is built here and updated after every removal and rollback, the
+    // voxels are still removed from the fine level. Call after initVolume and before setBurrs,
+    // whose stencils are padded by a coarse voxel
+    void setHapticLevel(chai3d::cVoxelObject* a_coarseObj, int a_factor);
+
+    // Precomputes the stencils of the burrs, call after initVolume. Doesn't emit burrChanged
+    void setBurrs(const std::vector<double>& a_radii, int a_activeBurrIdx);
+
+    // The tip is the first cursor. The shaft cursors past the end of a_shaftRadii use its last
+    // radius, a_spacing is the distance between two cursors along the drill axis. Selects the
+    // kernels of the number of cursors, unrolled for 1 to 8 cursors, larger counts take the
+    // generic kernels
+    void setToolCursors(const std::vector<chai3d::cToolCursor*>& a_toolCursors, const std::vector<double>& a_shaftRadii, double a_spacing);
+
+    // Runs the broad-phase of the shaft cursors on a_numWorkers threads, 0 for the calling
+    // thread. The forces are always computed on the calling thread
+    void startForceWorkers(int a_numWorkers);
+
+    void stop();
+
+    void setListener(DrillingEventListener* a_listener) {m_listener = a_listener;}
+
+    // Enables the broad-phase that skips the shaft cursors that can't touch the volume
+    void setCulling(bool a_enable) {m_culling = a_enable;}
+
+    // Switches the tip cursor and the stencil to another burr and emits burrChanged
+    void setBurr(int a_burrIdx);
+
+    // Moves the goals of the cursors along the x axis of the target pose of the tip
+    void toolCursorsPosUpdate(const chai3d::cTransform& a_targetPose);
+
+    // Places the proxies of the cursors on their goals
+    void toolCursorsInitialize();
+
+    // Selects the cursor the furthest from its goal as the one holding the drill
+    void checkShaftCollision();
+
+    // True if the tip is in contact with the volume and holds the drill
+    bool isTipDrilling() const;
+
+    // Removes the occupied voxels inside the burr at the proxy of the tip, returns their number.
+    // a_time stamps the tick in the journal
+    size_t removeVoxelsInBurr(double a_time);
+
+    // Removes voxels already cleared in another copy of the volume, e.g. by the GPU carver, with
+    // the same journal and events as removeVoxelsInBurr(). The voxels that aren't occupied
+    // anymore are skipped. The bricks are published to a_exchange if it isn't null, instead of
+    // the exchange of the volume, so that the owner can tell them apart
+    size_t applyRemovedVoxels(const std::vector<JournalEntry>& a_voxels, double a_time, DirtyBrickExchange* a_exchange);
+
+    // Journals the removed voxels so that the drilling can be rolled back, null to disable
+    void setJournal(VoxelJournal* a_journal);
+
+    // The palette of a labeled volume, null for an RGBA one. Owned by the caller
+    void setPalette(const VoxelPalette* a_palette) {m_voxelRemover.setPalette(a_palette);}
+
+    // Restores the voxels removed since a position of the journal, returns their number
+    size_t rollbackTo(uint64_t a_position);
+
+    // Runs the broad-phase and computes the forces of the cursors that may be in contact
+    void computeForces();
+
+    BrickOccupancy& getOccupancy() {return m_occupancy;}
+
+    // The object the tool cursors collide with, the volume unless a haptic level is set
+    chai3d::cVoxelObject* getHapticVoxelObject() const {return m_hapticVoxelObj;}
+
+    const VolumeLod& getLod() const {return m_lod;}
+
+    const VoxelRemover& getVoxelRemover() const {return m_voxelRemover;}
+
+    const std::vector<chai3d::cToolCursor*>& getToolCursors() const {return m_toolCursors;}
+
+    chai3d::cToolCursor* getTargetToolCursor() const {return m_toolCursors[m_targetToolCursorIdx];}
+
+    int getTargetToolCursorIdx() const {return m_targetToolCursorIdx;}
+
+    int getActiveBurrIdx() const {return m_activeBurrIdx;}
+
+    double getBurrRadius(int a_burrIdx) const {return m_burrRadii[a_burrIdx];}
+
+    const BurrStencil& getBurrStencil(int a_burrIdx) const {return m_burrStencils[a_burrIdx];}
+
+    int getNumBurrs() const {return int(m_burrRadii.size());}
+
+    double getSpacing() const {return m_spacing;}
+
+    // number of shaft cursors skipped by the broad-phase in the last tick
+    int getCulledToolCursorCount() const {return m_culledToolCursorCount;}
+
+    int getNumForceWorkers() const {return m_toolCursorPool.getNumWorkers();}
+
+private:
+    typedef void (*GoalKernel)(const chai3d::cVector3d& a_origin, const chai3d::cVector3d& a_step, chai3d::cVector3d* a_goals, int a_count);
+    typedef int (*TargetKernel)(const double* a_errors, int a_count);
+
+    friend class ToolCursorCullTask;
+
+    // selects the shaft tool cursors that may be in contact, the others are moved to their goal
+    void cullToolCursors();
+
+    // tests whether a shaft tool cursor can touch the volume, stores its goal and the result
+    void testToolCursor(size_t a_idx);
+
+    double getShaftRadius(size_t a_idx) const {return m_shaftRadii[std::min(a_idx, m_shaftRadii.size() - 1)];}
+
+    // recomputes the coarse voxels over the voxels modified since the last call
+    void updateHapticLevel();
+
+    chai3d::cVoxelObject* m_voxelObj;
+    int m_voxelCount[3];
+
+    // coarse level the tool cursors collide with, m_voxelObj if the haptic level isn't set
+    chai3d::cVoxelObject* m_hapticVoxelObj;
+    VolumeLod m_lod;
+
+    // sparse occupancy of the voxels, read by the removal loop before touching the image
+    BrickOccupancy m_occupancy;
+
+    // bricks modified in the current tick
+    DirtyBrickSet m_tickDirtyBricks;
+    DirtyBrickExchange* m_dirtyBrickExchange;
+
+    VoxelRemover m_voxelRemover;
+    VoxelJournal* m_journal;
+
+    std::vector<double> m_burrRadii;
+    std::vector<BurrStencil> m_burrStencils;
+    int m_activeBurrIdx;
+
+    std::vector<chai3d::cToolCursor*> m_toolCursors;
+    std::vector<double> m_shaftRadii;
+    double m_spacing;
+
+    // distance between the proxy and goal of each tool cursor after its last force computation
+    std::vector<double> m_toolCursorErrors;
+
+    // goals of the tool cursors along the drill axis, and the kernels of their number
+    std::vector<chai3d::cVector3d> m_toolCursorGoals;
+    GoalKernel m_goalKernel;
+    TargetKernel m_targetKernel;
+
+    // tool cursors whose forces are computed this tick, the tip is always the first
+    std::vector<int> m_activeToolCursors;
+
+    int m_targetToolCursorIdx;
+
+    bool m_culling;
+    int m_culledToolCursorCount;
+
+    // goal of the tip tool cursor in the last tick, bounds the motion of the shaft between ticks
+    chai3d::cVector3d m_lastTipGoalPos;
+
+    // inputs and results of the broad-phase test of each shaft tool cursor
+    bool m_nearVolume;
+    std::vector<chai3d::cVector3d> m_cullGoals;
+    std::vector<unsigned char> m_toolCursorCulled;
+
+    // workers running the broad-phase tests of the shaft tool cursors
+    ParallelForPool m_toolCursorPool;
+    ToolCursorCullTask m_toolCursorCullTask;
+
+    DrillingEventListener* m_listener;
+};
+
+#endif // DRILLING_CORE_H
@@ -0,0 +1,596 @@
+//==============================================================================
+/*
+    Software License Agreement (BSD License)
+    Copyright (c) 2019-2021, AMBF
+    (https://github.com/WPI-AIM/ambf)
+
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions
+    are met:
+
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+    copyright notice, this list of conditions and the following
+    disclaimer in the documentation and/or other materials provided
+    with the distribution.
+
+    * Neither the name of authors nor the names of its contributors may
+    be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+//==============================================================================
+
+// A headless server hosting several independent drilling sessions in one process, e.g. one
+// per trainee of a lab. The volume is loaded once into a read-only base and every session
+// drills its own copy-on-write overlay of it, so an extra session only costs the pages it
+// drilled. Each session runs the drilling core with its own tool cursors on its own thread,
+// pinned to a core, takes the drill pose and burr from its command topics and publishes the
+// same topics as the plugin under its own name.
+
+#include <chai3d.h>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <pthread.h>
+#include <sstream>
+#include <geometry_msgs/PoseStamped.h>
+#include <std_msgs/UInt8.h>
+#include "collision_publisher.h"
+#include "drilling_core.h"
+#include "removal_statistics.h"
+#include "slice_loader.h"
+#include "triple_buffer.h"
+#include "volume_overlay.h"
+#include "volume_source.h"
+
+using namespace std;
+using namespace chai3d;
+
+///
+/// \brief The latest drill command of a session, in the frame of the volume
+///
+struct SessionCommand{
+    cVector3d m_pos;
+    cMatrix3d m_rot;
+    int m_burrIdx;
+};
+
+///
+/// \brief The settings shared by all the sessions
+///
+struct SessionSettings{
+    int m_voxelCount[3];
+    double m_dimensions[3];
+    int m_toolCursorCount;
+    double m_toolCursorOffset;
+    int m_brickSize;
+    int m_forceWorkers;
+    double m_stiffness;
+    double m_rate;
+    double m_removalStatsInterval;
+    size_t m_publisherQueueSize;
+};
+
+static const vector<double> s_burrRadii{0.02014, 0.04030, 0.06041};
+static const vector<double> s_toolCursorRadii{0.02, 0.013, 0.015, 0.017, 0.019, 0.021, 0.023, 0.025};
+static const cColorb s_boneColor(255, 249, 219, 255);
+
+static volatile sig_atomic_t s_running = 1;
+
+static void onSignal(int){
+    s_running = 0;
+}
+
+///
+/// \brief One drilling session: a world with a voxel object on an overlay of the base volume,
+/// the drilling core and its tool cursors, and a publisher under the name of the session.
+/// The commands are received on the ROS spinner thread and read by the session thread.
+///
+class DrillingSession: public DrillingEventListener{
+public:
+    DrillingSession(const string& a_namespace, const string& a_name);
+    ~DrillingSession();
+
+    bool init(const VolumeBase& a_base, const SessionSettings& a_settings);
+
+    // Runs the session loop on its own thread, pinned to a_cpu unless it's negative
+    void start(int a_cpu);
+    void stop();
+
+    const string& getName() const {return m_name;}
+    size_t getPrivateBytes() const {return m_overlay.getPrivateBytes();}
+
+    virtual void voxelRemoved(int a_x, int a_y, int a_z, const cColorb& a_color, int a_label) override;
+    virtual void voxelsRemoved(size_t a_count) override;
+    virtual void burrChanged(int a_burrIdx, double a_radius) override;
+
+private:
+    void poseCallback(const geometry_msgs::PoseStamped::ConstPtr& a_msg);
+    void burrCallback(const std_msgs::UInt8::ConstPtr& a_msg);
+    // Pins the calling thread to a_cpu unless it's negative, then runs the ticks
+    void sessionLoop(int a_cpu);
+
+    string m_namespace;
+    string m_name;
+    SessionSettings m_settings;
+
+    VolumeOverlay m_overlay;
+    cWorld* m_world;
+    cMultiImagePtr m_image;
+    vector<cToolCursor*> m_toolCursors;
+    DirtyBrickExchange m_dirtyBrickExchange;
+    DrillingCore m_core;
+    DrillingPublisher* m_drillingPub;
+    ros::Subscriber m_poseSub;
+    ros::Subscriber m_burrSub;
+
+    // Owned by the spinner thread
+    SessionCommand m_lastCommand;
+    TripleBuffer<SessionCommand> m_commands;
+
+    // Owned by the session thread
+    double m_time;
+    bool m_tickCriticalContact;
+    RemovalStatistics m_removalStats;
+    RemovalSummary m_removalSummary;
+
+    // true from the end of init until the tool cursors are stopped
+    bool m_initialized;
+    atomic<bool> m_running;
+    thread m_thread;
+};
+
+DrillingSession::DrillingSession(const string& a_namespace, const string& a_name){
+    m_namespace = a_namespace;
+    m_name = a_name;
+    m_world = nullptr;
+    m_drillingPub = nullptr;
+    m_time = 0.0;
+    m_tickCriticalContact = false;
+    m_initialized = false;
+    m_running = false;
+}
+
+DrillingSession::~DrillingSession(){
+    stop();
+    m_poseSub.shutdown();
+    m_burrSub.shutdown();
+    delete m_drillingPub;
+    // the voxel object and the tool cursors are children of the world
+    delete m_world;
+}
+
+bool DrillingSession::init(const VolumeBase &a_base, const SessionSettings &a_settings){
+    m_settings = a_settings;
+    if (!m_overlay.map(a_base)){
+        return false;
+    }
+
+    m_world = new cWorld();
+
+    // the image uses the overlay as its voxels instead of a copy of its own
+    m_image = cMultiImage::create();
+    m_image->allocate(m_settings.m_voxelCount[0], m_settings.m_voxelCount[1], m_settings.m_voxelCount[2], GL_RGBA);
+    if (!m_image->setData(m_overlay.getData(), m_overlay.getSize(), false)){
+        cerr << "WARNING! FAILED TO SHARE THE BASE VOLUME WITH SESSION " << m_name << ", IT HOLDS A COPY OF ITS OWN" << endl;
+        memcpy(m_image->getData(), m_overlay.getData(), m_overlay.getSize());
+        m_overlay.unmap();
+    }
+
+    const double* dimensions = m_settings.m_dimensions;
+    cVoxelObject* voxelObj = new cVoxelObject();
+    voxelObj->m_minCorner.set(-0.5 * dimensions[0], -0.5 * dimensions[1], -0.5 * dimensions[2]);
+    voxelObj->m_maxCorner.set(0.5 * dimensions[0], 0.5 * dimensions[1], 0.5 * dimensions[2]);
+    voxelObj->m_minTextureCoord.set(0.0, 0.0, 0.0);
+    voxelObj->m_maxTextureCoord.set(1.0, 1.0, 1.0);
+    cTexture3dPtr texture = cTexture3d::create();
+    texture->setImage(m_image);
+    voxelObj->setTexture(texture);
+    voxelObj->m_material->setStiffness(m_settings.m_stiffness);
+    voxelObj->m_material->setDamping(0.0);
+    voxelObj->m_material->setDynamicFriction(0.0);
+    voxelObj->setUseMaterial(true);
+    m_world->addChild(voxelObj);
+
+    m_core.initVolume(voxelObj, m_settings.m_voxelCount, m_settings.m_brickSize, &m_dirtyBrickExchange);
+    m_core.setBurrs(s_burrRadii, 0);
+    m_core.setListener(this);
+    m_core.setCulling(true);
+
+    // the drill starts above the volume, pointing down
+    m_lastCommand.m_pos.set(0.0, 0.0, dimensions[2]);
+    m_lastCommand.m_rot.setExtrinsicEulerRotationRad(0.0, -C_PI / 2.0, 0.0, C_EULER_ORDER_XYZ);
+    m_lastCommand.m_burrIdx = 0;
+    m_commands.write(m_lastCommand);
+
+    int nt = m_settings.m_toolCursorCount;
+    m_toolCursors.resize(nt);
+    for (int i = 0 ; i < nt ; i++){
+        m_toolCursors[i] = new cToolCursor(m_world);
+        m_world->addChild(m_toolCursors[i]);
+        m_toolCursors[i]->setRadius(i == 0 ? s_burrRadii[0] : s_toolCursorRadii[min(size_t(i), s_toolCursorRadii.size() - 1)]);
+    }
+    m_core.setToolCursors(m_toolCursors, s_toolCursorRadii, m_settings.m_toolCursorOffset);
+
+    cTransform pose;
+    pose.setLocalPos(m_lastCommand.m_pos);
+    pose.setLocalRot(m_lastCommand.m_rot);
+    m_core.toolCursorsPosUpdate(pose);
+    m_world->computeGlobalPositions(true);
+    m_core.toolCursorsInitialize();
+    m_core.startForceWorkers(min(m_settings.m_forceWorkers, max(nt - 2, 0)));
+
+    m_removalStats.setPalette(nullptr);
+
+    m_drillingPub = new DrillingPublisher(m_namespace, m_name, false, m_settings.m_publisherQueueSize);
+    float dim[3] = {float(dimensions[0]), float(dimensions[1]), float(dimensions[2])};
+    int voxelCount[3] = {m_settings.m_voxelCount[0], m_settings.m_voxelCount[1], m_settings.m_voxelCount[2]};
+    m_drillingPub->volumeProp(dim, voxelCount);
+
+    string prefix = m_namespace + "/" + m_name;
+    m_poseSub = m_drillingPub->m_rosNode->subscribe(prefix + "/command/drill_pose", 1, &DrillingSession::poseCallback, this);
+    m_burrSub = m_drillingPub->m_rosNode->subscribe(prefix + "/command/burr", 1, &DrillingSession::burrCallback, this);
+    m_initialized = true;
+    return true;
+}
+
+void DrillingSession::poseCallback(const geometry_msgs::PoseStamped::ConstPtr &a_msg){
+    const geometry_msgs::Pose& pose = a_msg->pose;
+    m_lastCommand.m_pos.set(pose.position.x, pose.position.y, pose.position.z);
+    cQuaternion rot(pose.orientation.w, pose.orientation.x, pose.orientation.y, pose.orientation.z);
+    rot.normalize();
+    rot.toRotMat(m_lastCommand.m_rot);
+    m_commands.write(m_lastCommand);
+}
+
+void DrillingSession::burrCallback(const std_msgs::UInt8::ConstPtr &a_msg){
+    if (a_msg->data >= s_burrRadii.size()){
+        cerr << "WARNING! DRILL BURR AT INDEX " << int(a_msg->data) << " DOES NOT EXIST, IGNORED BY SESSION " << m_name << endl;
+        return;
+    }
+    m_lastCommand.m_burrIdx = a_msg->data;
+    m_commands.write(m_lastCommand);
+}
+
+void DrillingSession::start(int a_cpu){
+    m_running = true;
+    m_thread = thread(&DrillingSession::sessionLoop, this, a_cpu);
+}
+
+void DrillingSession::stop(){
+    if (m_thread.joinable()){
+        m_running = false;
+        m_thread.join();
+    }
+    if (m_initialized){
+        m_initialized = false;
+        m_core.stop();
+        for (size_t i = 0 ; i < m_toolCursors.size() ; i++){
+            m_toolCursors[i]->stop();
+        }
+        m_drillingPub->close();
+    }
+}
+
+void DrillingSession::voxelRemoved(int a_x, int a_y, int a_z, const cColorb &a_color, int a_label){
+    if (a_color != s_boneColor){
+        m_tickCriticalContact = true;
+    }
+    m_removalStats.voxelRemoved(a_color.m_color, a_label);
+
+    double voxel_array[3] = {double(a_x), double(a_y), double(a_z)};
+    cColorf color_glFloat = a_color.getColorf();
+    float color_array[4] = {color_glFloat.getR(), color_glFloat.getG(), color_glFloat.getB(), color_glFloat.getA()};
+    m_drillingPub->voxelRemoved(voxel_array, color_array, a_label, m_time);
+}
+
+void DrillingSession::voxelsRemoved(size_t a_count){
+    m_drillingPub->publishVoxelsRemoved(m_time);
+}
+
+void DrillingSession::burrChanged(int a_burrIdx, double a_radius){
+    m_drillingPub->burrChange(a_radius, m_time);
+}
+
+///
+/// \brief This method runs the steps of one tick of the haptic loop of the plugin at the rate of
+/// the server, with the tool cursors following the latest commanded pose
+///
+void DrillingSession::sessionLoop(int a_cpu){
+    // pinned before the first tick, so that no tick runs on another CPU
+    if (a_cpu >= 0){
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(a_cpu, &cpus);
+        int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (result != 0){
+            cerr << "WARNING! FAILED TO PIN SESSION " << m_name << " TO CPU " << a_cpu << ": " << strerror(result) << endl;
+        }
+    }
+
+    typedef chrono::steady_clock Clock;
+    Clock::duration period = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / m_settings.m_rate));
+    Clock::time_point nextTick = Clock::now();
+    Clock::time_point lastRemovalStatsTime = nextTick;
+    unsigned long long tick = 0;
+    // m_lastCommand belongs to the spinner, the first command is the one written by init
+    SessionCommand command;
+    m_commands.read(command);
+    cTransform pose;
+
+    while (m_running){
+        m_commands.read(command);
+        m_time = tick / m_settings.m_rate;
+        m_tickCriticalContact = false;
+
+        m_world->computeGlobalPositions(true);
+        if (command.m_burrIdx != m_core.getActiveBurrIdx()){
+            m_core.setBurr(command.m_burrIdx);
+        }
+        pose.setLocalPos(command.m_pos);
+        pose.setLocalRot(command.m_rot);
+        m_core.toolCursorsPosUpdate(pose);
+        m_core.checkShaftCollision();
+        if (m_core.isTipDrilling()){
+            m_core.removeVoxelsInBurr(m_time);
+        }
+        m_core.computeForces();
+        m_removalStats.tick(m_time, m_tickCriticalContact);
+
+        Clock::time_point now = Clock::now();
+        if (m_settings.m_removalStatsInterval > 0.0 && chrono::duration<double>(now - lastRemovalStatsTime).count() >= m_settings.m_removalStatsInterval){
+            lastRemovalStatsTime = now;
+            m_removalStats.collect(m_removalSummary);
+            m_drillingPub->removalStats(m_removalSummary, m_time);
+        }
+
+        // a session that falls behind skips the missed ticks instead of catching up in a burst
+        tick++;
+        nextTick += period;
+        if (nextTick < now){
+            nextTick = now;
+        }
+        this_thread::sleep_until(nextTick);
+    }
+}
+
+///
+/// \brief Parses a comma separated list of CPU indices, e.g. 2,3,4
+///
+static bool parseCpuList(const string& a_text, vector<int>& a_cpus){
+    stringstream ss(a_text);
+    string item;
+    while (getline(ss, item, ',')){
+        if (item.empty()){
+            continue;
+        }
+        char* end = nullptr;
+        long cpu = strtol(item.c_str(), &end, 10);
+        if (*end != '\0' || cpu < 0 || cpu >= CPU_SETSIZE){
+            cerr << "ERROR! INVALID CPU INDEX " << item << " IN " << a_text << endl;
+            return false;
+        }
+        a_cpus.push_back(int(cpu));
+    }
+    return true;
+}
+
+///
+/// \brief Generates the same synthetic volume as the benchmark, a sphere of bone around a
+/// smaller sphere of another color standing for a critical structure
+///
+static void generateVolume(int a_size, vector<unsigned char>& a_data){
+    const cColorb critical(200, 40, 40, 255);
+    a_data.assign(size_t(a_size) * a_size * a_size * 4, 0);
+
+    double center = 0.5 * a_size;
+    for (int z = 0 ; z < a_size ; z++){
+        for (int y = 0 ; y < a_size ; y++){
+            for (int x = 0 ; x < a_size ; x++){
+                double dx = x + 0.5 - center, dy = y + 0.5 - center, dz = z + 0.5 - center;
+                double r = sqrt(dx * dx + dy * dy + dz * dz) / a_size;
+                const cColorb* color = r < 0.1 ? &critical : (r < 0.4 ? &s_boneColor : NULL);
+                if (color){
+                    memcpy(&a_data[((size_t(z) * a_size + y) * a_size + x) * 4], color->m_color, 4);
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv){
+    // ros::init must run first: it removes the ROS remappings from the arguments before they are
+    // parsed, and the sessions create their DrillingPublisher, whose node comes from
+    // afROSNode::getNode(), in init. The server handles SIGINT itself
+    ros::init(argc, argv, "volumetric_drilling_server", ros::init_options::NoSigintHandler);
+
+    namespace p_opt = boost::program_options;
+    p_opt::options_description cmd_opts("volumetric_drilling_server Command Line Options");
+    cmd_opts.add_options()
+            ("help,h", "Show Info")
+            ("adf", p_opt::value<string>()->default_value(""), "Volume ADF to load, a synthetic volume is generated if empty. Default empty")
+            ("size", p_opt::value<int>()->default_value(128), "Number of voxels along each axis of the synthetic volume. Default 128")
+            ("sessions", p_opt::value<int>()->default_value(1), "Number of drilling sessions, named session_0, session_1, ... Default 1")
+            ("cpus", p_opt::value<string>()->default_value(""), "Comma separated CPUs the sessions are pinned to, session i on the CPU at i modulo their count, empty to leave them unpinned. Default empty")
+            ("rate", p_opt::value<float>()->default_value(1000.0), "Rate of the loop of each session in Hz. Default 1000")
+            ("rosns", p_opt::value<string>()->default_value("ambf"), "Namespace of the ROS topics, each session publishes under /<rosns>/<session>/. Default ambf")
+            ("nt", p_opt::value<int>()->default_value(8), "Number Tool Cursors to Load per session. Default 8")
+            ("ds", p_opt::value<float>()->default_value(0.026), "Offset between shaft tool cursors. Default 0.026")
+            ("fcw", p_opt::value<int>()->default_value(0), "Worker threads running the broad-phase of the shaft tool cursors of each session, 0 to run it on the session thread. The forces are always computed on the session thread. Default 0")
+            ("bs", p_opt::value<int>()->default_value(16), "Size of the bricks used to track modified voxels. Default 16")
+            ("stiffness", p_opt::value<float>()->default_value(2000.0), "Stiffness of the volume. Default 2000")
+            ("pqs", p_opt::value<int>()->default_value(262144), "Capacity of the queue between each session and its ROS publisher thread. Default 262144")
+            ("rsr", p_opt::value<float>()->default_value(10.0), "Rate the removal statistics of each session are published at in Hz, 0 to disable. Default 10");
+
+    p_opt::variables_map var_map;
+    p_opt::store(p_opt::command_line_parser(argc, argv).options(cmd_opts).run(), var_map);
+    p_opt::notify(var_map);
+
+    if(var_map.count("help")){
+        std::cout<< cmd_opts << std::endl;
+        return 0;
+    }
+
+    string adf_filepath = var_map["adf"].as<string>();
+    int volume_size = var_map["size"].as<int>();
+    int session_count = var_map["sessions"].as<int>();
+    string cpu_list = var_map["cpus"].as<string>();
+    double rate = var_map["rate"].as<float>();
+    string ros_namespace = var_map["rosns"].as<string>();
+    int nt = var_map["nt"].as<int>();
+    double ds = var_map["ds"].as<float>();
+    int force_workers = var_map["fcw"].as<int>();
+    int brick_size = var_map["bs"].as<int>();
+    double stiffness = var_map["stiffness"].as<float>();
+    int publisher_queue_size = var_map["pqs"].as<int>();
+    double removal_stats_rate = var_map["rsr"].as<float>();
+
+    if (session_count <= 0){
+        cerr << "ERROR! NUMBER OF SESSIONS MUST BE POSITIVE. Specified value = " << session_count << endl;
+        return 1;
+    }
+
+    if (nt <= 0 || nt > 32){
+        cerr << "ERROR! VALID NUMBER OF TOOL CURSORS ARE BETWEEN 1 - 32. Specified value = " << nt << endl;
+        return 1;
+    }
+
+    if (rate <= 0.0){
+        cerr << "ERROR! SESSION RATE MUST BE POSITIVE. Specified value = " << rate << endl;
+        return 1;
+    }
+
+    if (force_workers < 0){
+        cerr << "ERROR! NUMBER OF FORCE WORKERS MUST NOT BE NEGATIVE. Specified value = " << force_workers << endl;
+        return 1;
+    }
+
+    if (brick_size <= 0 || (brick_size & (brick_size - 1)) != 0){
+        cerr << "ERROR! BRICK SIZE MUST BE A POWER OF TWO. Specified value = " << brick_size << endl;
+        return 1;
+    }
+
+    if (publisher_queue_size <= 0){
+        cerr << "ERROR! PUBLISHER QUEUE SIZE MUST BE POSITIVE. Specified value = " << publisher_queue_size << endl;
+        return 1;
+    }
+
+    vector<int> cpus;
+    if (!parseCpuList(cpu_list, cpus)){
+        return 1;
+    }
+
+    // Volume, loaded once into the base shared by the sessions
+    SessionSettings settings;
+    vector<unsigned char> data;
+    uint32_t voxelCount[3];
+    double dimensions[3] = {1.0, 1.0, 1.0};
+    if (!adf_filepath.empty()){
+        VolumeImageSource source;
+        if (!source.loadFromADF(adf_filepath)){
+            cerr << "ERROR! FAILED TO LOAD THE VOLUME OF " << adf_filepath << endl;
+            return 1;
+        }
+        VolumeSliceLoader loader(source.m_loaderWorkers);
+        if (!loader.load(source, data, voxelCount[0], voxelCount[1])){
+            return 1;
+        }
+        loader.printStats(source.m_name);
+        voxelCount[2] = source.m_count;
+        for (int i = 0 ; i < 3 ; i++){
+            dimensions[i] = source.m_dimensions[i];
+        }
+    }
+    else{
+        if (volume_size <= 0){
+            cerr << "ERROR! SYNTHETIC VOLUME SIZE MUST BE POSITIVE. Specified value = " << volume_size << endl;
+            return 1;
+        }
+        generateVolume(volume_size, data);
+        voxelCount[0] = voxelCount[1] = voxelCount[2] = volume_size;
+    }
+
+    VolumeBase base;
+    if (!base.create(data.data(), data.size())){
+        return 1;
+    }
+    data.clear();
+    data.shrink_to_fit();
+
+    for (int i = 0 ; i < 3 ; i++){
+        settings.m_voxelCount[i] = voxelCount[i];
+        settings.m_dimensions[i] = dimensions[i];
+    }
+    settings.m_toolCursorCount = nt;
+    settings.m_toolCursorOffset = ds;
+    settings.m_brickSize = brick_size;
+    settings.m_forceWorkers = force_workers;
+    settings.m_stiffness = stiffness;
+    settings.m_rate = rate;
+    settings.m_removalStatsInterval = removal_stats_rate > 0.0 ? 1.0 / removal_stats_rate : 0.0;
+    settings.m_publisherQueueSize = publisher_queue_size;
+
+    cerr << "INFO! HOSTING " << session_count << " DRILLING SESSIONS ON A " << voxelCount[0] << "x" << voxelCount[1] << "x" << voxelCount[2]
+         << " VOLUME OF " << base.getSize() / (1024 * 1024) << " MB SHARED BY ALL THE SESSIONS" << endl;
+
+    vector<DrillingSession*> sessions;
+    for (int i = 0 ; i < session_count ; i++){
+        DrillingSession* session = new DrillingSession(ros_namespace, "session_" + to_string(i));
+        if (!session->init(base, settings)){
+            cerr << "ERROR! FAILED TO INITIALIZE SESSION " << session->getName() << endl;
+            delete session;
+            for (size_t j = 0 ; j < sessions.size() ; j++){
+                delete sessions[j];
+            }
+            return 1;
+        }
+        sessions.push_back(session);
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    // the command callbacks of all the sessions run on a single spinner thread
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
+
+    for (int i = 0 ; i < session_count ; i++){
+        int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        sessions[i]->start(cpu);
+        cerr << "INFO! SESSION " << sessions[i]->getName() << " LISTENING ON /" << ros_namespace << "/" << sessions[i]->getName() << "/command/";
+        if (cpu >= 0){
+            cerr << " PINNED TO CPU " << cpu;
+        }
+        cerr << endl;
+    }
+
+    while (s_running && ros::ok()){
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+
+    spinner.stop();
+    for (int i = 0 ; i < session_count ; i++){
+        sessions[i]->stop();
+        cerr << "INFO! SESSION " << sessions[i]->getName() << " DRILLED " << sessions[i]->getPrivateBytes() / 1024 << " KB OF THE VOLUME" << endl;
+        delete sessions[i];
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include "frame_readback.h"
+#include <cstring>
+
+using namespace std;
+
+// frames in flight, enough to hide the latency of the copies at the frame rate
+static const size_t s_numReadbackSlots = 3;
+
+FrameReadback::FrameReadback(){
+    m_frameSize = 0;
+    m_firstSlot = 0;
+    m_pendingCount = 0;
+}
+
+FrameReadback::~FrameReadback(){
+}
+
+bool FrameReadback::init(const vector<FrameStreamDesc> &a_streams){
+    m_streams = a_streams;
+    m_offsets.clear();
+    m_frameSize = 0;
+    for (size_t i = 0 ; i < m_streams.size() ; i++){
+        m_offsets.push_back(m_frameSize);
+        m_frameSize += m_streams[i].getSize();
+    }
+    if (m_frameSize == 0){
+        return false;
+    }
+
+    m_buffers.resize(s_numReadbackSlots);
+    m_fences.assign(s_numReadbackSlots, (GLsync)0);
+    glGenBuffers(GLsizei(m_buffers.size()), m_buffers.data());
+    for (size_t i = 0 ; i < m_buffers.size() ; i++){
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, m_frameSize, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_firstSlot = 0;
+    m_pendingCount = 0;
+    return true;
+}
+
+int FrameReadback::capture(const vector<GLuint> &a_textureIds){
+    if (m_pendingCount == m_buffers.size() || a_textureIds.size() != m_streams.size()){
+        return -1;
+    }
+
+    size_t slot = (m_firstSlot + m_pendingCount) % m_buffers.size();
+    GLint packAlignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    GLint prevTexture;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTexture);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffers[slot]);
+    for (size_t i = 0 ; i < m_streams.size() ; i++){
+        glBindTexture(GL_TEXTURE_2D, a_textureIds[i]);
+        if (m_streams[i].m_depth){
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, GL_FLOAT, (void*)m_offsets[i]);
+        }
+        else{
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, (void*)m_offsets[i]);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, prevTexture);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+
+    m_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_pendingCount++;
+    return int(slot);
+}
+
+///
+/// \brief This method maps the oldest pixel buffer once its copies are complete. The textures
+/// are stored bottom to top, the rows are flipped on the way out.
+///
+int FrameReadback::poll(unsigned char *a_frame){
+    if (m_pendingCount == 0){
+        return -1;
+    }
+
+    size_t slot = m_firstSlot;
+    GLenum result = glClientWaitSync(m_fences[slot], 0, 0);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED){
+        return -1;
+    }
+    glDeleteSync(m_fences[slot]);
+    m_fences[slot] = (GLsync)0;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffers[slot]);
+    const unsigned char* mapped = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m_frameSize, GL_MAP_READ_BIT);
+    if (mapped){
+        for (size_t i = 0 ; i < m_streams.size() ; i++){
+            size_t rowSize = size_t(m_streams[i].m_width) * m_streams[i].getPixelSize();
+            const unsigned char* src = mapped + m_offsets[i];
+            unsigned char* dst = a_frame + m_offsets[i];
+            for (int y = 0 ; y < m_streams[i].m_height ; y++){
+                memcpy(dst + (m_streams[i].m_height - 1 - y) * rowSize, src + y * rowSize, rowSize);
+            }
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_firstSlot = (m_firstSlot + 1) % m_buffers.size();
+    m_pendingCount--;
+    return mapped ? int(slot) : -1;
+}
+
+void FrameReadback::destroy(){
+    for (size_t i = 0 ; i < m_fences.size() ; i++){
+        if (m_fences[i]){
+            glDeleteSync(m_fences[i]);
+        }
+    }
+    m_fences.clear();
+    if (!m_buffers.empty()){
+        glDeleteBuffers(GLsizei(m_buffers.size()), m_buffers.data());
+        m_buffers.clear();
+    }
+    m_pendingCount = 0;
+}
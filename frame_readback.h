@@ -0,0 +1,73 @@
+#ifndef FRAME_READBACK_H
+#define FRAME_READBACK_H
+
+#include <chai3d.h>
+#include <string>
+#include <vector>
+
+///
+/// \brief A 2D texture read back every captured frame, the color or the depth of a camera
+///
+struct FrameStreamDesc{
+    std::string m_name;
+    int m_width;
+    int m_height;
+    // GL_DEPTH_COMPONENT read as floats if true, GL_RGB bytes otherwise
+    bool m_depth;
+    // clipping planes of the camera, to linearize the depth
+    double m_near;
+    double m_far;
+
+    size_t getPixelSize() const {return m_depth ? sizeof(float) : 3;}
+
+    size_t getSize() const {return size_t(m_width) * m_height * getPixelSize();}
+};
+
+///
+/// \brief Reads a set of textures back to the CPU without stalling the pipeline. Each capture
+/// copies the textures into a pixel buffer object and sets a fence, the buffer is mapped a few
+/// frames later once the fence has signaled. A frame holds the streams one after the other,
+/// with their rows top to bottom.
+///
+class FrameReadback{
+public:
+    FrameReadback();
+    ~FrameReadback();
+
+    // Creates the pixel buffers, needs a current GL context
+    bool init(const std::vector<FrameStreamDesc>& a_streams);
+
+    bool isEnabled() const {return !m_buffers.empty();}
+
+    // frames that can be in flight at once
+    size_t getSlotCount() const {return m_buffers.size();}
+
+    // bytes of a frame, all streams included
+    size_t getFrameSize() const {return m_frameSize;}
+
+    size_t getStreamOffset(size_t a_streamIdx) const {return m_offsets[a_streamIdx];}
+
+    // Starts reading back one texture per stream, returns the slot of the frame or -1 if all
+    // the slots are in flight
+    int capture(const std::vector<GLuint>& a_textureIds);
+
+    // Copies the oldest frame whose fence has signaled to a_frame, getFrameSize() bytes,
+    // returns its slot or -1 if none is ready
+    int poll(unsigned char* a_frame);
+
+    // Deletes the GL objects. Needs a current GL context
+    void destroy();
+
+private:
+    std::vector<FrameStreamDesc> m_streams;
+    std::vector<size_t> m_offsets;
+    size_t m_frameSize;
+
+    std::vector<GLuint> m_buffers;
+    std::vector<GLsync> m_fences;
+    // oldest slot in flight and number of slots in flight
+    size_t m_firstSlot;
+    size_t m_pendingCount;
+};
+
+#endif // FRAME_READBACK_H
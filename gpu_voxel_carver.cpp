@@ -0,0 +1,330 @@
+#include "gpu_voxel_carver.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+// frames whose voxels may be in flight at once
+static const size_t s_numReadbackSlots = 3;
+
+// size of the count at the start of each readback slot
+static const size_t s_slotHeaderSize = 8;
+
+static const char* s_carveShaderSource = R"(
+#version 430
+layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+
+layout(rgba8, binding = 0) uniform image3D uVolume;
+
+// the voxels cleared by this frame, uCount may grow past the capacity
+layout(std430, binding = 1) buffer CarvedVoxels{
+    uint uCount;
+    uint uPad;
+    uvec2 uVoxels[];
+};
+
+uniform ivec3 uVolumeSize;
+uniform ivec3 uMin;
+uniform ivec3 uMax;
+uniform ivec3 uCenter;
+uniform vec3 uRadius;
+uniform uint uCapacity;
+
+void main(){
+    ivec3 voxel = uMin + ivec3(gl_GlobalInvocationID);
+    if (any(greaterThanEqual(voxel, uMax))) return;
+
+    vec3 n = vec3(voxel - uCenter) / uRadius;
+    if (dot(n, n) > 1.0) return;
+
+    vec4 color = imageLoad(uVolume, voxel);
+    if (color == vec4(0.0)) return;
+
+    // a voxel that can't be read back stays, the next ticks of the burr carve it again
+    uint idx = atomicAdd(uCount, 1u);
+    if (idx >= uCapacity) return;
+
+    imageStore(uVolume, voxel, vec4(0.0));
+    uint linear = (uint(voxel.z) * uint(uVolumeSize.y) + uint(voxel.y)) * uint(uVolumeSize.x) + uint(voxel.x);
+    uVoxels[idx] = uvec2(linear, packUnorm4x8(color));
+}
+)";
+
+GpuVoxelCarver::GpuVoxelCarver(){
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = 0;
+    }
+    m_maxVoxelsPerFrame = 0;
+    m_program = 0;
+    m_volumeSizeLocation = -1;
+    m_minLocation = -1;
+    m_maxLocation = -1;
+    m_centerLocation = -1;
+    m_radiusLocation = -1;
+    m_capacityLocation = -1;
+    m_buffer = 0;
+    m_mapped = NULL;
+    m_slotStride = 0;
+    m_nextSlot = 0;
+    m_generation.store(0);
+    m_dropGeneration.store(0);
+    m_droppedRequestCount.store(0);
+}
+
+GpuVoxelCarver::~GpuVoxelCarver(){
+    // The GL context may already be gone here, the objects are released with destroy()
+}
+
+bool GpuVoxelCarver::init(const int a_voxelCount[3], size_t a_maxVoxelsPerFrame){
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major < 4 || (major == 4 && minor < 4)){
+        cerr << "WARNING! GPU CARVING NEEDS OPENGL 4.4, THE CONTEXT IS " << major << "." << minor << endl;
+        return false;
+    }
+    if (uint64_t(a_voxelCount[0]) * a_voxelCount[1] * a_voxelCount[2] > UINT32_MAX){
+        cerr << "WARNING! GPU CARVING ONLY SUPPORTS VOLUMES OF UP TO 2^32 VOXELS" << endl;
+        return false;
+    }
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = a_voxelCount[i];
+    }
+    m_maxVoxelsPerFrame = a_maxVoxelsPerFrame;
+
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 1, &s_carveShaderSource, NULL);
+    glCompileShader(shader);
+    GLint status = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE){
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        cerr << "ERROR! FAILED TO COMPILE THE GPU CARVING SHADER: " << log << endl;
+        glDeleteShader(shader);
+        return false;
+    }
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE){
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        cerr << "ERROR! FAILED TO LINK THE GPU CARVING SHADER: " << log << endl;
+        glDeleteProgram(program);
+        return false;
+    }
+    m_volumeSizeLocation = glGetUniformLocation(program, "uVolumeSize");
+    m_minLocation = glGetUniformLocation(program, "uMin");
+    m_maxLocation = glGetUniformLocation(program, "uMax");
+    m_centerLocation = glGetUniformLocation(program, "uCenter");
+    m_radiusLocation = glGetUniformLocation(program, "uRadius");
+    m_capacityLocation = glGetUniformLocation(program, "uCapacity");
+
+    // the slots are bound as ranges of the same buffer, aligned as the context requires
+    GLint alignment = 256;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    size_t slotSize = s_slotHeaderSize + m_maxVoxelsPerFrame * 2 * sizeof(uint32_t);
+    m_slotStride = (slotSize + alignment - 1) / alignment * alignment;
+
+    GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, m_slotStride * s_numReadbackSlots, NULL, flags);
+    m_mapped = (unsigned char*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, m_slotStride * s_numReadbackSlots, flags);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    if (!m_mapped){
+        cerr << "ERROR! FAILED TO MAP THE GPU CARVING READBACK BUFFER" << endl;
+        glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+        glDeleteProgram(program);
+        return false;
+    }
+
+    m_slots.resize(s_numReadbackSlots);
+    for (size_t i = 0 ; i < m_slots.size() ; i++){
+        m_slots[i].m_fence = 0;
+        m_slots[i].m_readCount = 0;
+        m_slots[i].m_generation = 0;
+    }
+    m_nextSlot = 0;
+    m_program = program;
+    return true;
+}
+
+bool GpuVoxelCarver::submit(const GpuCarveRequest &a_request){
+    if (!m_requests.push(a_request)){
+        m_droppedRequestCount.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+///
+/// \brief This method reads back the oldest slots first, so that the haptic loop removes the
+/// voxels in the order they were carved, then dispatches the requests of the frame into the
+/// next free slot. Without a free slot the requests wait for the next frame.
+///
+void GpuVoxelCarver::update(GLuint a_textureId){
+    if (!isEnabled()){
+        return;
+    }
+
+    for (size_t i = 0 ; i < m_slots.size() ; i++){
+        size_t slotIdx = (m_nextSlot + i) % m_slots.size();
+        ReadbackSlot& slot = m_slots[slotIdx];
+        if (slot.m_fence == 0){
+            continue;
+        }
+        GLenum result = glClientWaitSync(slot.m_fence, 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED){
+            break;
+        }
+        if (!readSlot(slot, slotIdx)){
+            break;
+        }
+        glDeleteSync(slot.m_fence);
+        slot.m_fence = 0;
+    }
+
+    // consecutive ticks of a burr that doesn't move carve the same voxels
+    GpuCarveRequest request;
+    while (m_requests.pop(request)){
+        if (!m_frameRequests.empty() && memcmp(&m_frameRequests.back(), &request, sizeof(request)) == 0){
+            continue;
+        }
+        m_frameRequests.push_back(request);
+    }
+
+    ReadbackSlot& slot = m_slots[m_nextSlot];
+    if (m_frameRequests.empty() || slot.m_fence != 0 || a_textureId == 0){
+        return;
+    }
+
+    unsigned char* slotData = m_mapped + m_nextSlot * m_slotStride;
+    memset(slotData, 0, s_slotHeaderSize);
+
+    GLint prevProgram;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &prevProgram);
+    glUseProgram(m_program);
+    glUniform3i(m_volumeSizeLocation, m_voxelCount[0], m_voxelCount[1], m_voxelCount[2]);
+    glUniform1ui(m_capacityLocation, GLuint(m_maxVoxelsPerFrame));
+    glBindImageTexture(0, a_textureId, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA8);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, m_buffer, m_nextSlot * m_slotStride, m_slotStride);
+
+    for (size_t i = 0 ; i < m_frameRequests.size() ; i++){
+        dispatch(m_frameRequests[i]);
+    }
+    m_frameRequests.clear();
+
+    // the rendering samples the carved texture, the CPU reads the mapped voxels
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+    slot.m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.m_readCount = 0;
+    slot.m_generation = m_generation.load(memory_order_relaxed);
+    m_nextSlot = (m_nextSlot + 1) % m_slots.size();
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+    glBindImageTexture(0, 0, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA8);
+    glUseProgram(prevProgram);
+}
+
+void GpuVoxelCarver::dispatch(const GpuCarveRequest &a_request){
+    int boxMin[3], boxMax[3];
+    for (int i = 0 ; i < 3 ; i++){
+        int extent = int(floor(a_request.m_radius[i]));
+        boxMin[i] = max(a_request.m_center[i] - extent, 0);
+        boxMax[i] = min(a_request.m_center[i] + extent + 1, m_voxelCount[i]);
+        if (boxMin[i] >= boxMax[i]){
+            return;
+        }
+    }
+    glUniform3i(m_minLocation, boxMin[0], boxMin[1], boxMin[2]);
+    glUniform3i(m_maxLocation, boxMax[0], boxMax[1], boxMax[2]);
+    glUniform3i(m_centerLocation, a_request.m_center[0], a_request.m_center[1], a_request.m_center[2]);
+    glUniform3f(m_radiusLocation, a_request.m_radius[0], a_request.m_radius[1], a_request.m_radius[2]);
+    glDispatchCompute((boxMax[0] - boxMin[0] + 3) / 4, (boxMax[1] - boxMin[1] + 3) / 4, (boxMax[2] - boxMin[2] + 3) / 4);
+    // the next burr of the frame may overlap this one
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+bool GpuVoxelCarver::readSlot(ReadbackSlot &a_slot, size_t a_slotIdx){
+    const unsigned char* slotData = m_mapped + a_slotIdx * m_slotStride;
+    uint32_t count;
+    memcpy(&count, slotData, sizeof(count));
+    count = min(count, uint32_t(m_maxVoxelsPerFrame));
+
+    const uint32_t* voxels = (const uint32_t*)(slotData + s_slotHeaderSize);
+    GpuCarvedVoxel carved;
+    carved.m_generation = a_slot.m_generation;
+    for ( ; a_slot.m_readCount < count ; a_slot.m_readCount++){
+        carved.m_voxel.m_voxelIdx = voxels[2 * a_slot.m_readCount];
+        // packUnorm4x8 puts the red channel in the lowest byte
+        uint32_t color = voxels[2 * a_slot.m_readCount + 1];
+        for (int c = 0 ; c < 4 ; c++){
+            carved.m_voxel.m_color[c] = (unsigned char)(color >> (8 * c));
+        }
+        if (!m_carvedVoxels.push(carved)){
+            return false;
+        }
+    }
+    return true;
+}
+
+void GpuVoxelCarver::collect(vector<JournalEntry> &a_voxels, vector<JournalEntry> &a_staleVoxels){
+    a_voxels.clear();
+    a_staleVoxels.clear();
+    uint32_t generation = m_generation.load(memory_order_acquire);
+    uint32_t dropGeneration = m_dropGeneration.load(memory_order_acquire);
+    GpuCarvedVoxel carved;
+    while (m_carvedVoxels.pop(carved)){
+        if (carved.m_generation == generation){
+            a_voxels.push_back(carved.m_voxel);
+        }
+        else if (carved.m_generation >= dropGeneration){
+            a_staleVoxels.push_back(carved.m_voxel);
+        }
+    }
+}
+
+void GpuVoxelCarver::invalidateInFlight(){
+    m_generation.fetch_add(1, memory_order_acq_rel);
+}
+
+void GpuVoxelCarver::dropCarvedVoxels(){
+    // the slots dispatched from now on are kept
+    m_dropGeneration.store(m_generation.fetch_add(1, memory_order_acq_rel) + 1, memory_order_release);
+}
+
+void GpuVoxelCarver::reset(){
+    GpuCarveRequest request;
+    while (m_requests.pop(request)){
+    }
+    m_frameRequests.clear();
+    invalidateInFlight();
+}
+
+void GpuVoxelCarver::destroy(){
+    for (size_t i = 0 ; i < m_slots.size() ; i++){
+        if (m_slots[i].m_fence != 0){
+            glDeleteSync(m_slots[i].m_fence);
+            m_slots[i].m_fence = 0;
+        }
+    }
+    if (m_buffer != 0){
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffer);
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+        m_mapped = NULL;
+    }
+    if (m_program != 0){
+        glDeleteProgram(m_program);
+        m_program = 0;
+    }
+}
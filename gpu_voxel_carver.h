@@ -0,0 +1,127 @@
+#ifndef GPU_VOXEL_CARVER_H
+#define GPU_VOXEL_CARVER_H
+
+#include <atomic>
+#include <chai3d.h>
+#include <stdint.h>
+#include <vector>
+#include "spsc_ring_buffer.h"
+#include "voxel_journal.h"
+
+///
+/// \brief A burr to carve out of the volume texture: the voxel at its center and its radii
+/// in voxels, the same ellipsoid as the BurrStencil of the burr.
+///
+struct GpuCarveRequest{
+    int m_center[3];
+    float m_radius[3];
+};
+
+///
+/// \brief A voxel carved by the GPU, tagged with the generation of the volume it was carved in
+///
+struct GpuCarvedVoxel{
+    JournalEntry m_voxel;
+    uint32_t m_generation;
+};
+
+///
+/// \brief Removes the voxels of the burr directly in the 3D texture of the volume with a compute
+/// shader, so that drilling doesn't upload the modified bricks. The haptic loop submits one
+/// request per drilling tick, the graphics thread dispatches the requests of a frame and the
+/// shader appends the index and color of every voxel it clears to a buffer. The buffers of the
+/// last few frames are persistently mapped and read back once their fence has signaled, without
+/// stalling the pipeline, and the voxels are handed to the haptic loop, which removes them from
+/// the CPU copy of the volume a few frames later. The CPU copy stays the reference for the
+/// forces, the journal and the published events.
+///
+/// Uploading the CPU copy to the texture, e.g. after a rollback, overwrites the voxels carved by
+/// the slots still in flight, so invalidateInFlight() marks their voxels as stale: they are still
+/// removed from the CPU copy, and their bricks uploaded again, so both copies agree.
+///
+/// Needs OpenGL 4.4 and an RGBA8 volume texture, the only format the shader can write.
+///
+class GpuVoxelCarver{
+public:
+    GpuVoxelCarver();
+    ~GpuVoxelCarver();
+
+    // Compiles the shader and creates the readback buffers, a_maxVoxelsPerFrame voxels each.
+    // Needs a current GL context. Returns false if the context can't run the carver
+    bool init(const int a_voxelCount[3], size_t a_maxVoxelsPerFrame);
+
+    bool isEnabled() const {return m_program != 0;}
+
+    // Queues a carve for the next frame. Called by the haptic loop, returns false if the queue
+    // is full
+    bool submit(const GpuCarveRequest& a_request);
+
+    // Dispatches the queued requests on the texture and reads back the buffers whose fence
+    // has signaled. Called by the graphics thread
+    void update(GLuint a_textureId);
+
+    // Moves the voxels read back since the last call to a_voxels, and to a_staleVoxels those
+    // whose carve was overwritten by an upload of the CPU copy. Called by the haptic loop
+    void collect(std::vector<JournalEntry>& a_voxels, std::vector<JournalEntry>& a_staleVoxels);
+
+    // Marks the voxels carved by the slots dispatched so far as stale. Called by the graphics
+    // thread after it uploaded part of the CPU copy to the texture
+    void invalidateInFlight();
+
+    // Drops the voxels carved so far, read back or not, e.g. when the CPU copy is restored.
+    // Called by the haptic loop
+    void dropCarvedVoxels();
+
+    // Drops the pending requests and marks the slots in flight as stale, once the restored
+    // volume is to be uploaded. Called by the graphics thread
+    void reset();
+
+    // Deletes the GL objects. Needs a current GL context
+    void destroy();
+
+    unsigned long long getDroppedRequestCount() const {return m_droppedRequestCount.load();}
+
+private:
+    struct ReadbackSlot{
+        GLsync m_fence;
+        // voxels of the slot already handed to the haptic loop
+        uint32_t m_readCount;
+        // generation of the volume when the slot was dispatched
+        uint32_t m_generation;
+    };
+
+    void dispatch(const GpuCarveRequest& a_request);
+
+    // hands the voxels of a slot whose fence has signaled to the haptic loop, returns false
+    // if the queue is full and the slot must be read again
+    bool readSlot(ReadbackSlot& a_slot, size_t a_slotIdx);
+
+    int m_voxelCount[3];
+    size_t m_maxVoxelsPerFrame;
+
+    GLuint m_program;
+    GLint m_volumeSizeLocation;
+    GLint m_minLocation;
+    GLint m_maxLocation;
+    GLint m_centerLocation;
+    GLint m_radiusLocation;
+    GLint m_capacityLocation;
+
+    // one slot per frame in flight, each with a count and m_maxVoxelsPerFrame voxels
+    GLuint m_buffer;
+    unsigned char* m_mapped;
+    size_t m_slotStride;
+    std::vector<ReadbackSlot> m_slots;
+    size_t m_nextSlot;
+
+    SPSCRingBuffer<GpuCarveRequest> m_requests{4096};
+    SPSCRingBuffer<GpuCarvedVoxel> m_carvedVoxels{1 << 20};
+    std::vector<GpuCarveRequest> m_frameRequests;
+    // generation of the volume, bumped by each upload of the CPU copy, and the first one
+    // whose voxels are kept
+    std::atomic<uint32_t> m_generation;
+    std::atomic<uint32_t> m_dropGeneration;
+    std::atomic<unsigned long long> m_droppedRequestCount;
+};
+
+#endif // GPU_VOXEL_CARVER_H
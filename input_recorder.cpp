@@ -0,0 +1,144 @@
+#include "input_recorder.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+const char* InputRecorder::s_magic = "VDRILREC";
+
+InputRecorder::InputRecorder(size_t a_capacity): m_queue(a_capacity){
+    m_batch.resize(1024);
+    m_file = NULL;
+    m_recording.store(false);
+    m_running.store(false);
+    m_writtenCount.store(0);
+    m_droppedCount.store(0);
+}
+
+InputRecorder::~InputRecorder(){
+    stop();
+}
+
+bool InputRecorder::start(const string &a_filepath, const double a_volumePos[3], const double a_volumeRot[9]){
+    stop();
+
+    m_file = fopen(a_filepath.c_str(), "wb");
+    if (!m_file){
+        cerr << "ERROR! FAILED TO CREATE RECORDING FILE " << a_filepath << endl;
+        return false;
+    }
+
+    InputRecordHeader header;
+    memcpy(header.m_magic, s_magic, sizeof(header.m_magic));
+    header.m_version = s_version;
+    header.m_recordSize = sizeof(InputRecord);
+    memcpy(header.m_volumePos, a_volumePos, sizeof(header.m_volumePos));
+    memcpy(header.m_volumeRot, a_volumeRot, sizeof(header.m_volumeRot));
+    if (fwrite(&header, sizeof(header), 1, m_file) != 1){
+        cerr << "ERROR! FAILED TO WRITE RECORDING FILE " << a_filepath << endl;
+        fclose(m_file);
+        m_file = NULL;
+        return false;
+    }
+
+    // records pushed after the previous recording stopped belong to neither recording
+    InputRecord stale;
+    while (m_queue.pop(stale)){
+    }
+
+    m_filepath = a_filepath;
+    m_writtenCount.store(0);
+    m_droppedCount.store(0);
+    m_running.store(true);
+    m_writerThread = thread(&InputRecorder::writerLoop, this);
+    m_recording.store(true, memory_order_release);
+    return true;
+}
+
+void InputRecorder::stop(){
+    m_recording.store(false, memory_order_release);
+    if (m_writerThread.joinable()){
+        m_running.store(false);
+        m_writerThread.join();
+    }
+    if (m_file){
+        fclose(m_file);
+        m_file = NULL;
+    }
+}
+
+void InputRecorder::record(const InputRecord &a_record){
+    if (!m_recording.load(memory_order_relaxed)){
+        return;
+    }
+    if (!m_queue.push(a_record)){
+        m_droppedCount.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+///
+/// \brief Runs on the writer thread. Writes the ring in batches, and flushes what is left once
+/// the recording is stopped.
+///
+void InputRecorder::writerLoop(){
+    while (true){
+        // Read the flag before flushing so that no record pushed before stop() is missed
+        bool running = m_running.load();
+        if (!flush()){
+            cerr << "ERROR! FAILED TO WRITE RECORDING FILE " << m_filepath << ", RECORDING STOPPED" << endl;
+            m_recording.store(false, memory_order_release);
+            return;
+        }
+        if (!running){
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    fflush(m_file);
+}
+
+bool InputRecorder::flush(){
+    size_t count = 0;
+    while (true){
+        bool empty = !m_queue.pop(m_batch[count]);
+        if (!empty){
+            count++;
+        }
+        if (count == m_batch.size() || (empty && count > 0)){
+            if (fwrite(m_batch.data(), sizeof(InputRecord), count, m_file) != count){
+                return false;
+            }
+            m_writtenCount.fetch_add(count, memory_order_relaxed);
+            count = 0;
+        }
+        if (empty){
+            return true;
+        }
+    }
+}
+
+bool InputRecorder::load(const string &a_filepath, InputRecordHeader &a_header, vector<InputRecord> &a_records){
+    FILE* file = fopen(a_filepath.c_str(), "rb");
+    if (!file){
+        cerr << "ERROR! FAILED TO OPEN RECORDING FILE " << a_filepath << endl;
+        return false;
+    }
+
+    bool valid = fread(&a_header, sizeof(a_header), 1, file) == 1 &&
+            memcmp(a_header.m_magic, s_magic, sizeof(a_header.m_magic)) == 0 &&
+            a_header.m_version == s_version && a_header.m_recordSize == sizeof(InputRecord);
+    if (!valid){
+        cerr << "ERROR! " << a_filepath << " IS NOT A RECORDING OF THIS VERSION" << endl;
+        fclose(file);
+        return false;
+    }
+
+    a_records.clear();
+    InputRecord record;
+    while (fread(&record, sizeof(record), 1, file) == 1){
+        a_records.push_back(record);
+    }
+    fclose(file);
+    return true;
+}
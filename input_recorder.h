@@ -0,0 +1,111 @@
+#ifndef INPUT_RECORDER_H
+#define INPUT_RECORDER_H
+
+#include <atomic>
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spsc_ring_buffer.h"
+
+///
+/// \brief Start of a recording file, followed by the records. The poses of the records are in
+/// the world frame, the pose of the volume lets a replay express them in the volume frame.
+///
+struct InputRecordHeader{
+    char m_magic[8];
+    uint32_t m_version;
+    // sizeof(InputRecord) when the file was written
+    uint32_t m_recordSize;
+    double m_volumePos[3];
+    // row major
+    double m_volumeRot[9];
+};
+
+///
+/// \brief The inputs of one tick of the haptic loop and the drill pose commanded from them.
+/// The layout is fixed, the padding is explicit so the records can be written as they are.
+///
+struct InputRecord{
+    enum Flags{
+        DEVICE_AVAILABLE = 1 << 0,
+        DEVICE_CLUTCH = 1 << 1,
+        CAMERA_CLUTCH = 1 << 2,
+        OVERRIDE_DRILL_CONTROL = 1 << 3
+    };
+
+    uint64_t m_tick;
+    // simulation time of the physics step and time since the previous tick, in seconds
+    double m_simTime;
+    double m_dt;
+
+    // pose and linear velocity as read from the haptic device, m_T_i and m_V_i
+    float m_devicePos[3];
+    float m_deviceRot[9];
+    float m_deviceVel[3];
+    float m_pad0;
+
+    // target pose of the drill, m_T_d, after the inputs are applied
+    double m_drillPos[3];
+    double m_drillRot[9];
+
+    uint8_t m_flags;
+    int8_t m_burrIdx;
+    uint8_t m_pad1[6];
+};
+
+///
+/// \brief Records the inputs of the haptic loop at full rate. record() only copies the record
+/// into a preallocated ring, a background thread writes the ring to a binary file. Records
+/// that don't fit in the ring are dropped and counted, the haptic loop never waits.
+///
+class InputRecorder{
+public:
+    // The capacity is the number of records the ring holds, rounded up to a power of two
+    explicit InputRecorder(size_t a_capacity = 65536);
+    ~InputRecorder();
+
+    // Creates the file and starts the writer thread, call from a single control thread
+    bool start(const std::string& a_filepath, const double a_volumePos[3], const double a_volumeRot[9]);
+
+    // Writes the remaining records and closes the file
+    void stop();
+
+    bool isRecording() const {return m_recording.load(std::memory_order_acquire);}
+
+    // Called by the haptic loop
+    void record(const InputRecord& a_record);
+
+    const std::string& getFilepath() const {return m_filepath;}
+
+    unsigned long long getWrittenCount() const {return m_writtenCount.load(std::memory_order_relaxed);}
+
+    unsigned long long getDroppedCount() const {return m_droppedCount.load(std::memory_order_relaxed);}
+
+    // Reads a whole recording, e.g. for a replay
+    static bool load(const std::string& a_filepath, InputRecordHeader& a_header, std::vector<InputRecord>& a_records);
+
+    static const char* s_magic;
+    static const uint32_t s_version = 1;
+
+private:
+    void writerLoop();
+
+    // Writes the records in the ring, returns false on a write error
+    bool flush();
+
+    SPSCRingBuffer<InputRecord> m_queue;
+    std::vector<InputRecord> m_batch;
+
+    std::string m_filepath;
+    FILE* m_file;
+    std::thread m_writerThread;
+    std::atomic<bool> m_recording;
+    std::atomic<bool> m_running;
+
+    std::atomic<unsigned long long> m_writtenCount;
+    std::atomic<unsigned long long> m_droppedCount;
+};
+
+#endif // INPUT_RECORDER_H
@@ -0,0 +1,257 @@
+#include "occupancy_texture.h"
+#include <algorithm>
+
+using namespace std;
+
+OccupancyTexture::OccupancyTexture(){
+    for (int i = 0 ; i < 3 ; i++){
+        m_cellCount[i] = 0;
+        m_texCoordScale[i] = 1.0;
+        m_dirtyMin[i] = 0;
+        m_dirtyMax[i] = 0;
+    }
+    m_skipDistance = 1;
+    m_boundsDirty = true;
+    m_dirty = false;
+    m_recreate = false;
+    m_textureId = 0;
+}
+
+OccupancyTexture::~OccupancyTexture(){
+    // The GL context may already be gone here, the texture is released with destroy()
+}
+
+void OccupancyTexture::setSkipDistance(int a_cells){
+    m_skipDistance = min(max(a_cells, 1), 254);
+}
+
+void OccupancyTexture::build(const BrickOccupancy &a_occupancy){
+    bool resized = false;
+    for (int i = 0 ; i < 3 ; i++){
+        resized |= m_cellCount[i] != a_occupancy.getNumBricks(i);
+        m_cellCount[i] = a_occupancy.getNumBricks(i);
+        int paddedCount = m_cellCount[i] * a_occupancy.getBrickSize();
+        m_texCoordScale[i] = paddedCount > 0 ? double(a_occupancy.getVoxelCount(i)) / paddedCount : 1.0;
+    }
+    m_texels.assign(size_t(m_cellCount[0]) * m_cellCount[1] * m_cellCount[2], 0);
+
+    int cellMin[3] = {0, 0, 0};
+    updateCells(a_occupancy, cellMin, m_cellCount);
+
+    // the dimensions changed, the texture is recreated on the next upload
+    m_recreate |= resized;
+}
+
+void OccupancyTexture::update(const BrickOccupancy &a_occupancy, const VoxelBox &a_box){
+    if (m_texels.empty()){
+        return;
+    }
+
+    int brickSize = a_occupancy.getBrickSize();
+    int cellMin[3], cellMax[3];
+    for (int i = 0 ; i < 3 ; i++){
+        // bricks overlapping the box, grown by the skip distance since a texel depends on
+        // the bricks up to that distance
+        cellMin[i] = max(a_box.m_min[i] / brickSize - m_skipDistance, 0);
+        cellMax[i] = min((a_box.m_max[i] - 1) / brickSize + 1 + m_skipDistance, m_cellCount[i]);
+        if (cellMin[i] >= cellMax[i]){
+            return;
+        }
+    }
+    updateCells(a_occupancy, cellMin, cellMax);
+}
+
+void OccupancyTexture::updateCells(const BrickOccupancy &a_occupancy, const int a_min[3], const int a_max[3]){
+    // Chebyshev distance to the nearest occupied brick, one axis after the other. A distance
+    // only matters up to the skip distance plus one, so the distances of the cells are exact
+    // when the bricks up to the skip distance around them are part of the computation
+    const int cap = m_skipDistance + 1;
+    int srcMin[3], srcSize[3];
+    for (int i = 0 ; i < 3 ; i++){
+        srcMin[i] = max(a_min[i] - m_skipDistance, 0);
+        srcSize[i] = min(a_max[i] + m_skipDistance, m_cellCount[i]) - srcMin[i];
+    }
+    const size_t stride[3] = {1, size_t(srcSize[0]), size_t(srcSize[0]) * srcSize[1]};
+    m_distances.resize(size_t(srcSize[0]) * srcSize[1] * srcSize[2]);
+
+    // along x, to the nearest occupied brick of the row on either side
+    for (int z = 0 ; z < srcSize[2] ; z++){
+        for (int y = 0 ; y < srcSize[1] ; y++){
+            unsigned char* row = &m_distances[z * stride[2] + y * stride[1]];
+            int d = cap;
+            for (int x = 0 ; x < srcSize[0] ; x++){
+                d = a_occupancy.getBrickCount(srcMin[0] + x, srcMin[1] + y, srcMin[2] + z) > 0 ? 0 : min(d + 1, cap);
+                row[x] = d;
+            }
+            d = cap;
+            for (int x = srcSize[0] - 1 ; x >= 0 ; x--){
+                d = row[x] == 0 ? 0 : min(d + 1, cap);
+                row[x] = min<int>(row[x], d);
+            }
+        }
+    }
+
+    // along y then z, the distance of a cell is the smallest of the distances of the cells
+    // of its line, each at least its offset along the line
+    for (int axis = 1 ; axis < 3 ; axis++){
+        // the line runs along the axis, the lines are spread along x and the remaining axis
+        const int u = 0;
+        const int v = axis == 1 ? 2 : 1;
+        const int n = srcSize[axis];
+        m_lineDistances.resize(n);
+        for (int b = 0 ; b < srcSize[v] ; b++){
+            for (int a = 0 ; a < srcSize[u] ; a++){
+                unsigned char* line = &m_distances[a * stride[u] + b * stride[v]];
+                for (int k = 0 ; k < n ; k++){
+                    m_lineDistances[k] = line[k * stride[axis]];
+                }
+                for (int k = 0 ; k < n ; k++){
+                    int d = m_lineDistances[k];
+                    for (int o = 1 ; o < d ; o++){
+                        if (k - o >= 0){
+                            d = min(d, max<int>(o, m_lineDistances[k - o]));
+                        }
+                        if (k + o < n){
+                            d = min(d, max<int>(o, m_lineDistances[k + o]));
+                        }
+                    }
+                    line[k * stride[axis]] = d;
+                }
+            }
+        }
+    }
+
+    // the cells next to an occupied brick are marched, the others skip the cube of cells
+    // that are all farther from it
+    for (int z = a_min[2] ; z < a_max[2] ; z++){
+        for (int y = a_min[1] ; y < a_max[1] ; y++){
+            for (int x = a_min[0] ; x < a_max[0] ; x++){
+                int d = m_distances[(z - srcMin[2]) * stride[2] + (y - srcMin[1]) * stride[1] + (x - srcMin[0])];
+                m_texels[getCellIndex(x, y, z)] = max(d - 1, 0);
+            }
+        }
+    }
+    m_boundsDirty = true;
+
+    if (!m_dirty){
+        for (int i = 0 ; i < 3 ; i++){
+            m_dirtyMin[i] = a_min[i];
+            m_dirtyMax[i] = a_max[i];
+        }
+        m_dirty = true;
+    }
+    else{
+        for (int i = 0 ; i < 3 ; i++){
+            m_dirtyMin[i] = min(m_dirtyMin[i], a_min[i]);
+            m_dirtyMax[i] = max(m_dirtyMax[i], a_max[i]);
+        }
+    }
+}
+
+void OccupancyTexture::upload(){
+    if (m_texels.empty() || (!m_dirty && !m_recreate && m_textureId != 0)){
+        return;
+    }
+
+    if (m_recreate && m_textureId != 0){
+        glDeleteTextures(1, &m_textureId);
+        m_textureId = 0;
+    }
+    m_recreate = false;
+
+    GLint prevTexture;
+    glGetIntegerv(GL_TEXTURE_BINDING_3D, &prevTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (m_textureId == 0){
+        glGenTextures(1, &m_textureId);
+        glBindTexture(GL_TEXTURE_3D, m_textureId);
+        // nearest filtering, a texel must never blend into an empty neighbour
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, m_cellCount[0], m_cellCount[1], m_cellCount[2], 0,
+                     GL_RED, GL_UNSIGNED_BYTE, &m_texels[0]);
+    }
+    else{
+        glBindTexture(GL_TEXTURE_3D, m_textureId);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, m_cellCount[0]);
+        glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, m_cellCount[1]);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, m_dirtyMin[0]);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, m_dirtyMin[1]);
+        glPixelStorei(GL_UNPACK_SKIP_IMAGES, m_dirtyMin[2]);
+
+        glTexSubImage3D(GL_TEXTURE_3D, 0,
+                        m_dirtyMin[0], m_dirtyMin[1], m_dirtyMin[2],
+                        m_dirtyMax[0] - m_dirtyMin[0], m_dirtyMax[1] - m_dirtyMin[1], m_dirtyMax[2] - m_dirtyMin[2],
+                        GL_RED, GL_UNSIGNED_BYTE, &m_texels[0]);
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_IMAGES, 0);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_3D, prevTexture);
+    m_dirty = false;
+}
+
+void OccupancyTexture::bind(int a_textureUnit){
+    if (m_textureId == 0){
+        return;
+    }
+    glActiveTexture(GL_TEXTURE0 + a_textureUnit);
+    glBindTexture(GL_TEXTURE_3D, m_textureId);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void OccupancyTexture::destroy(){
+    if (m_textureId != 0){
+        glDeleteTextures(1, &m_textureId);
+        m_textureId = 0;
+    }
+    m_dirty = !m_texels.empty();
+}
+
+size_t OccupancyTexture::getOccupiedCellCount() const{
+    return count(m_texels.begin(), m_texels.end(), 0);
+}
+
+bool OccupancyTexture::getOccupiedBounds(cVector3d &a_min, cVector3d &a_max){
+    if (m_boundsDirty){
+        for (int i = 0 ; i < 3 ; i++){
+            m_boundsMin[i] = m_cellCount[i];
+            m_boundsMax[i] = 0;
+        }
+        for (int z = 0 ; z < m_cellCount[2] ; z++){
+            for (int y = 0 ; y < m_cellCount[1] ; y++){
+                const unsigned char* row = &m_texels[getCellIndex(0, y, z)];
+                for (int x = 0 ; x < m_cellCount[0] ; x++){
+                    if (row[x] == 0){
+                        m_boundsMin[0] = min(m_boundsMin[0], x);
+                        m_boundsMax[0] = max(m_boundsMax[0], x + 1);
+                        m_boundsMin[1] = min(m_boundsMin[1], y);
+                        m_boundsMax[1] = max(m_boundsMax[1], y + 1);
+                        m_boundsMin[2] = min(m_boundsMin[2], z);
+                        m_boundsMax[2] = max(m_boundsMax[2], z + 1);
+                    }
+                }
+            }
+        }
+        m_boundsDirty = false;
+    }
+
+    for (int i = 0 ; i < 3 ; i++){
+        if (m_boundsMin[i] >= m_boundsMax[i]){
+            return false;
+        }
+        double cellSize = 1.0 / (m_cellCount[i] * m_texCoordScale[i]);
+        a_min(i) = m_boundsMin[i] * cellSize;
+        a_max(i) = min(m_boundsMax[i] * cellSize, 1.0);
+    }
+    return true;
+}
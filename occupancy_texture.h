@@ -0,0 +1,89 @@
+#ifndef OCCUPANCY_TEXTURE_H
+#define OCCUPANCY_TEXTURE_H
+
+#include "brick_occupancy.h"
+#include "dirty_bricks.h"
+#include <chai3d.h>
+#include <vector>
+
+///
+/// \brief Low resolution 3D texture with one texel per brick of the volume, used by the
+/// volume shaders to skip the empty macro-cells along the ray. A texel is zero if its
+/// brick or any of its 26 neighbours holds an occupied voxel, so the trilinear samples and
+/// the gradients taken near the border of an occupied brick are never skipped. Otherwise it
+/// holds the radius, in cells and up to the skip distance, of the cube of skipped cells
+/// centered on it, so a ray can jump over several empty cells at once.
+/// The texels are computed on the CPU and only the modified ones are uploaded.
+///
+class OccupancyTexture{
+public:
+    OccupancyTexture();
+    ~OccupancyTexture();
+
+    // Largest radius a texel holds, from 1, a ray only skips the cell it is in, to 254.
+    // Must be set before building the texture
+    void setSkipDistance(int a_cells);
+
+    int getSkipDistance() const {return m_skipDistance;}
+
+    // Recomputes all the texels from the occupancy, the whole texture is uploaded next time
+    void build(const BrickOccupancy& a_occupancy);
+
+    // Recomputes the texels around the bricks overlapping a box of modified voxels
+    void update(const BrickOccupancy& a_occupancy, const VoxelBox& a_box);
+
+    // Creates the texture or uploads the modified texels. Needs a current GL context
+    void upload();
+
+    // Binds the texture to a texture unit, the active unit is restored to unit 0
+    void bind(int a_textureUnit);
+
+    // Deletes the texture. Needs a current GL context
+    void destroy();
+
+    bool isUploaded() const {return m_textureId != 0;}
+
+    int getNumCells(int a_axis) const {return m_cellCount[a_axis];}
+
+    // Scale from the texture coordinates of the volume to the ones of this texture,
+    // the bricks on the far faces of the volume may be partially outside of it
+    double getTexCoordScale(int a_axis) const {return m_texCoordScale[a_axis];}
+
+    // Number of texels the rays march through
+    size_t getOccupiedCellCount() const;
+
+    // Bounds of the texels the rays march through, in texture coordinates of the volume.
+    // Returns false if every texel is skipped
+    bool getOccupiedBounds(cVector3d& a_min, cVector3d& a_max);
+
+private:
+    inline size_t getCellIndex(int a_x, int a_y, int a_z) const{
+        return (size_t(a_z) * m_cellCount[1] + a_y) * m_cellCount[0] + a_x;
+    }
+
+    void updateCells(const BrickOccupancy& a_occupancy, const int a_min[3], const int a_max[3]);
+
+    int m_cellCount[3];
+    double m_texCoordScale[3];
+    std::vector<unsigned char> m_texels;
+    int m_skipDistance;
+    // Chebyshev distances to the nearest occupied brick, capped, of the cells updated
+    std::vector<unsigned char> m_distances;
+    std::vector<unsigned char> m_lineDistances;
+
+    // Bounds of the marched texels, in cells, m_boundsMax is exclusive
+    int m_boundsMin[3];
+    int m_boundsMax[3];
+    bool m_boundsDirty;
+
+    // Range of texels modified since the last upload, m_dirtyMax is exclusive
+    int m_dirtyMin[3];
+    int m_dirtyMax[3];
+    bool m_dirty;
+    // Set when the number of cells changed and the texture must be recreated
+    bool m_recreate;
+
+    GLuint m_textureId;
+};
+
+#endif // OCCUPANCY_TEXTURE_H
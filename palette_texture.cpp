@@ -0,0 +1,61 @@
+#include "palette_texture.h"
+
+using namespace std;
+
+PaletteTexture::PaletteTexture(){
+    m_dirty = false;
+    m_textureId = 0;
+}
+
+PaletteTexture::~PaletteTexture(){
+    // The GL context may already be gone here, the texture is released with destroy()
+}
+
+void PaletteTexture::set(const VoxelPalette &a_palette){
+    m_colors = a_palette.getColors();
+    m_dirty = true;
+}
+
+void PaletteTexture::upload(){
+    if (m_colors.empty() || !m_dirty){
+        return;
+    }
+
+    GLint prevTexture;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTexture);
+
+    if (m_textureId == 0){
+        glGenTextures(1, &m_textureId);
+        glBindTexture(GL_TEXTURE_2D, m_textureId);
+        // nearest filtering, two labels must never blend
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, VoxelPalette::MAX_LABELS, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &m_colors[0]);
+    }
+    else{
+        glBindTexture(GL_TEXTURE_2D, m_textureId);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VoxelPalette::MAX_LABELS, 1, GL_RGBA, GL_UNSIGNED_BYTE, &m_colors[0]);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, prevTexture);
+    m_dirty = false;
+}
+
+void PaletteTexture::bind(int a_textureUnit){
+    if (m_textureId == 0){
+        return;
+    }
+    glActiveTexture(GL_TEXTURE0 + a_textureUnit);
+    glBindTexture(GL_TEXTURE_2D, m_textureId);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void PaletteTexture::destroy(){
+    if (m_textureId != 0){
+        glDeleteTextures(1, &m_textureId);
+        m_textureId = 0;
+    }
+    m_dirty = !m_colors.empty();
+}
@@ -0,0 +1,37 @@
+#ifndef PALETTE_TEXTURE_H
+#define PALETTE_TEXTURE_H
+
+#include "voxel_palette.h"
+#include <chai3d.h>
+#include <vector>
+
+///
+/// \brief 256x1 RGBA texture with the colors of the labels of a VoxelPalette, looked up by the
+/// volume shaders with the label of the nearest voxel.
+///
+class PaletteTexture{
+public:
+    PaletteTexture();
+    ~PaletteTexture();
+
+    // Copies the colors of the palette, the texture is uploaded next time
+    void set(const VoxelPalette& a_palette);
+
+    // Creates or updates the texture. Needs a current GL context
+    void upload();
+
+    // Binds the texture to a texture unit, the active unit is restored to unit 0
+    void bind(int a_textureUnit);
+
+    // Deletes the texture. Needs a current GL context
+    void destroy();
+
+    bool isUploaded() const {return m_textureId != 0;}
+
+private:
+    std::vector<unsigned char> m_colors;
+    bool m_dirty;
+    GLuint m_textureId;
+};
+
+#endif // PALETTE_TEXTURE_H
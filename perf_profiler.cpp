@@ -0,0 +1,167 @@
+#include "perf_profiler.h"
+#include <cstdio>
+
+using namespace std;
+
+LatencyHistogram::LatencyHistogram(){
+    for (int i = 0 ; i < s_numBuckets ; i++){
+        m_counts[i].store(0, memory_order_relaxed);
+        m_collectedCounts[i] = 0;
+    }
+    m_max.store(0, memory_order_relaxed);
+}
+
+int LatencyHistogram::getBucket(uint64_t a_nanoseconds){
+    const uint64_t linearRange = 1 << s_subBucketBits;
+    if (a_nanoseconds < linearRange){
+        return int(a_nanoseconds);
+    }
+    int exponent = 63 - __builtin_clzll(a_nanoseconds);
+    int subBucket = int(a_nanoseconds >> (exponent - s_subBucketBits)) & (linearRange - 1);
+    return ((exponent - s_subBucketBits + 1) << s_subBucketBits) + subBucket;
+}
+
+double LatencyHistogram::getBucketValue(int a_bucket){
+    const int linearRange = 1 << s_subBucketBits;
+    if (a_bucket < linearRange){
+        return a_bucket;
+    }
+    int exponent = (a_bucket >> s_subBucketBits) + s_subBucketBits - 1;
+    int subBucket = a_bucket & (linearRange - 1);
+    double width = double(uint64_t(1) << (exponent - s_subBucketBits));
+    return (linearRange + subBucket) * width + 0.5 * width;
+}
+
+void LatencyHistogram::record(uint64_t a_nanoseconds){
+    m_counts[getBucket(a_nanoseconds)].fetch_add(1, memory_order_relaxed);
+
+    uint64_t prevMax = m_max.load(memory_order_relaxed);
+    while (a_nanoseconds > prevMax && !m_max.compare_exchange_weak(prevMax, a_nanoseconds, memory_order_relaxed)){
+    }
+}
+
+void LatencyHistogram::collect(PerfStageStats &a_stats){
+    // a record that races with the copy lands in the next window
+    uint64_t* counts = m_windowCounts;
+    uint64_t total = 0;
+    for (int i = 0 ; i < s_numBuckets ; i++){
+        uint64_t count = m_counts[i].load(memory_order_relaxed);
+        counts[i] = count - m_collectedCounts[i];
+        m_collectedCounts[i] = count;
+        total += counts[i];
+    }
+    double maxValue = double(m_max.exchange(0, memory_order_relaxed));
+
+    a_stats.m_count = total;
+    a_stats.m_p50 = 0.0;
+    a_stats.m_p99 = 0.0;
+    a_stats.m_max = maxValue * 1e-3;
+    if (total == 0){
+        return;
+    }
+
+    const uint64_t p50Rank = (total + 1) / 2;
+    const uint64_t p99Rank = total - total / 100;
+    uint64_t cumulative = 0;
+    bool p50Found = false;
+    for (int i = 0 ; i < s_numBuckets ; i++){
+        cumulative += counts[i];
+        if (!p50Found && cumulative >= p50Rank){
+            a_stats.m_p50 = min(getBucketValue(i), maxValue) * 1e-3;
+            p50Found = true;
+        }
+        if (cumulative >= p99Rank){
+            a_stats.m_p99 = min(getBucketValue(i), maxValue) * 1e-3;
+            break;
+        }
+    }
+}
+
+PerfProfiler::PerfProfiler(){
+    m_enabled = false;
+    m_traceCapacity = 0;
+    m_traceCount.store(0, memory_order_relaxed);
+    m_startTime = Clock::now();
+}
+
+void PerfProfiler::init(bool a_enabled, size_t a_traceCapacity){
+    m_enabled = a_enabled;
+    m_startTime = Clock::now();
+    m_traceCapacity = a_enabled ? a_traceCapacity : 0;
+    m_traceCount.store(0, memory_order_relaxed);
+    if (m_traceCapacity > 0){
+        m_traceEvents.reset(new TraceEvent[m_traceCapacity]);
+    }
+    else{
+        m_traceEvents.reset();
+    }
+}
+
+void PerfProfiler::record(PerfStage a_stage, Clock::time_point a_start, Clock::time_point a_end){
+    int64_t duration = chrono::duration_cast<chrono::nanoseconds>(a_end - a_start).count();
+    m_histograms[a_stage].record(duration > 0 ? uint64_t(duration) : 0);
+
+    if (m_traceCapacity > 0){
+        size_t idx = m_traceCount.fetch_add(1, memory_order_relaxed);
+        if (idx < m_traceCapacity){
+            TraceEvent& event = m_traceEvents[idx];
+            event.m_stage = a_stage;
+            event.m_thread = getThreadId();
+            event.m_start = chrono::duration_cast<chrono::nanoseconds>(a_start - m_startTime).count();
+            event.m_duration = duration;
+        }
+    }
+}
+
+void PerfProfiler::collect(vector<PerfStageStats> &a_stats){
+    a_stats.resize(PERF_NUM_STAGES);
+    for (int i = 0 ; i < PERF_NUM_STAGES ; i++){
+        a_stats[i].m_name = getStageName(PerfStage(i));
+        m_histograms[i].collect(a_stats[i]);
+    }
+}
+
+bool PerfProfiler::writeTrace(const string &a_filepath) const{
+    FILE* file = fopen(a_filepath.c_str(), "w");
+    if (!file){
+        return false;
+    }
+
+    size_t count = min(m_traceCount.load(memory_order_acquire), m_traceCapacity);
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t i = 0 ; i < count ; i++){
+        const TraceEvent& event = m_traceEvents[i];
+        fprintf(file, "{\"name\":\"%s\",\"cat\":\"volumetric_drilling\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                getStageName(PerfStage(event.m_stage)), event.m_thread, event.m_start * 1e-3, event.m_duration * 1e-3,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(file, "]}\n");
+    return fclose(file) == 0;
+}
+
+uint64_t PerfProfiler::getTraceDroppedCount() const{
+    size_t count = m_traceCount.load(memory_order_relaxed);
+    return count > m_traceCapacity ? count - m_traceCapacity : 0;
+}
+
+const char* PerfProfiler::getStageName(PerfStage a_stage){
+    switch (a_stage) {
+    case PERF_PHYSICS_UPDATE: return "physics_update";
+    case PERF_HAPTIC_TICK: return "haptic_tick";
+    case PERF_POSE_UPDATE: return "pose_update";
+    case PERF_SHAFT_COLLISION: return "shaft_collision";
+    case PERF_DRILL_POSE: return "drill_pose";
+    case PERF_VOXEL_REMOVAL: return "voxel_removal";
+    case PERF_FORCE_COMPUTATION: return "force_computation";
+    case PERF_APPLY_TO_DEVICE: return "apply_to_device";
+    case PERF_GRAPHICS_UPDATE: return "graphics_update";
+    case PERF_TEXTURE_UPLOAD: return "texture_upload";
+    default: return "unknown";
+    }
+}
+
+int PerfProfiler::getThreadId(){
+    static atomic<int> s_nextThreadId(0);
+    static thread_local int s_threadId = s_nextThreadId.fetch_add(1, memory_order_relaxed);
+    return s_threadId;
+}
@@ -0,0 +1,149 @@
+#ifndef PERF_PROFILER_H
+#define PERF_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+///
+/// \brief The timed stages of the haptic loop, the physics update and the graphics update
+///
+enum PerfStage{
+    PERF_PHYSICS_UPDATE,
+    PERF_HAPTIC_TICK,
+    PERF_POSE_UPDATE,
+    PERF_SHAFT_COLLISION,
+    PERF_DRILL_POSE,
+    PERF_VOXEL_REMOVAL,
+    PERF_FORCE_COMPUTATION,
+    PERF_APPLY_TO_DEVICE,
+    PERF_GRAPHICS_UPDATE,
+    PERF_TEXTURE_UPLOAD,
+    PERF_NUM_STAGES
+};
+
+///
+/// \brief Latency statistics of one stage over a window, in microseconds
+///
+struct PerfStageStats{
+    std::string m_name;
+    uint64_t m_count = 0;
+    double m_p50 = 0.0;
+    double m_p99 = 0.0;
+    double m_max = 0.0;
+};
+
+///
+/// \brief A lock-free histogram of durations. The buckets are log-linear, eight per power of
+/// two, so a percentile is off by at most 12.5%. record() is safe from any thread and never
+/// blocks. collect() must only be called from one thread and returns the statistics of the
+/// durations recorded since its previous call.
+///
+class LatencyHistogram{
+public:
+    LatencyHistogram();
+
+    void record(uint64_t a_nanoseconds);
+
+    void collect(PerfStageStats& a_stats);
+
+private:
+    static const int s_subBucketBits = 3;
+    static const int s_numBuckets = 64 << s_subBucketBits;
+
+    static int getBucket(uint64_t a_nanoseconds);
+
+    // Middle of the range of durations of a bucket, in nanoseconds
+    static double getBucketValue(int a_bucket);
+
+    std::atomic<uint64_t> m_counts[s_numBuckets];
+    std::atomic<uint64_t> m_max;
+
+    // Counts at the previous collect(), owned by the reader
+    uint64_t m_collectedCounts[s_numBuckets];
+    uint64_t m_windowCounts[s_numBuckets];
+};
+
+///
+/// \brief Times the stages of the simulation. Every stage feeds a LatencyHistogram, and with
+/// tracing enabled every timed scope is also stored as a complete event in a preallocated
+/// buffer, which is written in the Chrome trace format (chrome://tracing, Perfetto) on demand.
+/// A disabled profiler doesn't read the clock.
+///
+class PerfProfiler{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    PerfProfiler();
+
+    // A trace capacity of 0 disables the trace
+    void init(bool a_enabled, size_t a_traceCapacity = 0);
+
+    bool isEnabled() const {return m_enabled;}
+
+    bool isTracing() const {return m_traceCapacity > 0;}
+
+    void record(PerfStage a_stage, Clock::time_point a_start, Clock::time_point a_end);
+
+    // Statistics of all the stages since the previous call, only call from one thread
+    void collect(std::vector<PerfStageStats>& a_stats);
+
+    // Writes the traced events as a Chrome trace JSON file. Call once the timed threads are stopped
+    bool writeTrace(const std::string& a_filepath) const;
+
+    // Number of events that didn't fit in the trace buffer
+    uint64_t getTraceDroppedCount() const;
+
+    static const char* getStageName(PerfStage a_stage);
+
+private:
+    struct TraceEvent{
+        int m_stage;
+        int m_thread;
+        int64_t m_start;
+        int64_t m_duration;
+    };
+
+    // A small id per thread that records, for the trace
+    static int getThreadId();
+
+    bool m_enabled;
+    Clock::time_point m_startTime;
+
+    LatencyHistogram m_histograms[PERF_NUM_STAGES];
+
+    std::unique_ptr<TraceEvent[]> m_traceEvents;
+    size_t m_traceCapacity;
+    std::atomic<size_t> m_traceCount;
+};
+
+///
+/// \brief Records the duration of its own scope in a stage of a PerfProfiler
+///
+class PerfScope{
+public:
+    PerfScope(PerfProfiler& a_profiler, PerfStage a_stage): m_profiler(a_profiler), m_stage(a_stage){
+        if (m_profiler.isEnabled()){
+            m_start = PerfProfiler::Clock::now();
+        }
+    }
+
+    ~PerfScope(){
+        if (m_profiler.isEnabled()){
+            m_profiler.record(m_stage, m_start, PerfProfiler::Clock::now());
+        }
+    }
+
+private:
+    PerfScope(const PerfScope&);
+    PerfScope& operator=(const PerfScope&);
+
+    PerfProfiler& m_profiler;
+    PerfStage m_stage;
+    PerfProfiler::Clock::time_point m_start;
+};
+
+#endif // PERF_PROFILER_H
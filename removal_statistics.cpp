@@ -0,0 +1,155 @@
+#include "removal_statistics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+static inline uint32_t packColor(const unsigned char* a_rgb){
+    return uint32_t(a_rgb[0]) | (uint32_t(a_rgb[1]) << 8) | (uint32_t(a_rgb[2]) << 16);
+}
+
+RemovalStatistics::RemovalStatistics(double a_rateWindow){
+    m_rateWindow = a_rateWindow > 0.0 ? a_rateWindow : 1.0;
+    m_usePalette = false;
+    memset(m_colors, 0, sizeof(m_colors));
+    m_entryCount = 1;
+    m_resetRequested = false;
+    reset();
+}
+
+void RemovalStatistics::setPalette(const unsigned char *a_colors){
+    m_usePalette = a_colors != nullptr;
+    if (m_usePalette){
+        memcpy(m_colors, a_colors, sizeof(m_colors));
+        m_entryCount.store(MAX_LABELS, memory_order_release);
+    }
+    else{
+        memset(m_colors, 0, sizeof(m_colors));
+        m_entryCount.store(1, memory_order_release);
+    }
+    reset();
+}
+
+///
+/// \brief This method finds the entry of a voxel. Neighbouring voxels usually share their color,
+/// so the entry of the previous voxel is tried first, then the colors seen so far.
+///
+int RemovalStatistics::getEntry(const unsigned char a_color[4], int a_label){
+    if (m_usePalette){
+        return a_label & (MAX_LABELS - 1);
+    }
+
+    uint32_t color = packColor(a_color);
+    if (m_lastEntry >= 0 && color == m_lastColor){
+        return m_lastEntry;
+    }
+
+    int count = m_entryCount.load(memory_order_relaxed);
+    int entry = 0;
+    for (int i = 1 ; i < count ; i++){
+        if (packColor(&m_colors[4 * i]) == color){
+            entry = i;
+            break;
+        }
+    }
+    if (entry == 0 && count < MAX_LABELS){
+        entry = count;
+        unsigned char* rgba = &m_colors[4 * entry];
+        rgba[0] = a_color[0];
+        rgba[1] = a_color[1];
+        rgba[2] = a_color[2];
+        rgba[3] = 255;
+        m_entryCount.store(count + 1, memory_order_release);
+    }
+
+    m_lastColor = color;
+    m_lastEntry = entry;
+    return entry;
+}
+
+void RemovalStatistics::voxelRemoved(const unsigned char a_color[4], int a_label){
+    std::atomic<int64_t>& removed = m_removed[getEntry(a_color, a_label)];
+    removed.store(removed.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    m_totalRemoved.store(m_totalRemoved.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+void RemovalStatistics::voxelRestored(const unsigned char a_color[4], int a_label){
+    std::atomic<int64_t>& removed = m_removed[getEntry(a_color, a_label)];
+    removed.store(removed.load(memory_order_relaxed) - 1, memory_order_relaxed);
+    m_totalRemoved.store(m_totalRemoved.load(memory_order_relaxed) - 1, memory_order_relaxed);
+}
+
+///
+/// \brief This method updates the removal rate and the contact time. The simulation time only
+/// advances with the physics update, the haptic ticks in between are accumulated until it does.
+/// The rate is an exponential moving average, so it needs no history of the removals.
+///
+void RemovalStatistics::tick(double a_time, bool a_criticalContact){
+    if (m_resetRequested.exchange(false, memory_order_acquire)){
+        reset();
+    }
+
+    m_contactSinceLastTime |= a_criticalContact;
+    int64_t total = m_totalRemoved.load(memory_order_relaxed);
+    if (!m_lastTimeValid){
+        m_lastTime = a_time;
+        m_lastTotalRemoved = total;
+        m_lastTimeValid = true;
+        return;
+    }
+
+    double dt = a_time - m_lastTime;
+    if (dt <= 0.0){
+        return;
+    }
+
+    double rate = m_removalRate.load(memory_order_relaxed);
+    double alpha = 1.0 - exp(-dt / m_rateWindow);
+    rate += alpha * (double(total - m_lastTotalRemoved) / dt - rate);
+    m_removalRate.store(rate, memory_order_relaxed);
+
+    if (m_contactSinceLastTime){
+        m_criticalContactTime.store(m_criticalContactTime.load(memory_order_relaxed) + dt, memory_order_relaxed);
+    }
+
+    m_lastTime = a_time;
+    m_lastTotalRemoved = total;
+    m_contactSinceLastTime = false;
+}
+
+void RemovalStatistics::reset(){
+    for (int i = 0 ; i < MAX_LABELS ; i++){
+        m_removed[i].store(0, memory_order_relaxed);
+    }
+    m_totalRemoved.store(0, memory_order_relaxed);
+    m_removalRate.store(0.0, memory_order_relaxed);
+    m_criticalContactTime.store(0.0, memory_order_relaxed);
+    m_lastColor = 0;
+    m_lastEntry = -1;
+    m_lastTime = 0.0;
+    m_lastTimeValid = false;
+    m_lastTotalRemoved = 0;
+    m_contactSinceLastTime = false;
+}
+
+void RemovalStatistics::collect(RemovalSummary &a_summary) const{
+    a_summary.m_labels.clear();
+    a_summary.m_colors.clear();
+    a_summary.m_removed.clear();
+
+    int count = m_entryCount.load(memory_order_acquire);
+    for (int i = 0 ; i < count ; i++){
+        int64_t removed = m_removed[i].load(memory_order_relaxed);
+        if (removed <= 0){
+            continue;
+        }
+        a_summary.m_labels.push_back(uint8_t(i));
+        a_summary.m_colors.insert(a_summary.m_colors.end(), &m_colors[4 * i], &m_colors[4 * i] + 4);
+        a_summary.m_removed.push_back(uint64_t(removed));
+    }
+    int64_t total = m_totalRemoved.load(memory_order_relaxed);
+    a_summary.m_totalRemoved = total > 0 ? uint64_t(total) : 0;
+    a_summary.m_removalRate = max(m_removalRate.load(memory_order_relaxed), 0.0);
+    a_summary.m_criticalContactTime = m_criticalContactTime.load(memory_order_relaxed);
+}
@@ -0,0 +1,87 @@
+#ifndef REMOVAL_STATISTICS_H
+#define REMOVAL_STATISTICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+///
+/// \brief Summary of the drilling read by the graphics thread: the voxels removed per label,
+/// how fast they are removed and for how long the burr was in contact with a critical structure
+///
+struct RemovalSummary{
+    // label of each entry, the palette label in a labeled volume, the index of the color in
+    // the order it was first removed otherwise
+    std::vector<uint8_t> m_labels;
+    // RGBA color of each entry
+    std::vector<uint8_t> m_colors;
+    std::vector<uint64_t> m_removed;
+    uint64_t m_totalRemoved = 0;
+    // voxels per second, averaged over the rate window
+    double m_removalRate = 0.0;
+    // seconds of simulation time
+    double m_criticalContactTime = 0.0;
+};
+
+///
+/// \brief Lock-free counters of the removed voxels, updated by the removal loop. Only the haptic
+/// loop writes them, any other thread may collect a summary at any time without blocking it.
+/// The voxels of an RGBA volume are counted by color, the first 255 distinct colors each get an
+/// entry and the others are counted in entry 0. The restored voxels are subtracted, so the counts
+/// are those of the voxels missing from the volume.
+///
+class RemovalStatistics{
+public:
+    static const int MAX_LABELS = 256;
+
+    // The removal rate is averaged over a_rateWindow seconds of simulation time
+    RemovalStatistics(double a_rateWindow = 1.0);
+
+    // The colors of the labels of a labeled volume, MAX_LABELS RGBA colors, or nullptr to count
+    // the voxels of an RGBA volume by color. Call before the haptic loop starts
+    void setPalette(const unsigned char* a_colors);
+
+    // Called by the haptic loop for every removed and restored voxel, a_label is only used in a
+    // labeled volume
+    void voxelRemoved(const unsigned char a_color[4], int a_label);
+    void voxelRestored(const unsigned char a_color[4], int a_label);
+
+    // Called by the haptic loop once per tick, a_criticalContact if the burr touched a critical
+    // structure in the tick
+    void tick(double a_time, bool a_criticalContact);
+
+    // Clears the counters at the next tick, e.g. once the volume was reset. Safe from any thread
+    void requestReset() {m_resetRequested.store(true, std::memory_order_release);}
+
+    // Copies the current counters, the entries without any removed voxel are skipped
+    void collect(RemovalSummary& a_summary) const;
+
+private:
+    int getEntry(const unsigned char a_color[4], int a_label);
+
+    void reset();
+
+    double m_rateWindow;
+    bool m_usePalette;
+
+    // RGBA colors of the entries, written before the entry count is published
+    unsigned char m_colors[4 * MAX_LABELS];
+    std::atomic<int> m_entryCount;
+
+    // written by the haptic loop only, so they are updated with plain loads and stores
+    std::atomic<int64_t> m_removed[MAX_LABELS];
+    std::atomic<int64_t> m_totalRemoved;
+    std::atomic<double> m_removalRate;
+    std::atomic<double> m_criticalContactTime;
+    std::atomic<bool> m_resetRequested;
+
+    // owned by the haptic loop
+    uint32_t m_lastColor;
+    int m_lastEntry;
+    double m_lastTime;
+    bool m_lastTimeValid;
+    int64_t m_lastTotalRemoved;
+    bool m_contactSinceLastTime;
+};
+
+#endif // REMOVAL_STATISTICS_H
@@ -0,0 +1,174 @@
+#include "render_quality.h"
+#include <algorithm>
+
+using namespace std;
+
+GpuFrameTimer::GpuFrameTimer(){
+    for (int i = 0 ; i < s_numQueries ; i++){
+        m_beginQueries[i] = 0;
+        m_endQueries[i] = 0;
+        m_pending[i] = false;
+    }
+    m_current = 0;
+    m_active = false;
+    m_endMarked = false;
+    m_created = false;
+    m_lastFrameTime = -1.0;
+}
+
+void GpuFrameTimer::beginFrame(){
+    if (!m_created){
+        glGenQueries(s_numQueries, m_beginQueries);
+        glGenQueries(s_numQueries, m_endQueries);
+        m_created = true;
+    }
+
+    // a frame in which the volume wasn't rendered isn't measured, its pair is reused
+    if (m_active && m_endMarked){
+        m_pending[m_current] = true;
+        m_current = (m_current + 1) % s_numQueries;
+    }
+    m_active = false;
+    m_endMarked = false;
+
+    // read the results in the order the queries were issued, stop at the first one not ready
+    for (int i = 0 ; i < s_numQueries ; i++){
+        int idx = (m_current + i) % s_numQueries;
+        if (!m_pending[idx]){
+            continue;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(m_endQueries[idx], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available){
+            break;
+        }
+        GLuint64 beginTime = 0;
+        GLuint64 endTime = 0;
+        glGetQueryObjectui64v(m_beginQueries[idx], GL_QUERY_RESULT, &beginTime);
+        glGetQueryObjectui64v(m_endQueries[idx], GL_QUERY_RESULT, &endTime);
+        m_lastFrameTime = endTime > beginTime ? double(endTime - beginTime) * 1e-9 : 0.0;
+        m_pending[idx] = false;
+    }
+
+    // all the queries are still in flight, skip measuring this frame rather than waiting
+    if (m_pending[m_current]){
+        return;
+    }
+
+    glQueryCounter(m_beginQueries[m_current], GL_TIMESTAMP);
+    m_active = true;
+}
+
+void GpuFrameTimer::markFrameEnd(){
+    if (!m_active){
+        return;
+    }
+    glQueryCounter(m_endQueries[m_current], GL_TIMESTAMP);
+    m_endMarked = true;
+}
+
+void GpuFrameTimer::destroy(){
+    if (!m_created){
+        return;
+    }
+    glDeleteQueries(s_numQueries, m_beginQueries);
+    glDeleteQueries(s_numQueries, m_endQueries);
+    for (int i = 0 ; i < s_numQueries ; i++){
+        m_beginQueries[i] = 0;
+        m_endQueries[i] = 0;
+        m_pending[i] = false;
+    }
+    m_active = false;
+    m_endMarked = false;
+    m_created = false;
+}
+
+RenderQualityController::RenderQualityController(){
+    m_targetFrameTime = 0.0;
+    m_maxQuality = 1.0;
+    m_maxSmoothingLevel = 1;
+    m_quality = 1.0;
+    m_smoothingLevel = 1;
+    m_frameInterval = -1.0;
+    m_gpuFrameTime = -1.0;
+    m_framesSinceChange = 0;
+}
+
+void RenderQualityController::init(double a_targetFrameRate, double a_maxQuality, int a_maxSmoothingLevel){
+    m_targetFrameTime = a_targetFrameRate > 0.0 ? 1.0 / a_targetFrameRate : 0.0;
+    m_maxQuality = a_maxQuality;
+    m_maxSmoothingLevel = max(a_maxSmoothingLevel, 1);
+    m_quality = m_maxQuality;
+    m_smoothingLevel = m_maxSmoothingLevel;
+    m_frameInterval = -1.0;
+    m_gpuFrameTime = -1.0;
+    m_framesSinceChange = 0;
+}
+
+void RenderQualityController::setMaxQuality(double a_quality){
+    m_maxQuality = a_quality;
+    m_quality = min(m_quality, m_maxQuality);
+}
+
+void RenderQualityController::setMaxSmoothingLevel(int a_level){
+    m_maxSmoothingLevel = max(a_level, 1);
+    m_smoothingLevel = min(m_smoothingLevel, m_maxSmoothingLevel);
+}
+
+bool RenderQualityController::update(double a_frameInterval, double a_gpuFrameTime, bool a_fastMotion){
+    if (!isEnabled() || a_frameInterval <= 0.0){
+        return false;
+    }
+
+    const double alpha = 0.25;
+    m_frameInterval = m_frameInterval < 0.0 ? a_frameInterval : m_frameInterval + alpha * (a_frameInterval - m_frameInterval);
+    if (a_gpuFrameTime >= 0.0){
+        m_gpuFrameTime = m_gpuFrameTime < 0.0 ? a_gpuFrameTime : m_gpuFrameTime + alpha * (a_gpuFrameTime - m_gpuFrameTime);
+    }
+
+    double minQuality = m_maxQuality * m_minQualityScale;
+    double qualityCap = a_fastMotion ? max(m_maxQuality * m_motionQualityScale, minQuality) : m_maxQuality;
+    int smoothingCap = a_fastMotion ? 1 : m_maxSmoothingLevel;
+
+    double prevQuality = m_quality;
+    int prevSmoothingLevel = m_smoothingLevel;
+
+    // the motion caps apply right away
+    m_quality = min(m_quality, qualityCap);
+    m_smoothingLevel = min(m_smoothingLevel, smoothingCap);
+
+    if (++m_framesSinceChange >= m_settleFrames){
+        // The frame interval shows the missed frames, and the GPU time, which stops before
+        // the swap, shows the headroom even when the interval is held at the target by the
+        // vertical sync
+        double load = m_gpuFrameTime >= 0.0 ? m_gpuFrameTime : m_frameInterval;
+
+        if (m_frameInterval > 1.1 * m_targetFrameTime || load > 0.95 * m_targetFrameTime){
+            if (m_smoothingLevel > 1){
+                m_smoothingLevel--;
+            }
+            else{
+                // the cost of the ray march is roughly proportional to its resolution
+                double scale = min(max(0.75, 0.9 * m_targetFrameTime / max(m_frameInterval, load)), 0.95);
+                m_quality = max(m_quality * scale, minQuality);
+            }
+        }
+        else if (load < 0.7 * m_targetFrameTime && m_frameInterval < 1.05 * m_targetFrameTime){
+            if (m_quality < qualityCap){
+                m_quality = min(m_quality + 0.02 * m_maxQuality, qualityCap);
+            }
+            else if (m_smoothingLevel < smoothingCap){
+                m_smoothingLevel++;
+            }
+        }
+    }
+
+    bool changed = m_quality != prevQuality || m_smoothingLevel != prevSmoothingLevel;
+    if (changed){
+        // average the measurements of the new settings only
+        m_framesSinceChange = 0;
+        m_frameInterval = -1.0;
+        m_gpuFrameTime = -1.0;
+    }
+    return changed;
+}
@@ -0,0 +1,117 @@
+#ifndef RENDER_QUALITY_H
+#define RENDER_QUALITY_H
+
+#include <chai3d.h>
+
+///
+/// \brief Measures the GPU time of the rendering of a frame with a ring of GL_TIMESTAMP query
+/// pairs, from the graphics update that starts the frame to the last draw of the volume, so
+/// the swap and the wait for the vertical sync aren't part of it. The results are read a few
+/// frames later, once they are available, so the measurement never stalls the pipeline.
+///
+class GpuFrameTimer{
+public:
+    GpuFrameTimer();
+
+    // Stores the timestamps of the previous frame and starts the next one, before the cameras
+    // render. Needs a current GL context
+    void beginFrame();
+
+    // Marks the end of the work of the frame, the last mark before the next beginFrame() is
+    // the one measured. Needs a current GL context
+    void markFrameEnd();
+
+    // Deletes the queries. Needs a current GL context
+    void destroy();
+
+    // GPU time of the latest measured frame in seconds, negative until the first result
+    double getLastFrameTime() const {return m_lastFrameTime;}
+
+private:
+    static const int s_numQueries = 4;
+
+    GLuint m_beginQueries[s_numQueries];
+    GLuint m_endQueries[s_numQueries];
+    bool m_pending[s_numQueries];
+    // Index of the query pair that is started next, which is also the oldest pending one
+    int m_current;
+    bool m_active;
+    bool m_endMarked;
+    bool m_created;
+    double m_lastFrameTime;
+};
+
+///
+/// \brief An empty object of the scene graph that marks the end of the frame of a GpuFrameTimer
+/// when it renders. As a child of the volume, it renders right after the volume in each pass
+/// of each camera.
+///
+class GpuFrameEndMarker: public chai3d::cGenericObject{
+public:
+    GpuFrameEndMarker(GpuFrameTimer* a_timer) {m_timer = a_timer;}
+
+protected:
+    virtual void render(chai3d::cRenderOptions& a_options) {m_timer->markFrameEnd();}
+
+private:
+    GpuFrameTimer* m_timer;
+};
+
+///
+/// \brief Adjusts the ray marching quality and the smoothing level of the volume to hold a
+/// target frame rate. The smoothing level, whose cost grows with its cube, is lowered first
+/// and raised last. While the drill moves fast the quality is capped to a fraction of the
+/// maximum, and it climbs back to the maximum once the drill is still and there is headroom.
+///
+class RenderQualityController{
+public:
+    RenderQualityController();
+
+    // A target frame rate of 0 disables the controller
+    void init(double a_targetFrameRate, double a_maxQuality, int a_maxSmoothingLevel);
+
+    bool isEnabled() const {return m_targetFrameTime > 0.0;}
+
+    // Quality and smoothing level set by the user, the controller never goes above them
+    void setMaxQuality(double a_quality);
+    void setMaxSmoothingLevel(int a_level);
+
+    // Feeds the measurements of the last frame, negative GPU times are ignored.
+    // Returns true if the quality or the smoothing level changed
+    bool update(double a_frameInterval, double a_gpuFrameTime, bool a_fastMotion);
+
+    double getQuality() const {return m_quality;}
+
+    double getMaxQuality() const {return m_maxQuality;}
+
+    int getSmoothingLevel() const {return m_smoothingLevel;}
+
+    double getAverageFrameInterval() const {return m_frameInterval;}
+
+    double getAverageGpuFrameTime() const {return m_gpuFrameTime;}
+
+    // Lowest quality, as a fraction of the maximum
+    double m_minQualityScale = 0.25;
+
+    // Cap of the quality while the drill moves fast, as a fraction of the maximum
+    double m_motionQualityScale = 0.6;
+
+    // Frames to wait after a change for the measurements to settle
+    int m_settleFrames = 8;
+
+private:
+    double m_targetFrameTime;
+    double m_maxQuality;
+    int m_maxSmoothingLevel;
+
+    double m_quality;
+    int m_smoothingLevel;
+
+    // Exponential moving averages of the measurements, negative until the first one
+    double m_frameInterval;
+    double m_gpuFrameTime;
+
+    int m_framesSinceChange;
+};
+
+#endif // RENDER_QUALITY_H
@@ -25,7 +25,7 @@ from cv_bridge import CvBridge, CvBridgeError
 from sensor_msgs.msg import Image, PointCloud2
 
 try:
-    from vdrilling_msgs.msg import points, UInt8Stamped, VolumeProp
+    from vdrilling_msgs.msg import points, UInt8Stamped, VolumeProp, VoxelsRemoved
 except ImportError:
     print("\nvdrilling_msgs.msg: cannot open shared message file. " +
           "Please source <volumetric_plugin_path>/vdrilling_msgs/build/devel/setup.bash \n")
@@ -248,6 +248,19 @@ def rm_vox_callback(rm_vox_msg):
     collisions['voxel_color'].append(int_vox_color)
 
 
+def rm_vox_batch_callback(rm_vox_batch_msg):
+    time_stamp = rm_vox_batch_msg.header.stamp.to_sec()
+    # uint8[] is deserialized as bytes, the labels are 0 for an RGBA volume
+    labels = bytearray(rm_vox_batch_msg.voxel_label)
+    if len(labels) != len(rm_vox_batch_msg.voxel_removed):
+        labels = bytearray(len(rm_vox_batch_msg.voxel_removed))
+    for voxel, color, label in zip(rm_vox_batch_msg.voxel_removed, rm_vox_batch_msg.voxel_color, labels):
+        collisions['time_stamp'].append(time_stamp)
+        collisions['voxel_removed'].append([voxel.x, voxel.y, voxel.z])
+        collisions['voxel_color'].append([round(elem * 255) for elem in [color.r, color.g, color.b, color.a]])
+        collisions['voxel_label'].append(label)
+
+
 def burr_change_callback(burr_change_msg):
     global burr_change
     burr_change['time_stamp'].append(burr_change_msg.header.stamp.to_sec())
@@ -321,6 +334,17 @@ def setup_subscriber(args):
             log.log(logging.CRITICAL, "CRITICAL! Failed to subscribe to " + args.rm_vox_topic)
             exit()
 
+    if args.rm_vox_batch_topic != 'None':
+        if args.rm_vox_batch_topic in active_topics:
+            rospy.Subscriber(args.rm_vox_batch_topic, VoxelsRemoved, rm_vox_batch_callback, queue_size=100)
+            collisions['time_stamp'] = []
+            collisions['voxel_removed'] = []
+            collisions['voxel_color'] = []
+            collisions['voxel_label'] = []
+        else:
+            log.log(logging.CRITICAL, "CRITICAL! Failed to subscribe to " + args.rm_vox_batch_topic)
+            exit()
+
     if args.burr_change_topic != 'None':
         if args.burr_change_topic in active_topics:
             rospy.Subscriber(args.burr_change_topic, UInt8Stamped, burr_change_callback)
@@ -418,8 +442,11 @@ if __name__ == '__main__':
         '--stereoR_topic', default='/ambf/env/cameras/stereoR/ImageData', type=str)
     parser.add_argument(
         '--segm_topic', default='/ambf/env/cameras/segmentation_camera/ImageData', type=str)
+    # The per-voxel topic is only published when the plugin is launched with --pvt true
+    parser.add_argument(
+        '--rm_vox_topic', default='None', type=str)
     parser.add_argument(
-        '--rm_vox_topic', default='/ambf/volumetric_drilling/voxels_removed', type=str)
+        '--rm_vox_batch_topic', default='/ambf/volumetric_drilling/voxels_removed_batch', type=str)
     parser.add_argument(
         '--burr_change_topic', default='/ambf/volumetric_drilling/burr_change', type=str)
     parser.add_argument(
@@ -0,0 +1,99 @@
+"""
+Reader of the volume exported by the plugin with --shm <name>. The segment is mapped read
+only, a snapshot is a copy taken between two reads of the sequence of the header, which is
+odd while the plugin writes. After a first snapshot, update() only copies the bricks changed
+since, so following the drilling costs the size of the drilled bricks rather than the volume.
+
+    volume = SharedVolume('/volumetric_drilling')
+    generation, voxels = volume.snapshot()
+    while True:
+        generation = volume.update(voxels, generation)
+"""
+
+import mmap
+import struct
+import time
+
+import numpy as np
+
+HEADER = struct.Struct('<8sIIQQd3III3IQQQQQ')
+MAGIC = b'VDRILSHM'
+VERSION = 1
+SEQUENCE_OFFSET = 16
+
+
+class SharedVolume:
+    def __init__(self, name='/volumetric_drilling'):
+        self._file = open('/dev/shm/' + name.lstrip('/'), 'rb')
+        self._map = mmap.mmap(self._file.fileno(), 0, access=mmap.ACCESS_READ)
+
+        fields = HEADER.unpack_from(self._map, 0)
+        if fields[0] != MAGIC or fields[1] != VERSION:
+            raise ValueError(name + ' is not a volume of this version')
+        self.voxel_count = fields[6:9]
+        self.bytes_per_voxel = fields[9]
+        self.brick_size = fields[10]
+        self.brick_count = fields[11:14]
+        data_offset, generation_offset, _, palette_offset, _ = fields[14:19]
+
+        x, y, z = self.voxel_count
+        bx, by, bz = self.brick_count
+        self._voxels = np.frombuffer(self._map, dtype=np.uint8, count=x * y * z * self.bytes_per_voxel,
+                                     offset=data_offset).reshape([z, y, x, self.bytes_per_voxel])
+        self._brick_generations = np.frombuffer(self._map, dtype=np.uint64, count=bx * by * bz,
+                                                offset=generation_offset).reshape([bz, by, bx])
+        self._palette = np.frombuffer(self._map, dtype=np.uint8, count=256 * 4, offset=palette_offset).reshape([256, 4])
+
+    def close(self):
+        self._voxels = None
+        self._brick_generations = None
+        self._palette = None
+        self._map.close()
+        self._file.close()
+
+    def _sequence(self):
+        return struct.unpack_from('<Q', self._map, SEQUENCE_OFFSET)[0]
+
+    def _read(self, copy, retries):
+        for _ in range(retries):
+            begin = self._sequence()
+            if begin & 1:
+                time.sleep(0)
+                continue
+            generation, sim_time = struct.unpack_from('<Qd', self._map, SEQUENCE_OFFSET + 8)
+            result = copy(generation)
+            if self._sequence() == begin:
+                return generation, sim_time, result
+        raise RuntimeError('the volume kept changing during %d reads' % retries)
+
+    def snapshot(self, retries=1000):
+        """
+        :return: the generation and a copy of the voxels, z, y, x, bytes per voxel
+        """
+        generation, _, voxels = self._read(lambda _: self._voxels.copy(), retries)
+        return generation, voxels
+
+    def update(self, voxels, generation, retries=1000):
+        """
+        Copies the bricks changed since a generation to a snapshot
+        :return: the generation of the snapshot
+        """
+        def copy(_):
+            changed = np.argwhere(self._brick_generations > generation)
+            s = self.brick_size
+            for bz, by, bx in changed:
+                region = (slice(bz * s, (bz + 1) * s), slice(by * s, (by + 1) * s), slice(bx * s, (bx + 1) * s))
+                voxels[region] = self._voxels[region]
+            return None
+
+        new_generation, _, _ = self._read(copy, retries)
+        return new_generation
+
+    def sim_time(self):
+        return self._read(lambda _: None, 1000)[1]
+
+    def palette(self):
+        """
+        :return: the 256 RGBA colors of the labels of a labeled volume, zero for an RGBA one
+        """
+        return self._palette.copy()
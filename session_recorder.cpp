@@ -0,0 +1,424 @@
+#include "session_recorder.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#ifdef VOLUMETRIC_DRILLING_HDF5
+#include <hdf5.h>
+#endif
+
+using namespace std;
+
+// removed voxels appended to the datasets at once
+static const size_t s_voxelBatchSize = 65536;
+
+#ifdef VOLUMETRIC_DRILLING_HDF5
+
+// rows per chunk of the voxel and pose datasets, the frames are chunked one frame at a time
+static const hsize_t s_chunkRows = 4096;
+
+///
+/// \brief A dataset of rows of a fixed shape that grows along its first dimension
+///
+class ChunkedDataset{
+public:
+    ChunkedDataset(): m_dataset(-1), m_type(-1), m_rows(0) {}
+
+    bool create(hid_t a_group, const char* a_name, hid_t a_type, const vector<hsize_t>& a_rowDims, hsize_t a_chunkRows, int a_deflateLevel){
+        m_type = a_type;
+        m_rowDims = a_rowDims;
+        m_rows = 0;
+
+        vector<hsize_t> dims(1, 0), maxDims(1, H5S_UNLIMITED), chunk(1, a_chunkRows);
+        dims.insert(dims.end(), a_rowDims.begin(), a_rowDims.end());
+        maxDims.insert(maxDims.end(), a_rowDims.begin(), a_rowDims.end());
+        chunk.insert(chunk.end(), a_rowDims.begin(), a_rowDims.end());
+
+        hid_t space = H5Screate_simple(int(dims.size()), dims.data(), maxDims.data());
+        hid_t properties = H5Pcreate(H5P_DATASET_CREATE);
+        H5Pset_chunk(properties, int(chunk.size()), chunk.data());
+        if (a_deflateLevel > 0){
+            H5Pset_shuffle(properties);
+            H5Pset_deflate(properties, unsigned(a_deflateLevel));
+        }
+        m_dataset = H5Dcreate2(a_group, a_name, a_type, space, H5P_DEFAULT, properties, H5P_DEFAULT);
+        H5Pclose(properties);
+        H5Sclose(space);
+        return m_dataset >= 0;
+    }
+
+    bool append(const void* a_data, size_t a_rows){
+        if (a_rows == 0){
+            return true;
+        }
+        vector<hsize_t> dims(1, m_rows + a_rows), start(1, m_rows), count(1, a_rows);
+        dims.insert(dims.end(), m_rowDims.begin(), m_rowDims.end());
+        start.insert(start.end(), m_rowDims.size(), 0);
+        count.insert(count.end(), m_rowDims.begin(), m_rowDims.end());
+
+        if (H5Dset_extent(m_dataset, dims.data()) < 0){
+            return false;
+        }
+        hid_t fileSpace = H5Dget_space(m_dataset);
+        H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, start.data(), NULL, count.data(), NULL);
+        hid_t memorySpace = H5Screate_simple(int(count.size()), count.data(), NULL);
+        herr_t status = H5Dwrite(m_dataset, m_type, memorySpace, fileSpace, H5P_DEFAULT, a_data);
+        H5Sclose(memorySpace);
+        H5Sclose(fileSpace);
+        m_rows += a_rows;
+        return status >= 0;
+    }
+
+    void close(){
+        if (m_dataset >= 0){
+            H5Dclose(m_dataset);
+            m_dataset = -1;
+        }
+    }
+
+private:
+    hid_t m_dataset;
+    hid_t m_type;
+    vector<hsize_t> m_rowDims;
+    hsize_t m_rows;
+};
+
+struct SessionFile{
+    hid_t m_file = -1;
+    vector<hid_t> m_groups;
+
+    ChunkedDataset m_time;
+    vector<ChunkedDataset> m_streams;
+    vector<ChunkedDataset> m_poses;
+
+    ChunkedDataset m_voxelTime;
+    ChunkedDataset m_voxelRemoved;
+    ChunkedDataset m_voxelColor;
+    ChunkedDataset m_voxelLabel;
+
+    ChunkedDataset m_burrTime;
+    ChunkedDataset m_burrSize;
+
+    ~SessionFile(){
+        m_time.close();
+        for (size_t i = 0 ; i < m_streams.size() ; i++){
+            m_streams[i].close();
+        }
+        for (size_t i = 0 ; i < m_poses.size() ; i++){
+            m_poses[i].close();
+        }
+        m_voxelTime.close();
+        m_voxelRemoved.close();
+        m_voxelColor.close();
+        m_voxelLabel.close();
+        m_burrTime.close();
+        m_burrSize.close();
+        for (size_t i = 0 ; i < m_groups.size() ; i++){
+            H5Gclose(m_groups[i]);
+        }
+        if (m_file >= 0){
+            H5Fclose(m_file);
+        }
+    }
+
+    hid_t createGroup(const char* a_name){
+        hid_t group = H5Gcreate2(m_file, a_name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        if (group >= 0){
+            m_groups.push_back(group);
+        }
+        return group;
+    }
+};
+
+#else
+
+struct SessionFile{
+};
+
+#endif
+
+SessionRecorder::SessionRecorder(size_t a_voxelCapacity, size_t a_frameCount):
+    m_freeFrames(a_frameCount), m_frames(a_frameCount), m_voxels(a_voxelCapacity), m_burrChanges(1024){
+    for (size_t i = 0 ; i < a_frameCount ; i++){
+        m_framePool.push_back(unique_ptr<SessionFrame>(new SessionFrame()));
+    }
+    m_voxelBatch.resize(s_voxelBatchSize);
+    m_metersPerUnit = 1.0;
+    m_recording.store(false);
+    m_running.store(false);
+    m_writtenFrameCount.store(0);
+    m_writtenVoxelCount.store(0);
+    m_droppedVoxelCount.store(0);
+}
+
+SessionRecorder::~SessionRecorder(){
+    stop();
+}
+
+///
+/// \brief This method creates the file with the groups and datasets of scripts/data_record.py.
+/// The frame pool is sized for the streams here, so that the graphics thread never allocates.
+///
+bool SessionRecorder::start(const string &a_filepath, const vector<FrameStreamDesc> &a_streams, const vector<string> &a_poseNames,
+                            double a_metersPerUnit, double a_voxelVolume){
+    stop();
+
+#ifdef VOLUMETRIC_DRILLING_HDF5
+    unique_ptr<SessionFile> file(new SessionFile());
+    file->m_file = H5Fcreate(a_filepath.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (file->m_file < 0){
+        cerr << "ERROR! FAILED TO CREATE SESSION FILE " << a_filepath << endl;
+        return false;
+    }
+
+    hid_t metadata = file->createGroup("metadata");
+    hid_t data = file->createGroup("data");
+    hid_t voxelsRemoved = file->createGroup("voxels_removed");
+    hid_t burrChange = file->createGroup("burr_change");
+    bool valid = metadata >= 0 && data >= 0 && voxelsRemoved >= 0 && burrChange >= 0;
+
+    // the volume of a voxel in mm^3, as the python recorder stores it
+    if (valid){
+        hid_t space = H5Screate(H5S_SCALAR);
+        hid_t dataset = H5Dcreate2(metadata, "voxel_volume", H5T_NATIVE_DOUBLE, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        valid = dataset >= 0 && H5Dwrite(dataset, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &a_voxelVolume) >= 0;
+        if (dataset >= 0){
+            H5Dclose(dataset);
+        }
+        H5Sclose(space);
+    }
+
+    valid = valid && file->m_time.create(data, "time", H5T_NATIVE_DOUBLE, {}, s_chunkRows, 0);
+    file->m_streams.resize(a_streams.size());
+    for (size_t i = 0 ; valid && i < a_streams.size() ; i++){
+        const FrameStreamDesc& stream = a_streams[i];
+        if (stream.m_depth){
+            valid = file->m_streams[i].create(data, stream.m_name.c_str(), H5T_NATIVE_FLOAT,
+                                              {hsize_t(stream.m_height), hsize_t(stream.m_width)}, 1, 1);
+        }
+        else{
+            valid = file->m_streams[i].create(data, stream.m_name.c_str(), H5T_NATIVE_UINT8,
+                                              {hsize_t(stream.m_height), hsize_t(stream.m_width), 3}, 1, 1);
+        }
+    }
+    file->m_poses.resize(a_poseNames.size());
+    for (size_t i = 0 ; valid && i < a_poseNames.size() ; i++){
+        valid = file->m_poses[i].create(data, ("pose_" + a_poseNames[i]).c_str(), H5T_NATIVE_DOUBLE, {7}, s_chunkRows, 0);
+    }
+
+    valid = valid && file->m_voxelTime.create(voxelsRemoved, "time_stamp", H5T_NATIVE_DOUBLE, {}, s_chunkRows, 1) &&
+            file->m_voxelRemoved.create(voxelsRemoved, "voxel_removed", H5T_NATIVE_INT32, {3}, s_chunkRows, 1) &&
+            file->m_voxelColor.create(voxelsRemoved, "voxel_color", H5T_NATIVE_UINT8, {4}, s_chunkRows, 1) &&
+            file->m_voxelLabel.create(voxelsRemoved, "voxel_label", H5T_NATIVE_UINT8, {}, s_chunkRows, 1) &&
+            file->m_burrTime.create(burrChange, "time_stamp", H5T_NATIVE_DOUBLE, {}, 256, 0) &&
+            file->m_burrSize.create(burrChange, "burr_size", H5T_NATIVE_DOUBLE, {}, 256, 0);
+    if (!valid){
+        cerr << "ERROR! FAILED TO CREATE THE DATASETS OF SESSION FILE " << a_filepath << endl;
+        return false;
+    }
+    m_file = move(file);
+#else
+    cerr << "ERROR! THE PLUGIN WAS BUILT WITHOUT HDF5, CAN'T RECORD THE SESSION TO " << a_filepath << endl;
+    return false;
+#endif
+
+    m_streams = a_streams;
+    m_poseNames = a_poseNames;
+    m_metersPerUnit = a_metersPerUnit;
+
+    size_t frameSize = 0;
+    for (size_t i = 0 ; i < m_streams.size() ; i++){
+        frameSize += m_streams[i].getSize();
+    }
+
+    // items pushed after the previous recording stopped belong to neither recording
+    SessionFrame* frame;
+    while (m_frames.pop(frame)){
+    }
+    while (m_freeFrames.pop(frame)){
+    }
+    SessionVoxel voxel;
+    while (m_voxels.pop(voxel)){
+    }
+    SessionBurrChange staleBurrChange;
+    while (m_burrChanges.pop(staleBurrChange)){
+    }
+    for (size_t i = 0 ; i < m_framePool.size() ; i++){
+        m_framePool[i]->m_data.resize(frameSize);
+        m_framePool[i]->m_poses.resize(m_poseNames.size());
+        m_freeFrames.push(m_framePool[i].get());
+    }
+
+    m_filepath = a_filepath;
+    m_writtenFrameCount.store(0);
+    m_writtenVoxelCount.store(0);
+    m_droppedVoxelCount.store(0);
+    m_running.store(true);
+    m_writerThread = thread(&SessionRecorder::writerLoop, this);
+    m_recording.store(true, memory_order_release);
+    return true;
+}
+
+void SessionRecorder::stop(){
+    m_recording.store(false, memory_order_release);
+    if (m_writerThread.joinable()){
+        m_running.store(false);
+        m_writerThread.join();
+    }
+    m_file.reset();
+}
+
+SessionFrame *SessionRecorder::acquireFrame(){
+    SessionFrame* frame = NULL;
+    if (!m_recording.load(memory_order_relaxed)){
+        return NULL;
+    }
+    return m_freeFrames.pop(frame) ? frame : NULL;
+}
+
+void SessionRecorder::pushFrame(SessionFrame *a_frame){
+    m_frames.push(a_frame);
+}
+
+void SessionRecorder::recordVoxel(double a_time, int a_x, int a_y, int a_z, const unsigned char a_color[4], int a_label){
+    if (!m_recording.load(memory_order_relaxed)){
+        return;
+    }
+    SessionVoxel voxel;
+    voxel.m_time = a_time;
+    voxel.m_voxel[0] = a_x;
+    voxel.m_voxel[1] = a_y;
+    voxel.m_voxel[2] = a_z;
+    memcpy(voxel.m_color, a_color, sizeof(voxel.m_color));
+    voxel.m_label = uint8_t(a_label);
+    if (!m_voxels.push(voxel)){
+        m_droppedVoxelCount.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+void SessionRecorder::recordBurrChange(double a_time, double a_burrSize){
+    if (!m_recording.load(memory_order_relaxed)){
+        return;
+    }
+    SessionBurrChange burrChange;
+    burrChange.m_time = a_time;
+    burrChange.m_burrSize = a_burrSize;
+    m_burrChanges.push(burrChange);
+}
+
+///
+/// \brief Runs on the writer thread. Appends the queues to the file, and flushes what is left
+/// once the recording is stopped.
+///
+void SessionRecorder::writerLoop(){
+    while (true){
+        // Read the flag before flushing so that nothing pushed before stop() is missed
+        bool running = m_running.load();
+        if (!flush()){
+            cerr << "ERROR! FAILED TO WRITE SESSION FILE " << m_filepath << ", RECORDING STOPPED" << endl;
+            m_recording.store(false, memory_order_release);
+            return;
+        }
+        if (!running){
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(5));
+    }
+}
+
+bool SessionRecorder::flush(){
+#ifdef VOLUMETRIC_DRILLING_HDF5
+    SessionFrame* frame;
+    while (m_frames.pop(frame)){
+        bool written = writeFrame(*frame);
+        m_freeFrames.push(frame);
+        if (!written){
+            return false;
+        }
+        m_writtenFrameCount.fetch_add(1, memory_order_relaxed);
+    }
+
+    while (true){
+        size_t count = 0;
+        while (count < m_voxelBatch.size() && m_voxels.pop(m_voxelBatch[count])){
+            count++;
+        }
+        if (count == 0){
+            break;
+        }
+
+        // the rows are appended column by column
+        m_voxelTimes.resize(count);
+        m_voxelPositions.resize(3 * count);
+        m_voxelColors.resize(4 * count);
+        m_voxelLabels.resize(count);
+        for (size_t i = 0 ; i < count ; i++){
+            const SessionVoxel& voxel = m_voxelBatch[i];
+            m_voxelTimes[i] = voxel.m_time;
+            memcpy(&m_voxelPositions[3 * i], voxel.m_voxel, sizeof(voxel.m_voxel));
+            memcpy(&m_voxelColors[4 * i], voxel.m_color, sizeof(voxel.m_color));
+            m_voxelLabels[i] = voxel.m_label;
+        }
+        if (!m_file->m_voxelTime.append(m_voxelTimes.data(), count) ||
+                !m_file->m_voxelRemoved.append(m_voxelPositions.data(), count) ||
+                !m_file->m_voxelColor.append(m_voxelColors.data(), count) ||
+                !m_file->m_voxelLabel.append(m_voxelLabels.data(), count)){
+            return false;
+        }
+        m_writtenVoxelCount.fetch_add(count, memory_order_relaxed);
+    }
+
+    SessionBurrChange burrChange;
+    while (m_burrChanges.pop(burrChange)){
+        if (!m_file->m_burrTime.append(&burrChange.m_time, 1) || !m_file->m_burrSize.append(&burrChange.m_burrSize, 1)){
+            return false;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+///
+/// \brief This method appends a frame to the data group. The depths are read back as the
+/// values of the depth buffer and stored as distances along the view axis in meters.
+///
+bool SessionRecorder::writeFrame(const SessionFrame &a_frame){
+#ifdef VOLUMETRIC_DRILLING_HDF5
+    if (!m_file->m_time.append(&a_frame.m_time, 1)){
+        return false;
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0 ; i < m_streams.size() ; i++){
+        const FrameStreamDesc& stream = m_streams[i];
+        const unsigned char* pixels = a_frame.m_data.data() + offset;
+        offset += stream.getSize();
+
+        if (stream.m_depth){
+            size_t pixelCount = size_t(stream.m_width) * stream.m_height;
+            m_linearDepth.resize(pixelCount);
+            const float* depth = (const float*)pixels;
+            double n = stream.m_near;
+            double f = stream.m_far;
+            for (size_t p = 0 ; p < pixelCount ; p++){
+                double ndc = 2.0 * depth[p] - 1.0;
+                m_linearDepth[p] = float(2.0 * n * f / (f + n - ndc * (f - n)) * m_metersPerUnit);
+            }
+            pixels = (const unsigned char*)m_linearDepth.data();
+        }
+        if (!m_file->m_streams[i].append(pixels, 1)){
+            return false;
+        }
+    }
+
+    for (size_t i = 0 ; i < m_poseNames.size() ; i++){
+        if (!m_file->m_poses[i].append(a_frame.m_poses[i].m_pose, 1)){
+            return false;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
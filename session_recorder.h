@@ -0,0 +1,134 @@
+#ifndef SESSION_RECORDER_H
+#define SESSION_RECORDER_H
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frame_readback.h"
+#include "spsc_ring_buffer.h"
+
+///
+/// \brief A pose in the world frame, position in meters and quaternion as [qx, qy, qz, qw]
+///
+struct SessionPose{
+    double m_pose[7];
+};
+
+///
+/// \brief The streams of a frame read back from the cameras, with the time and the poses of
+/// the objects when it was captured
+///
+struct SessionFrame{
+    double m_time;
+    std::vector<SessionPose> m_poses;
+    std::vector<unsigned char> m_data;
+};
+
+///
+/// \brief A voxel removed by the drill, as published on the batch topic
+///
+struct SessionVoxel{
+    double m_time;
+    int32_t m_voxel[3];
+    uint8_t m_color[4];
+    uint8_t m_label;
+};
+
+struct SessionBurrChange{
+    double m_time;
+    double m_burrSize;
+};
+
+struct SessionFile;
+
+///
+/// \brief Records a drilling session in process to an HDF5 file with the layout of
+/// scripts/data_record.py: the camera frames and object poses in the data group, the removed
+/// voxels and the burr changes in their groups. The frames are read back asynchronously by a
+/// FrameReadback on the graphics thread and the voxels and burr changes are queued by the
+/// haptic loop, so no message is serialized. A writer thread appends everything to chunked,
+/// compressed datasets. The frames are taken from a fixed pool and the queues are
+/// preallocated, the voxels that don't fit are dropped and counted and a frame is only
+/// captured when a free one is at hand, the producers never wait.
+///
+/// Needs HDF5, the recorder only reports an error when the plugin is built without it.
+///
+class SessionRecorder{
+public:
+    // a_voxelCapacity is the number of removed voxels the queue holds, a_frameCount the number
+    // of frames that can wait for the writer
+    explicit SessionRecorder(size_t a_voxelCapacity = 1 << 20, size_t a_frameCount = 16);
+    ~SessionRecorder();
+
+    // Creates the file and starts the writer thread. The frames hold the streams one after the
+    // other and the poses of the named objects. a_metersPerUnit converts the positions and the
+    // depths, a_voxelVolume is the volume of a voxel in mm^3
+    bool start(const std::string& a_filepath, const std::vector<FrameStreamDesc>& a_streams,
+               const std::vector<std::string>& a_poseNames, double a_metersPerUnit, double a_voxelVolume);
+
+    // Writes what is queued and closes the file
+    void stop();
+
+    bool isRecording() const {return m_recording.load(std::memory_order_acquire);}
+
+    // A frame to fill, null if all the frames are queued. Called by the graphics thread
+    SessionFrame* acquireFrame();
+
+    // Queues a frame returned by acquireFrame(). Called by the graphics thread
+    void pushFrame(SessionFrame* a_frame);
+
+    // Called by the haptic loop
+    void recordVoxel(double a_time, int a_x, int a_y, int a_z, const unsigned char a_color[4], int a_label);
+
+    // Called by the haptic loop
+    void recordBurrChange(double a_time, double a_burrSize);
+
+    const std::string& getFilepath() const {return m_filepath;}
+
+    unsigned long long getWrittenFrameCount() const {return m_writtenFrameCount.load(std::memory_order_relaxed);}
+
+    unsigned long long getWrittenVoxelCount() const {return m_writtenVoxelCount.load(std::memory_order_relaxed);}
+
+    unsigned long long getDroppedVoxelCount() const {return m_droppedVoxelCount.load(std::memory_order_relaxed);}
+
+private:
+    void writerLoop();
+
+    // Writes the queued frames, voxels and burr changes, returns false on a write error
+    bool flush();
+
+    bool writeFrame(const SessionFrame& a_frame);
+
+    std::vector<FrameStreamDesc> m_streams;
+    std::vector<std::string> m_poseNames;
+    double m_metersPerUnit;
+
+    std::vector<std::unique_ptr<SessionFrame>> m_framePool;
+    // frames handed back by the writer and frames waiting for it
+    SPSCRingBuffer<SessionFrame*> m_freeFrames;
+    SPSCRingBuffer<SessionFrame*> m_frames;
+    SPSCRingBuffer<SessionVoxel> m_voxels;
+    SPSCRingBuffer<SessionBurrChange> m_burrChanges;
+
+    std::vector<SessionVoxel> m_voxelBatch;
+    std::vector<int32_t> m_voxelPositions;
+    std::vector<uint8_t> m_voxelColors;
+    std::vector<uint8_t> m_voxelLabels;
+    std::vector<double> m_voxelTimes;
+    std::vector<float> m_linearDepth;
+
+    std::string m_filepath;
+    std::unique_ptr<SessionFile> m_file;
+    std::thread m_writerThread;
+    std::atomic<bool> m_recording;
+    std::atomic<bool> m_running;
+
+    std::atomic<unsigned long long> m_writtenFrameCount;
+    std::atomic<unsigned long long> m_writtenVoxelCount;
+    std::atomic<unsigned long long> m_droppedVoxelCount;
+};
+
+#endif // SESSION_RECORDER_H
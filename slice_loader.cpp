@@ -0,0 +1,111 @@
+#include "slice_loader.h"
+#include <chai3d.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace chai3d;
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(const Clock::time_point& a_start){
+    return chrono::duration<double>(Clock::now() - a_start).count();
+}
+
+VolumeSliceLoader::VolumeSliceLoader(int a_numWorkers){
+    m_numWorkers = a_numWorkers;
+    if (m_numWorkers <= 0){
+        m_numWorkers = max(int(thread::hardware_concurrency()), 1);
+    }
+    m_totalTime = 0.0;
+}
+
+bool VolumeSliceLoader::decodeSlice(const VolumeImageSource &a_source, int a_idx, unsigned char *a_data, uint32_t a_width, uint32_t a_height){
+    Clock::time_point start = Clock::now();
+
+    string filepath = a_source.getSliceFilepath(a_idx);
+    cImage slice;
+    if (!slice.loadFromFile(filepath)){
+        cerr << "ERROR! FAILED TO LOAD VOLUME SLICE " << filepath << endl;
+        return false;
+    }
+    slice.convert(GL_RGBA);
+    if (slice.getWidth() != a_width || slice.getHeight() != a_height){
+        cerr << "ERROR! VOLUME SLICE " << filepath << " IS " << slice.getWidth() << "x" << slice.getHeight()
+             << ", EXPECTED " << a_width << "x" << a_height << endl;
+        return false;
+    }
+
+    size_t sliceSize = size_t(a_width) * a_height * 4;
+    memcpy(a_data + sliceSize * a_idx, slice.getData(), sliceSize);
+
+    m_sliceDecodeTimes[a_idx] = secondsSince(start);
+    return true;
+}
+
+bool VolumeSliceLoader::loadInto(const VolumeImageSource &a_source, unsigned char *a_data, uint32_t a_width, uint32_t a_height){
+    Clock::time_point start = Clock::now();
+    m_sliceDecodeTimes.assign(a_source.m_count, 0.0);
+
+    // Each worker takes the next slice that hasn't been claimed yet
+    atomic<int> nextSlice(0);
+    atomic<bool> failed(false);
+    auto worker = [&](){
+        int idx;
+        while (!failed && (idx = nextSlice.fetch_add(1)) < a_source.m_count){
+            if (!decodeSlice(a_source, idx, a_data, a_width, a_height)){
+                failed = true;
+            }
+        }
+    };
+
+    int numThreads = min(m_numWorkers, a_source.m_count);
+    vector<thread> threads;
+    for (int i = 1 ; i < numThreads ; i++){
+        threads.push_back(thread(worker));
+    }
+    worker();
+    for (size_t i = 0 ; i < threads.size() ; i++){
+        threads[i].join();
+    }
+
+    m_totalTime = secondsSince(start);
+    return !failed;
+}
+
+bool VolumeSliceLoader::load(const VolumeImageSource &a_source, vector<unsigned char> &a_data, uint32_t &a_width, uint32_t &a_height){
+    if (!a_source.isValid()){
+        return false;
+    }
+
+    // The first slice sets the size of the volume
+    cImage first;
+    if (!first.loadFromFile(a_source.getSliceFilepath(0))){
+        cerr << "ERROR! FAILED TO LOAD VOLUME SLICE " << a_source.getSliceFilepath(0) << endl;
+        return false;
+    }
+    a_width = first.getWidth();
+    a_height = first.getHeight();
+
+    a_data.resize(size_t(a_width) * a_height * 4 * a_source.m_count);
+    return loadInto(a_source, a_data.data(), a_width, a_height);
+}
+
+void VolumeSliceLoader::printStats(const string &a_name) const{
+    if (m_sliceDecodeTimes.empty()){
+        return;
+    }
+    double minTime = m_sliceDecodeTimes[0], maxTime = m_sliceDecodeTimes[0], sum = 0.0;
+    for (size_t i = 0 ; i < m_sliceDecodeTimes.size() ; i++){
+        minTime = min(minTime, m_sliceDecodeTimes[i]);
+        maxTime = max(maxTime, m_sliceDecodeTimes[i]);
+        sum += m_sliceDecodeTimes[i];
+    }
+    cerr << "INFO! LOADED " << m_sliceDecodeTimes.size() << " SLICES OF " << a_name << " WITH " << m_numWorkers
+         << " WORKERS IN " << m_totalTime << " s. SLICE DECODE MIN / MEAN / MAX: "
+         << minTime * 1000.0 << " / " << sum / m_sliceDecodeTimes.size() * 1000.0 << " / " << maxTime * 1000.0 << " ms" << endl;
+}
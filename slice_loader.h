@@ -0,0 +1,45 @@
+#ifndef SLICE_LOADER_H
+#define SLICE_LOADER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "volume_source.h"
+
+///
+/// \brief Decodes the slices of a volume on a pool of worker threads, each slice being
+/// copied to its final offset in the 3D image buffer.
+///
+class VolumeSliceLoader{
+public:
+    // 0 workers uses one per hardware thread
+    explicit VolumeSliceLoader(int a_numWorkers = 0);
+
+    // Decodes all the slices of the source into a_data, which must hold
+    // a_width * a_height * a_source.m_count RGBA voxels with 8 bits per channel.
+    bool loadInto(const VolumeImageSource& a_source, unsigned char* a_data, uint32_t a_width, uint32_t a_height);
+
+    // Same as above but allocates the buffer, whose size is given by the first slice
+    bool load(const VolumeImageSource& a_source, std::vector<unsigned char>& a_data, uint32_t& a_width, uint32_t& a_height);
+
+    int getNumWorkers() const {return m_numWorkers;}
+
+    // Decode time of each slice of the last load, in seconds
+    const std::vector<double>& getSliceDecodeTimes() const {return m_sliceDecodeTimes;}
+
+    // Wall time of the last load, in seconds
+    double getTotalTime() const {return m_totalTime;}
+
+    // Prints the wall time and the min / mean / max slice decode times of the last load
+    void printStats(const std::string& a_name) const;
+
+private:
+    // Decodes one slice, returns false if it can't be loaded or has the wrong size
+    bool decodeSlice(const VolumeImageSource& a_source, int a_idx, unsigned char* a_data, uint32_t a_width, uint32_t a_height);
+
+    int m_numWorkers;
+    std::vector<double> m_sliceDecodeTimes;
+    double m_totalTime;
+};
+
+#endif // SLICE_LOADER_H
@@ -0,0 +1,72 @@
+#ifndef SPSC_RING_BUFFER_H
+#define SPSC_RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+///
+/// \brief A lock-free, fixed capacity ring buffer for exactly one producer
+/// thread and one consumer thread. push() never blocks or allocates, which makes
+/// it safe to call from the haptics / physics loop.
+///
+template <typename T>
+class SPSCRingBuffer{
+public:
+    // The capacity is rounded up to the next power of two
+    explicit SPSCRingBuffer(size_t a_capacity){
+        size_t capacity = 2;
+        while (capacity < a_capacity){
+            capacity <<= 1;
+        }
+        m_buffer.resize(capacity);
+        m_mask = capacity - 1;
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+    }
+
+    // Called by the producer. Returns false if the buffer is full.
+    bool push(const T& a_item){
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) > m_mask){
+            return false;
+        }
+        m_buffer[head & m_mask] = a_item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Called by the consumer. Returns false if the buffer is empty.
+    bool pop(T& a_item){
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)){
+            return false;
+        }
+        a_item = m_buffer[tail & m_mask];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const{
+        return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const{
+        return m_mask + 1;
+    }
+
+private:
+    std::vector<T> m_buffer;
+    size_t m_mask;
+
+    // Written by the producer only. The padding keeps the indices on separate
+    // cache lines to avoid false sharing between the two threads.
+    char m_pad0[64];
+    std::atomic<size_t> m_head;
+    char m_pad1[64];
+    // Written by the consumer only.
+    std::atomic<size_t> m_tail;
+    char m_pad2[64];
+};
+
+#endif // SPSC_RING_BUFFER_H
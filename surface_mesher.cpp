@@ -0,0 +1,406 @@
+#include "surface_mesher.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+// The six tetrahedra of a cell, all sharing the diagonal from corner 0 to corner 7. Corner k
+// is at offset (k & 1, (k >> 1) & 1, (k >> 2) & 1). In each tetrahedron, the bits of a corner
+// include those of the previous one, so every edge goes from a corner to one of its supersets
+static const int s_cellTetrahedra[6][4] = {
+    {0, 1, 3, 7}, {0, 3, 2, 7}, {0, 2, 6, 7}, {0, 6, 4, 7}, {0, 4, 5, 7}, {0, 5, 1, 7}
+};
+
+SurfaceMesher::SurfaceMesher(){
+    m_data = NULL;
+    m_bytesPerVoxel = 0;
+    m_palette = NULL;
+    m_brickSize = 16;
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = 0;
+        m_brickCount[i] = 0;
+        m_origin[i] = 0.0;
+        m_voxelSize[i] = 1.0;
+    }
+    m_changedSinceSnapshot = false;
+    m_snapshotIndex = 0;
+    m_exportScale = 1.0;
+    m_snapshotInterval = 0.0;
+    m_snapshotScale = 1.0;
+    m_running.store(false);
+    m_meshedBrickCount.store(0);
+}
+
+SurfaceMesher::~SurfaceMesher(){
+    stop();
+}
+
+void SurfaceMesher::init(const unsigned char *a_data, int a_bytesPerVoxel, const int a_voxelCount[3], int a_brickSize,
+                         const double a_origin[3], const double a_voxelSize[3]){
+    m_data = a_data;
+    m_bytesPerVoxel = a_bytesPerVoxel;
+    m_brickSize = a_brickSize;
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = a_voxelCount[i];
+        m_brickCount[i] = (a_voxelCount[i] + a_brickSize - 1) / a_brickSize;
+        m_origin[i] = a_origin[i];
+        m_voxelSize[i] = a_voxelSize[i];
+    }
+    m_pendingBricks.init(m_voxelCount[0], m_voxelCount[1], m_voxelCount[2], m_brickSize);
+}
+
+void SurfaceMesher::start(){
+    if (isRunning() || !m_data){
+        return;
+    }
+    size_t numBricks = size_t(m_brickCount[0]) * m_brickCount[1] * m_brickCount[2];
+    m_brickMeshes.resize(numBricks);
+    m_brickQueued.assign(numBricks, 0);
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_pendingBricks.markAll();
+    }
+    m_running.store(true, memory_order_release);
+    m_thread = thread(&SurfaceMesher::meshingLoop, this);
+}
+
+void SurfaceMesher::stop(){
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_running.store(false, memory_order_release);
+    }
+    m_wakeup.notify_one();
+    if (m_thread.joinable()){
+        m_thread.join();
+    }
+}
+
+void SurfaceMesher::markDirty(const vector<VoxelBox> &a_boxes){
+    if (a_boxes.empty() || !isRunning()){
+        return;
+    }
+    {
+        lock_guard<mutex> lock(m_mutex);
+        for (size_t i = 0 ; i < a_boxes.size() ; i++){
+            m_pendingBricks.markBox(a_boxes[i]);
+        }
+    }
+    m_wakeup.notify_one();
+}
+
+void SurfaceMesher::reset(const unsigned char *a_data){
+    bool wasRunning = isRunning();
+    stop();
+    if (a_data){
+        m_data = a_data;
+    }
+    if (wasRunning){
+        start();
+    }
+}
+
+void SurfaceMesher::requestExport(const string &a_filepath, double a_scale){
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_exportFilepath = a_filepath;
+        m_exportScale = a_scale;
+    }
+    m_wakeup.notify_one();
+}
+
+void SurfaceMesher::setSnapshots(double a_interval, const string &a_directory, double a_scale){
+    lock_guard<mutex> lock(m_mutex);
+    m_snapshotInterval = a_interval;
+    m_snapshotDirectory = a_directory;
+    m_snapshotScale = a_scale;
+}
+
+///
+/// \brief Runs on the meshing thread. Meshes the dirty bricks as they come, then writes the
+/// requested export and the snapshot that is due, if any.
+///
+void SurfaceMesher::meshingLoop(){
+    chrono::steady_clock::time_point lastSnapshotTime = chrono::steady_clock::now();
+    while (true){
+        string exportFilepath, snapshotDirectory;
+        double exportScale, snapshotInterval, snapshotScale;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_wakeup.wait_for(lock, chrono::milliseconds(100), [this]{
+                return !m_running.load(memory_order_relaxed) || !m_pendingBricks.isEmpty() || !m_exportFilepath.empty();
+            });
+            if (!m_running.load(memory_order_relaxed)){
+                break;
+            }
+            m_pendingBricks.extractBoxes(m_dirtyBoxes);
+            exportFilepath.swap(m_exportFilepath);
+            exportScale = m_exportScale;
+            snapshotInterval = m_snapshotInterval;
+            snapshotDirectory = m_snapshotDirectory;
+            snapshotScale = m_snapshotScale;
+        }
+
+        if (!meshDirtyBricks()){
+            break;
+        }
+
+        if (!exportFilepath.empty()){
+            size_t numTriangles;
+            if (writeObj(exportFilepath, exportScale, numTriangles)){
+                cerr << "INFO! SAVED THE VOLUME SURFACE TO " << exportFilepath << " (" << numTriangles << " TRIANGLES)" << endl;
+            }
+        }
+
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        if (snapshotInterval > 0.0 && m_changedSinceSnapshot &&
+                chrono::duration<double>(now - lastSnapshotTime).count() >= snapshotInterval){
+            char name[32];
+            snprintf(name, sizeof(name), "surface_%04d.obj", m_snapshotIndex++);
+            string filepath = snapshotDirectory.empty() ? string(name) : snapshotDirectory + "/" + name;
+            size_t numTriangles;
+            writeObj(filepath, snapshotScale, numTriangles);
+            m_changedSinceSnapshot = false;
+            lastSnapshotTime = now;
+        }
+    }
+}
+
+bool SurfaceMesher::meshDirtyBricks(){
+    // a voxel is a corner of the cells on both of its sides, so the bricks holding the cells
+    // just below a box of modified voxels are meshed again too
+    vector<size_t> bricks;
+    for (size_t i = 0 ; i < m_dirtyBoxes.size() ; i++){
+        const VoxelBox& box = m_dirtyBoxes[i];
+        int bmin[3], bmax[3];
+        for (int a = 0 ; a < 3 ; a++){
+            bmin[a] = max(box.m_min[a] - 1, 0) / m_brickSize;
+            bmax[a] = min((box.m_max[a] - 1) / m_brickSize, m_brickCount[a] - 1);
+        }
+        for (int bz = bmin[2] ; bz <= bmax[2] ; bz++){
+            for (int by = bmin[1] ; by <= bmax[1] ; by++){
+                for (int bx = bmin[0] ; bx <= bmax[0] ; bx++){
+                    size_t idx = getBrickIndex(bx, by, bz);
+                    if (!m_brickQueued[idx]){
+                        m_brickQueued[idx] = 1;
+                        bricks.push_back(idx);
+                    }
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0 ; i < bricks.size() ; i++){
+        if (!isRunning()){
+            // keep the bricks that weren't meshed for the next start
+            lock_guard<mutex> lock(m_mutex);
+            for (size_t j = 0 ; j < m_dirtyBoxes.size() ; j++){
+                m_pendingBricks.markBox(m_dirtyBoxes[j]);
+            }
+            for (size_t j = i ; j < bricks.size() ; j++){
+                m_brickQueued[bricks[j]] = 0;
+            }
+            return false;
+        }
+        size_t idx = bricks[i];
+        int bx = int(idx % m_brickCount[0]);
+        int by = int((idx / m_brickCount[0]) % m_brickCount[1]);
+        int bz = int(idx / (size_t(m_brickCount[0]) * m_brickCount[1]));
+        meshBrick(bx, by, bz, m_brickMeshes[idx]);
+        m_brickQueued[idx] = 0;
+        m_meshedBrickCount.fetch_add(1, memory_order_relaxed);
+    }
+    m_changedSinceSnapshot |= !bricks.empty();
+    m_dirtyBoxes.clear();
+    return true;
+}
+
+inline bool SurfaceMesher::isInside(int a_x, int a_y, int a_z) const{
+    if (a_x < 0 || a_y < 0 || a_z < 0 || a_x >= m_voxelCount[0] || a_y >= m_voxelCount[1] || a_z >= m_voxelCount[2]){
+        return false;
+    }
+    const unsigned char* voxel = m_data + ((size_t(a_z) * m_voxelCount[1] + a_y) * m_voxelCount[0] + a_x) * m_bytesPerVoxel;
+    for (int i = 0 ; i < m_bytesPerVoxel ; i++){
+        if (voxel[i]){
+            return true;
+        }
+    }
+    return false;
+}
+
+///
+/// \brief This method meshes the cells of a brick. The cell (x, y, z) spans the voxel centers
+/// (x, y, z) to (x + 1, y + 1, z + 1). The first brick along an axis also holds the cells
+/// at -1, so that the surface is closed where the volume is cut by its bounds.
+///
+void SurfaceMesher::meshBrick(int a_bx, int a_by, int a_bz, BrickMesh &a_mesh){
+    a_mesh.clear();
+    m_edgeVertices.clear();
+
+    int brick[3] = {a_bx, a_by, a_bz};
+    int cmin[3], cmax[3];
+    for (int a = 0 ; a < 3 ; a++){
+        cmin[a] = brick[a] == 0 ? -1 : brick[a] * m_brickSize;
+        cmax[a] = min((brick[a] + 1) * m_brickSize, m_voxelCount[a]);
+    }
+    uint64_t paddedCount[3] = {uint64_t(m_voxelCount[0]) + 2, uint64_t(m_voxelCount[1]) + 2, uint64_t(m_voxelCount[2]) + 2};
+
+    for (int cz = cmin[2] ; cz < cmax[2] ; cz++){
+        for (int cy = cmin[1] ; cy < cmax[1] ; cy++){
+            for (int cx = cmin[0] ; cx < cmax[0] ; cx++){
+                int mask = 0;
+                for (int k = 0 ; k < 8 ; k++){
+                    if (isInside(cx + (k & 1), cy + ((k >> 1) & 1), cz + ((k >> 2) & 1))){
+                        mask |= 1 << k;
+                    }
+                }
+                if (mask == 0 || mask == 0xFF){
+                    continue;
+                }
+
+                for (int t = 0 ; t < 6 ; t++){
+                    const int* tet = s_cellTetrahedra[t];
+                    int inside[4], outside[4];
+                    int numInside = 0, numOutside = 0;
+                    for (int v = 0 ; v < 4 ; v++){
+                        if (mask & (1 << tet[v])){
+                            inside[numInside++] = tet[v];
+                        }
+                        else{
+                            outside[numOutside++] = tet[v];
+                        }
+                    }
+                    if (numInside == 0 || numOutside == 0){
+                        continue;
+                    }
+
+                    // the triangles as pairs of (inside, outside) corners
+                    int tri[2][3][2];
+                    int numTriangles;
+                    if (numInside == 1){
+                        tri[0][0][0] = inside[0]; tri[0][0][1] = outside[0];
+                        tri[0][1][0] = inside[0]; tri[0][1][1] = outside[1];
+                        tri[0][2][0] = inside[0]; tri[0][2][1] = outside[2];
+                        numTriangles = 1;
+                    }
+                    else if (numInside == 3){
+                        tri[0][0][0] = inside[0]; tri[0][0][1] = outside[0];
+                        tri[0][1][0] = inside[1]; tri[0][1][1] = outside[0];
+                        tri[0][2][0] = inside[2]; tri[0][2][1] = outside[0];
+                        numTriangles = 1;
+                    }
+                    else{
+                        tri[0][0][0] = inside[0]; tri[0][0][1] = outside[0];
+                        tri[0][1][0] = inside[0]; tri[0][1][1] = outside[1];
+                        tri[0][2][0] = inside[1]; tri[0][2][1] = outside[1];
+                        tri[1][0][0] = inside[0]; tri[1][0][1] = outside[0];
+                        tri[1][1][0] = inside[1]; tri[1][1][1] = outside[1];
+                        tri[1][2][0] = inside[1]; tri[1][2][1] = outside[0];
+                        numTriangles = 2;
+                    }
+
+                    // the triangles face from the inside corners to the outside ones
+                    double outward[3] = {0.0, 0.0, 0.0};
+                    for (int a = 0 ; a < 3 ; a++){
+                        for (int i = 0 ; i < numInside ; i++){
+                            outward[a] -= double((inside[i] >> a) & 1) / numInside;
+                        }
+                        for (int o = 0 ; o < numOutside ; o++){
+                            outward[a] += double((outside[o] >> a) & 1) / numOutside;
+                        }
+                    }
+
+                    for (int ti = 0 ; ti < numTriangles ; ti++){
+                        uint32_t indices[3];
+                        double pos[3][3];
+                        for (int v = 0 ; v < 3 ; v++){
+                            int kIn = tri[ti][v][0];
+                            int kOut = tri[ti][v][1];
+                            int kLow = (kIn & kOut) == kIn ? kIn : kOut;
+                            int kHigh = kLow == kIn ? kOut : kIn;
+                            int low[3] = {cx + (kLow & 1), cy + ((kLow >> 1) & 1), cz + ((kLow >> 2) & 1)};
+                            int in[3] = {cx + (kIn & 1), cy + ((kIn >> 1) & 1), cz + ((kIn >> 2) & 1)};
+                            for (int a = 0 ; a < 3 ; a++){
+                                pos[v][a] = (double(low[a]) + 0.5 * ((kHigh ^ kLow) >> a & 1)) * m_voxelSize[a] + m_origin[a];
+                            }
+
+                            uint64_t key = ((uint64_t(low[2] + 1) * paddedCount[1] + uint64_t(low[1] + 1)) * paddedCount[0] + uint64_t(low[0] + 1)) * 8 + uint64_t(kHigh ^ kLow);
+                            unordered_map<uint64_t, uint32_t>::iterator it = m_edgeVertices.find(key);
+                            if (it != m_edgeVertices.end()){
+                                indices[v] = it->second;
+                                continue;
+                            }
+
+                            indices[v] = uint32_t(a_mesh.m_positions.size() / 3);
+                            m_edgeVertices[key] = indices[v];
+                            for (int a = 0 ; a < 3 ; a++){
+                                a_mesh.m_positions.push_back(float(pos[v][a]));
+                            }
+                            const unsigned char* voxel = m_data + ((size_t(in[2]) * m_voxelCount[1] + in[1]) * m_voxelCount[0] + in[0]) * m_bytesPerVoxel;
+                            unsigned char color[4];
+                            if (m_palette){
+                                m_palette->toRGBA(voxel, color);
+                            }
+                            for (int c = 0 ; c < 4 ; c++){
+                                a_mesh.m_colors.push_back(m_palette ? color[c] : m_bytesPerVoxel >= 4 ? voxel[c] : (c == 3 ? 255 : voxel[0]));
+                            }
+                        }
+
+                        double e1[3], e2[3];
+                        for (int a = 0 ; a < 3 ; a++){
+                            e1[a] = pos[1][a] - pos[0][a];
+                            e2[a] = pos[2][a] - pos[0][a];
+                        }
+                        double normal[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+                        double facing = 0.0;
+                        for (int a = 0 ; a < 3 ; a++){
+                            facing += normal[a] * outward[a] * m_voxelSize[a];
+                        }
+                        if (facing < 0.0){
+                            swap(indices[1], indices[2]);
+                        }
+                        a_mesh.m_indices.push_back(indices[0]);
+                        a_mesh.m_indices.push_back(indices[1]);
+                        a_mesh.m_indices.push_back(indices[2]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool SurfaceMesher::writeObj(const string &a_filepath, double a_scale, size_t &a_numTriangles){
+    FILE* file = fopen(a_filepath.c_str(), "w");
+    if (!file){
+        cerr << "ERROR! FAILED TO CREATE SURFACE FILE " << a_filepath << endl;
+        return false;
+    }
+
+    size_t vertexOffset = 1;
+    a_numTriangles = 0;
+    for (size_t bi = 0 ; bi < m_brickMeshes.size() ; bi++){
+        const BrickMesh& mesh = m_brickMeshes[bi];
+        size_t numVertices = mesh.m_positions.size() / 3;
+        for (size_t v = 0 ; v < numVertices ; v++){
+            const float* p = &mesh.m_positions[3 * v];
+            const unsigned char* c = &mesh.m_colors[4 * v];
+            fprintf(file, "v %f %f %f %.3f %.3f %.3f\n", p[0] * a_scale, p[1] * a_scale, p[2] * a_scale,
+                    c[0] / 255.0, c[1] / 255.0, c[2] / 255.0);
+        }
+        for (size_t t = 0 ; t < mesh.m_indices.size() ; t += 3){
+            fprintf(file, "f %zu %zu %zu\n", vertexOffset + mesh.m_indices[t], vertexOffset + mesh.m_indices[t + 1],
+                    vertexOffset + mesh.m_indices[t + 2]);
+        }
+        vertexOffset += numVertices;
+        a_numTriangles += mesh.getTriangleCount();
+    }
+
+    bool valid = !ferror(file);
+    if (fclose(file) != 0 || !valid){
+        cerr << "ERROR! FAILED TO WRITE SURFACE FILE " << a_filepath << endl;
+        return false;
+    }
+    return true;
+}
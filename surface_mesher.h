@@ -0,0 +1,131 @@
+#ifndef SURFACE_MESHER_H
+#define SURFACE_MESHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "dirty_bricks.h"
+#include "voxel_palette.h"
+
+///
+/// \brief Triangles of the surface inside one brick of the volume, in the local frame of the
+/// volume. Each three consecutive indices form a triangle.
+///
+struct BrickMesh{
+    std::vector<float> m_positions;
+    // rgba of each vertex, the color of the voxel inside the surface
+    std::vector<unsigned char> m_colors;
+    std::vector<uint32_t> m_indices;
+
+    void clear(){
+        m_positions.clear();
+        m_colors.clear();
+        m_indices.clear();
+    }
+
+    size_t getTriangleCount() const {return m_indices.size() / 3;}
+};
+
+///
+/// \brief Keeps a mesh of the surface of the volume up to date on a background thread. The mesh
+/// is cached per brick, and only the bricks modified by the drill are meshed again. Exports and
+/// periodic snapshots write the cached bricks to OBJ files from the same thread, so the caller
+/// never waits for the meshing or the file.
+///
+/// The surface separates the occupied voxels, the ones with any non-zero byte, from the empty
+/// ones. Each cell between eight voxel centers is split into six tetrahedra along its diagonal,
+/// the same split in every cell keeps the surface closed across cells and bricks. The voxels
+/// may be modified while a brick is meshed, the brick is then marked again and meshed later.
+///
+class SurfaceMesher{
+public:
+    SurfaceMesher();
+    ~SurfaceMesher();
+
+    // a_origin is the center of the voxel (0, 0, 0) and a_voxelSize the distance between two
+    // voxel centers along each axis, in the local frame of the volume
+    void init(const unsigned char* a_data, int a_bytesPerVoxel, const int a_voxelCount[3], int a_brickSize,
+              const double a_origin[3], const double a_voxelSize[3]);
+
+    // Starts the thread and meshes the whole volume in the background
+    void start();
+
+    void stop();
+
+    bool isRunning() const {return m_running.load(std::memory_order_acquire);}
+
+    // Marks the bricks overlapping the boxes of modified voxels to be meshed again
+    void markDirty(const std::vector<VoxelBox>& a_boxes);
+
+    // The vertices of a labeled volume take the color of the label of their voxel. Call before
+    // start(), the palette is owned by the caller
+    void setPalette(const VoxelPalette* a_palette) {m_palette = a_palette;}
+
+    // Meshes the whole volume again, e.g. after a reset. a_data replaces the voxels if not null
+    void reset(const unsigned char* a_data);
+
+    // Writes the surface to an OBJ file once the pending bricks are meshed, the positions are
+    // multiplied by a_scale
+    void requestExport(const std::string& a_filepath, double a_scale);
+
+    // Exports a snapshot to a_directory/surface_<n>.obj every a_interval seconds if the surface
+    // changed since the previous one. 0 disables the snapshots
+    void setSnapshots(double a_interval, const std::string& a_directory, double a_scale);
+
+    unsigned long long getMeshedBrickCount() const {return m_meshedBrickCount.load(std::memory_order_relaxed);}
+
+private:
+    void meshingLoop();
+
+    // Meshes the bricks marked dirty, returns false if the thread was stopped before the end
+    bool meshDirtyBricks();
+
+    void meshBrick(int a_bx, int a_by, int a_bz, BrickMesh& a_mesh);
+
+    bool writeObj(const std::string& a_filepath, double a_scale, size_t& a_numTriangles);
+
+    // true if the sample at voxel (x, y, z) is inside the surface, false outside the volume
+    inline bool isInside(int a_x, int a_y, int a_z) const;
+
+    size_t getBrickIndex(int a_bx, int a_by, int a_bz) const{
+        return (size_t(a_bz) * m_brickCount[1] + a_by) * m_brickCount[0] + a_bx;
+    }
+
+    const unsigned char* m_data;
+    int m_bytesPerVoxel;
+    const VoxelPalette* m_palette;
+    int m_voxelCount[3];
+    int m_brickSize;
+    int m_brickCount[3];
+    double m_origin[3];
+    double m_voxelSize[3];
+
+    // owned by the meshing thread
+    std::vector<BrickMesh> m_brickMeshes;
+    std::vector<char> m_brickQueued;
+    std::vector<VoxelBox> m_dirtyBoxes;
+    std::unordered_map<uint64_t, uint32_t> m_edgeVertices;
+    bool m_changedSinceSnapshot;
+    int m_snapshotIndex;
+
+    // shared with the callers, guarded by m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    DirtyBrickSet m_pendingBricks;
+    std::string m_exportFilepath;
+    double m_exportScale;
+    double m_snapshotInterval;
+    std::string m_snapshotDirectory;
+    double m_snapshotScale;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<unsigned long long> m_meshedBrickCount;
+};
+
+#endif // SURFACE_MESHER_H
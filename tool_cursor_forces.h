@@ -0,0 +1,23 @@
+#ifndef TOOL_CURSOR_FORCES_H
+#define TOOL_CURSOR_FORCES_H
+
+#include "worker_pool.h"
+
+class DrillingCore;
+
+///
+/// \brief Runs the broad-phase test of one shaft tool cursor. The test only reads the poses of
+/// the cursors and the occupancy of the volume, and stores its result in the cursor's own slot,
+/// so the cursors are tested in parallel. The forces themselves are computed one cursor after
+/// the other: CHAI3D writes the interaction state of every object of the world the cursors
+/// share, e.g. the last interaction point of the volume, while computing the forces of one.
+///
+class ToolCursorCullTask: public ParallelTask{
+public:
+    // tests the shaft cursor a_index + 1
+    virtual void run(size_t a_index) override;
+
+    DrillingCore* m_core = nullptr;
+};
+
+#endif // TOOL_CURSOR_FORCES_H
@@ -0,0 +1,52 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+///
+/// \brief A lock-free snapshot of a value shared by one writer thread and one reader thread.
+/// The writer always publishes its latest value and the reader always gets the latest one
+/// published, neither of them ever waits for the other, so it suits exchanging state between
+/// loops running at different rates.
+///
+template <typename T>
+class TripleBuffer{
+public:
+    TripleBuffer(){
+        m_writeIdx = 0;
+        m_middle.store(1, std::memory_order_relaxed);
+        m_readIdx = 2;
+    }
+
+    // Called by the writer
+    void write(const T& a_value){
+        m_buffers[m_writeIdx] = a_value;
+        unsigned prev = m_middle.exchange(m_writeIdx | s_freshBit, std::memory_order_acq_rel);
+        m_writeIdx = prev & s_indexMask;
+    }
+
+    // Called by the reader, copies the latest value and returns true if it wasn't read before
+    bool read(T& a_value){
+        bool fresh = (m_middle.load(std::memory_order_relaxed) & s_freshBit) != 0;
+        if (fresh){
+            unsigned prev = m_middle.exchange(m_readIdx, std::memory_order_acq_rel);
+            m_readIdx = prev & s_indexMask;
+        }
+        a_value = m_buffers[m_readIdx];
+        return fresh;
+    }
+
+private:
+    static const unsigned s_indexMask = 3;
+    static const unsigned s_freshBit = 4;
+
+    T m_buffers[3];
+    // Owned by the writer
+    unsigned m_writeIdx;
+    // Index of the buffer in between, with the fresh bit set when it holds an unread value
+    std::atomic<unsigned> m_middle;
+    // Owned by the reader
+    unsigned m_readIdx;
+};
+
+#endif // TRIPLE_BUFFER_H
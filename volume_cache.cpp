@@ -0,0 +1,142 @@
+#include "volume_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char VOLUME_CACHE_MAGIC[8] = {'V', 'D', 'V', 'O', 'L', 'C', 'A', 'C'};
+static const uint32_t VOLUME_CACHE_VERSION = 1;
+
+// FNV-1a
+static void hashBytes(uint64_t& a_hash, const void* a_data, size_t a_size){
+    const unsigned char* bytes = (const unsigned char*)a_data;
+    for (size_t i = 0 ; i < a_size ; i++){
+        a_hash ^= bytes[i];
+        a_hash *= 1099511628211ULL;
+    }
+}
+
+VolumeCache::VolumeCache(){
+    memset(&m_header, 0, sizeof(m_header));
+    m_mapping = NULL;
+    m_mappingSize = 0;
+    m_data = NULL;
+}
+
+VolumeCache::~VolumeCache(){
+    close();
+}
+
+string VolumeCache::getCacheFilepath(const VolumeImageSource &a_source){
+    string dir = a_source.m_path;
+    while (dir.size() > 1 && dir[dir.size() - 1] == '/'){
+        dir.erase(dir.size() - 1);
+    }
+    return dir + ".vcache";
+}
+
+uint64_t VolumeCache::computeSourceHash(const VolumeImageSource &a_source){
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0 ; i < a_source.m_count ; i++){
+        string filepath = a_source.getSliceFilepath(i);
+        hashBytes(hash, filepath.c_str(), filepath.size());
+
+        struct stat info;
+        if (stat(filepath.c_str(), &info) == 0){
+            int64_t size = info.st_size;
+            int64_t mtime = info.st_mtime;
+            hashBytes(hash, &size, sizeof(size));
+            hashBytes(hash, &mtime, sizeof(mtime));
+        }
+    }
+    return hash;
+}
+
+void VolumeCache::initHeader(VolumeCacheHeader &a_header, uint32_t a_width, uint32_t a_height, uint32_t a_depth, uint32_t a_bytesPerVoxel, uint32_t a_format, uint64_t a_sourceHash){
+    memset(&a_header, 0, sizeof(a_header));
+    memcpy(a_header.m_magic, VOLUME_CACHE_MAGIC, sizeof(VOLUME_CACHE_MAGIC));
+    a_header.m_version = VOLUME_CACHE_VERSION;
+    a_header.m_width = a_width;
+    a_header.m_height = a_height;
+    a_header.m_depth = a_depth;
+    a_header.m_bytesPerVoxel = a_bytesPerVoxel;
+    a_header.m_format = a_format;
+    a_header.m_sourceHash = a_sourceHash;
+    a_header.m_dataSize = uint64_t(a_width) * a_height * a_depth * a_bytesPerVoxel;
+}
+
+bool VolumeCache::open(const string &a_filepath, uint64_t a_sourceHash, uint32_t a_width, uint32_t a_height, uint32_t a_depth, uint32_t a_bytesPerVoxel){
+    close();
+
+    int fd = ::open(a_filepath.c_str(), O_RDONLY);
+    if (fd < 0){
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(VolumeCacheHeader)){
+        ::close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED){
+        return false;
+    }
+
+    VolumeCacheHeader header;
+    memcpy(&header, mapping, sizeof(header));
+    bool valid = memcmp(header.m_magic, VOLUME_CACHE_MAGIC, sizeof(VOLUME_CACHE_MAGIC)) == 0 &&
+            header.m_version == VOLUME_CACHE_VERSION &&
+            header.m_sourceHash == a_sourceHash &&
+            header.m_width == a_width && header.m_height == a_height && header.m_depth == a_depth &&
+            header.m_bytesPerVoxel == a_bytesPerVoxel &&
+            header.m_dataSize == uint64_t(a_width) * a_height * a_depth * a_bytesPerVoxel &&
+            sizeof(VolumeCacheHeader) + header.m_dataSize <= uint64_t(info.st_size);
+
+    if (!valid){
+        munmap(mapping, info.st_size);
+        return false;
+    }
+
+    m_header = header;
+    m_mapping = mapping;
+    m_mappingSize = info.st_size;
+    m_data = (const unsigned char*)mapping + sizeof(VolumeCacheHeader);
+    return true;
+}
+
+void VolumeCache::close(){
+    if (m_mapping){
+        munmap(m_mapping, m_mappingSize);
+    }
+    m_mapping = NULL;
+    m_mappingSize = 0;
+    m_data = NULL;
+}
+
+bool VolumeCache::write(const string &a_filepath, const VolumeCacheHeader &a_header, const unsigned char *a_data){
+    string tmpFilepath = a_filepath + ".tmp";
+    FILE* file = fopen(tmpFilepath.c_str(), "wb");
+    if (!file){
+        cerr << "ERROR! FAILED TO OPEN VOLUME CACHE " << tmpFilepath << " FOR WRITING" << endl;
+        return false;
+    }
+
+    bool ok = fwrite(&a_header, sizeof(a_header), 1, file) == 1 &&
+            fwrite(a_data, 1, a_header.m_dataSize, file) == a_header.m_dataSize;
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok || rename(tmpFilepath.c_str(), a_filepath.c_str()) != 0){
+        cerr << "ERROR! FAILED TO WRITE VOLUME CACHE " << a_filepath << endl;
+        remove(tmpFilepath.c_str());
+        return false;
+    }
+    return true;
+}
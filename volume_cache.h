@@ -0,0 +1,68 @@
+#ifndef VOLUME_CACHE_H
+#define VOLUME_CACHE_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include "volume_source.h"
+
+///
+/// \brief Header at the start of a volume cache file, followed by the raw voxel data.
+///
+struct VolumeCacheHeader{
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_depth;
+    uint32_t m_bytesPerVoxel;
+    // OpenGL format of the voxels, e.g. GL_RGBA
+    uint32_t m_format;
+    // Hash of the names, sizes and modification times of the source slices
+    uint64_t m_sourceHash;
+    uint64_t m_dataSize;
+};
+
+///
+/// \brief A raw binary copy of a volume, stored next to its image directory and memory
+/// mapped read-only. Decoding hundreds of slices is replaced by a single file mapping,
+/// and resetting the volume becomes a memcpy from the mapping.
+///
+class VolumeCache{
+public:
+    VolumeCache();
+    ~VolumeCache();
+
+    // Filepath of the cache of the images, e.g. resources/volumes/ear3_512.vcache
+    static std::string getCacheFilepath(const VolumeImageSource& a_source);
+
+    static uint64_t computeSourceHash(const VolumeImageSource& a_source);
+
+    // Maps the cache file. Fails if the file is missing or doesn't match the source hash
+    // and the expected dimensions.
+    bool open(const std::string& a_filepath, uint64_t a_sourceHash, uint32_t a_width, uint32_t a_height, uint32_t a_depth, uint32_t a_bytesPerVoxel);
+
+    void close();
+
+    // Writes a new cache file. The data is written to a temporary file which is then
+    // renamed, so that a concurrent reader never sees a partial file.
+    static bool write(const std::string& a_filepath, const VolumeCacheHeader& a_header, const unsigned char* a_data);
+
+    static void initHeader(VolumeCacheHeader& a_header, uint32_t a_width, uint32_t a_height, uint32_t a_depth, uint32_t a_bytesPerVoxel, uint32_t a_format, uint64_t a_sourceHash);
+
+    bool isOpen() const {return m_data != NULL;}
+
+    const VolumeCacheHeader& getHeader() const {return m_header;}
+
+    const unsigned char* getData() const {return m_data;}
+
+    size_t getDataSize() const {return m_header.m_dataSize;}
+
+private:
+    VolumeCacheHeader m_header;
+    void* m_mapping;
+    size_t m_mappingSize;
+    const unsigned char* m_data;
+};
+
+#endif // VOLUME_CACHE_H
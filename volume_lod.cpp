@@ -0,0 +1,89 @@
+#include "volume_lod.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+VolumeLod::VolumeLod(){
+    for (int i = 0 ; i < 3 ; i++){
+        m_fineCount[i] = 0;
+        m_coarseCount[i] = 0;
+    }
+    m_bytesPerVoxel = 4;
+    m_factor = 1;
+}
+
+void VolumeLod::init(const int a_fineCount[3], int a_bytesPerVoxel, int a_factor){
+    m_factor = max(a_factor, 1);
+    m_bytesPerVoxel = a_bytesPerVoxel;
+    for (int i = 0 ; i < 3 ; i++){
+        m_fineCount[i] = a_fineCount[i];
+        m_coarseCount[i] = (a_fineCount[i] + m_factor - 1) / m_factor;
+    }
+}
+
+///
+/// \brief This method computes a coarse voxel from its fine voxels. A fine voxel is occupied
+/// when any of its bytes isn't zero, the densest occupied one is kept so that a voxel with a
+/// color but no density still makes the coarse voxel occupied.
+///
+inline void VolumeLod::computeVoxel(const unsigned char *a_fine, unsigned char *a_coarse, int a_x, int a_y, int a_z) const{
+    int x1 = min((a_x + 1) * m_factor, m_fineCount[0]);
+    int y1 = min((a_y + 1) * m_factor, m_fineCount[1]);
+    int z1 = min((a_z + 1) * m_factor, m_fineCount[2]);
+
+    const unsigned char* best = NULL;
+    int bestDensity = -1;
+    for (int z = a_z * m_factor ; z < z1 ; z++){
+        for (int y = a_y * m_factor ; y < y1 ; y++){
+            const unsigned char* voxel = a_fine + ((size_t(z) * m_fineCount[1] + y) * m_fineCount[0] + a_x * m_factor) * m_bytesPerVoxel;
+            for (int x = a_x * m_factor ; x < x1 ; x++, voxel += m_bytesPerVoxel){
+                int density = voxel[m_bytesPerVoxel - 1];
+                if (density <= bestDensity){
+                    continue;
+                }
+                bool empty = true;
+                for (int b = 0 ; b < m_bytesPerVoxel ; b++){
+                    empty &= voxel[b] == 0;
+                }
+                if (!empty){
+                    best = voxel;
+                    bestDensity = density;
+                }
+            }
+        }
+    }
+
+    unsigned char* out = a_coarse + ((size_t(a_z) * m_coarseCount[1] + a_y) * m_coarseCount[0] + a_x) * m_bytesPerVoxel;
+    if (best){
+        memcpy(out, best, m_bytesPerVoxel);
+    }
+    else{
+        memset(out, 0, m_bytesPerVoxel);
+    }
+}
+
+void VolumeLod::build(const unsigned char *a_fine, unsigned char *a_coarse) const{
+    VoxelBox box;
+    for (int i = 0 ; i < 3 ; i++){
+        box.m_min[i] = 0;
+        box.m_max[i] = m_fineCount[i];
+    }
+    update(a_fine, a_coarse, box);
+}
+
+void VolumeLod::update(const unsigned char *a_fine, unsigned char *a_coarse, const VoxelBox &a_fineBox) const{
+    int coarseMin[3], coarseMax[3];
+    for (int i = 0 ; i < 3 ; i++){
+        coarseMin[i] = max(a_fineBox.m_min[i], 0) / m_factor;
+        coarseMax[i] = min((min(a_fineBox.m_max[i], m_fineCount[i]) + m_factor - 1) / m_factor, m_coarseCount[i]);
+    }
+
+    for (int z = coarseMin[2] ; z < coarseMax[2] ; z++){
+        for (int y = coarseMin[1] ; y < coarseMax[1] ; y++){
+            for (int x = coarseMin[0] ; x < coarseMax[0] ; x++){
+                computeVoxel(a_fine, a_coarse, x, y, z);
+            }
+        }
+    }
+}
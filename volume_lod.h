@@ -0,0 +1,43 @@
+#ifndef VOLUME_LOD_H
+#define VOLUME_LOD_H
+
+#include "dirty_bricks.h"
+
+///
+/// \brief A coarse level of a volume for the haptics, built from the fine level that is
+/// rendered. Each coarse voxel covers a cube of a_factor fine voxels per axis and takes the
+/// bytes of its densest fine voxel, so the coarse level is a max pyramid of the fine one: it is
+/// occupied wherever any of its fine voxels is, and the proxies resting on it never sink into
+/// the rendered surface. The voxels are raw bytes of any format whose last byte is the density,
+/// i.e. the alpha of RGBA and the density of a labeled volume. The levels are owned by the
+/// caller, after a removal on the fine level update() recomputes the coarse voxels of its box.
+///
+class VolumeLod{
+public:
+    VolumeLod();
+
+    void init(const int a_fineCount[3], int a_bytesPerVoxel, int a_factor);
+
+    bool isEnabled() const {return m_factor > 1;}
+
+    int getFactor() const {return m_factor;}
+
+    // voxels of the coarse level along an axis, the fine count rounded up to the factor
+    int getCoarseCount(int a_axis) const {return m_coarseCount[a_axis];}
+
+    // Computes the whole coarse level
+    void build(const unsigned char* a_fine, unsigned char* a_coarse) const;
+
+    // Recomputes the coarse voxels covering a box of fine voxels
+    void update(const unsigned char* a_fine, unsigned char* a_coarse, const VoxelBox& a_fineBox) const;
+
+private:
+    inline void computeVoxel(const unsigned char* a_fine, unsigned char* a_coarse, int a_x, int a_y, int a_z) const;
+
+    int m_fineCount[3];
+    int m_coarseCount[3];
+    int m_bytesPerVoxel;
+    int m_factor;
+};
+
+#endif // VOLUME_LOD_H
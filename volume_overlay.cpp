@@ -0,0 +1,128 @@
+#include "volume_overlay.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+VolumeBase::VolumeBase(){
+    m_fd = -1;
+    m_size = 0;
+}
+
+VolumeBase::~VolumeBase(){
+    close();
+}
+
+bool VolumeBase::create(const unsigned char *a_data, size_t a_size){
+    close();
+    m_fd = memfd_create("volumetric_drilling_base", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (m_fd < 0){
+        cerr << "ERROR! FAILED TO CREATE THE BASE VOLUME: " << strerror(errno) << endl;
+        return false;
+    }
+    if (ftruncate(m_fd, a_size) != 0){
+        cerr << "ERROR! FAILED TO ALLOCATE " << a_size / (1024 * 1024) << " MB FOR THE BASE VOLUME: " << strerror(errno) << endl;
+        close();
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < a_size){
+        ssize_t count = pwrite(m_fd, a_data + written, a_size - written, written);
+        if (count < 0 && errno == EINTR){
+            continue;
+        }
+        if (count <= 0){
+            cerr << "ERROR! FAILED TO WRITE THE BASE VOLUME: " << strerror(errno) << endl;
+            close();
+            return false;
+        }
+        written += count;
+    }
+
+    // the private mappings of the overlays are still allowed once the writes are sealed
+    if (fcntl(m_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0){
+        cerr << "WARNING! FAILED TO SEAL THE BASE VOLUME READ-ONLY: " << strerror(errno) << endl;
+    }
+    m_size = a_size;
+    return true;
+}
+
+void VolumeBase::close(){
+    if (m_fd >= 0){
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_size = 0;
+}
+
+VolumeOverlay::VolumeOverlay(){
+    m_data = NULL;
+    m_size = 0;
+}
+
+VolumeOverlay::~VolumeOverlay(){
+    unmap();
+}
+
+bool VolumeOverlay::map(const VolumeBase &a_base){
+    unmap();
+    if (a_base.getFd() < 0 || a_base.getSize() == 0){
+        cerr << "ERROR! THE BASE VOLUME OF THE OVERLAY ISN'T CREATED" << endl;
+        return false;
+    }
+    void* mapping = mmap(NULL, a_base.getSize(), PROT_READ | PROT_WRITE, MAP_PRIVATE, a_base.getFd(), 0);
+    if (mapping == MAP_FAILED){
+        cerr << "ERROR! FAILED TO MAP THE OVERLAY OF THE BASE VOLUME: " << strerror(errno) << endl;
+        return false;
+    }
+    m_data = (unsigned char*)mapping;
+    m_size = a_base.getSize();
+    return true;
+}
+
+void VolumeOverlay::unmap(){
+    if (m_data){
+        munmap(m_data, m_size);
+        m_data = NULL;
+    }
+    m_size = 0;
+}
+
+size_t VolumeOverlay::getPrivateBytes() const{
+    if (!m_data){
+        return 0;
+    }
+
+    // the mapping is found by its start address, the line of its range is followed by its fields
+    char start[32];
+    snprintf(start, sizeof(start), "%lx-", (unsigned long)m_data);
+    ifstream smaps("/proc/self/smaps");
+    string line;
+    bool inMapping = false;
+    while (getline(smaps, line)){
+        string field = line.substr(0, line.find(' '));
+        bool isRange = !field.empty() && field[field.size() - 1] != ':' && field.find('-') != string::npos;
+        if (isRange){
+            if (inMapping){
+                break;
+            }
+            inMapping = line.compare(0, strlen(start), start) == 0;
+        }
+        else if (inMapping && line.compare(0, 10, "Anonymous:") == 0){
+            stringstream ss(line.substr(10));
+            size_t kb = 0;
+            ss >> kb;
+            return kb * 1024;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef VOLUME_OVERLAY_H
+#define VOLUME_OVERLAY_H
+
+#include <cstddef>
+
+///
+/// \brief The voxels of a volume held once in anonymous memory and sealed read-only, so that
+/// several drilling sessions of a process can share them. Each session maps it through its
+/// own VolumeOverlay.
+///
+class VolumeBase{
+public:
+    VolumeBase();
+    ~VolumeBase();
+
+    // Copies a_size bytes of voxels into the base, which can't be modified afterwards
+    bool create(const unsigned char* a_data, size_t a_size);
+    void close();
+
+    int getFd() const {return m_fd;}
+    size_t getSize() const {return m_size;}
+
+private:
+    int m_fd;
+    size_t m_size;
+};
+
+///
+/// \brief A private copy-on-write mapping of a VolumeBase. The drilled voxels are written to
+/// the mapping as to any other image, the kernel copies the pages they are in on the first
+/// write, so a session only holds the memory of the pages it modified.
+///
+class VolumeOverlay{
+public:
+    VolumeOverlay();
+    ~VolumeOverlay();
+
+    bool map(const VolumeBase& a_base);
+    void unmap();
+
+    unsigned char* getData() {return m_data;}
+    size_t getSize() const {return m_size;}
+
+    // Bytes of the pages copied from the base, reads the resident pages of the mapping so it
+    // isn't meant to be called every tick
+    size_t getPrivateBytes() const;
+
+private:
+    unsigned char* m_data;
+    size_t m_size;
+};
+
+#endif // VOLUME_OVERLAY_H
@@ -0,0 +1,196 @@
+#include "volume_shared_memory.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+const char* VolumeSharedMemory::s_magic = "VDRILSHM";
+
+static_assert(sizeof(SharedVolumeHeader) == 112, "The shared volume header must keep its layout");
+
+static size_t alignSize(size_t a_size){
+    return (a_size + 63) & ~size_t(63);
+}
+
+VolumeSharedMemory::VolumeSharedMemory(){
+    m_header = NULL;
+    m_data = NULL;
+    m_brickGenerations = NULL;
+    m_dirtyBits = NULL;
+    m_palette = NULL;
+    m_size = 0;
+    m_dirtyWordCount = 0;
+}
+
+VolumeSharedMemory::~VolumeSharedMemory(){
+    close();
+}
+
+bool VolumeSharedMemory::create(const string &a_name, const int a_voxelCount[3], int a_bytesPerVoxel, int a_brickSize){
+    close();
+
+    uint32_t brickCount[3];
+    size_t voxelCount = 1, totalBrickCount = 1;
+    for (int i = 0 ; i < 3 ; i++){
+        brickCount[i] = uint32_t((a_voxelCount[i] + a_brickSize - 1) / a_brickSize);
+        voxelCount *= size_t(a_voxelCount[i]);
+        totalBrickCount *= brickCount[i];
+    }
+    m_dirtyWordCount = (totalBrickCount + 63) / 64;
+
+    size_t dataOffset = alignSize(sizeof(SharedVolumeHeader));
+    size_t brickGenerationOffset = alignSize(dataOffset + voxelCount * a_bytesPerVoxel);
+    size_t dirtyBitsOffset = alignSize(brickGenerationOffset + totalBrickCount * sizeof(uint64_t));
+    size_t paletteOffset = alignSize(dirtyBitsOffset + m_dirtyWordCount * sizeof(uint64_t));
+    size_t size = paletteOffset + 256 * 4;
+
+    shm_unlink(a_name.c_str());
+    int fd = shm_open(a_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0){
+        cerr << "ERROR! FAILED TO CREATE SHARED MEMORY " << a_name << ": " << strerror(errno) << endl;
+        return false;
+    }
+    if (ftruncate(fd, off_t(size)) != 0){
+        cerr << "ERROR! FAILED TO RESIZE SHARED MEMORY " << a_name << " TO " << size << " BYTES: " << strerror(errno) << endl;
+        ::close(fd);
+        shm_unlink(a_name.c_str());
+        return false;
+    }
+    void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED){
+        cerr << "ERROR! FAILED TO MAP SHARED MEMORY " << a_name << ": " << strerror(errno) << endl;
+        shm_unlink(a_name.c_str());
+        return false;
+    }
+
+    // the segment is zero filled, the header is written before the magic is
+    unsigned char* base = (unsigned char*)mapped;
+    m_header = new (base) SharedVolumeHeader();
+    m_header->m_version = s_version;
+    m_header->m_headerSize = sizeof(SharedVolumeHeader);
+    m_header->m_sequence.store(0, memory_order_relaxed);
+    m_header->m_generation = 0;
+    m_header->m_simTime = 0.0;
+    for (int i = 0 ; i < 3 ; i++){
+        m_header->m_voxelCount[i] = uint32_t(a_voxelCount[i]);
+        m_header->m_brickCount[i] = brickCount[i];
+    }
+    m_header->m_bytesPerVoxel = uint32_t(a_bytesPerVoxel);
+    m_header->m_brickSize = uint32_t(a_brickSize);
+    m_header->m_dataOffset = dataOffset;
+    m_header->m_brickGenerationOffset = brickGenerationOffset;
+    m_header->m_dirtyBitsOffset = dirtyBitsOffset;
+    m_header->m_paletteOffset = paletteOffset;
+    m_header->m_size = size;
+    atomic_thread_fence(memory_order_release);
+    memcpy(m_header->m_magic, s_magic, sizeof(m_header->m_magic));
+
+    m_name = a_name;
+    m_size = size;
+    m_data = base + dataOffset;
+    m_brickGenerations = (uint64_t*)(base + brickGenerationOffset);
+    m_dirtyBits = (uint64_t*)(base + dirtyBitsOffset);
+    m_palette = base + paletteOffset;
+    return true;
+}
+
+void VolumeSharedMemory::beginWrite(){
+    uint64_t sequence = m_header->m_sequence.load(memory_order_relaxed);
+    m_header->m_sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memset(m_dirtyBits, 0, m_dirtyWordCount * sizeof(uint64_t));
+}
+
+void VolumeSharedMemory::endWrite(double a_simTime){
+    m_header->m_generation++;
+    m_header->m_simTime = a_simTime;
+    m_header->m_sequence.store(m_header->m_sequence.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+///
+/// \brief This method copies a box of voxels row by row and stamps its bricks with the
+/// generation being written.
+///
+void VolumeSharedMemory::copyBox(const unsigned char *a_data, const VoxelBox &a_box){
+    const uint32_t* count = m_header->m_voxelCount;
+    size_t bytesPerVoxel = m_header->m_bytesPerVoxel;
+    int boxMin[3], boxMax[3];
+    for (int i = 0 ; i < 3 ; i++){
+        boxMin[i] = max(a_box.m_min[i], 0);
+        boxMax[i] = min(a_box.m_max[i], int(count[i]));
+        if (boxMin[i] >= boxMax[i]){
+            return;
+        }
+    }
+
+    size_t rowSize = size_t(boxMax[0] - boxMin[0]) * bytesPerVoxel;
+    for (int z = boxMin[2] ; z < boxMax[2] ; z++){
+        for (int y = boxMin[1] ; y < boxMax[1] ; y++){
+            size_t offset = ((size_t(z) * count[1] + y) * count[0] + boxMin[0]) * bytesPerVoxel;
+            memcpy(m_data + offset, a_data + offset, rowSize);
+        }
+    }
+
+    int brickSize = int(m_header->m_brickSize);
+    const uint32_t* brickCount = m_header->m_brickCount;
+    uint64_t generation = m_header->m_generation + 1;
+    for (int bz = boxMin[2] / brickSize ; bz <= (boxMax[2] - 1) / brickSize ; bz++){
+        for (int by = boxMin[1] / brickSize ; by <= (boxMax[1] - 1) / brickSize ; by++){
+            for (int bx = boxMin[0] / brickSize ; bx <= (boxMax[0] - 1) / brickSize ; bx++){
+                size_t idx = (size_t(bz) * brickCount[1] + by) * brickCount[0] + bx;
+                m_brickGenerations[idx] = generation;
+                m_dirtyBits[idx >> 6] |= uint64_t(1) << (idx & 63);
+            }
+        }
+    }
+}
+
+void VolumeSharedMemory::writeAll(const unsigned char *a_data, const unsigned char *a_palette, double a_simTime){
+    if (!m_header){
+        return;
+    }
+    beginWrite();
+    if (a_palette){
+        memcpy(m_palette, a_palette, 256 * 4);
+    }
+    else{
+        memset(m_palette, 0, 256 * 4);
+    }
+    VoxelBox box;
+    for (int i = 0 ; i < 3 ; i++){
+        box.m_min[i] = 0;
+        box.m_max[i] = int(m_header->m_voxelCount[i]);
+    }
+    copyBox(a_data, box);
+    endWrite(a_simTime);
+}
+
+void VolumeSharedMemory::writeBoxes(const unsigned char *a_data, const vector<VoxelBox> &a_boxes, double a_simTime){
+    if (!m_header || a_boxes.empty()){
+        return;
+    }
+    beginWrite();
+    for (size_t i = 0 ; i < a_boxes.size() ; i++){
+        copyBox(a_data, a_boxes[i]);
+    }
+    endWrite(a_simTime);
+}
+
+void VolumeSharedMemory::close(){
+    if (m_header){
+        munmap(m_header, m_size);
+        shm_unlink(m_name.c_str());
+        m_header = NULL;
+        m_data = NULL;
+        m_brickGenerations = NULL;
+        m_dirtyBits = NULL;
+        m_palette = NULL;
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef VOLUME_SHARED_MEMORY_H
+#define VOLUME_SHARED_MEMORY_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "dirty_bricks.h"
+
+///
+/// \brief Start of the shared memory segment of a volume, followed by the voxels, the
+/// generation of each brick, the bricks changed by the last generation and the palette. The
+/// offsets are from the start of the segment, all fields are naturally aligned so that the
+/// layout is the same in any language.
+///
+struct SharedVolumeHeader{
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_headerSize;
+    // odd while the writer is copying, incremented twice per generation
+    std::atomic<uint64_t> m_sequence;
+    // incremented once per write, the voxels of generation 1 are the loaded volume
+    uint64_t m_generation;
+    double m_simTime;
+    uint32_t m_voxelCount[3];
+    uint32_t m_bytesPerVoxel;
+    uint32_t m_brickSize;
+    uint32_t m_brickCount[3];
+    uint64_t m_dataOffset;
+    // one uint64_t per brick, the generation that last changed it
+    uint64_t m_brickGenerationOffset;
+    // one bit per brick in uint64_t words, the bricks changed by the last generation
+    uint64_t m_dirtyBitsOffset;
+    // 256 RGBA colors of the labels of a labeled volume, zero for an RGBA one
+    uint64_t m_paletteOffset;
+    uint64_t m_size;
+};
+
+///
+/// \brief Exports the voxels of the volume in a named POSIX shared memory segment, so that
+/// local processes can map it and follow the drilling without the per voxel messages. The
+/// writer is the graphics thread, which copies the bricks it uploads to the texture, so the
+/// haptic loop does no extra work.
+///
+/// The header is a seqlock: a reader copies what it needs between two reads of the sequence
+/// and retries if the sequence was odd or changed. A reader that only copies the bricks whose
+/// generation is newer than its last snapshot stays consistent at any rate.
+///
+class VolumeSharedMemory{
+public:
+    VolumeSharedMemory();
+    ~VolumeSharedMemory();
+
+    // Creates the segment, replacing one of the same name. a_name starts with a slash
+    bool create(const std::string& a_name, const int a_voxelCount[3], int a_bytesPerVoxel, int a_brickSize);
+
+    bool isOpen() const {return m_header != NULL;}
+
+    int getBytesPerVoxel() const {return m_header ? int(m_header->m_bytesPerVoxel) : 0;}
+
+    // Copies the whole volume and the palette, null for an RGBA volume, as a new generation
+    void writeAll(const unsigned char* a_data, const unsigned char* a_palette, double a_simTime);
+
+    // Copies the boxes of the volume as a new generation
+    void writeBoxes(const unsigned char* a_data, const std::vector<VoxelBox>& a_boxes, double a_simTime);
+
+    // Unmaps and removes the segment
+    void close();
+
+    static const char* s_magic;
+    static const uint32_t s_version = 1;
+
+private:
+    void beginWrite();
+
+    void endWrite(double a_simTime);
+
+    void copyBox(const unsigned char* a_data, const VoxelBox& a_box);
+
+    std::string m_name;
+    SharedVolumeHeader* m_header;
+    unsigned char* m_data;
+    uint64_t* m_brickGenerations;
+    uint64_t* m_dirtyBits;
+    unsigned char* m_palette;
+    size_t m_size;
+    size_t m_dirtyWordCount;
+};
+
+#endif // VOLUME_SHARED_MEMORY_H
@@ -0,0 +1,132 @@
+#include "volume_source.h"
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <yaml-cpp/yaml.h>
+
+using namespace std;
+
+static string getDirectory(const string& a_filepath){
+    size_t pos = a_filepath.rfind("/");
+    if (pos == string::npos){
+        return "./";
+    }
+    return a_filepath.substr(0, pos + 1);
+}
+
+static string resolvePath(const string& a_dir, const string& a_path){
+    if (!a_path.empty() && a_path[0] == '/'){
+        return a_path;
+    }
+    return a_dir + a_path;
+}
+
+bool VolumeImageSource::loadFromADF(const string &a_adfFilepath){
+    YAML::Node adf;
+    try{
+        adf = YAML::LoadFile(a_adfFilepath);
+    }
+    catch(...){
+        cerr << "ERROR! FAILED TO LOAD ADF FILE " << a_adfFilepath << endl;
+        return false;
+    }
+
+    YAML::Node volumes = adf["volumes"];
+    if (!volumes.IsSequence() || volumes.size() == 0){
+        return false;
+    }
+
+    string volumeKey = volumes[0].as<string>();
+    YAML::Node images = adf[volumeKey]["source images"];
+    m_deferred = images.IsDefined();
+    if (!m_deferred){
+        images = adf[volumeKey]["images"];
+    }
+    if (!images.IsDefined()){
+        cerr << "ERROR! VOLUME " << volumeKey << " IN " << a_adfFilepath << " HAS NO IMAGES BLOCK" << endl;
+        return false;
+    }
+
+    m_name = adf[volumeKey]["name"].IsDefined() ? adf[volumeKey]["name"].as<string>() : volumeKey;
+    string path = images["path"].as<string>();
+    if (!path.empty() && path[path.size() - 1] != '/'){
+        path += "/";
+    }
+    m_path = resolvePath(getDirectory(a_adfFilepath), path);
+    m_prefix = images["prefix"].as<string>();
+    m_format = images["format"].as<string>();
+    m_count = images["count"].as<int>();
+    m_loaderWorkers = images["loader workers"].IsDefined() ? images["loader workers"].as<int>() : 0;
+
+    YAML::Node volume = adf[volumeKey];
+    double scale = volume["scale"].IsDefined() ? volume["scale"].as<double>() : 1.0;
+    const char* axes[3] = {"x", "y", "z"};
+    for (int i = 0 ; i < 3 ; i++){
+        m_dimensions[i] = scale * (volume["dimensions"].IsDefined() ? volume["dimensions"][axes[i]].as<double>() : 1.0);
+    }
+    return true;
+}
+
+bool VolumeImageSource::loadFromLaunchArgs(int argc, char **argv){
+    string launchFile, indices, adfs;
+    for (int i = 1 ; i < argc ; i++){
+        string arg = argv[i];
+        string next = i + 1 < argc ? argv[i + 1] : "";
+        if (arg == "--launch_file"){
+            launchFile = next;
+        }
+        else if (arg.find("--launch_file=") == 0){
+            launchFile = arg.substr(strlen("--launch_file="));
+        }
+        else if (arg == "-l"){
+            indices = next;
+        }
+        else if (arg == "-a"){
+            adfs = next;
+        }
+    }
+
+    vector<string> adfFilepaths;
+    string item;
+    if (!adfs.empty()){
+        stringstream ss(adfs);
+        while (getline(ss, item, ',')){
+            adfFilepaths.push_back(item);
+        }
+    }
+
+    if (!launchFile.empty() && !indices.empty()){
+        try{
+            YAML::Node launch = YAML::LoadFile(launchFile);
+            YAML::Node multibodies = launch["multibody configs"];
+            stringstream ss(indices);
+            while (getline(ss, item, ',')){
+                size_t idx = atoi(item.c_str());
+                if (idx < multibodies.size()){
+                    adfFilepaths.push_back(resolvePath(getDirectory(launchFile), multibodies[idx].as<string>()));
+                }
+            }
+        }
+        catch(...){
+            cerr << "ERROR! FAILED TO LOAD LAUNCH FILE " << launchFile << endl;
+        }
+    }
+
+    for (size_t i = 0 ; i < adfFilepaths.size() ; i++){
+        YAML::Node adf;
+        try{
+            adf = YAML::LoadFile(adfFilepaths[i]);
+        }
+        catch(...){
+            continue;
+        }
+        if (adf["volumes"].IsSequence() && adf["volumes"].size() > 0){
+            return loadFromADF(adfFilepaths[i]);
+        }
+    }
+    return false;
+}
+
+string VolumeImageSource::getSliceFilepath(int a_idx) const{
+    return m_path + m_prefix + to_string(a_idx) + "." + m_format;
+}
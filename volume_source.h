@@ -0,0 +1,44 @@
+#ifndef VOLUME_SOURCE_H
+#define VOLUME_SOURCE_H
+
+#include <string>
+#include <vector>
+
+///
+/// \brief The images block of a volume ADF, i.e. the stack of slices a volume is loaded from.
+///
+struct VolumeImageSource{
+    VolumeImageSource(): m_count(0), m_loaderWorkers(0), m_deferred(false) {
+        m_dimensions[0] = m_dimensions[1] = m_dimensions[2] = 1.0;
+    }
+
+    // Reads the images block of the first volume in the ADF file, or its source images block
+    // if it has one
+    bool loadFromADF(const std::string& a_adfFilepath);
+
+    // Finds the volume ADF among the multibodies loaded by the simulator, i.e. the
+    // --launch_file and -l arguments or the -a argument
+    bool loadFromLaunchArgs(int argc, char** argv);
+
+    // Filepath of the slice at index a_idx
+    std::string getSliceFilepath(int a_idx) const;
+
+    bool isValid() const {return m_count > 0;}
+
+    // Name of the volume in the ADF
+    std::string m_name;
+    // Absolute directory of the images
+    std::string m_path;
+    std::string m_prefix;
+    std::string m_format;
+    int m_count;
+    // Number of threads decoding the slices, from the optional "loader workers" key. 0 = one per core
+    int m_loaderWorkers;
+    // The slices are in a "source images" block, the images block only gives the simulator a
+    // placeholder and the slices are loaded by the plugin
+    bool m_deferred;
+    // Size of the volume in world units, i.e. its dimensions times its scale
+    double m_dimensions[3];
+};
+
+#endif // VOLUME_SOURCE_H
@@ -45,9 +45,20 @@
 
 #include "volumetric_drilling.h"
 #include <boost/program_options.hpp>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
 
 using namespace std;
 
+// the scene is a tenth of the real size in meters, the exported surfaces and the distances
+// given on the command line are in millimeters
+static const double s_millimetersPerUnit = 0.1 * 1000.0;
+
+// Flat colors of the matcaps until they are loaded
+static const cColorb s_volumeMatcapPlaceholder(220, 220, 220, 255);
+static const cColorb s_drillMatcapPlaceholder(90, 90, 90, 255);
 
 //------------------------------------------------------------------------------
 // DECLARED FUNCTIONS
@@ -61,10 +72,12 @@ afVolmetricDrillingPlugin::afVolmetricDrillingPlugin(){
     m_drillBurrSizes[2] = make_pair<double, string>(0.06041, "6 mm");
 
     // Set the 2nd drill burr type as the active one.
-    m_activeBurrIdx = 1;
+    m_selectedBurrIdx = 1;
 }
 
 int afVolmetricDrillingPlugin::init(int argc, char **argv, const afWorldPtr a_afWorld){
+    m_startupTimeline.start();
+    m_assetLoader.setTimeline(&m_startupTimeline);
 
     namespace p_opt = boost::program_options;
     p_opt::options_description cmd_opts("drilling_simulator Command Line Options");
@@ -74,7 +87,39 @@ int afVolmetricDrillingPlugin::init(int argc, char **argv, const afWorldPtr a_af
             ("ds", p_opt::value<float>()->default_value(0.026), "Offset between shaft tool cursors. Default 0.026")
             ("vm", p_opt::value<string>()->default_value("00ShinyWhite.jpg"), "Volume's Matcap Filename (Should be placed in the ./resources/matcap/ folder)")
             ("dm", p_opt::value<string>()->default_value("dark_metal_brushed.jpg"), "Drill's Matcap Filename (Should be placed in ./resources/matcap/ folder)")
-            ("mute", p_opt::value<bool>()->default_value(false), "Mute");
+            ("mute", p_opt::value<bool>()->default_value(false), "Mute")
+            ("pvt", p_opt::value<bool>()->default_value(false), "Also publish each removed voxel on the legacy voxels_removed topic. Default false")
+            ("pqs", p_opt::value<int>()->default_value(262144), "Capacity of the queue between the physics and the ROS publisher threads. Default 262144")
+            ("rosns", p_opt::value<string>()->default_value("ambf"), "Namespace of the ROS topics of the plugin. Default ambf")
+            ("rosname", p_opt::value<string>()->default_value("volumetric_drilling"), "Name of the drilling session, the topics are published under /<rosns>/<rosname>/. Default volumetric_drilling")
+            ("tub", p_opt::value<float>()->default_value(32.0), "Volume texture upload budget per frame in MB, 0 for unlimited. Default 32")
+            ("bs", p_opt::value<int>()->default_value(16), "Size of the bricks used to track modified voxels. Default 16")
+            ("vcache", p_opt::value<bool>()->default_value(true), "Keep a binary cache of the volume next to its image directory. Default true")
+            ("ess", p_opt::value<bool>()->default_value(true), "Skip the empty bricks of the volume while ray marching. Default true")
+            ("essd", p_opt::value<int>()->default_value(8), "Largest number of empty bricks a ray of the volume jumps over at once with --ess, from 1 to 254. Default 8")
+            ("aqfps", p_opt::value<float>()->default_value(0.0), "Target frame rate of the adaptive volume rendering quality, 0 to disable. Default 0")
+            ("fcw", p_opt::value<int>()->default_value(0), "Worker threads running the broad-phase of the shaft tool cursors, 0 to run it on the physics thread, -1 for one per core. The forces are always computed on the physics thread. Default 0")
+            ("bpc", p_opt::value<bool>()->default_value(true), "Skip the force computation of the shaft tool cursors that can't touch the volume. Default true")
+            ("hr", p_opt::value<float>()->default_value(0.0), "Rate of the dedicated haptic thread in Hz (1000 - 4000), 0 to run the haptic loop in the physics update. Default 0")
+            ("perf", p_opt::value<float>()->default_value(1.0), "Rate the stage latencies are published at on the perf topic in Hz, 0 to disable the timers. Default 1")
+            ("rsr", p_opt::value<float>()->default_value(10.0), "Rate the removed voxels per label, the removal rate and the critical structure contact time are published at on the removal_stats topic in Hz, 0 to disable. Default 10")
+            ("perfov", p_opt::value<bool>()->default_value(false), "Show the stage latencies in an overlay. Default false")
+            ("perftrace", p_opt::value<string>()->default_value(""), "Write the timed stages to this Chrome trace file on close, empty to disable. Default empty")
+            ("record", p_opt::value<string>()->default_value(""), "Record the inputs of the haptic loop to this file from the start, empty to only record with [CTRL+E]. Default empty")
+            ("srec", p_opt::value<string>()->default_value(""), "Record the session, the camera images and depth, the poses and the removed voxels, to this HDF5 file from the start, empty to only record with [CTRL+H]. Default empty")
+            ("shm", p_opt::value<string>()->default_value(""), "Export the voxels of the volume in this POSIX shared memory segment, e.g. /volumetric_drilling, for local analysis processes, empty to disable. Default empty")
+            ("srecfps", p_opt::value<float>()->default_value(30.0), "Rate the cameras and poses of the session are recorded at. Default 30")
+            ("jmb", p_opt::value<float>()->default_value(256.0), "Memory cap of the journal of removed voxels used to roll back the drilling, in MB, 0 to disable. Default 256")
+            ("undo", p_opt::value<float>()->default_value(5.0), "Seconds of drilling rolled back by [CTRL+Z]. Default 5")
+            ("cwd", p_opt::value<float>()->default_value(1.0), "Distance in mm between the burr and a critical structure, any voxel that isn't bone, that shows the warning, 0 to only warn on contact. Default 1")
+            ("cwf", p_opt::value<float>()->default_value(0.0), "Force in N that pushes the burr away from a critical structure it touches, fading out at the warning distance, 0 to disable. Default 0")
+            ("cwa", p_opt::value<bool>()->default_value(false), "Raise the pitch of the drill as the burr gets closer to a critical structure. Default false")
+            ("smi", p_opt::value<float>()->default_value(0.0), "Interval in seconds between the snapshots of the volume surface, 0 to disable. Default 0")
+            ("smd", p_opt::value<string>()->default_value("."), "Directory of the volume surface snapshots. Default .")
+            ("gpuc", p_opt::value<bool>()->default_value(false), "Carve the burr out of the volume texture with a compute shader and only read the removed voxels back, needs OpenGL 4.4 and an RGBA volume. Default false")
+            ("gpucv", p_opt::value<int>()->default_value(262144), "Maximum number of voxels carved by the GPU per frame. Default 262144")
+            ("labels", p_opt::value<bool>()->default_value(false), "Store the volume as an 8 bit label and an 8 bit density per voxel with a palette of its colors, for volumes of up to 255 colors. Default false")
+            ("lod", p_opt::value<int>()->default_value(1), "Fine voxels per axis in each voxel of the coarse level of the volume the tool cursors collide with, 1 to collide with the rendered volume. Default 1");
 
     p_opt::variables_map var_map;
     p_opt::store(p_opt::command_line_parser(argc, argv).options(cmd_opts).allow_unregistered().run(), var_map);
@@ -89,21 +134,149 @@ int afVolmetricDrillingPlugin::init(int argc, char **argv, const afWorldPtr a_af
     float ds = var_map["ds"].as<float>();
     string volume_matcap = var_map["vm"].as<string>();
     string drill_matcap = var_map["dm"].as<string>();
-    bool mute = var_map["mute"].as<bool>();
+    m_mute = var_map["mute"].as<bool>();
+    bool per_voxel_topic = var_map["pvt"].as<bool>();
+    int publisher_queue_size = var_map["pqs"].as<int>();
+    string ros_namespace = var_map["rosns"].as<string>();
+    string ros_session_name = var_map["rosname"].as<string>();
+    float texture_upload_budget = var_map["tub"].as<float>();
+    int brick_size = var_map["bs"].as<int>();
+    bool use_volume_cache = var_map["vcache"].as<bool>();
+    m_emptySpaceSkipping = var_map["ess"].as<bool>();
+    int empty_space_skip_distance = var_map["essd"].as<int>();
+    float adaptive_quality_fps = var_map["aqfps"].as<float>();
+    int force_workers = var_map["fcw"].as<int>();
+    bool tool_cursor_culling = var_map["bpc"].as<bool>();
+    float haptic_rate = var_map["hr"].as<float>();
+    float perf_rate = var_map["perf"].as<float>();
+    bool perf_overlay = var_map["perfov"].as<bool>();
+    float removal_stats_rate = var_map["rsr"].as<float>();
+    m_perfTraceFilepath = var_map["perftrace"].as<string>();
+    string record_filepath = var_map["record"].as<string>();
+    string session_filepath = var_map["srec"].as<string>();
+    float session_rate = var_map["srecfps"].as<float>();
+    string shared_memory_name = var_map["shm"].as<string>();
+    float journal_budget = var_map["jmb"].as<float>();
+    m_undoInterval = var_map["undo"].as<float>();
+    m_criticalWarningDistance = var_map["cwd"].as<float>() / s_millimetersPerUnit;
+    m_criticalForce = var_map["cwf"].as<float>();
+    m_criticalAudio = var_map["cwa"].as<bool>();
+    float snapshot_interval = var_map["smi"].as<float>();
+    string snapshot_directory = var_map["smd"].as<string>();
+    bool use_labels = var_map["labels"].as<bool>();
+    m_gpuCarvingRequested = var_map["gpuc"].as<bool>();
+    int gpu_carving_max_voxels = var_map["gpucv"].as<int>();
+    int haptic_lod = var_map["lod"].as<int>();
+
+    if (haptic_lod < 1){
+        cerr << "ERROR! THE HAPTIC LEVEL OF DETAIL MUST BE AT LEAST 1. Specified value = " << haptic_lod << endl;
+        return -1;
+    }
+
+    if (m_gpuCarvingRequested && gpu_carving_max_voxels <= 0){
+        cerr << "ERROR! THE NUMBER OF VOXELS CARVED BY THE GPU PER FRAME MUST BE POSITIVE. Specified value = " << gpu_carving_max_voxels << endl;
+        return -1;
+    }
+    m_gpuCarvingMaxVoxels = size_t(max(gpu_carving_max_voxels, 1));
+
+    if (publisher_queue_size <= 0){
+        cerr << "ERROR! PUBLISHER QUEUE SIZE MUST BE POSITIVE. Specified value = " << publisher_queue_size << endl;
+        return -1;
+    }
+
+    if (ros_session_name.empty()){
+        cerr << "ERROR! THE NAME OF THE DRILLING SESSION MUST NOT BE EMPTY" << endl;
+        return -1;
+    }
+
+    if (haptic_rate != 0 && (haptic_rate < 1000 || haptic_rate > 4000)){
+        cerr << "ERROR! HAPTIC RATE MUST BE 0 OR BETWEEN 1000 - 4000 HZ. Specified value = " << haptic_rate << endl;
+        return -1;
+    }
+
+    if (perf_rate < 0){
+        cerr << "ERROR! PERF PUBLISH RATE MUST NOT BE NEGATIVE. Specified value = " << perf_rate << endl;
+        return -1;
+    }
+
+    if (session_rate <= 0){
+        cerr << "ERROR! SESSION RECORDING RATE MUST BE POSITIVE. Specified value = " << session_rate << endl;
+        return -1;
+    }
+    m_sessionInterval = 1.0 / session_rate;
+
+    if (journal_budget < 0){
+        cerr << "ERROR! JOURNAL MEMORY CAP MUST NOT BE NEGATIVE. Specified value = " << journal_budget << endl;
+        return -1;
+    }
+
+    if (m_undoInterval <= 0){
+        cerr << "ERROR! UNDO INTERVAL MUST BE POSITIVE. Specified value = " << m_undoInterval << endl;
+        return -1;
+    }
+
+    if (m_criticalWarningDistance < 0 || m_criticalForce < 0){
+        cerr << "ERROR! CRITICAL WARNING DISTANCE AND FORCE MUST NOT BE NEGATIVE" << endl;
+        return -1;
+    }
+
+    if (snapshot_interval < 0){
+        cerr << "ERROR! SURFACE SNAPSHOT INTERVAL MUST NOT BE NEGATIVE. Specified value = " << snapshot_interval << endl;
+        return -1;
+    }
 
-    if (nt > 0 && nt <= 8){
+    if (adaptive_quality_fps < 0){
+        cerr << "ERROR! ADAPTIVE QUALITY FRAME RATE MUST NOT BE NEGATIVE. Specified value = " << adaptive_quality_fps << endl;
+        return -1;
+    }
+
+    if (brick_size <= 0 || (brick_size & (brick_size - 1)) != 0){
+        cerr << "ERROR! BRICK SIZE MUST BE A POWER OF TWO. Specified value = " << brick_size << endl;
+        return -1;
+    }
+
+    if (nt > 0 && nt <= 32){
         m_toolCursorList.resize(nt);
     }
     else{
-        cerr << "ERROR! VALID NUMBER OF TOOL CURSORS ARE BETWEEN 1 - 8. Specified value = " << nt << endl;
+        cerr << "ERROR! VALID NUMBER OF TOOL CURSORS ARE BETWEEN 1 - 32. Specified value = " << nt << endl;
         return -1;
     }
 
-    m_zeroColor = cColorb(0x00, 0x00, 0x00, 0x00);
+    // the physics thread tests a shaft cursor too, so at most one worker per other shaft cursor is useful
+    if (force_workers < 0){
+        force_workers = max(int(std::thread::hardware_concurrency()) - 1, 0);
+    }
+    force_workers = min(force_workers, max(nt - 2, 0));
+    m_core.setCulling(tool_cursor_culling);
+    if (force_workers > 0){
+        m_core.startForceWorkers(force_workers);
+        cerr << "INFO! RUNNING THE BROAD-PHASE OF THE SHAFT TOOL CURSORS ON " << force_workers << " WORKER THREADS" << endl;
+    }
 
-    m_boneColor = cColorb(255, 249, 219, 255);
+    // the trace holds about 24 MB of events, enough for minutes of the haptic loop
+    m_perf.init(perf_rate > 0, m_perfTraceFilepath.empty() ? 0 : 1 << 20);
+    if (m_perf.isEnabled()){
+        m_perfPublishInterval = 1.0 / perf_rate;
+        m_lastPerfPublishTime = std::chrono::steady_clock::now();
+    }
+    else if (!m_perfTraceFilepath.empty()){
+        cerr << "WARNING! PERF TIMERS ARE DISABLED, NO TRACE WILL BE WRITTEN" << endl;
+        m_perfTraceFilepath.clear();
+    }
+
+    // The assets are loaded in the background while the rest of the plugin is set up. The
+    // buffer of the sound is created in the context of the audio device
+    string file_path = __FILE__;
+    string cur_path = file_path.substr(0, file_path.rfind("/"));
+    m_drillAudioDevice = new cAudioDevice();
+    int fontAsset = m_assetLoader.loadFont("OVERLAY FONT");
+    m_volumeMatcapAsset = m_assetLoader.loadTexture("VOLUME MATCAP TEXTURE", cur_path + "/resources/matcap/" + volume_matcap);
+    m_drillMatcapAsset = m_assetLoader.loadTexture("DRILL MATCAP TEXTURE", cur_path + "/resources/matcap/" + drill_matcap);
+    m_drillAudioAsset = m_assetLoader.loadAudio("DRILL AUDIO", cur_path + "/resources/sounds/drill.wav");
+    m_startupTimeline.mark("options parsed, assets loading");
 
-    m_storedColor = cColorb(0x00, 0x00, 0x00, 0x00);
+    m_boneColor = cColorb(255, 249, 219, 255);
 
     m_dX = ds;
 
@@ -133,8 +306,8 @@ int afVolmetricDrillingPlugin::init(int argc, char **argv, const afWorldPtr a_af
         return -1;
     }
     else{
-        m_burrMesh = new cShapeSphere(m_drillBurrSizes[m_activeBurrIdx].first);
-        m_burrMesh->setRadius(m_drillBurrSizes[m_activeBurrIdx].first);
+        m_burrMesh = new cShapeSphere(m_drillBurrSizes[m_selectedBurrIdx].first);
+        m_burrMesh->setRadius(m_drillBurrSizes[m_selectedBurrIdx].first);
         m_burrMesh->m_material->setBlack();
         m_burrMesh->m_material->setShininess(0);
         m_burrMesh->m_material->m_specular.set(0, 0, 0);
@@ -152,6 +325,17 @@ int afVolmetricDrillingPlugin::init(int argc, char **argv, const afWorldPtr a_af
         m_voxelObj = m_volumeObject->getInternalVolume();
     }
 
+    if (!m_volumeSource.loadFromLaunchArgs(argc, argv)){
+        cerr << "INFO! COULD NOT FIND THE VOLUME ADF IN THE LAUNCH ARGUMENTS, VOLUME CACHE DISABLED" << endl;
+    }
+    else if (m_volumeSource.m_deferred){
+        if (!loadDeferredVolume(use_volume_cache)){
+            cerr << "ERROR! FAILED TO LOAD THE SOURCE IMAGES OF " << m_volumeSource.m_name << endl;
+            return -1;
+        }
+        m_startupTimeline.mark("volume loaded");
+    }
+
     // create a haptic device handler
     m_deviceHandler = new cHapticDeviceHandler();
 
@@ -163,6 +347,7 @@ int afVolmetricDrillingPlugin::init(int argc, char **argv, const afWorldPtr a_af
 
     // Initializing tool cursors
     toolCursorInit(a_afWorld);
+    m_startupTimeline.mark("tool cursors initialized");
 
     // read the scale factor between the physical workspace of the haptic
     // device and the virtual workspace defined for the tool
@@ -177,8 +362,9 @@ int afVolmetricDrillingPlugin::init(int argc, char **argv, const afWorldPtr a_af
     m_voxelObj->m_material->setDynamicFriction(0.0);
     m_voxelObj->setUseMaterial(true);
 
-    // create a font
-    cFontPtr font = NEW_CFONTCALIBRI40();
+    // the overlays are built with the font, so it's waited for
+    cFontPtr font = m_assetLoader.waitFont(fontAsset);
+    m_startupTimeline.mark("font ready");
 
     // A warning pop-up that shows up while drilling at critical region
     m_warningPopup = new cPanel();
@@ -209,7 +395,7 @@ int afVolmetricDrillingPlugin::init(int argc, char **argv, const afWorldPtr a_af
     m_drillSizeText->setLocalPos(20,70);
     m_drillSizeText->m_fontColor.setBlack();
     m_drillSizeText->setFontScale(.75);
-    m_drillSizeText->setText("Drill Size: " + m_drillBurrSizes[m_activeBurrIdx].second);
+    m_drillSizeText->setText("Drill Size: " + m_drillBurrSizes[m_selectedBurrIdx].second);
     m_mainCamera->getFrontLayer()->addChild(m_drillSizeText);
 
     m_drillControlModeText = new cLabel(font);
@@ -226,12 +412,45 @@ int afVolmetricDrillingPlugin::init(int argc, char **argv, const afWorldPtr a_af
     m_volumeSmoothingText->setText("[ALT+S] Volume Smoothing: DISABLED");
     m_mainCamera->getFrontLayer()->addChild(m_volumeSmoothingText);
 
+    // Stage latencies, in the top left corner
+    if (m_perf.isEnabled() && perf_overlay){
+        for (int i = 0 ; i < PERF_NUM_STAGES ; i++){
+            cLabel* perfText = new cLabel(font);
+            perfText->setLocalPos(20, m_mainCamera->m_height - 30 - 20 * i);
+            perfText->m_fontColor.setBlack();
+            perfText->setFontScale(.4);
+            perfText->setText(string(PerfProfiler::getStageName(PerfStage(i))) + ": -");
+            m_mainCamera->getFrontLayer()->addChild(perfText);
+            m_perfTexts.push_back(perfText);
+        }
+        m_textureUploadText = new cLabel(font);
+        m_textureUploadText->setLocalPos(20, m_mainCamera->m_height - 30 - 20 * PERF_NUM_STAGES);
+        m_textureUploadText->m_fontColor.setBlack();
+        m_textureUploadText->setFontScale(.4);
+        m_textureUploadText->setText("texture upload: -");
+        m_mainCamera->getFrontLayer()->addChild(m_textureUploadText);
+    }
+    m_startupTimeline.mark("overlay panels built");
+
     // Get drills initial pose
     m_T_d_init = m_drillRigidBody->getLocalTransform();
     m_T_d = m_T_d_init;
+    m_drillMeshPose = m_T_d_init;
+
+    // The quality and smoothing level of the volume are the ceilings of the controller
+    m_qualityController.init(adaptive_quality_fps, m_voxelObj->getQuality(), m_volumeSmoothingLevel);
+    if (m_qualityController.isEnabled()){
+        // the GPU time of a frame ends with the last draw of the volume, before the swap
+        m_voxelObj->addChild(new GpuFrameEndMarker(&m_gpuFrameTimer));
+        cerr << "INFO! ADAPTIVE VOLUME QUALITY ENABLED, TARGET FRAME RATE: " << adaptive_quality_fps;
+        if (m_stereoCameraL || m_stereoCameraR){
+            cerr << " (SHARED BY THE STEREO CAMERAS)";
+        }
+        cerr << endl;
+    }
 
     // Set up voxels_removed publisher
-    m_drillingPub = new DrillingPublisher("ambf", "volumetric_drilling");
+    m_drillingPub = new DrillingPublisher(ros_namespace, ros_session_name, per_voxel_topic, publisher_queue_size);
 
     // Volume Properties
     float dim[3];
@@ -243,222 +462,1483 @@ int afVolmetricDrillingPlugin::init(int argc, char **argv, const afWorldPtr a_af
     voxelCount[0] = m_volumeObject->getVoxelCount().get(0);
     voxelCount[1]= m_volumeObject->getVoxelCount().get(1);
     voxelCount[2] = m_volumeObject->getVoxelCount().get(2);
+    if (m_volumeSource.m_deferred){
+        // the simulator only knows the placeholder
+        voxelCount[0] = m_voxelObj->m_texture->m_image->getWidth();
+        voxelCount[1] = m_voxelObj->m_texture->m_image->getHeight();
+        voxelCount[2] = m_volumeSource.m_count;
+    }
+
+    m_drillingPub->volumeProp(dim, voxelCount);
+
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = voxelCount[i];
+    }
+
+    if (use_labels && convertVolumeToLabels()){
+        cerr << "INFO! STORING THE VOLUME AS THE LABELS OF " << m_voxelPalette.getLabelCount() << " COLORS" << endl;
+    }
+
+    m_dirtyBricks.init(m_voxelCount[0], m_voxelCount[1], m_voxelCount[2], brick_size);
+    m_dirtyBricks.initExchange(m_dirtyBrickExchange);
+    if (m_gpuCarvingRequested){
+        m_carvedBricks.init(m_voxelCount[0], m_voxelCount[1], m_voxelCount[2], brick_size);
+        m_carvedBricks.initExchange(m_carvedBrickExchange);
+    }
+    cImagePtr volumeImage = m_voxelObj->m_texture->m_image;
+    if (texture_upload_budget > 0){
+        m_textureUploadBudget = size_t(texture_upload_budget * 1024 * 1024 / volumeImage->getBytesPerPixel());
+    }
+
+    m_core.initVolume(m_voxelObj, m_voxelCount, brick_size, &m_dirtyBrickExchange);
+    if (!m_voxelPalette.isEmpty()){
+        m_core.setPalette(&m_voxelPalette);
+        m_surfaceMesher.setPalette(&m_voxelPalette);
+    }
+    m_removalStats.setPalette(m_voxelPalette.isEmpty() ? nullptr : m_voxelPalette.getColors().data());
+    if (removal_stats_rate > 0){
+        m_removalStatsInterval = 1.0 / removal_stats_rate;
+        m_lastRemovalStatsTime = std::chrono::steady_clock::now();
+    }
+    if (haptic_lod > 1){
+        initHapticLevel(haptic_lod);
+    }
+    BrickOccupancy& occupancy = m_core.getOccupancy();
+    cerr << "INFO! " << occupancy.getAllocatedBrickCount() << " OF " << occupancy.getTotalBrickCount()
+         << " VOLUME BRICKS ARE OCCUPIED (" << occupancy.getMemoryUsage() / 1024 << " KB)" << endl;
+
+    if (journal_budget > 0 && m_voxelJournal.init(m_voxelCount, size_t(journal_budget * 1024 * 1024))){
+        m_core.setJournal(&m_voxelJournal);
+        cerr << "INFO! JOURNALING THE REMOVED VOXELS, UP TO " << journal_budget << " MB" << endl;
+    }
+
+    // the surface is meshed between the voxel centers, in the local frame of the volume
+    double voxelOrigin[3], voxelSize[3];
+    for (int i = 0 ; i < 3 ; i++){
+        double texCoord = 0.5 / m_voxelCount[i];
+        voxelOrigin[i] = m_voxelObj->m_minCorner(i) + (texCoord - m_voxelObj->m_minTextureCoord(i)) /
+                (m_voxelObj->m_maxTextureCoord(i) - m_voxelObj->m_minTextureCoord(i)) * (m_voxelObj->m_maxCorner(i) - m_voxelObj->m_minCorner(i));
+        voxelSize[i] = m_core.getVoxelRemover().getVoxelSize(i);
+    }
+    m_surfaceMesher.init(volumeImage->getData(), volumeImage->getBytesPerPixel(), m_voxelCount, brick_size, voxelOrigin, voxelSize);
+    if (snapshot_interval > 0){
+        m_surfaceMesher.setSnapshots(snapshot_interval, snapshot_directory, s_millimetersPerUnit);
+        m_surfaceMesher.start();
+        cerr << "INFO! SAVING A SNAPSHOT OF THE VOLUME SURFACE TO " << snapshot_directory << " EVERY " << snapshot_interval << " S" << endl;
+    }
+
+    if (!shared_memory_name.empty()){
+        if (shared_memory_name[0] != '/'){
+            shared_memory_name = "/" + shared_memory_name;
+        }
+        if (m_volumeSharedMemory.create(shared_memory_name, m_voxelCount, volumeImage->getBytesPerPixel(), brick_size)){
+            m_volumeSharedMemory.writeAll(volumeImage->getData(), m_voxelPalette.isEmpty() ? nullptr : m_voxelPalette.getColors().data(), 0.0);
+            cerr << "INFO! EXPORTING THE VOLUME IN SHARED MEMORY " << shared_memory_name << endl;
+        }
+    }
+
+    if (m_emptySpaceSkipping){
+        if (empty_space_skip_distance < 1 || empty_space_skip_distance > 254){
+            cerr << "WARNING! THE EMPTY SPACE SKIP DISTANCE MUST BE FROM 1 TO 254 BRICKS, CLAMPING " << empty_space_skip_distance << endl;
+        }
+        // the distances are view independent, they are computed on the CPU after every drilled
+        // brick instead of being found by every ray
+        m_occupancyTexture.setSkipDistance(empty_space_skip_distance);
+        m_occupancyTexture.build(occupancy);
+        cerr << "INFO! EMPTY SPACE SKIPPING ENABLED, " << m_occupancyTexture.getOccupiedCellCount() << " OF "
+             << occupancy.getTotalBrickCount() << " MACRO-CELLS ARE RAY MARCHED, UP TO "
+             << m_occupancyTexture.getSkipDistance() << " SKIPPED AT ONCE" << endl;
+    }
+
+    if (m_volumeSource.isValid() && !m_volumeSource.m_deferred){
+        if (m_volumeSource.m_count != m_voxelCount[2]){
+            cerr << "WARNING! VOLUME ADF HAS " << m_volumeSource.m_count << " SLICES BUT THE VOLUME HAS " << m_voxelCount[2] << endl;
+            m_volumeSource = VolumeImageSource();
+        }
+        else if (use_volume_cache){
+            // the simulator decoded the slices, the cache only speeds up the resets
+            initVolumeCache(m_volumeSource, VolumeCache::computeSourceHash(m_volumeSource));
+        }
+    }
+
+    if (m_criticalWarningDistance > 0){
+        initCriticalDistanceField(m_criticalField, volumeImage->getData(), volumeImage->getBytesPerPixel());
+        // the haptic thread has a core of its own, a few workers are enough for the boxes of a frame
+        if (m_criticalField.isValid()){
+            m_criticalFieldPool.start(min(max(int(std::thread::hardware_concurrency()) - 2, 0), 4));
+        }
+    }
+
+    // Precompute the voxel stencils of all the drill burrs
+    vector<double> burrRadii;
+    for (auto& burr : m_drillBurrSizes){
+        burrRadii.push_back(burr.second.first);
+    }
+    m_core.setBurrs(burrRadii, m_selectedBurrIdx);
+    m_core.setListener(this);
+    m_startupTimeline.mark("volume initialized");
+
+    if (!record_filepath.empty() && !startInputRecording(record_filepath)){
+        return -1;
+    }
+
+    if (!session_filepath.empty() && !startSessionRecording(session_filepath)){
+        return -1;
+    }
+
+    // placeholders until swapInLoadedAssets() puts the loaded matcaps in their place
+    m_voxelObj->m_aoTexture = AssetLoader::createPlaceholderTexture(s_volumeMatcapPlaceholder);
+    m_voxelObj->m_aoTexture->setTextureUnit(GL_TEXTURE5);
+    if (m_drillRigidBody->getShaderProgram()){
+        cTexture2dPtr drillMatCap = AssetLoader::createPlaceholderTexture(s_drillMatcapPlaceholder);
+        drillMatCap->setTextureUnit(GL_TEXTURE3);
+        for (int mi = 0 ; mi < m_drillRigidBody->getVisualObject()->getNumMeshes(); mi++){
+            m_drillRigidBody->getVisualObject()->getMesh(mi)->m_metallicTexture = drillMatCap;
+        }
+        m_drillRigidBody->getShaderProgram()->setUniformi("matcapMap", C_TU_METALLIC);
+    }
+
+    cBackground* background = new cBackground();
+    background->setCornerColors(cColorf(1.0f, 1.0f, 1.0f),
+                                cColorf(1.0f, 1.0f, 1.0f),
+                                cColorf(0.6f, 0.6f, 0.6f),
+                                cColorf(0.6f, 0.6f, 0.6f));
+    m_mainCamera->getBackLayer()->addChild(background);
+
+    // the drill stays silent until its sound is loaded
+    m_mainCamera->getInternalCamera()->attachAudioDevice(m_drillAudioDevice);
+
+    if (haptic_rate > 0){
+        // the haptic thread starts from the current world state, before the first physics update
+        PhysicsSnapshot physics;
+        physics.m_cameraTransform = m_mainCamera->getLocalTransform();
+        physics.m_overrideDrillControl = getOverrideDrillControl();
+        physics.m_drillPose = m_drillRigidBody->getLocalTransform();
+        m_physicsSnapshots.write(physics);
+
+        m_hapticRate = haptic_rate;
+        m_hapticThreadRunning.store(true, std::memory_order_release);
+        m_hapticThread = std::thread(&afVolmetricDrillingPlugin::hapticLoop, this);
+
+        sched_param schedParam;
+        schedParam.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+        if (pthread_setschedparam(m_hapticThread.native_handle(), SCHED_FIFO, &schedParam) != 0){
+            cerr << "WARNING! COULD NOT SET A REAL-TIME PRIORITY FOR THE HAPTIC THREAD" << endl;
+        }
+        cerr << "INFO! RUNNING THE HAPTIC LOOP ON ITS OWN THREAD AT " << m_hapticRate << " HZ" << endl;
+    }
+
+    m_startupTimeline.mark("init done");
+    return 1;
+}
+
+void afVolmetricDrillingPlugin::graphicsUpdate(){
+    PerfScope graphicsScope(m_perf, PERF_GRAPHICS_UPDATE);
+
+    if (!m_firstFrameDrawn){
+        m_firstFrameDrawn = true;
+        m_startupTimeline.mark("first frame");
+    }
+    if (!m_assetLoader.isDone()){
+        swapInLoadedAssets();
+    }
+
+    if (m_volumeResetPreparing && m_flagVolumeResetPrepared.exchange(false, std::memory_order_acq_rel)){
+        m_volumeResetThread.join();
+        m_volumeResetPreparing = false;
+        if (m_volumeResetValid){
+            DrillCommand command;
+            command.m_type = DrillCommand::RESET_VOLUME;
+            m_volumeResetPending = true;
+            sendDrillCommand(command);
+        }
+    }
+    bool volumeReset = false;
+    if (m_volumeResetPending && m_flagVolumeResetDone.exchange(false, std::memory_order_acq_rel)){
+        finishVolumeReset();
+        volumeReset = true;
+    }
+
+    // upload the bricks of voxels modified since the last frame
+    m_textureUploadBytesLastFrame = 0;
+    if (!m_volumeResetPending && m_flagMarkVolumeForUpdate.exchange(false, std::memory_order_acq_rel)){
+        m_dirtyBricks.collect(m_dirtyBrickExchange);
+        if (m_gpuCarving.load(std::memory_order_relaxed)){
+            m_carvedBricks.collect(m_carvedBrickExchange);
+        }
+    }
+
+    if (m_gpuCarvingRequested){
+        initGpuCarving();
+    }
+    if (m_gpuCarving.load(std::memory_order_relaxed)){
+        PerfScope carveScope(m_perf, PERF_TEXTURE_UPLOAD);
+        // the restored volume is uploaded when the frame renders, the carves wait for it
+        if (!volumeReset){
+            m_gpuCarver.update(m_voxelObj->m_texture->getTextureId());
+        }
+
+        // the carved voxels only change the empty space and the surface, not the texture
+        if (!m_carvedBricks.isEmpty()){
+            m_carvedBricks.extractBoxes(m_carvedBoxes);
+            if (m_emptySpaceSkipping){
+                for (size_t bi = 0 ; bi < m_carvedBoxes.size() ; bi++){
+                    m_occupancyTexture.update(m_core.getOccupancy(), m_carvedBoxes[bi]);
+                }
+            }
+            m_surfaceMesher.markDirty(m_carvedBoxes);
+            if (m_volumeSharedMemory.isOpen()){
+                m_volumeSharedMemory.writeBoxes(m_voxelObj->m_texture->m_image->getData(), m_carvedBoxes, m_drillRigidBody->getCurrentTimeStamp());
+            }
+        }
+    }
+
+    // the distances around the critical voxels drilled or restored since the last frame
+    VoxelBox criticalBox;
+    if (!m_volumeResetPending && m_criticalBoxes.pop(criticalBox)){
+        VoxelBox box;
+        while (m_criticalBoxes.pop(box)){
+            for (int i = 0 ; i < 3 ; i++){
+                criticalBox.m_min[i] = min(criticalBox.m_min[i], box.m_min[i]);
+                criticalBox.m_max[i] = max(criticalBox.m_max[i], box.m_max[i]);
+            }
+        }
+        m_criticalField.update(m_voxelObj->m_texture->m_image->getData(), criticalBox, &m_criticalFieldPool);
+    }
+
+    // bricks beyond the upload budget of the previous frames are still pending
+    if (!m_volumeResetPending && !m_dirtyBricks.isEmpty())
+    {
+        PerfScope uploadScope(m_perf, PERF_TEXTURE_UPLOAD);
+        m_dirtyBricks.extractBoxes(m_uploadBoxes, m_textureUploadBudget);
+
+        for (size_t bi = 0 ; bi < m_uploadBoxes.size() ; bi++){
+            uploadVolumeBox(m_uploadBoxes[bi]);
+            if (m_emptySpaceSkipping){
+                m_occupancyTexture.update(m_core.getOccupancy(), m_uploadBoxes[bi]);
+            }
+        }
+        m_surfaceMesher.markDirty(m_uploadBoxes);
+        if (m_volumeSharedMemory.isOpen()){
+            m_volumeSharedMemory.writeBoxes(m_voxelObj->m_texture->m_image->getData(), m_uploadBoxes, m_drillRigidBody->getCurrentTimeStamp());
+        }
+        m_textureUploadBytesTotal += m_textureUploadBytesLastFrame;
+
+        // the uploads overwrote the voxels carved by the readbacks in flight with the CPU copy
+        if (m_gpuCarving.load(std::memory_order_relaxed) && !m_uploadBoxes.empty()){
+            m_gpuCarver.invalidateInFlight();
+        }
+    }
+    m_volumeObject->getShaderProgram()->setUniformi("aoMap", C_TU_AO);
+
+    if (m_emptySpaceSkipping){
+        // the drilled bricks that became empty are skipped from this frame on
+        m_occupancyTexture.upload();
+        m_occupancyTexture.bind(m_occupancyTextureUnit);
+        cShaderProgramPtr shaderProgram = m_volumeObject->getShaderProgram();
+        shaderProgram->setUniformi("uOccupancy", m_occupancyTextureUnit);
+        shaderProgram->setUniform("uOccupancySize", cVector3d(m_occupancyTexture.getNumCells(0),
+                                                              m_occupancyTexture.getNumCells(1),
+                                                              m_occupancyTexture.getNumCells(2)));
+        shaderProgram->setUniform("uOccupancyScale", cVector3d(m_occupancyTexture.getTexCoordScale(0),
+                                                               m_occupancyTexture.getTexCoordScale(1),
+                                                               m_occupancyTexture.getTexCoordScale(2)));
+        shaderProgram->setUniformi("uSkipEmptySpace", m_occupancyTexture.isUploaded());
+
+
+        // the rays start and end at the bounds of the bricks left to march
+        cVector3d occupiedMin, occupiedMax;
+        if (!m_occupancyTexture.getOccupiedBounds(occupiedMin, occupiedMax)){
+            // nothing left to march, an empty box discards every fragment
+            occupiedMin.set(1.0, 1.0, 1.0);
+            occupiedMax.set(0.0, 0.0, 0.0);
+        }
+        shaderProgram->setUniform("uOccupiedMin", occupiedMin);
+        shaderProgram->setUniform("uOccupiedMax", occupiedMax);
+        shaderProgram->setUniformi("uClipToOccupied", m_occupancyTexture.isUploaded());
+    }
+
+    if (!m_voxelPalette.isEmpty()){
+        m_paletteTexture.upload();
+        m_paletteTexture.bind(m_paletteTextureUnit);
+        cShaderProgramPtr shaderProgram = m_volumeObject->getShaderProgram();
+        shaderProgram->setUniformi("uPalette", m_paletteTextureUnit);
+        shaderProgram->setUniform("uVolumeSize", cVector3d(m_voxelCount[0], m_voxelCount[1], m_voxelCount[2]));
+        shaderProgram->setUniformi("uUseLabels", m_paletteTexture.isUploaded());
+    }
+
+    if (m_qualityController.isEnabled()){
+        updateRenderQuality();
+    }
+
+    if (m_sessionRecorder.isRecording()){
+        updateSessionRecording();
+    }
+
+    if (m_perf.isEnabled()){
+        updatePerfStats();
+    }
+
+    if (m_removalStatsInterval > 0){
+        updateRemovalStats();
+    }
+}
+
+///
+/// \brief This method puts the assets that finished loading in the background in the scene,
+/// in place of the placeholder matcaps, and starts the drill sound. Runs on the graphics thread
+/// until all of them are swapped in, then prints the startup timeline.
+///
+void afVolmetricDrillingPlugin::swapInLoadedAssets(){
+    cTexture2dPtr texture;
+    if (m_assetLoader.takeTexture(m_volumeMatcapAsset, texture)){
+        if (texture){
+            texture->setTextureUnit(GL_TEXTURE5);
+            m_voxelObj->m_aoTexture = texture;
+        }
+        m_startupTimeline.mark("volume matcap swapped in");
+    }
+
+    if (m_assetLoader.takeTexture(m_drillMatcapAsset, texture)){
+        if (texture && m_drillRigidBody->getShaderProgram()){
+            texture->setTextureUnit(GL_TEXTURE3);
+            for (int mi = 0 ; mi < m_drillRigidBody->getVisualObject()->getNumMeshes(); mi++){
+                m_drillRigidBody->getVisualObject()->getMesh(mi)->m_metallicTexture = texture;
+            }
+        }
+        m_startupTimeline.mark("drill matcap swapped in");
+    }
+
+    if (m_assetLoader.takeAudio(m_drillAudioAsset, m_drillAudioBuffer)){
+        if (m_drillAudioBuffer){
+            cAudioSource* source = new cAudioSource();
+            source->setAudioBuffer(m_drillAudioBuffer);
+            source->setLoop(true);
+            source->setGain(5.0);
+            if (!m_mute) source->play();
+            // the physics update moves the source once it is fully set up
+            m_drillAudioSource.store(source, std::memory_order_release);
+        }
+        m_startupTimeline.mark("drill audio started");
+    }
+
+    if (m_assetLoader.isDone()){
+        m_startupTimeline.print();
+    }
+}
+
+///
+/// \brief This method publishes the latencies of the timed stages since its previous
+/// publication and shows them in the overlay, if it's enabled. Runs on the graphics thread.
+///
+void afVolmetricDrillingPlugin::updatePerfStats(){
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double interval = std::chrono::duration<double>(now - m_lastPerfPublishTime).count();
+    if (interval < m_perfPublishInterval){
+        return;
+    }
+    m_lastPerfPublishTime = now;
+
+    // the bytes of the modified bricks, or of the whole volume after a reset, sent to the GPU
+    double uploadRate = double(m_textureUploadBytesTotal - m_textureUploadBytesPublished) / interval;
+    m_textureUploadBytesPublished = m_textureUploadBytesTotal;
+
+    m_perf.collect(m_perfStats);
+    m_drillingPub->perfStats(m_perfStats, m_textureUploadBytesTotal, uploadRate, m_drillRigidBody->getCurrentTimeStamp());
+
+    for (size_t i = 0 ; i < m_perfTexts.size() ; i++){
+        const PerfStageStats& stats = m_perfStats[i];
+        char text[128];
+        snprintf(text, sizeof(text), "%s: p50 %.1f us, p99 %.1f us, max %.1f us (%llu)", stats.m_name.c_str(),
+                 stats.m_p50, stats.m_p99, stats.m_max, (unsigned long long)stats.m_count);
+        m_perfTexts[i]->setText(text);
+    }
+    if (m_textureUploadText){
+        char text[128];
+        snprintf(text, sizeof(text), "texture upload: %.2f MB/s, %.1f MB total", uploadRate / (1024.0 * 1024.0),
+                 m_textureUploadBytesTotal / (1024.0 * 1024.0));
+        m_textureUploadText->setText(text);
+    }
+}
+
+///
+/// \brief This method publishes the summary of the removed voxels at the removal stats rate.
+/// The counters are updated by the haptic loop, reading them never blocks it.
+///
+void afVolmetricDrillingPlugin::updateRemovalStats(){
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - m_lastRemovalStatsTime).count() < m_removalStatsInterval){
+        return;
+    }
+    m_lastRemovalStatsTime = now;
+
+    m_removalStats.collect(m_removalSummary);
+    m_drillingPub->removalStats(m_removalSummary, m_drillRigidBody->getCurrentTimeStamp());
+}
+
+///
+/// \brief This method feeds the frame interval, the GPU time of the last measured frame and
+/// the motion of the drill to the quality controller. The settings are applied to the voxel
+/// object before any camera renders, so both eyes of the stereo pair always render a frame
+/// with the same quality, and their rendering cost is part of the measured frame, which ends
+/// with the last draw of the volume.
+///
+void afVolmetricDrillingPlugin::updateRenderQuality(){
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (!m_graphicsUpdateTimeValid){
+        m_lastGraphicsUpdateTime = now;
+        m_lastDrillPos = m_drillRigidBody->getLocalPos();
+        m_graphicsUpdateTimeValid = true;
+        m_gpuFrameTimer.beginFrame();
+        return;
+    }
+
+    double frameInterval = std::chrono::duration<double>(now - m_lastGraphicsUpdateTime).count();
+    m_lastGraphicsUpdateTime = now;
+    m_gpuFrameTimer.beginFrame();
+
+    cVector3d drillPos = m_drillRigidBody->getLocalPos();
+    double drillSpeed = frameInterval > 0.0 ? (drillPos - m_lastDrillPos).length() / frameInterval : 0.0;
+    m_lastDrillPos = drillPos;
+    m_timeSinceFastMotion = drillSpeed > m_fastMotionSpeed ? 0.0 : m_timeSinceFastMotion + frameInterval;
+    bool fastMotion = m_timeSinceFastMotion < m_fastMotionHoldTime;
+
+    if (m_qualityController.update(frameInterval, m_gpuFrameTimer.getLastFrameTime(), fastMotion)){
+        m_voxelObj->setQuality(m_qualityController.getQuality());
+        m_volumeObject->getShaderProgram()->setUniformi("uSmoothingLevel", m_qualityController.getSmoothingLevel());
+    }
+}
+
+///
+/// \brief This method creates the GPU carver on the first graphics update, when the GL context
+/// of the volume texture is current. The drilling stays on the CPU if the context or the format
+/// of the volume can't be carved.
+///
+void afVolmetricDrillingPlugin::initGpuCarving(){
+    m_gpuCarvingRequested = false;
+    if (m_voxelObj->m_texture->m_image->getBytesPerPixel() != 4){
+        cerr << "WARNING! GPU CARVING NEEDS AN RGBA VOLUME, REMOVING THE VOXELS ON THE CPU" << endl;
+        return;
+    }
+    if (!m_gpuCarver.init(m_voxelCount, m_gpuCarvingMaxVoxels)){
+        cerr << "WARNING! REMOVING THE VOXELS ON THE CPU" << endl;
+        return;
+    }
+    m_gpuCarving.store(true, std::memory_order_release);
+    cerr << "INFO! CARVING THE VOLUME ON THE GPU, UP TO " << m_gpuCarvingMaxVoxels << " VOXELS PER FRAME" << endl;
+}
+
+void afVolmetricDrillingPlugin::submitGpuCarve(){
+    const BurrStencil& stencil = m_core.getBurrStencil(m_core.getActiveBurrIdx());
+    if (stencil.isEmpty()){
+        return;
+    }
+    // the same center voxel as the removal on the CPU
+    cVector3d voxel = m_core.getVoxelRemover().getVoxelCoordinates(m_toolCursorList[0]->m_hapticPoint->getGlobalPosProxy());
+    GpuCarveRequest request;
+    for (int i = 0 ; i < 3 ; i++){
+        request.m_center[i] = int(floor(voxel(i)));
+        request.m_radius[i] = float(stencil.getRadius(i));
+    }
+    m_gpuCarver.submit(request);
+}
+
+///
+/// \brief This method removes the voxels read back from the GPU from the CPU copy of the volume,
+/// which journals and publishes them like the voxels removed on the CPU. Their bricks go to
+/// their own exchange, since the texture already holds them. The stale voxels, carved before an
+/// upload of the CPU copy overwrote them, e.g. after a rollback, go to the exchange of the
+/// volume instead, so their bricks are uploaded again without them.
+///
+void afVolmetricDrillingPlugin::applyGpuCarvedVoxels(){
+    m_gpuCarver.collect(m_gpuCarvedVoxels, m_gpuStaleVoxels);
+    if (!m_gpuCarvedVoxels.empty()){
+        m_core.applyRemovedVoxels(m_gpuCarvedVoxels, m_physicsState.m_simTime, &m_carvedBrickExchange);
+    }
+    if (!m_gpuStaleVoxels.empty()){
+        m_core.applyRemovedVoxels(m_gpuStaleVoxels, m_physicsState.m_simTime, nullptr);
+    }
+}
+
+///
+/// \brief This method copies a box of the volume image to the 3D texture with glTexSubImage3D.
+/// The texture's own markForPartialUpdate only holds a single region per frame, so the boxes
+/// of the dirty bricks are uploaded here directly.
+///
+void afVolmetricDrillingPlugin::uploadVolumeBox(const VoxelBox &a_box){
+    GLuint textureId = m_voxelObj->m_texture->getTextureId();
+    if (textureId == 0){
+        // the texture hasn't been created yet, the first render uploads the whole image
+        return;
+    }
+
+    cImagePtr image = m_voxelObj->m_texture->m_image;
+
+    GLint prevTexture;
+    glGetIntegerv(GL_TEXTURE_BINDING_3D, &prevTexture);
+    glBindTexture(GL_TEXTURE_3D, textureId);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, image->getWidth());
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, image->getHeight());
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, a_box.m_min[0]);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, a_box.m_min[1]);
+    glPixelStorei(GL_UNPACK_SKIP_IMAGES, a_box.m_min[2]);
+
+    glTexSubImage3D(GL_TEXTURE_3D, 0,
+                    a_box.m_min[0], a_box.m_min[1], a_box.m_min[2],
+                    a_box.m_max[0] - a_box.m_min[0], a_box.m_max[1] - a_box.m_min[1], a_box.m_max[2] - a_box.m_min[2],
+                    image->getFormat(), image->getType(), image->getData());
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_IMAGES, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glBindTexture(GL_TEXTURE_3D, prevTexture);
+
+    m_textureUploadBytesLastFrame += a_box.getVoxelCount() * image->getBytesPerPixel();
+}
+
+void afVolmetricDrillingPlugin::physicsUpdate(double dt){
+    PerfScope physicsScope(m_perf, PERF_PHYSICS_UPDATE);
+
+    m_worldPtr->getChaiWorld()->computeGlobalPositions(true);
+
+    cTransform T_c_w = m_mainCamera->getLocalTransform();
+
+    PhysicsSnapshot physics;
+    physics.m_cameraTransform = T_c_w;
+    physics.m_overrideDrillControl = getOverrideDrillControl();
+    physics.m_drillPose = m_drillRigidBody->getLocalTransform();
+    physics.m_simTime = m_drillRigidBody->getCurrentTimeStamp();
+    physics.m_dt = dt;
+    m_physicsSnapshots.write(physics);
+
+    // without a haptic thread the haptic loop runs once per physics step
+    if (!m_hapticThreadRunning.load(std::memory_order_acquire)){
+        hapticUpdate(dt);
+    }
+
+    HapticSnapshot haptic;
+    m_hapticSnapshots.read(haptic);
+    applyHapticSnapshot(haptic, T_c_w);
+}
+
+///
+/// \brief This method applies the latest state of the haptic loop to the world objects,
+/// which are only touched by the physics update.
+///
+void afVolmetricDrillingPlugin::applyHapticSnapshot(const HapticSnapshot &a_snapshot, const cTransform &a_cameraTransform){
+    if (a_snapshot.m_tick == 0){
+        // the haptic loop hasn't run yet
+        return;
+    }
+
+    cAudioSource* audioSource = m_drillAudioSource.load(std::memory_order_acquire);
+
+    if (a_snapshot.m_cameraClutch){
+        m_mainCamera->setView(a_cameraTransform.getLocalPos() + a_snapshot.m_cameraMotion, m_mainCamera->getTargetPosLocal(), m_mainCamera->getUpVector());
+    }
+
+    if (a_snapshot.m_controlsDrillPose){
+        m_drillRigidBody->setLocalTransform(a_snapshot.m_drillPose);
+        if (audioSource){
+            audioSource->setSourcePos(a_snapshot.m_drillPose.getLocalPos());
+        }
+    }
+
+    m_warningPopup->setShowPanel(a_snapshot.m_showWarning);
+    m_warningText->setShowEnabled(a_snapshot.m_showWarning);
+
+    if (audioSource){
+        double criticalPitch = m_criticalAudio ? a_snapshot.m_criticalProximity : 0.0;
+        audioSource->setPitch(3.0 - a_snapshot.m_forceRatio + criticalPitch);
+    }
+}
+
+///
+/// \brief This method is one tick of the haptic loop: it reads the device, moves the tool
+/// cursors, removes the voxels under the burr, computes the forces and sends them to the device.
+/// It runs either at the end of the physics update or on the haptic thread, and it is the only
+/// user of m_T_d, the tool cursors and the haptic device once the plugin is initialized.
+/// \param a_dt    Time since the last tick
+///
+void afVolmetricDrillingPlugin::hapticUpdate(double a_dt){
+    PerfScope tickScope(m_perf, PERF_HAPTIC_TICK);
+    m_physicsSnapshots.read(m_physicsState);
+
+    DrillCommand command;
+    while (m_drillCommands.pop(command)){
+        applyDrillCommand(command);
+    }
+
+    bool overrideDrillControl = m_physicsState.m_overrideDrillControl;
+    cTransform T_c_w = m_physicsState.m_cameraTransform;
+
+    // the device motion is integrated per tick, scale it so the drill speed doesn't depend on the rate
+    double motionScale = 1.0;
+    if (m_hapticThreadRunning.load(std::memory_order_relaxed) && m_physicsState.m_dt > 0.0){
+        motionScale = a_dt / m_physicsState.m_dt;
+    }
+
+    // read the device and move the tool cursors
+    {
+        PerfScope poseScope(m_perf, PERF_POSE_UPDATE);
+        m_hapticState.m_cameraClutch = false;
+        m_inputRecord.m_flags = overrideDrillControl ? InputRecord::OVERRIDE_DRILL_CONTROL : 0;
+
+        // If a valid haptic device is found, then it should be available
+        if (overrideDrillControl){
+            m_T_d = m_physicsState.m_drillPose;
+            m_drillMeshPose = m_T_d;
+        }
+        else if(m_hapticDevice->isDeviceAvailable()){
+            bool device_clutch, cam_clutch;
+            m_hapticDevice->getUserSwitch(0, device_clutch);
+            m_hapticDevice->getUserSwitch(1, cam_clutch);
+
+            m_hapticDevice->getTransform(m_T_i);
+            m_hapticDevice->getLinearVelocity(m_V_i);
+            if (m_inputRecorder.isRecording()){
+                m_inputRecord.m_flags |= InputRecord::DEVICE_AVAILABLE | (device_clutch ? InputRecord::DEVICE_CLUTCH : 0) | (cam_clutch ? InputRecord::CAMERA_CLUTCH : 0);
+                for (int i = 0 ; i < 3 ; i++){
+                    m_inputRecord.m_devicePos[i] = m_T_i.getLocalPos()(i);
+                    m_inputRecord.m_deviceVel[i] = m_V_i(i);
+                    for (int j = 0 ; j < 3 ; j++){
+                        m_inputRecord.m_deviceRot[3 * i + j] = m_T_i.getLocalRot()(i, j);
+                    }
+                }
+            }
+            m_V_i = T_c_w.getLocalRot() * (m_V_i / m_toolCursorList[0]->getWorkspaceScaleFactor());
+            m_T_d.setLocalPos(m_T_d.getLocalPos() + (m_V_i * 0.4 * motionScale * !device_clutch * !cam_clutch));
+            m_T_d.setLocalRot(T_c_w.getLocalRot() * m_T_i.getLocalRot());
+
+            // set zero forces when manipulating objects
+            if (device_clutch || cam_clutch){
+                if (cam_clutch){
+                    // the camera is moved by the physics update, once per physics step
+                    m_hapticState.m_cameraClutch = true;
+                    m_hapticState.m_cameraMotion = m_V_i * !device_clutch;
+                }
+                m_toolCursorList[0]->setDeviceLocalForce(0.0, 0.0, 0.0);
+            }
+        }
+
+        m_core.toolCursorsPosUpdate(m_T_d);
+    }
+
+    if (m_inputRecorder.isRecording()){
+        recordInputs(a_dt);
+    }
+
+    // check for shaft collision
+    {
+        PerfScope collisionScope(m_perf, PERF_SHAFT_COLLISION);
+        m_core.checkShaftCollision();
+    }
+
+    if (overrideDrillControl == false){
+        // updates position of drill mesh
+        PerfScope drillPoseScope(m_perf, PERF_DRILL_POSE);
+        drillPoseUpdateFromCursors();
+    }
+
+
+    bool gpuCarving = m_gpuCarving.load(std::memory_order_acquire);
+    if (gpuCarving){
+        PerfScope removalScope(m_perf, PERF_VOXEL_REMOVAL);
+        applyGpuCarvedVoxels();
+    }
+
+    if (m_core.isTipDrilling() /*&& (userSwitches == 2)*/)
+    {
+        PerfScope removalScope(m_perf, PERF_VOXEL_REMOVAL);
+        if (gpuCarving){
+            submitGpuCarve();
+        }
+        else{
+            m_core.removeVoxelsInBurr(m_physicsState.m_simTime);
+        }
+    }
+    // remove warning panel
+    else
+    {
+        m_hapticState.m_showWarning = false;
+    }
+
+    if (m_criticalField.isValid()){
+        publishCriticalBox();
+        updateCriticalProximity();
+    }
+    // compute interaction forces, the tip tool cursor on this thread and the shaft ones on the workers
+    {
+        PerfScope forceScope(m_perf, PERF_FORCE_COMPUTATION);
+        m_core.computeForces();
+    }
+
+    // check if device remains stuck inside voxel object
+    // Also orient the force to match the camera rotation
+    cVector3d force = m_core.getTargetToolCursor()->getDeviceLocalForce();
+    if (m_criticalForce > 0 && m_hapticState.m_criticalProximity > 0){
+        // pushes the burr along the distance field, away from the closest critical structure
+        cVector3d voxel = m_core.getVoxelRemover().getVoxelCoordinates(m_toolCursorList[0]->m_hapticPoint->getGlobalPosProxy());
+        double gradient[3];
+        m_criticalField.getGradient(int(floor(voxel(0))), int(floor(voxel(1))), int(floor(voxel(2))), gradient);
+        cVector3d direction = m_voxelObj->getGlobalRot() * cVector3d(gradient[0], gradient[1], gradient[2]);
+        force += direction * (m_criticalForce * m_hapticState.m_criticalProximity);
+    }
+    force = cTranspose(T_c_w.getLocalRot()) * force;
+    m_toolCursorList[0]->setDeviceLocalForce(force);
+    double max_force = m_hapticDevice->getSpecifications().m_maxLinearForce;
+    double force_mag = cClamp(force.length(), 0.0, max_force);
+    m_hapticState.m_forceRatio = force_mag / max_force;
+
+    if (m_flagStart)
+    {
+        if (force.length() != 0.0)
+        {
+        //    resetDrill();
+            m_counter = 0;
+        }
+        else
+        {
+            m_counter++;
+            if (m_counter > 10)
+                m_flagStart = false;
+        }
+    }
+    else
+    {
+        if (force.length() > 10.0)
+        {
+            m_flagStart = true;
+        }
+    }
+
+    /////////////////////////////////////////////////////////////////////////
+    // FINALIZE
+    /////////////////////////////////////////////////////////////////////////
+
+    // send forces to haptic device
+    if (overrideDrillControl == false){
+        PerfScope applyScope(m_perf, PERF_APPLY_TO_DEVICE);
+        m_toolCursorList[0]->applyToDevice();
+    }
+
+    // the burr touches a critical structure when it drills one or reaches it in the distance field
+    m_removalStats.tick(m_physicsState.m_simTime, m_tickCriticalContact || m_hapticState.m_criticalProximity >= 1.0);
+    m_tickCriticalContact = false;
+
+    m_hapticState.m_drillPose = m_drillMeshPose;
+    m_hapticState.m_controlsDrillPose = !overrideDrillControl;
+    m_hapticState.m_tick++;
+    m_hapticSnapshots.write(m_hapticState);
+}
+
+///
+/// \brief This method runs the haptic loop at m_hapticRate. It sleeps until shortly before
+/// each tick and spins for the rest, since sleeps alone overshoot by tens of microseconds.
+/// A tick that is late by more than a period doesn't try to catch up.
+///
+void afVolmetricDrillingPlugin::hapticLoop(){
+    typedef std::chrono::steady_clock Clock;
+    const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_hapticRate));
+    const Clock::duration spinTime = std::chrono::microseconds(200);
+
+    Clock::time_point lastTick = Clock::now();
+    Clock::time_point nextTick = lastTick + period;
+    while (m_hapticThreadRunning.load(std::memory_order_acquire)){
+        Clock::time_point now = Clock::now();
+        if (nextTick - now > spinTime){
+            std::this_thread::sleep_until(nextTick - spinTime);
+        }
+        while (Clock::now() < nextTick){
+            std::this_thread::yield();
+        }
+
+        now = Clock::now();
+        double dt = std::chrono::duration<double>(now - lastTick).count();
+        lastTick = now;
+        hapticUpdate(dt);
+        m_hapticTickCount.fetch_add(1, std::memory_order_relaxed);
+
+        nextTick += period;
+        if (Clock::now() > nextTick){
+            m_hapticOverrunCount.fetch_add(1, std::memory_order_relaxed);
+            nextTick = Clock::now() + period;
+        }
+    }
+}
+
+///
+/// \brief This method replaces the RGBA image of the volume by one with an 8 bit label and an
+/// 8 bit density per voxel, which halves the memory of the image and of its texture and the
+/// bytes uploaded per drilled brick. The density is the alpha of the voxel, which the collision
+/// detection and the isosurface of the shaders use, and the shaders look the color of the
+/// label up in the palette texture.
+///
+bool afVolmetricDrillingPlugin::convertVolumeToLabels(){
+    cImagePtr image = m_voxelObj->m_texture->m_image;
+    if (image->getBytesPerPixel() != 4){
+        cerr << "WARNING! ONLY RGBA VOLUMES CAN BE STORED AS LABELS, THE VOLUME HAS " << image->getBytesPerPixel() << " BYTES PER VOXEL" << endl;
+        return false;
+    }
+
+    cMultiImagePtr labelImage = cMultiImage::create();
+    labelImage->allocate(image->getWidth(), image->getHeight(), m_voxelCount[2], GL_LUMINANCE_ALPHA);
+    size_t voxelCount = size_t(image->getWidth()) * image->getHeight() * m_voxelCount[2];
+    if (!m_voxelPalette.convert(image->getData(), voxelCount, labelImage->getData())){
+        cerr << "WARNING! THE VOLUME HAS MORE THAN " << VoxelPalette::MAX_LABELS - 1 << " COLORS, KEEPING ITS RGBA VOXELS" << endl;
+        return false;
+    }
+    if (m_voxelPalette.isEmpty()){
+        cerr << "WARNING! THE VOLUME IS EMPTY, KEEPING ITS RGBA VOXELS" << endl;
+        return false;
+    }
+
+    m_voxelObj->m_texture->setImage(labelImage);
+    m_voxelObj->m_texture->markForUpdate();
+    m_paletteTexture.set(m_voxelPalette);
+    m_boneLabel = m_voxelPalette.findLabel(m_boneColor.m_color);
+    if (m_boneLabel == 0){
+        cerr << "WARNING! THE BONE COLOR ISN'T IN THE VOLUME, EVERY VOXEL IS A CRITICAL STRUCTURE" << endl;
+    }
+    return true;
+}
+
+///
+/// \brief This method creates the coarse level of the volume for the haptics. It is a hidden
+/// child of the volume, so it follows its pose, with the same corners and material, and its
+/// texture coordinates are scaled so that both levels cover the same box even when the voxel
+/// count isn't a multiple of the factor. The core builds it from the fine level and keeps it up
+/// to date with the removals, the proxies then only walk the coarse voxels.
+///
+void afVolmetricDrillingPlugin::initHapticLevel(int a_factor){
+    cImagePtr image = m_voxelObj->m_texture->m_image;
+    int coarseCount[3];
+    for (int i = 0 ; i < 3 ; i++){
+        coarseCount[i] = (m_voxelCount[i] + a_factor - 1) / a_factor;
+    }
+
+    cMultiImagePtr coarseImage = cMultiImage::create();
+    coarseImage->allocate(coarseCount[0], coarseCount[1], coarseCount[2], image->getFormat(), image->getType());
+    cTexture3dPtr coarseTexture = cTexture3d::create();
+    coarseTexture->setImage(coarseImage);
+
+    m_hapticVoxelObj = new cVoxelObject();
+    m_hapticVoxelObj->setTexture(coarseTexture);
+    for (int i = 0 ; i < 3 ; i++){
+        m_hapticTextureScale[i] = double(m_voxelCount[i]) / (double(coarseCount[i]) * a_factor);
+    }
+    updateHapticLevelBounds();
+    m_hapticVoxelObj->m_material = m_voxelObj->m_material;
+    m_hapticVoxelObj->setUseMaterial(true);
+    m_hapticVoxelObj->setShowEnabled(false);
+    m_voxelObj->addChild(m_hapticVoxelObj);
+
+    m_core.setHapticLevel(m_hapticVoxelObj, a_factor);
+    cerr << "INFO! TOOL CURSORS COLLIDE WITH A " << coarseCount[0] << "x" << coarseCount[1] << "x" << coarseCount[2]
+         << " LEVEL OF THE VOLUME, " << a_factor << " TIMES COARSER THAN THE RENDERED ONE" << endl;
+}
 
-    m_drillingPub->volumeProp(dim, voxelCount);
+void afVolmetricDrillingPlugin::updateHapticLevelBounds(){
+    m_hapticVoxelObj->m_minCorner = m_voxelObj->m_minCorner;
+    m_hapticVoxelObj->m_maxCorner = m_voxelObj->m_maxCorner;
+    for (int i = 0 ; i < 3 ; i++){
+        m_hapticVoxelObj->m_minTextureCoord(i) = m_voxelObj->m_minTextureCoord(i) * m_hapticTextureScale[i];
+        m_hapticVoxelObj->m_maxTextureCoord(i) = m_voxelObj->m_maxTextureCoord(i) * m_hapticTextureScale[i];
+    }
+}
 
-    string file_path = __FILE__;
-    string cur_path = file_path.substr(0, file_path.rfind("/"));
-    string volumeMatcapFilepath = cur_path + "/resources/matcap/" + volume_matcap;
-    cTexture2dPtr volMatCap = cTexture2d::create();
-    if(volMatCap->loadFromFile(volumeMatcapFilepath)){
-        m_volumeObject->getInternalVolume()->m_aoTexture = volMatCap;
-        m_volumeObject->getInternalVolume()->m_aoTexture->setTextureUnit(GL_TEXTURE5);
-        cerr << "SUCCESFULLY LOADED MATCAP TEXTURE" << endl;
+///
+/// \brief This method maps the binary cache of the volume. A valid cache holds the same voxels
+/// as the loaded image and is kept for resets. A missing or outdated cache is regenerated from
+/// the loaded image.
+/// \param a_source        The images block of the volume ADF
+/// \param a_sourceHash    Hash of the slices of a_source
+///
+void afVolmetricDrillingPlugin::initVolumeCache(const VolumeImageSource &a_source, uint64_t a_sourceHash){
+    cImagePtr image = m_voxelObj->m_texture->m_image;
+    uint32_t width = image->getWidth();
+    uint32_t height = image->getHeight();
+    uint32_t depth = m_voxelCount[2];
+    uint32_t bytesPerVoxel = image->getBytesPerPixel();
+
+    string cacheFilepath = VolumeCache::getCacheFilepath(a_source);
+    uint64_t sourceHash = a_sourceHash;
+
+    if (m_volumeCache.open(cacheFilepath, sourceHash, width, height, depth, bytesPerVoxel)){
+        cerr << "INFO! LOADED VOLUME CACHE " << cacheFilepath << endl;
+        return;
+    }
+
+    VolumeCacheHeader header;
+    VolumeCache::initHeader(header, width, height, depth, bytesPerVoxel, image->getFormat(), sourceHash);
+    if (VolumeCache::write(cacheFilepath, header, image->getData()) &&
+            m_volumeCache.open(cacheFilepath, sourceHash, width, height, depth, bytesPerVoxel)){
+        cerr << "INFO! WROTE VOLUME CACHE " << cacheFilepath << endl;
     }
     else{
-        cerr << "FAILED TO LOAD MATCAP TEXTURE" << endl;
+        cerr << "WARNING! FAILED TO CREATE VOLUME CACHE " << cacheFilepath << endl;
     }
+}
 
-    cTexture2dPtr drillMatCap = cTexture2d::create();
-    if (m_drillRigidBody->getShaderProgram()){
-        string drillMatcapFilepath = cur_path + "/resources/matcap/" + drill_matcap;
-        if(drillMatCap->loadFromFile(drillMatcapFilepath)){
-            for (int mi = 0 ; mi < m_drillRigidBody->getVisualObject()->getNumMeshes(); mi++){
-                m_drillRigidBody->getVisualObject()->getMesh(mi)->m_metallicTexture = drillMatCap;
-                m_drillRigidBody->getVisualObject()->getMesh(mi)->m_metallicTexture->setTextureUnit(GL_TEXTURE3);
-            }
-            m_drillRigidBody->getShaderProgram()->setUniformi("matcapMap", C_TU_METALLIC);
-            cerr << "SUCCESFULLY LOADED MATCAP2 TEXTURE" << endl;
+///
+/// \brief This method loads the volume when its ADF has a "source images" block. The images
+/// block of such an ADF is a small placeholder, so the simulator doesn't decode the slices on
+/// its single thread before the plugin starts. The voxels are copied from the cache when it is
+/// valid, otherwise the slices are decoded by the parallel slice loader and the cache is
+/// written for the next launch. The loaded image replaces the placeholder in the texture.
+/// \param a_useCache    Read and write the cache of the volume
+/// \return false if the slices couldn't be loaded
+///
+bool afVolmetricDrillingPlugin::loadDeferredVolume(bool a_useCache){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // the first slice gives the size of the volume
+    cImage first;
+    if (!first.loadFromFile(m_volumeSource.getSliceFilepath(0))){
+        cerr << "ERROR! FAILED TO LOAD VOLUME SLICE " << m_volumeSource.getSliceFilepath(0) << endl;
+        return false;
+    }
+    uint32_t width = first.getWidth();
+    uint32_t height = first.getHeight();
+    uint32_t depth = m_volumeSource.m_count;
+
+    cMultiImagePtr image = cMultiImage::create();
+    image->allocate(width, height, depth, GL_RGBA);
+
+    uint64_t sourceHash = 0;
+    if (a_useCache){
+        sourceHash = VolumeCache::computeSourceHash(m_volumeSource);
+        string cacheFilepath = VolumeCache::getCacheFilepath(m_volumeSource);
+        if (m_volumeCache.open(cacheFilepath, sourceHash, width, height, depth, 4)){
+            memcpy(image->getData(), m_volumeCache.getData(), m_volumeCache.getDataSize());
+            cerr << "INFO! LOADED THE VOLUME FROM ITS CACHE " << cacheFilepath << endl;
         }
-        else{
-            cerr << "FAILED TO LOAD MATCAP2 TEXTURE" << endl;
+    }
+    if (!m_volumeCache.isOpen()){
+        VolumeSliceLoader loader(m_volumeSource.m_loaderWorkers);
+        if (!loader.loadInto(m_volumeSource, image->getData(), width, height)){
+            return false;
         }
+        loader.printStats(m_volumeSource.m_name);
     }
 
-    cBackground* background = new cBackground();
-    background->setCornerColors(cColorf(1.0f, 1.0f, 1.0f),
-                                cColorf(1.0f, 1.0f, 1.0f),
-                                cColorf(0.6f, 0.6f, 0.6f),
-                                cColorf(0.6f, 0.6f, 0.6f));
-    m_mainCamera->getBackLayer()->addChild(background);
+    m_voxelObj->m_texture->setImage(image);
+    m_voxelObj->m_texture->markForUpdate();
+    if (a_useCache && !m_volumeCache.isOpen()){
+        initVolumeCache(m_volumeSource, sourceHash);
+    }
 
-    m_drillAudioDevice = new cAudioDevice();
-    m_mainCamera->getInternalCamera()->attachAudioDevice(m_drillAudioDevice);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    cerr << "INFO! LOADED " << width << "x" << height << "x" << depth << " VOXELS OF " << m_volumeSource.m_name
+         << " IN " << elapsed << " S" << endl;
+    return true;
+}
 
-    m_drillAudioBuffer = new cAudioBuffer();
-    string drillAudioFilepath = cur_path + "/resources/sounds/drill.wav";
-    if (m_drillAudioBuffer->loadFromFile(drillAudioFilepath)){
-        m_drillAudioSource = new cAudioSource();
-//        m_drillAudioBuffer->convertToMono();
-        m_drillAudioSource->setAudioBuffer(m_drillAudioBuffer);
-        m_drillAudioSource->setLoop(true);
-        m_drillAudioSource->setGain(5.0);
-        if (!mute) m_drillAudioSource->play();
+///
+/// \brief This method computes the distance field to the critical structures, up to the warning
+/// distance from the surface of the largest burr. The field is cached next to the volume cache,
+/// since the transform of a large volume takes a few seconds even on all the cores.
+///
+void afVolmetricDrillingPlugin::initCriticalDistanceField(CriticalDistanceField &a_field, const unsigned char *a_data, int a_bytesPerVoxel){
+    double maxBurrRadius = 0.0;
+    for (auto& burr : m_drillBurrSizes){
+        maxBurrRadius = max(maxBurrRadius, burr.second.first);
     }
-    else{
-        delete m_drillAudioSource;
-        delete m_drillAudioBuffer;
-        m_drillAudioSource = nullptr;
-        m_drillAudioBuffer = nullptr;
-        cerr << "FAILED TO LOAD DRILL AUDIO FROM " << drillAudioFilepath << endl;
+    double voxelSize[3];
+    for (int i = 0 ; i < 3 ; i++){
+        voxelSize[i] = m_core.getVoxelRemover().getVoxelSize(i);
+    }
+    double maxDistance = m_criticalWarningDistance + maxBurrRadius + cVector3d(voxelSize[0], voxelSize[1], voxelSize[2]).length();
+    // the density of bone is its alpha, so a labeled voxel is bone when both its bytes match
+    unsigned char boneLabel[4] = {(unsigned char)m_boneLabel, m_boneColor.m_color[3], 0, 0};
+    const unsigned char* boneColor = m_voxelPalette.isEmpty() ? m_boneColor.m_color : boneLabel;
+    a_field.init(m_voxelCount, voxelSize, maxDistance, a_bytesPerVoxel, boneColor);
+
+    string cacheFilepath;
+    uint64_t sourceHash = 0;
+    if (m_volumeCache.isOpen()){
+        cacheFilepath = VolumeCache::getCacheFilepath(m_volumeSource) + ".dist";
+        sourceHash = m_volumeCache.getHeader().m_sourceHash;
+        if (a_field.load(cacheFilepath, sourceHash)){
+            cerr << "INFO! LOADED CRITICAL STRUCTURE DISTANCES " << cacheFilepath << endl;
+            return;
+        }
     }
 
-    return 1;
-}
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t criticalCount = a_field.build(a_data, max(int(std::thread::hardware_concurrency()) - 1, 0));
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    cerr << "INFO! COMPUTED THE DISTANCES TO " << criticalCount << " CRITICAL VOXELS IN " << elapsed << " S ("
+         << a_field.getMemoryUsage() / (1024 * 1024) << " MB)" << endl;
 
-void afVolmetricDrillingPlugin::graphicsUpdate(){
+    if (!cacheFilepath.empty() && !a_field.save(cacheFilepath, sourceHash)){
+        cerr << "WARNING! FAILED TO CACHE THE CRITICAL STRUCTURE DISTANCES TO " << cacheFilepath << endl;
+    }
+}
 
-    // update region of voxels to be updated
-    if (m_flagMarkVolumeForUpdate)
-    {
-        m_mutexVoxel.acquire();
-        cVector3d min = m_volumeUpdate.m_min;
-        cVector3d max = m_volumeUpdate.m_max;
-        m_volumeUpdate.setEmpty();
-        m_mutexVoxel.release();
-        ((cTexture3d*)m_voxelObj->m_texture.get())->markForPartialUpdate(min, max);
-        m_flagMarkVolumeForUpdate = false;
+///
+/// \brief This method looks up the distance between the surface of the burr and the closest
+/// critical structure, and raises the warning within the warning distance.
+///
+void afVolmetricDrillingPlugin::updateCriticalProximity(){
+    cVector3d voxel = m_core.getVoxelRemover().getVoxelCoordinates(m_toolCursorList[0]->m_hapticPoint->getGlobalPosProxy());
+    double distance = m_criticalField.getDistance(int(floor(voxel(0))), int(floor(voxel(1))), int(floor(voxel(2))))
+            - m_core.getBurrRadius(m_core.getActiveBurrIdx());
+    m_hapticState.m_criticalProximity = cClamp(1.0 - distance / m_criticalWarningDistance, 0.0, 1.0);
+    if (distance < m_criticalWarningDistance){
+        m_hapticState.m_showWarning = true;
     }
-    m_volumeObject->getShaderProgram()->setUniformi("aoMap", C_TU_AO);
 }
 
-void afVolmetricDrillingPlugin::physicsUpdate(double dt){
+///
+/// \brief This method requests a reset of the volume. The restored voxels are built on a
+/// thread of their own, so the slices can be decoded and the critical distances computed while
+/// the drilling goes on. The haptic loop, which drills the voxels and reads the occupancy and
+/// the critical distances, then swaps them in, and the graphics thread uploads the volume.
+///
+void afVolmetricDrillingPlugin::resetVolume(){
+    if (m_volumeResetPreparing || m_volumeResetPending){
+        cerr << "WARNING! THE VOLUME IS ALREADY BEING RESET" << endl;
+        return;
+    }
+    if (!m_volumeCache.isOpen() && !m_volumeSource.isValid()){
+        cerr << "WARNING! THE VOLUME CAN ONLY BE RESET FROM ITS CACHE OR ITS SOURCE IMAGES, NEITHER WAS FOUND" << endl;
+        return;
+    }
+    m_volumeResetPreparing = true;
+    m_volumeResetThread = std::thread(&afVolmetricDrillingPlugin::prepareVolumeReset, this);
+}
 
-    m_worldPtr->getChaiWorld()->computeGlobalPositions(true);
+///
+/// \brief This method builds the restored volume in the format of the volume image. With a
+/// valid cache this is a copy from the mapped file, otherwise the slices are decoded again in
+/// parallel. A label volume is converted again, which gives the labels of its palette.
+///
+void afVolmetricDrillingPlugin::prepareVolumeReset(){
+    cImagePtr image = m_voxelObj->m_texture->m_image;
+    uint32_t width = image->getWidth();
+    uint32_t height = image->getHeight();
+    int bytesPerVoxel = image->getBytesPerPixel();
+    size_t voxelCount = size_t(width) * height * m_voxelCount[2];
+    m_volumeResetValid = false;
+    m_resetVoxels.resize(voxelCount * bytesPerVoxel);
+
+    // RGBA voxels to convert to labels, a cache written before the conversion holds them too
+    vector<unsigned char> rgba;
+    const unsigned char* labelSource = nullptr;
+    if (m_volumeCache.isOpen() && m_volumeCache.getHeader().m_bytesPerVoxel == uint32_t(bytesPerVoxel)){
+        memcpy(m_resetVoxels.data(), m_volumeCache.getData(), m_resetVoxels.size());
+    }
+    else if (m_volumeCache.isOpen() && m_volumeCache.getHeader().m_bytesPerVoxel == 4 && !m_voxelPalette.isEmpty()){
+        labelSource = m_volumeCache.getData();
+    }
+    else if (bytesPerVoxel == 4 || !m_voxelPalette.isEmpty()){
+        rgba.resize(voxelCount * 4);
+        VolumeSliceLoader loader(m_volumeSource.m_loaderWorkers);
+        if (!m_volumeSource.isValid() || !loader.loadInto(m_volumeSource, rgba.data(), width, height)){
+            cerr << "ERROR! FAILED TO LOAD THE SLICES TO RESET THE VOLUME" << endl;
+            m_flagVolumeResetPrepared.store(true, std::memory_order_release);
+            return;
+        }
+        loader.printStats(m_volumeSource.m_name);
+        if (bytesPerVoxel == 4){
+            m_resetVoxels.swap(rgba);
+        }
+        else{
+            labelSource = rgba.data();
+        }
+    }
+    else{
+        cerr << "ERROR! ONLY RGBA VOLUMES CAN BE RESET FROM THEIR SLICES, THE VOLUME HAS " << bytesPerVoxel << " BYTES PER VOXEL" << endl;
+        m_flagVolumeResetPrepared.store(true, std::memory_order_release);
+        return;
+    }
 
-    cTransform T_c_w = m_mainCamera->getLocalTransform();
-    // If a valid haptic device is found, then it should be available
-    if (getOverrideDrillControl()){
-        m_T_d = m_drillRigidBody->getLocalTransform();
-    }
-    else if(m_hapticDevice->isDeviceAvailable()){
-        bool device_clutch, cam_clutch;
-        m_hapticDevice->getUserSwitch(0, device_clutch);
-        m_hapticDevice->getUserSwitch(1, cam_clutch);
-
-        m_hapticDevice->getTransform(m_T_i);
-        m_hapticDevice->getLinearVelocity(m_V_i);
-        m_V_i = T_c_w.getLocalRot() * (m_V_i / m_toolCursorList[0]->getWorkspaceScaleFactor());
-        m_T_d.setLocalPos(m_T_d.getLocalPos() + (m_V_i * 0.4 * !device_clutch * !cam_clutch));
-        m_T_d.setLocalRot(T_c_w.getLocalRot() * m_T_i.getLocalRot());
-
-        // set zero forces when manipulating objects
-        if (device_clutch || cam_clutch){
-            if (cam_clutch){
-                 m_mainCamera->setView(T_c_w.getLocalPos() + m_V_i * !device_clutch, m_mainCamera->getTargetPosLocal(), m_mainCamera->getUpVector());
-            }
-            m_toolCursorList[0]->setDeviceLocalForce(0.0, 0.0, 0.0);
+    if (labelSource){
+        VoxelPalette palette;
+        if (!palette.convert(labelSource, voxelCount, m_resetVoxels.data()) || palette.getColors() != m_voxelPalette.getColors()){
+            cerr << "ERROR! THE LABELS OF THE RESET VOLUME DON'T MATCH ITS PALETTE" << endl;
+            m_flagVolumeResetPrepared.store(true, std::memory_order_release);
+            return;
         }
     }
 
-    toolCursorsPosUpdate(m_T_d);
+    const BrickOccupancy& occupancy = m_core.getOccupancy();
+    m_resetOccupancy.init(occupancy.getVoxelCount(0), occupancy.getVoxelCount(1), occupancy.getVoxelCount(2), occupancy.getBrickSize());
+    m_resetOccupancy.build(m_resetVoxels.data(), bytesPerVoxel);
+    if (m_criticalWarningDistance > 0){
+        initCriticalDistanceField(m_resetCriticalField, m_resetVoxels.data(), bytesPerVoxel);
+    }
 
-    // check for shaft collision
-    checkShaftCollision();
+    m_volumeResetValid = true;
+    m_flagVolumeResetPrepared.store(true, std::memory_order_release);
+}
 
-    if (getOverrideDrillControl() == false){
-        // updates position of drill mesh
-        drillPoseUpdateFromCursors();
+///
+/// \brief This method swaps the restored volume in. The tick only stalls for the copy of the
+/// voxels and the rebuild of the haptic level, if any.
+///
+void afVolmetricDrillingPlugin::applyVolumeReset(){
+    m_hapticDevice->setForce(cVector3d(0., 0., 0.));
+
+    memcpy(m_voxelObj->m_texture->m_image->getData(), m_resetVoxels.data(), m_resetVoxels.size());
+    m_core.swapOccupancy(m_resetOccupancy);
+    // the voxels carved so far were carved from the volume before the reset
+    if (m_gpuCarving.load(std::memory_order_relaxed)){
+        m_gpuCarver.dropCarvedVoxels();
+    }
+    m_removalStats.requestReset();
+    if (m_resetCriticalField.isValid()){
+        std::swap(m_criticalField, m_resetCriticalField);
     }
 
+    // the journaled voxels belong to the volume before the reset
+    if (m_voxelJournal.isEnabled()){
+        m_voxelJournal.clear();
+    }
+    m_flagVolumeResetDone.store(true, std::memory_order_release);
+}
 
-    if (m_toolCursorList[0]->isInContact(m_voxelObj) && m_targetToolCursorIdx == 0 /*&& (userSwitches == 2)*/)
-    {
+void afVolmetricDrillingPlugin::finishVolumeReset(){
+    cImagePtr image = m_voxelObj->m_texture->m_image;
+    m_voxelObj->m_texture->markForUpdate();
+    m_textureUploadBytesTotal += size_t(image->getWidth()) * image->getHeight() * m_voxelCount[2] * image->getBytesPerPixel();
+    if (m_emptySpaceSkipping){
+        m_occupancyTexture.build(m_core.getOccupancy());
+    }
+    m_surfaceMesher.reset(image->getData());
+    if (m_volumeSharedMemory.isOpen() && m_volumeSharedMemory.getBytesPerVoxel() == int(image->getBytesPerPixel())){
+        m_volumeSharedMemory.writeAll(image->getData(), m_voxelPalette.isEmpty() ? nullptr : m_voxelPalette.getColors().data(),
+                                      m_drillRigidBody->getCurrentTimeStamp());
+    }
+    // the restored texture overwrites the voxels carved since the haptic loop restored the volume
+    if (m_gpuCarver.isEnabled()){
+        m_gpuCarver.reset();
+    }
+    m_volumeResetPending = false;
 
-        for (int ci = 0 ; ci < 3 ; ci++){
-            // retrieve contact event
-            cCollisionEvent* contact = m_toolCursorList[0]->m_hapticPoint->getCollisionEvent(ci);
+    // the previous voxels, occupancy and distances were swapped out by the haptic loop
+    vector<unsigned char>().swap(m_resetVoxels);
+    BrickOccupancy previousOccupancy;
+    previousOccupancy.swap(m_resetOccupancy);
+    m_resetCriticalField = CriticalDistanceField();
+}
 
-            cVector3d orig(contact->m_voxelIndexX, contact->m_voxelIndexY, contact->m_voxelIndexZ);
+///
+/// \brief This method starts recording the inputs of the haptic loop. The pose of the volume is
+/// stored with the records so that a replay can express the drill poses in its frame.
+/// \param a_filepath    File to write, recording_<date>_<time>.vdrec in the working directory if empty
+/// \return true if the recording started
+///
+bool afVolmetricDrillingPlugin::startInputRecording(string a_filepath){
+    if (a_filepath.empty()){
+        char name[64];
+        time_t now = time(nullptr);
+        strftime(name, sizeof(name), "recording_%Y%m%d_%H%M%S.vdrec", localtime(&now));
+        a_filepath = name;
+    }
 
-            m_voxelObj->m_texture->m_image->getVoxelColor(uint(orig.x()), uint(orig.y()), uint(orig.z()), m_storedColor);
+    double volumePos[3], volumeRot[9];
+    cVector3d pos = m_voxelObj->getGlobalPos();
+    cMatrix3d rot = m_voxelObj->getGlobalRot();
+    for (int i = 0 ; i < 3 ; i++){
+        volumePos[i] = pos(i);
+        for (int j = 0 ; j < 3 ; j++){
+            volumeRot[3 * i + j] = rot(i, j);
+        }
+    }
 
-            //if the tool comes in contact with the critical region, instantiate the warning message
-            if(m_storedColor != m_boneColor && m_storedColor != m_zeroColor)
-            {
-                m_warningPopup->setShowPanel(true);
-                m_warningText->setShowEnabled(true);
-            }
+    if (!m_inputRecorder.start(a_filepath, volumePos, volumeRot)){
+        return false;
+    }
+    cerr << "INFO! RECORDING THE HAPTIC LOOP INPUTS TO " << a_filepath << endl;
+    return true;
+}
 
-            m_voxelObj->m_texture->m_image->setVoxelColor(uint(orig.x()), uint(orig.y()), uint(orig.z()), m_zeroColor);
+void afVolmetricDrillingPlugin::stopInputRecording(){
+    m_inputRecorder.stop();
+    cerr << "INFO! RECORDED " << m_inputRecorder.getWrittenCount() << " TICKS TO " << m_inputRecorder.getFilepath();
+    if (m_inputRecorder.getDroppedCount() > 0){
+        cerr << ", " << m_inputRecorder.getDroppedCount() << " TICKS DIDN'T FIT IN THE QUEUE";
+    }
+    cerr << endl;
+}
 
-            //Publisher for voxels removed
-            if(m_storedColor != m_zeroColor)
-            {
-                double sim_time = m_drillRigidBody->getCurrentTimeStamp();
+///
+/// \brief This method completes the record of the current tick with the commanded drill pose. It
+/// only copies values, the file is written by the thread of the recorder.
+/// \param a_dt    Time since the last tick
+///
+void afVolmetricDrillingPlugin::recordInputs(double a_dt){
+    if (!(m_inputRecord.m_flags & InputRecord::DEVICE_AVAILABLE)){
+        memset(m_inputRecord.m_devicePos, 0, sizeof(m_inputRecord.m_devicePos));
+        memset(m_inputRecord.m_deviceRot, 0, sizeof(m_inputRecord.m_deviceRot));
+        memset(m_inputRecord.m_deviceVel, 0, sizeof(m_inputRecord.m_deviceVel));
+    }
+    m_inputRecord.m_tick = m_hapticState.m_tick;
+    m_inputRecord.m_simTime = m_physicsState.m_simTime;
+    m_inputRecord.m_dt = a_dt;
+    for (int i = 0 ; i < 3 ; i++){
+        m_inputRecord.m_drillPos[i] = m_T_d.getLocalPos()(i);
+        for (int j = 0 ; j < 3 ; j++){
+            m_inputRecord.m_drillRot[3 * i + j] = m_T_d.getLocalRot()(i, j);
+        }
+    }
+    m_inputRecord.m_burrIdx = m_core.getActiveBurrIdx();
+    m_inputRecorder.record(m_inputRecord);
+}
 
-                double voxel_array[3] = {orig.get(0), orig.get(1), orig.get(2)};
+///
+/// \brief This method starts recording the session in process. The cameras are read back from
+/// their frame buffers, which AMBF only renders for the cameras that publish their images, so
+/// the streams are those of data_record.py: the left and right stereo images and the image and
+/// depth of the segmentation camera.
+/// \param a_filepath    File to write, session_<date>_<time>.hdf5 in the working directory if empty
+/// \return true if the recording started
+///
+bool afVolmetricDrillingPlugin::startSessionRecording(string a_filepath){
+    if (a_filepath.empty()){
+        char name[64];
+        time_t now = time(nullptr);
+        strftime(name, sizeof(name), "session_%Y%m%d_%H%M%S.hdf5", localtime(&now));
+        a_filepath = name;
+    }
 
-                cColorf color_glFloat = m_storedColor.getColorf();
-                float color_array[4];
-                color_array[0] = color_glFloat.getR();
-                color_array[1] = color_glFloat.getG();
-                color_array[2] = color_glFloat.getB();
-                color_array[3] = color_glFloat.getA();
+    m_sessionStreams.clear();
+    m_sessionTextureIds.clear();
+    auto addCamera = [&](afCameraPtr a_camera, const char* a_imageName, const char* a_depthName){
+        if (!a_camera){
+            return;
+        }
+        if (!a_camera->m_frameBuffer){
+            cerr << "WARNING! CAMERA " << a_camera->getName() << " DOESN'T PUBLISH ITS IMAGE, IT ISN'T RECORDED" << endl;
+            return;
+        }
+        FrameStreamDesc stream;
+        stream.m_name = a_imageName;
+        stream.m_width = a_camera->m_frameBuffer->getWidth();
+        stream.m_height = a_camera->m_frameBuffer->getHeight();
+        stream.m_depth = false;
+        stream.m_near = a_camera->getInternalCamera()->getNearClippingPlane();
+        stream.m_far = a_camera->getInternalCamera()->getFarClippingPlane();
+        m_sessionStreams.push_back(stream);
+        m_sessionTextureIds.push_back(a_camera->m_frameBuffer->getImageBuffer()->getTextureId());
+        if (a_depthName){
+            stream.m_name = a_depthName;
+            stream.m_depth = true;
+            m_sessionStreams.push_back(stream);
+            m_sessionTextureIds.push_back(a_camera->m_frameBuffer->getDepthBuffer()->getTextureId());
+        }
+    };
+    addCamera(m_stereoCameraL, "l_img", nullptr);
+    addCamera(m_stereoCameraR, "r_img", nullptr);
+    addCamera(m_worldPtr->getCamera("segmentation_camera"), "segm", "depth");
+    if (m_sessionStreams.empty()){
+        cerr << "WARNING! NO CAMERA PUBLISHES ITS IMAGE, ONLY THE POSES AND THE REMOVED VOXELS ARE RECORDED" << endl;
+    }
 
+    m_sessionPoseNames = {"mastoidectomy_drill", "main_camera", "mastoidectomy_volume"};
 
-                m_drillingPub->voxelsRemoved(voxel_array,color_array,sim_time);
-            }
+    double voxelVolume = 1.0;
+    for (int i = 0 ; i < 3 ; i++){
+        voxelVolume *= m_volumeObject->getDimensions().get(i) / m_voxelCount[i] * s_millimetersPerUnit;
+    }
 
-            m_mutexVoxel.acquire();
-            m_volumeUpdate.enclose(cVector3d(uint(orig.x()), uint(orig.y()), uint(orig.z())));
-            m_mutexVoxel.release();
-            // mark voxel for update
-        }
+    if (!m_sessionRecorder.start(a_filepath, m_sessionStreams, m_sessionPoseNames, s_millimetersPerUnit / 1000.0, voxelVolume)){
+        return false;
+    }
+    m_sessionFrame = nullptr;
+    m_sessionLastCaptureTime = -1.0;
+    m_sessionDroppedFrameCount = 0;
+    cerr << "INFO! RECORDING THE SESSION, " << m_sessionStreams.size() << " CAMERA STREAMS, TO " << a_filepath << endl;
+    return true;
+}
 
-        m_flagMarkVolumeForUpdate = true;
+///
+/// \brief This method stops the session recording. Needs the GL context, the frames still in
+/// flight in the readback are dropped.
+///
+void afVolmetricDrillingPlugin::stopSessionRecording(){
+    m_sessionRecorder.stop();
+    m_sessionReadback.destroy();
+    m_sessionFrame = nullptr;
+    cerr << "INFO! RECORDED " << m_sessionRecorder.getWrittenFrameCount() << " FRAMES AND "
+         << m_sessionRecorder.getWrittenVoxelCount() << " REMOVED VOXELS TO " << m_sessionRecorder.getFilepath();
+    if (m_sessionDroppedFrameCount > 0){
+        cerr << ", " << m_sessionDroppedFrameCount << " FRAMES WERE SKIPPED";
     }
-    // remove warning panel
-    else
-    {
-        m_warningPopup->setShowPanel(false);
-        m_warningText->setShowEnabled(false);
+    if (m_sessionRecorder.getDroppedVoxelCount() > 0){
+        cerr << ", " << m_sessionRecorder.getDroppedVoxelCount() << " VOXELS DIDN'T FIT IN THE QUEUE";
     }
-    // compute interaction forces
-    for(int i = 0 ; i < m_toolCursorList.size() ; i++){
-        m_toolCursorList[i]->computeInteractionForces();
+    cerr << endl;
+}
+
+///
+/// \brief This method captures the cameras and the poses at the session rate, then hands the
+/// frames whose readback has completed to the writer. A frame is skipped, not waited for, when
+/// the readback slots or the frames of the recorder are all in use.
+///
+void afVolmetricDrillingPlugin::updateSessionRecording(){
+    if (!m_sessionStreams.empty() && !m_sessionReadback.isEnabled()){
+        if (!m_sessionReadback.init(m_sessionStreams)){
+            cerr << "ERROR! FAILED TO CREATE THE READBACK BUFFERS OF THE SESSION, THE CAMERAS AREN'T RECORDED" << endl;
+            m_sessionStreams.clear();
+        }
+        m_sessionSlots.resize(m_sessionReadback.getSlotCount());
     }
 
-    // check if device remains stuck inside voxel object
-    // Also orient the force to match the camera rotation
-    cVector3d force = cTranspose(T_c_w.getLocalRot()) * m_targetToolCursor->getDeviceLocalForce();
-    m_toolCursorList[0]->setDeviceLocalForce(force);
-    double force_mag = cClamp(force.length(), 0.0, m_hapticDevice->getSpecifications().m_maxLinearForce);
-    if (m_drillAudioSource){
-        m_drillAudioSource->setPitch(3.0 - force_mag / m_hapticDevice->getSpecifications().m_maxLinearForce);
+    double time = m_drillRigidBody->getCurrentTimeStamp();
+    if (m_sessionLastCaptureTime < 0.0 || time - m_sessionLastCaptureTime >= m_sessionInterval){
+        m_sessionLastCaptureTime = time;
+        if (m_sessionReadback.isEnabled()){
+            int slot = m_sessionReadback.capture(m_sessionTextureIds);
+            if (slot >= 0){
+                m_sessionSlots[slot].m_time = time;
+                getSessionPoses(m_sessionSlots[slot].m_poses);
+            }
+            else{
+                m_sessionDroppedFrameCount++;
+            }
+        }
+        else{
+            SessionFrame* frame = m_sessionRecorder.acquireFrame();
+            if (frame){
+                frame->m_time = time;
+                getSessionPoses(frame->m_poses);
+                m_sessionRecorder.pushFrame(frame);
+            }
+            else{
+                m_sessionDroppedFrameCount++;
+            }
+        }
     }
 
-    if (m_flagStart)
-    {
-        if (force.length() != 0.0)
-        {
-        //    resetDrill();
-            m_counter = 0;
+    while (m_sessionReadback.isEnabled()){
+        if (!m_sessionFrame){
+            m_sessionFrame = m_sessionRecorder.acquireFrame();
+            if (!m_sessionFrame){
+                break;
+            }
         }
-        else
-        {
-            m_counter++;
-            if (m_counter > 10)
-                m_flagStart = false;
+        int slot = m_sessionReadback.poll(m_sessionFrame->m_data.data());
+        if (slot < 0){
+            break;
         }
+        m_sessionFrame->m_time = m_sessionSlots[slot].m_time;
+        m_sessionFrame->m_poses = m_sessionSlots[slot].m_poses;
+        m_sessionRecorder.pushFrame(m_sessionFrame);
+        m_sessionFrame = nullptr;
     }
-    else
-    {
-        if (force.length() > 10.0)
-        {
-            m_flagStart = true;
+}
+
+void afVolmetricDrillingPlugin::getSessionPoses(vector<SessionPose> &a_poses){
+    cVector3d positions[3] = {m_drillRigidBody->getLocalPos(), m_mainCamera->getLocalPos(), m_volumeObject->getLocalPos()};
+    cMatrix3d rotations[3] = {m_drillRigidBody->getLocalRot(), m_mainCamera->getLocalRot(), m_volumeObject->getLocalRot()};
+    a_poses.resize(3);
+    for (int i = 0 ; i < 3 ; i++){
+        cQuaternion quat;
+        quat.fromRotMat(rotations[i]);
+        for (int j = 0 ; j < 3 ; j++){
+            a_poses[i].m_pose[j] = positions[i](j) * s_millimetersPerUnit / 1000.0;
         }
+        a_poses[i].m_pose[3] = quat.x;
+        a_poses[i].m_pose[4] = quat.y;
+        a_poses[i].m_pose[5] = quat.z;
+        a_poses[i].m_pose[6] = quat.w;
     }
+}
 
-    /////////////////////////////////////////////////////////////////////////
-    // FINALIZE
-    /////////////////////////////////////////////////////////////////////////
+void afVolmetricDrillingPlugin::voxelRemoved(int a_x, int a_y, int a_z, const cColorb &a_color, int a_label){
+    //if the tool comes in contact with the critical region, instantiate the warning message
+    if(!isBoneVoxel(a_color, a_label))
+    {
+        m_hapticState.m_showWarning = true;
+        m_tickCriticalContact = true;
+        markCriticalVoxel(a_x, a_y, a_z);
+    }
+    m_removalStats.voxelRemoved(a_color.m_color, a_label);
 
-    // send forces to haptic device
-    if (getOverrideDrillControl() == false){
-        m_toolCursorList[0]->applyToDevice();
+    //Publisher for voxels removed
+    double voxel_array[3] = {double(a_x), double(a_y), double(a_z)};
+
+    cColorf color_glFloat = a_color.getColorf();
+    float color_array[4];
+    color_array[0] = color_glFloat.getR();
+    color_array[1] = color_glFloat.getG();
+    color_array[2] = color_glFloat.getB();
+    color_array[3] = color_glFloat.getA();
+
+    m_drillingPub->voxelRemoved(voxel_array,color_array,a_label,m_physicsState.m_simTime);
+
+    if (m_sessionRecorder.isRecording()){
+        m_sessionRecorder.recordVoxel(m_physicsState.m_simTime, a_x, a_y, a_z, a_color.m_color, a_label);
+    }
+}
+
+void afVolmetricDrillingPlugin::voxelsRemoved(size_t a_count){
+    // Publish all the voxels removed in this tick as a single message
+    m_drillingPub->publishVoxelsRemoved(m_physicsState.m_simTime);
+
+    // The bricks modified in this tick were handed to the graphics thread
+    m_flagMarkVolumeForUpdate.store(true, std::memory_order_release);
+}
+
+void afVolmetricDrillingPlugin::burrChanged(int a_burrIdx, double a_radius){
+    // published from the haptic loop so that the publisher queue keeps a single producer
+    m_drillingPub->burrChange(a_radius, m_physicsState.m_simTime);
+
+    if (m_sessionRecorder.isRecording()){
+        m_sessionRecorder.recordBurrChange(m_physicsState.m_simTime, a_radius);
+    }
+}
+
+void afVolmetricDrillingPlugin::voxelRestored(int a_x, int a_y, int a_z, const cColorb &a_color, int a_label){
+    if (!isBoneVoxel(a_color, a_label)){
+        markCriticalVoxel(a_x, a_y, a_z);
+    }
+    m_removalStats.voxelRestored(a_color.m_color, a_label);
+}
+
+void afVolmetricDrillingPlugin::markCriticalVoxel(int a_x, int a_y, int a_z){
+    if (!m_criticalField.isValid()){
+        return;
+    }
+    int voxel[3] = {a_x, a_y, a_z};
+    for (int i = 0 ; i < 3 ; i++){
+        if (!m_tickCriticalModified){
+            m_tickCriticalBox.m_min[i] = voxel[i];
+            m_tickCriticalBox.m_max[i] = voxel[i] + 1;
+        }
+        else{
+            m_tickCriticalBox.m_min[i] = min(m_tickCriticalBox.m_min[i], voxel[i]);
+            m_tickCriticalBox.m_max[i] = max(m_tickCriticalBox.m_max[i], voxel[i] + 1);
+        }
     }
+    m_tickCriticalModified = true;
+}
+
+void afVolmetricDrillingPlugin::publishCriticalBox(){
+    if (!m_tickCriticalModified){
+        return;
+    }
+    // without room in the queue the box grows with the next ticks and is retried
+    if (m_criticalBoxes.push(m_tickCriticalBox)){
+        m_tickCriticalModified = false;
+    }
+}
+
+void afVolmetricDrillingPlugin::voxelsRestored(size_t a_count){
+    cerr << "INFO! RESTORED " << a_count << " VOXELS, THE JOURNAL HOLDS " << m_voxelJournal.getEntryCount()
+         << " (" << m_voxelJournal.getMemoryUsage() / 1024 << " KB)" << endl;
 
+    // the restored bricks are uploaded like the drilled ones
+    m_flagMarkVolumeForUpdate.store(true, std::memory_order_release);
 }
 
 ///
@@ -492,20 +1972,22 @@ void afVolmetricDrillingPlugin::toolCursorInit(const afWorldPtr a_afWorld){
 
             // if the haptic device has a gripper, enable it as a user switch
             m_hapticDevice->setEnableGripperUserSwitch(true);
-            m_toolCursorList[i]->setRadius(m_drillBurrSizes[m_activeBurrIdx].first); // Set the correct radius for the tip which is not from the list of cursor radii
+            m_toolCursorList[i]->setRadius(m_drillBurrSizes[m_selectedBurrIdx].first); // Set the correct radius for the tip which is not from the list of cursor radii
         }
         else
         {
             m_toolCursorList[i]->setShowContactPoints(m_showGoalProxySpheres, m_showGoalProxySpheres);
             m_toolCursorList[i]->m_hapticPoint->m_sphereProxy->m_material->setGreenChartreuse();
             m_toolCursorList[i]->m_hapticPoint->m_sphereGoal->m_material->setOrangeCoral();
-            m_toolCursorList[i]->setRadius(m_toolCursorRadius[i]);
+            m_toolCursorList[i]->setRadius(m_toolCursorRadius[min(size_t(i), m_toolCursorRadius.size() - 1)]);
         }
      }
 
+    m_core.setToolCursors(m_toolCursorList, m_toolCursorRadius, m_dX);
+
     // Initialize the start pose of the tool cursors
-    toolCursorsPosUpdate(m_T_d);
-    toolCursorsInitialize();
+    m_core.toolCursorsPosUpdate(m_T_d);
+    m_core.toolCursorsInitialize();
 }
 
 
@@ -514,7 +1996,10 @@ void afVolmetricDrillingPlugin::toolCursorInit(const afWorldPtr a_afWorld){
 /// \param a_vel
 ///
 void afVolmetricDrillingPlugin::incrementDevicePos(cVector3d a_vel){
-    m_T_d.setLocalPos(m_T_d.getLocalPos() + a_vel);
+    DrillCommand command;
+    command.m_type = DrillCommand::TRANSLATE;
+    command.m_vector = a_vel;
+    sendDrillCommand(command);
 }
 
 
@@ -523,103 +2008,149 @@ void afVolmetricDrillingPlugin::incrementDevicePos(cVector3d a_vel){
 /// \param a_rot
 ///
 void afVolmetricDrillingPlugin::incrementDeviceRot(cVector3d a_rot){
-    cMatrix3d R_cmd;
-    R_cmd.setExtrinsicEulerRotationDeg(a_rot(0), a_rot(1), a_rot(2), C_EULER_ORDER_XYZ);
-    R_cmd = m_T_d.getLocalRot() * R_cmd;
-    m_T_d.setLocalRot(R_cmd);
+    DrillCommand command;
+    command.m_type = DrillCommand::ROTATE;
+    command.m_vector = a_rot;
+    sendDrillCommand(command);
 }
 
 ///
-/// \brief afVolmetricDrillingPlugin::toolCursorsInitialize
+/// \brief This method queues a change of the drill. The keyboard and the haptic loop run on
+/// different threads, so the changes are applied by the haptic loop at its next tick.
 ///
-void afVolmetricDrillingPlugin::toolCursorsInitialize(){
-    for (int i = 0 ;  i < m_toolCursorList.size() ; i++){
-        m_toolCursorList[i]->initialize();
+void afVolmetricDrillingPlugin::sendDrillCommand(const DrillCommand &a_command){
+    if (!m_drillCommands.push(a_command)){
+        cerr << "WARNING! DRILL COMMAND QUEUE IS FULL, COMMAND IGNORED" << endl;
     }
 }
 
-///
-/// \brief This method updates the position of the shaft tool cursors
-/// which eventually updates the position of the whole tool.
-///
-void afVolmetricDrillingPlugin::toolCursorsPosUpdate(cTransform a_targetPose){
-    cVector3d n_x = a_targetPose.getLocalRot().getCol0() * m_dX;
-    for (int i = 0 ; i < m_toolCursorList.size() ; i++){
-        cVector3d P = a_targetPose.getLocalPos() + n_x * i;
-        m_toolCursorList[i]->setDeviceLocalPos(P);
-        m_toolCursorList[i]->setDeviceLocalRot(a_targetPose.getLocalRot());
+void afVolmetricDrillingPlugin::applyDrillCommand(const DrillCommand &a_command){
+    switch (a_command.m_type) {
+    case DrillCommand::TRANSLATE:
+        m_T_d.setLocalPos(m_T_d.getLocalPos() + a_command.m_vector);
+        break;
+    case DrillCommand::ROTATE:{
+        cMatrix3d R_cmd;
+        R_cmd.setExtrinsicEulerRotationDeg(a_command.m_vector(0), a_command.m_vector(1), a_command.m_vector(2), C_EULER_ORDER_XYZ);
+        R_cmd = m_T_d.getLocalRot() * R_cmd;
+        m_T_d.setLocalRot(R_cmd);
+        break;
+    }
+    case DrillCommand::RESET:
+        resetDrillState();
+        break;
+    case DrillCommand::CHANGE_BURR:
+        m_core.setBurr(a_command.m_burrIdx);
+        break;
+    case DrillCommand::RESET_VOLUME:
+        applyVolumeReset();
+        break;
+    default:
+        applyJournalCommand(a_command);
+        break;
     }
 }
 
-void afVolmetricDrillingPlugin::resetDrill(){
-    m_hapticDevice->setForce(cVector3d(0., 0., 0.));
-    m_T_d = m_T_d_init;
-    toolCursorsPosUpdate(m_T_d);
-    toolCursorsInitialize();
-    drillPoseUpdateFromCursors();
+void afVolmetricDrillingPlugin::sendJournalCommand(DrillCommand::Type a_type, double a_seconds){
+    if (!m_voxelJournal.isEnabled()){
+        cerr << "WARNING! THE JOURNAL OF REMOVED VOXELS IS DISABLED, START THE PLUGIN WITH --jmb <MB>" << endl;
+        return;
+    }
+    DrillCommand command;
+    command.m_type = a_type;
+    command.m_seconds = a_seconds;
+    sendDrillCommand(command);
 }
 
 ///
-/// \brief This method checks for collision between the tool shaft and the volume.
-/// The error between the proxy and goal position of each of the shaft tool cursors is constantly
-/// computed. The shaft tool cursor having the maximum error is set as g_targetToolCursor. Further, the
-/// position of the drill mesh is set such that it follows the proxy position of the g_targetToolCursor.
-/// If there's no collision, the drill mesh follows the proxy position of the shaft tool cursor which is
-/// closest to the tip tool cursor.
+/// \brief This method applies a command on the journal. It runs on the haptic loop, the only
+/// writer of the journal and the volume, so a rollback never races with the drilling.
 ///
-void afVolmetricDrillingPlugin::checkShaftCollision(){
-
-    m_maxError = 0;
-    m_targetToolCursor = m_toolCursorList[0];
-    m_targetToolCursorIdx = 0;
-    for(int i=0; i<m_toolCursorList.size(); i++)
-    {
-
-        m_currError = cDistance(m_toolCursorList[i]->m_hapticPoint->getLocalPosProxy(), m_toolCursorList[i]->m_hapticPoint->getLocalPosGoal());
-
-        if(abs(m_currError) > abs(m_maxError + 0.00001))
-        {
-            m_maxError = m_currError;
-            m_targetToolCursor = m_toolCursorList[i];
-            m_targetToolCursorIdx = i;
+void afVolmetricDrillingPlugin::applyJournalCommand(const DrillCommand &a_command){
+    double simTime = m_physicsState.m_simTime;
+    switch (a_command.m_type) {
+    case DrillCommand::CHECKPOINT:{
+        size_t count = m_voxelJournal.createCheckpoint(simTime);
+        cerr << "INFO! SAVED CHECKPOINT " << count << " AT " << simTime << " S" << endl;
+        break;
+    }
+    case DrillCommand::UNDO:{
+        double targetTime = simTime - a_command.m_seconds;
+        if (targetTime < m_voxelJournal.getOldestTime()){
+            cerr << "WARNING! THE JOURNAL ONLY GOES BACK TO " << m_voxelJournal.getOldestTime() << " S" << endl;
+        }
+        m_core.rollbackTo(m_voxelJournal.getPositionAt(targetTime));
+        break;
+    }
+    case DrillCommand::ROLLBACK_TO_CHECKPOINT:{
+        uint64_t position;
+        double checkpointTime;
+        if (!m_voxelJournal.getLastCheckpoint(position, checkpointTime)){
+            cerr << "WARNING! NO CHECKPOINT TO ROLL BACK TO" << endl;
+            break;
         }
+        m_core.rollbackTo(position);
+        cerr << "INFO! ROLLED BACK TO THE CHECKPOINT AT " << checkpointTime << " S" << endl;
+        break;
     }
+    case DrillCommand::CLEAR_JOURNAL:
+        m_voxelJournal.clear();
+        break;
+    default:
+        break;
+    }
+}
+
+void afVolmetricDrillingPlugin::resetDrill(){
+    DrillCommand command;
+    command.m_type = DrillCommand::RESET;
+    sendDrillCommand(command);
 }
 
+void afVolmetricDrillingPlugin::resetDrillState(){
+    m_hapticDevice->setForce(cVector3d(0., 0., 0.));
+    m_T_d = m_T_d_init;
+    m_core.toolCursorsPosUpdate(m_T_d);
+    m_core.toolCursorsInitialize();
+    drillPoseUpdateFromCursors();
+}
 
 ///
 /// \brief This method updates the position of the drill mesh.
 /// After obtaining g_targetToolCursor, the drill mesh adjust it's position and rotation
-/// such that it follows the proxy position of the g_targetToolCursor.
+/// such that it follows the proxy position of the g_targetToolCursor. The pose is stored in
+/// m_drillMeshPose and applied to the drill rigid body by the physics update.
 ///
 void afVolmetricDrillingPlugin::drillPoseUpdateFromCursors(){
     cMatrix3d newDrillRot;
     newDrillRot = m_toolCursorList[0]->getDeviceLocalRot();
+    cToolCursor* targetToolCursor = m_core.getTargetToolCursor();
+    int targetToolCursorIdx = m_core.getTargetToolCursorIdx();
 //    cerr << newDrillRot.str(2) << endl;
 
-    if(m_targetToolCursorIdx == 0){
+    if(targetToolCursorIdx == 0){
         cTransform T_tip;
         T_tip.setLocalPos(m_toolCursorList[0]->m_hapticPoint->getLocalPosProxy());
         T_tip.setLocalRot(newDrillRot);
-        m_drillRigidBody->setLocalTransform(T_tip);
+        m_drillMeshPose = T_tip;
     }
-    else if(cDistance(m_targetToolCursor->m_hapticPoint->getLocalPosProxy(), m_targetToolCursor->m_hapticPoint->getLocalPosGoal()) <= 0.001)
+    else if(cDistance(targetToolCursor->m_hapticPoint->getLocalPosProxy(), targetToolCursor->m_hapticPoint->getLocalPosGoal()) <= 0.001)
     {
         // direction of positive x-axis of drill mesh
-        cVector3d xDir = m_drillRigidBody->getLocalRot().getCol0();
+        cVector3d xDir = m_drillMeshPose.getLocalRot().getCol0();
 
         cVector3d newDrillPos;
 
         // drill mesh will make a sudden jump towards the followSphere
         if(!m_suddenJump)
         {
-            newDrillPos = (m_targetToolCursor->m_hapticPoint->getLocalPosProxy() - xDir * m_dX * m_targetToolCursorIdx);
+            newDrillPos = (targetToolCursor->m_hapticPoint->getLocalPosProxy() - xDir * m_dX * targetToolCursorIdx);
         }
 
         // drill mesh slowly moves towards the followSphere
         else
         {
-            newDrillPos = m_drillRigidBody->getLocalPos() + ((m_targetToolCursor->m_hapticPoint->getLocalPosProxy() - xDir * m_dX * m_targetToolCursorIdx) - m_drillRigidBody->getLocalPos()) * 0.04;
+            newDrillPos = m_drillMeshPose.getLocalPos() + ((targetToolCursor->m_hapticPoint->getLocalPosProxy() - xDir * m_dX * targetToolCursorIdx) - m_drillMeshPose.getLocalPos()) * 0.04;
         }
 
 //        cVector3d L = g_targetToolCursor->m_hapticPoint->getLocalPosProxy() - g_toolCursorList[0]->getDeviceLocalPos();
@@ -637,8 +2168,7 @@ void afVolmetricDrillingPlugin::drillPoseUpdateFromCursors(){
         trans.setLocalRot(newDrillRot);
 
 //        g_drillRigidBody->setLocalPos(g_drillRigidBody->getLocalPos() + newDrillPos);
-        m_drillRigidBody->setLocalTransform(trans);
-        m_drillAudioSource->setSourcePos(newDrillPos);
+        m_drillMeshPose = trans;
     }
 }
 
@@ -649,13 +2179,14 @@ void afVolmetricDrillingPlugin::drillPoseUpdateFromCursors(){
 ///
 void afVolmetricDrillingPlugin::changeBurrSize(int burrType){
     if (m_drillBurrSizes.find(burrType) != m_drillBurrSizes.end()){
-        m_toolCursorList[0]->setRadius(m_drillBurrSizes[burrType].first);
         m_burrMesh->setRadius(m_drillBurrSizes[burrType].first);
         cout << "Drill Size changed to " << m_drillBurrSizes[burrType].second << endl;
         m_drillSizeText->setText("Drill Size: " + m_drillBurrSizes[burrType].second);
 
-        double sim_time = m_drillRigidBody->getCurrentTimeStamp();
-        m_drillingPub->burrChange(m_drillBurrSizes[burrType].first, sim_time);
+        DrillCommand command;
+        command.m_type = DrillCommand::CHANGE_BURR;
+        command.m_burrIdx = burrType;
+        sendDrillCommand(command);
     }
     else{
         cerr << "ERROR! DRILL BURR AT INDEX " << burrType << " DOES NOT EXIST" << endl;
@@ -727,23 +2258,49 @@ void afVolmetricDrillingPlugin::keyboardUpdate(GLFWwindow *a_window, int a_key,
             }
         }
 
-        // option - polygonize model and save to file
+        // option - export the surface of the volume to a file, meshed in the background
         else if (a_key == GLFW_KEY_P) {
-            cMultiMesh *surface = new cMultiMesh;
-            m_voxelObj->polygonize(surface, 0.01, 0.01, 0.01);
-            double SCALE = 0.1;
-            double METERS_TO_MILLIMETERS = 1000.0;
-            surface->scale(SCALE * METERS_TO_MILLIMETERS);
-            surface->setUseVertexColors(true);
-            surface->saveToFile("volume.obj");
-            cout << "> Volume has been polygonized and saved to disk                            \r";
-            delete surface;
+            if (!m_surfaceMesher.isRunning()){
+                m_surfaceMesher.start();
+            }
+            m_surfaceMesher.requestExport("volume.obj", s_millimetersPerUnit);
+            cout << "> Volume surface export requested, saving to disk in the background        \r";
         }
 
-        // toggles size of drill burr/tip tool cursor
+        // toggles the recording of the haptic loop inputs
+        else if (a_key == GLFW_KEY_E){
+            if (m_inputRecorder.isRecording()){
+                stopInputRecording();
+            }
+            else{
+                startInputRecording("");
+            }
+        }
+
+        // toggles the recording of the session to HDF5
+        else if (a_key == GLFW_KEY_H){
+            if (m_sessionRecorder.isRecording()){
+                stopSessionRecording();
+            }
+            else{
+                startSessionRecording("");
+            }
+        }
+
+        // restores the volume to its original state
         else if (a_key == GLFW_KEY_N){
             cerr << "INFO! RESETTING THE VOLUME" << endl;
-            m_volumeObject->reset();
+            resetVolume();
+        }
+
+        // rolls back the last seconds of drilling
+        else if (a_key == GLFW_KEY_Z){
+            sendJournalCommand(DrillCommand::UNDO, m_undoInterval);
+        }
+
+        // saves a checkpoint of the volume to roll back to with [ALT+J]
+        else if (a_key == GLFW_KEY_J){
+            sendJournalCommand(DrillCommand::CHECKPOINT, 0.0);
         }
 
         // Reset the drill pose
@@ -753,8 +2310,13 @@ void afVolmetricDrillingPlugin::keyboardUpdate(GLFWwindow *a_window, int a_key,
         }
     }
     else if(a_mods == GLFW_MOD_ALT){
+        // Roll back the volume to the last checkpoint
+        if (a_key == GLFW_KEY_J){
+            sendJournalCommand(DrillCommand::ROLLBACK_TO_CHECKPOINT, 0.0);
+        }
+
         // Toggle Volume Smoothing
-        if (a_key == GLFW_KEY_S){
+        else if (a_key == GLFW_KEY_S){
             m_enableVolumeSmoothing = !m_enableVolumeSmoothing;
             cerr << "INFO! ENABLE VOLUME SMOOTHING: " << m_enableVolumeSmoothing << endl;
             m_volumeObject->getShaderProgram()->setUniformi("uSmoothVolume", m_enableVolumeSmoothing);
@@ -763,13 +2325,15 @@ void afVolmetricDrillingPlugin::keyboardUpdate(GLFWwindow *a_window, int a_key,
         }
         else if(a_key == GLFW_KEY_UP){
             m_volumeSmoothingLevel = cClamp(m_volumeSmoothingLevel+1, 1, 10);
+            m_qualityController.setMaxSmoothingLevel(m_volumeSmoothingLevel);
             cerr << "INFO! SETTING SMOOTHING LEVEL " << m_volumeSmoothingLevel << endl;
-            m_volumeObject->getShaderProgram()->setUniformi("uSmoothingLevel", m_volumeSmoothingLevel);
+            m_volumeObject->getShaderProgram()->setUniformi("uSmoothingLevel", m_qualityController.isEnabled() ? m_qualityController.getSmoothingLevel() : m_volumeSmoothingLevel);
         }
         else if(a_key == GLFW_KEY_DOWN){
             m_volumeSmoothingLevel = cClamp(m_volumeSmoothingLevel-1, 1, 10);
+            m_qualityController.setMaxSmoothingLevel(m_volumeSmoothingLevel);
             cerr << "INFO! SETTING SMOOTHING LEVEL " << m_volumeSmoothingLevel << endl;
-            m_volumeObject->getShaderProgram()->setUniformi("uSmoothingLevel", m_volumeSmoothingLevel);
+            m_volumeObject->getShaderProgram()->setUniformi("uSmoothingLevel", m_qualityController.isEnabled() ? m_qualityController.getSmoothingLevel() : m_volumeSmoothingLevel);
         }
 
         std::string text = "[ALT+S] Volume Smoothing: " + std::string(m_enableVolumeSmoothing ? "ENABLED" : "DISABLED");
@@ -843,15 +2407,25 @@ void afVolmetricDrillingPlugin::keyboardUpdate(GLFWwindow *a_window, int a_key,
         }
         // option - decrease quality of graphic rendering
         else if (a_key == GLFW_KEY_L) {
-            double value = m_voxelObj->getQuality();
+            // with the adaptive quality the keys move its ceiling
+            double value = m_qualityController.isEnabled() ? m_qualityController.getMaxQuality() : m_voxelObj->getQuality();
             m_voxelObj->setQuality(value - 0.01);
+            if (m_qualityController.isEnabled()){
+                m_qualityController.setMaxQuality(m_voxelObj->getQuality());
+                m_voxelObj->setQuality(m_qualityController.getQuality());
+            }
             cout << "> Quality set to " << cStr(m_voxelObj->getQuality(), 1) << "                            \r";
         }
 
         // option - increase quality of graphic rendering
         else if (a_key == GLFW_KEY_U) {
-            double value = m_voxelObj->getQuality();
+            // with the adaptive quality the keys move its ceiling
+            double value = m_qualityController.isEnabled() ? m_qualityController.getMaxQuality() : m_voxelObj->getQuality();
             m_voxelObj->setQuality(value + 0.01);
+            if (m_qualityController.isEnabled()){
+                m_qualityController.setMaxQuality(m_voxelObj->getQuality());
+                m_voxelObj->setQuality(m_qualityController.getQuality());
+            }
             cout << "> Quality set to " << cStr(m_voxelObj->getQuality(), 1) << "                            \r";
         }
 
@@ -998,8 +2572,8 @@ void afVolmetricDrillingPlugin::keyboardUpdate(GLFWwindow *a_window, int a_key,
 
         // toggles size of drill burr/tip tool cursor
         else if (a_key == GLFW_KEY_C){
-            m_activeBurrIdx = (m_activeBurrIdx + 1) % 3;
-            changeBurrSize(m_activeBurrIdx);
+            m_selectedBurrIdx = (m_selectedBurrIdx + 1) % 3;
+            changeBurrSize(m_selectedBurrIdx);
         }
 
         else if (a_key == GLFW_KEY_KP_ADD){
@@ -1020,6 +2594,10 @@ void afVolmetricDrillingPlugin::keyboardUpdate(GLFWwindow *a_window, int a_key,
         }
     }
 
+    // the haptic level follows the cropping of the volume
+    if (m_hapticVoxelObj){
+        updateHapticLevelBounds();
+    }
 }
 
 
@@ -1038,13 +2616,60 @@ void afVolmetricDrillingPlugin::reset(){
 
 bool afVolmetricDrillingPlugin::close()
 {
+    if (m_volumeResetThread.joinable()){
+        m_volumeResetThread.join();
+    }
+    if (m_hapticThreadRunning.exchange(false)){
+        m_hapticThread.join();
+        cerr << "INFO! HAPTIC THREAD RAN " << m_hapticTickCount.load() << " TICKS, "
+             << m_hapticOverrunCount.load() << " MISSED THEIR PERIOD" << endl;
+    }
+
+    m_core.stop();
+    m_criticalFieldPool.stop();
+
+    // the haptic loop is stopped, the recording is complete
+    if (m_inputRecorder.isRecording()){
+        stopInputRecording();
+    }
+    if (m_sessionRecorder.isRecording()){
+        stopSessionRecording();
+    }
+
     for(auto tool : m_toolCursorList)
     {
         tool->stop();
     }
 
-    if (m_drillAudioSource){
-        delete m_drillAudioSource;
+    m_surfaceMesher.stop();
+    m_volumeSharedMemory.close();
+    m_occupancyTexture.destroy();
+    m_paletteTexture.destroy();
+    if (m_gpuCarver.isEnabled()){
+        if (m_gpuCarver.getDroppedRequestCount() > 0){
+            cerr << "WARNING! " << m_gpuCarver.getDroppedRequestCount() << " GPU CARVE REQUESTS DIDN'T FIT IN THE QUEUE" << endl;
+        }
+        m_gpuCarver.destroy();
+    }
+    m_gpuFrameTimer.destroy();
+
+    // the timed threads are stopped, the trace is complete
+    if (!m_perfTraceFilepath.empty()){
+        if (m_perf.writeTrace(m_perfTraceFilepath)){
+            cerr << "INFO! WROTE THE PERF TRACE TO " << m_perfTraceFilepath;
+            if (m_perf.getTraceDroppedCount() > 0){
+                cerr << ", " << m_perf.getTraceDroppedCount() << " EVENTS DIDN'T FIT";
+            }
+            cerr << endl;
+        }
+        else{
+            cerr << "ERROR! FAILED TO WRITE THE PERF TRACE TO " << m_perfTraceFilepath << endl;
+        }
+    }
+
+    cAudioSource* audioSource = m_drillAudioSource.exchange(nullptr);
+    if (audioSource){
+        delete audioSource;
     }
     if (m_drillAudioBuffer){
         delete m_drillAudioBuffer;
@@ -1055,5 +2680,12 @@ bool afVolmetricDrillingPlugin::close()
     }
     delete m_deviceHandler;
 
+    // Flush the removals queued right before shutdown
+    if (m_drillingPub){
+        m_drillingPub->close();
+        delete m_drillingPub;
+        m_drillingPub = nullptr;
+    }
+
     return true;
 }
@@ -2,11 +2,80 @@
 #define GL_SILENCE_DEPRECATION
 #include <afFramework.h>
 #include "collision_publisher.h"
+#include "burr_stencil.h"
+#include "dirty_bricks.h"
+#include "brick_occupancy.h"
+#include "occupancy_texture.h"
+#include "palette_texture.h"
+#include "gpu_voxel_carver.h"
+#include "volume_cache.h"
+#include "slice_loader.h"
+#include "render_quality.h"
+#include "drilling_core.h"
+#include "triple_buffer.h"
+#include "perf_profiler.h"
+#include "removal_statistics.h"
+#include "input_recorder.h"
+#include "session_recorder.h"
+#include "volume_shared_memory.h"
+#include "surface_mesher.h"
+#include "critical_distance_field.h"
+#include "spsc_ring_buffer.h"
+#include "asset_loader.h"
+#include <chrono>
 
 using namespace std;
 using namespace ambf;
 
-class afVolmetricDrillingPlugin: public afSimulatorPlugin{
+///
+/// \brief Pose of the drill and contact state, published by the haptic loop for the physics update
+///
+struct HapticSnapshot{
+    // pose the drill mesh follows, only applied when the haptic loop controls the drill
+    cTransform m_drillPose;
+    bool m_controlsDrillPose = false;
+
+    // motion of the camera while its clutch is pressed
+    bool m_cameraClutch = false;
+    cVector3d m_cameraMotion;
+
+    // the burr touched a voxel that isn't bone, or came within the warning distance of one
+    bool m_showWarning = false;
+
+    // 0 beyond the warning distance of the critical structures, up to 1 when the burr touches them
+    double m_criticalProximity = 0.0;
+
+    // force sent to the device, as a fraction of its maximum force
+    double m_forceRatio = 0.0;
+
+    unsigned long long m_tick = 0;
+};
+
+///
+/// \brief World state the haptic loop needs, published by the physics update
+///
+struct PhysicsSnapshot{
+    cTransform m_cameraTransform;
+    bool m_overrideDrillControl = false;
+    // pose of the drill rigid body, followed by the haptic loop when the drill control is overridden
+    cTransform m_drillPose;
+    double m_simTime = 0.0;
+    double m_dt = 0.0;
+};
+
+///
+/// \brief A change of the drill requested from the keyboard, applied by the haptic loop
+///
+struct DrillCommand{
+    enum Type{TRANSLATE, ROTATE, RESET, CHANGE_BURR, CHECKPOINT, UNDO, ROLLBACK_TO_CHECKPOINT, CLEAR_JOURNAL, RESET_VOLUME};
+    Type m_type;
+    cVector3d m_vector;
+    int m_burrIdx;
+    // seconds of drilling rolled back by UNDO
+    double m_seconds;
+};
+
+class afVolmetricDrillingPlugin: public afSimulatorPlugin, public DrillingEventListener{
 public:
     afVolmetricDrillingPlugin();
     virtual int init(int argc, char** argv, const afWorldPtr a_afWorld) override;
@@ -19,24 +88,37 @@ public:
     virtual void reset() override;
     virtual bool close() override;
 
-    DrillingPublisher* m_drillingPub;
+    // bytes of the volume texture re-uploaded in the last graphics update and since start
+    size_t getTextureUploadBytesLastFrame() const {return m_textureUploadBytesLastFrame;}
+    size_t getTextureUploadBytesTotal() const {return m_textureUploadBytesTotal;}
+
+    DrillingPublisher* m_drillingPub = nullptr;
 protected:
     // Initialize tool cursors
     void toolCursorInit(const afWorldPtr);
 
-    void incrementDevicePos(cVector3d a_pos);
+    // one tick of the tool cursor / voxel loop, run by the physics update or the haptic thread
+    void hapticUpdate(double a_dt);
 
-    void incrementDeviceRot(cVector3d a_rot);
+    // runs hapticUpdate at the fixed haptic rate
+    void hapticLoop();
 
-    void toolCursorsInitialize();
+    // applies the state published by the haptic loop to the world
+    void applyHapticSnapshot(const HapticSnapshot& a_snapshot, const cTransform& a_cameraTransform);
 
-    // update position of shaft tool cursors
-    void toolCursorsPosUpdate(cTransform a_devicePose);
+    // queues a change of the drill for the haptic loop
+    void sendDrillCommand(const DrillCommand& a_command);
+
+    void applyDrillCommand(const DrillCommand& a_command);
+
+    void incrementDevicePos(cVector3d a_pos);
+
+    void incrementDeviceRot(cVector3d a_rot);
 
     void resetDrill();
 
-    // check for shaft collision
-    void checkShaftCollision(void);
+    // resets the drill from the haptic loop
+    void resetDrillState();
 
     // update position of drill mesh
     void drillPoseUpdateFromCursors(void);
@@ -44,12 +126,124 @@ protected:
     // toggles size of the drill burr
     void changeBurrSize(int burrType);
 
+    // starts a recording of the haptic loop inputs, a timestamped file is used if the path is empty
+    bool startInputRecording(string a_filepath);
+
+    void stopInputRecording();
+
+    // fills m_inputRecord with the drill pose of this tick and hands it to the recorder
+    void recordInputs(double a_dt);
+
+    // starts recording the cameras, poses and removals to an HDF5 file, a timestamped file is
+    // used if the path is empty
+    bool startSessionRecording(string a_filepath);
+
+    void stopSessionRecording();
+
+    // reads back the cameras at the session rate and queues the frames read back, from the graphics thread
+    void updateSessionRecording();
+
+    // poses of the recorded objects, in the order of their names
+    void getSessionPoses(vector<SessionPose>& a_poses);
+
+    // publishes a voxel removed by the burr and raises the warning outside the bone
+    virtual void voxelRemoved(int a_x, int a_y, int a_z, const cColorb& a_color, int a_label) override;
+
+    // publishes the voxels removed in a tick and flags the volume for an update
+    virtual void voxelsRemoved(size_t a_count) override;
+
+    virtual void burrChanged(int a_burrIdx, double a_radius) override;
+
+    virtual void voxelRestored(int a_x, int a_y, int a_z, const cColorb& a_color, int a_label) override;
+
+    // true if a voxel is bone, by its label in a labeled volume
+    bool isBoneVoxel(const cColorb& a_color, int a_label) const{
+        return m_voxelPalette.isEmpty() ? a_color == m_boneColor : a_label == m_boneLabel;
+    }
+
+    // flags the volume for an update after a rollback of the journal
+    virtual void voxelsRestored(size_t a_count) override;
+
+    // grows the box of the critical voxels modified in this tick
+    void markCriticalVoxel(int a_x, int a_y, int a_z);
+
+    // hands the box of the critical voxels modified in this tick to the graphics thread
+    void publishCriticalBox();
+
+    // loads the distance field to the critical structures of the voxels from its cache, or
+    // computes it
+    void initCriticalDistanceField(CriticalDistanceField& a_field, const unsigned char* a_data, int a_bytesPerVoxel);
+
+    // distance between the burr and the critical structures, sets the proximity of the snapshot
+    void updateCriticalProximity();
+
+    // queues a command that acts on the journal, if it is enabled
+    void sendJournalCommand(DrillCommand::Type a_type, double a_seconds);
+
+    // applies a command on the journal from the haptic loop
+    void applyJournalCommand(const DrillCommand& a_command);
+
+    // creates the GPU carver once the GL context is current, falls back to the CPU removal on failure
+    void initGpuCarving();
+
+    // hands the burr of this tick to the GPU carver
+    void submitGpuCarve();
+
+    // removes the voxels carved by the GPU from the CPU copy of the volume, from the haptic loop
+    void applyGpuCarvedVoxels();
+
+    // uploads a box of the volume image to the 3D texture
+    void uploadVolumeBox(const VoxelBox& a_box);
+
+    // replaces the RGBA image of the volume by the labels and densities of its colors
+    bool convertVolumeToLabels();
+
+    // creates the coarse level of the volume the tool cursors collide with
+    void initHapticLevel(int a_factor);
+
+    // copies the corners of the volume to the haptic level, with its texture coordinates
+    void updateHapticLevelBounds();
+
+    // maps the binary cache of the volume, writing it first if it's missing or outdated
+    void initVolumeCache(const VolumeImageSource& a_source, uint64_t a_sourceHash);
+
+    // loads the slices of a volume whose ADF only gives the simulator a placeholder, from the
+    // cache or with the parallel slice loader
+    bool loadDeferredVolume(bool a_useCache);
+
+    // restores the volume to its original state, the voxels are restored by the haptic loop
+    void resetVolume();
+
+    // builds the restored voxels, their occupancy and their distances to the critical
+    // structures. Runs on the reset thread
+    void prepareVolumeReset();
+
+    // swaps the restored voxels, occupancy and distances in. Runs on the haptic loop, the only
+    // writer of the volume
+    void applyVolumeReset();
+
+    // uploads the restored volume and rebuilds what the graphics thread derives from it, once
+    // the haptic loop has restored the voxels
+    void finishVolumeReset();
+
+    // adapts the rendering quality of the volume to the measured frame times
+    void updateRenderQuality();
+
+    // publishes the stage latencies and updates their overlay, at the perf publish rate
+    void updatePerfStats();
+
+    // publishes the per label summary of the removed voxels, at the removal stats rate
+    void updateRemovalStats();
+
+    // puts the assets loaded in the background in the scene in place of their placeholders
+    void swapInLoadedAssets();
+
     bool getOverrideDrillControl(){return m_overrideDrillControl;}
 
     void setOverrideDrillControl(bool val){m_overrideDrillControl = val;}
 
 private:
-    cTransform m_T_d, m_T_d_init; // Drills target pose
+    cTransform m_T_d, m_T_d_init; // Drills target pose, only used by the haptic loop
     cTransform m_T_i; // Input device transform
     cVector3d m_V_i; // Input device linear velocity
 
@@ -57,17 +251,120 @@ private:
 
     cVoxelObject* m_voxelObj;
 
-    cToolCursor* m_targetToolCursor;
+    // hidden coarse level of the volume the tool cursors collide with, null if they collide with m_voxelObj
+    cVoxelObject* m_hapticVoxelObj = nullptr;
+    double m_hapticTextureScale[3];
 
     int m_renderingMode = 0;
 
     double m_opticalDensity;
 
-    cMutex m_mutexVoxel;
+    // hands the modified bricks from the physics thread to the graphics thread once per tick
+    DirtyBrickExchange m_dirtyBrickExchange;
+
+    // bricks waiting to be uploaded to the texture, only touched by the graphics thread
+    DirtyBrickSet m_dirtyBricks;
+
+    // boxes of voxels uploaded in the current graphics update
+    vector<VoxelBox> m_uploadBoxes;
+
+    // maximum number of voxels re-uploaded to the texture per graphics update, 0 = unlimited
+    size_t m_textureUploadBudget = 0;
+
+    // voxel removal, tool cursor poses, broad-phase and forces, shared with the benchmark
+    DrillingCore m_core;
+
+    // voxels removed by the drill, written and rolled back by the haptic loop
+    VoxelJournal m_voxelJournal;
+
+    // seconds of drilling rolled back by [CTRL+Z]
+    double m_undoInterval = 5.0;
+
+    // distance from the voxels to the critical structures, updated by the graphics thread
+    CriticalDistanceField m_criticalField;
+
+    // workers helping the graphics thread update the distances around the drilled boxes
+    ParallelForPool m_criticalFieldPool;
+
+    // distance between the burr and the critical structures that raises the warning, 0 = disabled
+    double m_criticalWarningDistance = 0.0;
+
+    // force pushing the burr away from the critical structures at contact, 0 = disabled
+    double m_criticalForce = 0.0;
+
+    // raise the pitch of the drill as it gets closer to the critical structures
+    bool m_criticalAudio = false;
 
-    cCollisionAABBBox m_volumeUpdate;
+    // critical voxels modified in the current tick and the boxes handed to the graphics thread
+    VoxelBox m_tickCriticalBox;
+    bool m_tickCriticalModified = false;
+    SPSCRingBuffer<VoxelBox> m_criticalBoxes{256};
 
-    cColorb m_zeroColor;
+    // one texel per brick, used by the volume shaders to skip the empty space
+    OccupancyTexture m_occupancyTexture;
+
+    // mesh of the volume surface, updated from the uploaded boxes and exported in the background
+    SurfaceMesher m_surfaceMesher;
+
+    bool m_emptySpaceSkipping = true;
+
+    // texture unit of the occupancy texture, unused by the voxel object's own textures
+    int m_occupancyTextureUnit = 7;
+
+    // colors of the labels when the volume is stored as labels and densities, empty otherwise
+    VoxelPalette m_voxelPalette;
+    PaletteTexture m_paletteTexture;
+    int m_paletteTextureUnit = 8;
+
+    // label of the bone color, 0 if the volume has no bone
+    int m_boneLabel = 0;
+
+    // carves the burr out of the volume texture, the CPU copy follows a few frames later
+    GpuVoxelCarver m_gpuCarver;
+    bool m_gpuCarvingRequested = false;
+    size_t m_gpuCarvingMaxVoxels = 0;
+    // set by the graphics thread once the carver runs, read by the haptic loop
+    std::atomic<bool> m_gpuCarving{false};
+
+    // bricks of the voxels carved by the GPU, the texture already holds them
+    DirtyBrickExchange m_carvedBrickExchange;
+    DirtyBrickSet m_carvedBricks;
+    vector<VoxelBox> m_carvedBoxes;
+
+    // voxels read back from the GPU, and those whose carve an upload overwrote, only touched by
+    // the haptic loop
+    vector<JournalEntry> m_gpuCarvedVoxels;
+    vector<JournalEntry> m_gpuStaleVoxels;
+
+    // measures the GPU time of the frames for the quality controller
+    GpuFrameTimer m_gpuFrameTimer;
+
+    // adjusts the quality and smoothing level of the volume to hold the target frame rate
+    RenderQualityController m_qualityController;
+
+    std::chrono::steady_clock::time_point m_lastGraphicsUpdateTime;
+    bool m_graphicsUpdateTimeValid = false;
+
+    // last position of the drill and time it last moved fast, seen by the graphics thread
+    cVector3d m_lastDrillPos;
+    double m_timeSinceFastMotion = 0.0;
+
+    // speed of the drill above which its motion is fast, in world units per second
+    double m_fastMotionSpeed = 0.5;
+
+    // time the drill must be slow for before the full quality is restored, in seconds
+    double m_fastMotionHoldTime = 0.3;
+
+    // images the volume was loaded from
+    VolumeImageSource m_volumeSource;
+
+    // read-only mapping of the original volume, used for resets
+    VolumeCache m_volumeCache;
+
+    size_t m_textureUploadBytesLastFrame = 0;
+    size_t m_textureUploadBytesTotal = 0;
+    // total at the last perf publish, for the upload rate
+    size_t m_textureUploadBytesPublished = 0;
 
     bool m_flagStart = true;
 
@@ -81,7 +378,25 @@ private:
     // a pointer to the current haptic device
     cGenericHapticDevicePtr m_hapticDevice;
 
-    bool m_flagMarkVolumeForUpdate = false;
+    // set by the physics thread when it has published modified bricks
+    std::atomic<bool> m_flagMarkVolumeForUpdate{false};
+
+    // the restored volume is built on the reset thread while the drilling goes on, then swapped
+    // in by the haptic loop
+    std::thread m_volumeResetThread;
+    bool m_volumeResetPreparing = false;
+    // set by the reset thread once it is done, m_volumeResetValid if it succeeded
+    std::atomic<bool> m_flagVolumeResetPrepared{false};
+    bool m_volumeResetValid = false;
+    vector<unsigned char> m_resetVoxels;
+    BrickOccupancy m_resetOccupancy;
+    CriticalDistanceField m_resetCriticalField;
+
+    // set by the graphics thread until the haptic loop has applied a requested volume reset,
+    // the modified bricks and critical boxes are left in their queues meanwhile
+    bool m_volumeResetPending = false;
+    // set by the haptic loop once the voxels of the volume are restored
+    std::atomic<bool> m_flagVolumeResetDone{false};
 
     afRigidBodyPtr m_drillRigidBody;
 
@@ -108,7 +423,79 @@ private:
     // list of tool cursors
     vector<cToolCursor*> m_toolCursorList;
 
-    // radius of tool cursors
+    // rate of the haptic thread in Hz, 0 to run the haptic loop in the physics update
+    double m_hapticRate = 0.0;
+
+    std::thread m_hapticThread;
+    std::atomic<bool> m_hapticThreadRunning{false};
+
+    // ticks of the haptic thread and the ones that missed their period
+    std::atomic<unsigned long long> m_hapticTickCount{0};
+    std::atomic<unsigned long long> m_hapticOverrunCount{0};
+
+    // state exchanged between the haptic loop and the physics update
+    TripleBuffer<HapticSnapshot> m_hapticSnapshots;
+    TripleBuffer<PhysicsSnapshot> m_physicsSnapshots;
+
+    // latest snapshots, each owned by the thread that reads it
+    PhysicsSnapshot m_physicsState;
+    HapticSnapshot m_hapticState;
+
+    // keyboard changes of the drill, applied by the haptic loop
+    SPSCRingBuffer<DrillCommand> m_drillCommands{256};
+
+    // pose of the drill mesh computed by the haptic loop
+    cTransform m_drillMeshPose;
+
+    // burr selected from the keyboard, the drilling core owns the one used by the haptic loop
+    int m_selectedBurrIdx = 0;
+
+    // timers of the stages of the haptic loop, the physics and the graphics updates
+    PerfProfiler m_perf;
+
+    // time between two publications of the stage latencies, in seconds
+    double m_perfPublishInterval = 1.0;
+    std::chrono::steady_clock::time_point m_lastPerfPublishTime;
+    vector<PerfStageStats> m_perfStats;
+
+    // removed voxels per label, removal rate and critical contact time, counted by the haptic
+    // loop and published every m_removalStatsInterval seconds, 0 = disabled
+    RemovalStatistics m_removalStats;
+    double m_removalStatsInterval = 0.0;
+    std::chrono::steady_clock::time_point m_lastRemovalStatsTime;
+    RemovalSummary m_removalSummary;
+    // a critical voxel was drilled in the current tick
+    bool m_tickCriticalContact = false;
+
+    // one label per timed stage, empty unless the overlay is enabled
+    vector<cLabel*> m_perfTexts;
+    cLabel* m_textureUploadText = nullptr;
+
+    // file the Chrome trace of the stages is written to on close, empty to disable
+    string m_perfTraceFilepath;
+
+    // inputs of the haptic loop, recorded for a replay in the benchmark
+    InputRecorder m_inputRecorder;
+    InputRecord m_inputRecord{};
+
+    // voxels of the volume exported for local processes, written with the uploaded bricks
+    VolumeSharedMemory m_volumeSharedMemory;
+
+    // cameras, poses and removals of the session, recorded to HDF5 without ROS
+    SessionRecorder m_sessionRecorder;
+    FrameReadback m_sessionReadback;
+    vector<FrameStreamDesc> m_sessionStreams;
+    vector<GLuint> m_sessionTextureIds;
+    vector<string> m_sessionPoseNames;
+    // capture time and poses of the frames in flight, per readback slot
+    vector<SessionFrame> m_sessionSlots;
+    // free frame waiting for the next readback
+    SessionFrame* m_sessionFrame = nullptr;
+    double m_sessionInterval = 1.0 / 30.0;
+    double m_sessionLastCaptureTime = -1.0;
+    unsigned long long m_sessionDroppedFrameCount = 0;
+
+    // radius of tool cursors, the cursors past the end of the list use its last radius
     vector<double> m_toolCursorRadius{0.02, 0.013, 0.015, 0.017, 0.019, 0.021, 0.023, 0.025};
 
     // warning pop-up panel
@@ -120,37 +507,38 @@ private:
     cLabel* m_drillSizeText;
     cLabel* m_drillControlModeText;
 
-    // current and maximum distance between proxy and goal spheres
-    double m_currError = 0;
-    double m_maxError = 0;
-
-    // for storing index of follow sphere
-    int m_targetToolCursorIdx = 0;
-
     // toggles whether the drill mesh should move slowly towards the followSphere
     // or make a sudden jump
     bool m_suddenJump = true;
 
-    // index of current drill size
-    int m_activeBurrIdx = 0;
-
     // A map of drill burr indices, radius and description
     map<int, pair<double, string>> m_drillBurrSizes;
 
+    // number of voxels along each axis of the volume
+    int m_voxelCount[3];
+
     // color property of bone
     cColorb m_boneColor;
 
-    // get color of voxels at (x,y,z)
-    cColorb m_storedColor;
-
     bool m_enableVolumeSmoothing = false;
     int m_volumeSmoothingLevel = 2;
 
     cLabel* m_volumeSmoothingText;
 
-    cAudioSource* m_drillAudioSource = nullptr;
+    // created by the graphics thread once its buffer is loaded, read by the physics update
+    std::atomic<cAudioSource*> m_drillAudioSource{nullptr};
     cAudioBuffer* m_drillAudioBuffer = nullptr;
     cAudioDevice* m_drillAudioDevice = nullptr;
+    bool m_mute = false;
+
+    // the matcaps and the drill sound are loaded by m_assetLoader during init and swapped in by
+    // graphicsUpdate, the timeline is printed once they all are
+    StartupTimeline m_startupTimeline;
+    AssetLoader m_assetLoader;
+    int m_volumeMatcapAsset = -1;
+    int m_drillMatcapAsset = -1;
+    int m_drillAudioAsset = -1;
+    bool m_firstFrameDrawn = false;
 };
 
 
@@ -0,0 +1,113 @@
+#include "voxel_journal.h"
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+VoxelJournal::VoxelJournal(){
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = 0;
+    }
+    m_maxBytes = 0;
+    m_basePosition = 0;
+    m_baseTime = 0.0;
+    m_droppedCount = 0;
+    m_rolledBackCount = 0;
+}
+
+bool VoxelJournal::init(const int a_voxelCount[3], size_t a_maxBytes){
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = a_voxelCount[i];
+    }
+    m_maxBytes = 0;
+    clear();
+    m_droppedCount = 0;
+    m_rolledBackCount = 0;
+
+    uint64_t voxels = uint64_t(m_voxelCount[0]) * m_voxelCount[1] * m_voxelCount[2];
+    if (voxels > UINT32_MAX){
+        cerr << "ERROR! THE VOXEL JOURNAL ONLY SUPPORTS VOLUMES OF UP TO 2^32 VOXELS" << endl;
+        return false;
+    }
+    m_maxBytes = a_maxBytes;
+    return true;
+}
+
+void VoxelJournal::commitTick(double a_time){
+    uint64_t end = m_chunks.empty() ? m_basePosition : m_chunks.back().m_end;
+    if (getPosition() == end){
+        return;
+    }
+    JournalChunk chunk;
+    chunk.m_time = a_time;
+    chunk.m_end = getPosition();
+    m_chunks.push_back(chunk);
+
+    if (getMemoryUsage() > m_maxBytes){
+        compact();
+    }
+}
+
+size_t VoxelJournal::createCheckpoint(double a_time){
+    JournalCheckpoint checkpoint;
+    checkpoint.m_time = a_time;
+    checkpoint.m_position = getPosition();
+    m_checkpoints.push_back(checkpoint);
+    return m_checkpoints.size();
+}
+
+bool VoxelJournal::getLastCheckpoint(uint64_t &a_position, double &a_time) const{
+    if (m_checkpoints.empty()){
+        return false;
+    }
+    a_position = m_checkpoints.back().m_position;
+    a_time = m_checkpoints.back().m_time;
+    return true;
+}
+
+uint64_t VoxelJournal::getPositionAt(double a_time) const{
+    // the chunks are sealed in time order
+    auto it = upper_bound(m_chunks.begin(), m_chunks.end(), a_time,
+                          [](double a_t, const JournalChunk& a_chunk){return a_t < a_chunk.m_time;});
+    if (it == m_chunks.begin()){
+        return m_basePosition;
+    }
+    return (it - 1)->m_end;
+}
+
+void VoxelJournal::clear(){
+    m_basePosition = getPosition();
+    m_entries.clear();
+    m_chunks.clear();
+    m_checkpoints.clear();
+    m_baseTime = 0.0;
+}
+
+size_t VoxelJournal::getMemoryUsage() const{
+    return m_entries.size() * sizeof(JournalEntry) + m_chunks.size() * sizeof(JournalChunk) +
+            m_checkpoints.size() * sizeof(JournalCheckpoint);
+}
+
+///
+/// \brief This method drops the oldest chunks until the journal is under its cap, a quarter of
+/// the cap below it so that the ticks that follow don't each drop a chunk. The positions of the
+/// remaining entries don't change, only the checkpoints older than the kept chunks are forgotten.
+///
+void VoxelJournal::compact(){
+    size_t target = m_maxBytes - m_maxBytes / 4;
+    while (!m_chunks.empty() && getMemoryUsage() > target){
+        const JournalChunk& chunk = m_chunks.front();
+        size_t count = size_t(chunk.m_end - m_basePosition);
+        m_entries.erase(m_entries.begin(), m_entries.begin() + count);
+        m_basePosition = chunk.m_end;
+        m_baseTime = chunk.m_time;
+        m_droppedCount += count;
+        m_chunks.pop_front();
+    }
+
+    size_t firstKept = 0;
+    while (firstKept < m_checkpoints.size() && m_checkpoints[firstKept].m_position < m_basePosition){
+        firstKept++;
+    }
+    m_checkpoints.erase(m_checkpoints.begin(), m_checkpoints.begin() + firstKept);
+}
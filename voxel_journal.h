@@ -0,0 +1,152 @@
+#ifndef VOXEL_JOURNAL_H
+#define VOXEL_JOURNAL_H
+
+#include <cstddef>
+#include <deque>
+#include <stdint.h>
+#include <vector>
+
+///
+/// \brief A voxel removed by the drill: its linear index and its bytes before it was cleared,
+/// its RGBA color or its label and density in a labeled volume
+///
+struct JournalEntry{
+    uint32_t m_voxelIdx;
+    unsigned char m_color[4];
+};
+
+///
+/// \brief Append-only journal of the removed voxels, so that the drilling can be rolled back
+/// to any earlier tick or checkpoint by restoring only the voxels removed since then. The
+/// entries of a tick are sealed into a chunk stamped with the time of the tick. A position in
+/// the journal counts every entry ever appended, so positions stay valid while the oldest
+/// chunks are dropped to keep the journal under its memory cap.
+///
+/// Appending, sealing and rolling back are meant to run on the thread that removes the voxels,
+/// the journal isn't thread safe.
+///
+class VoxelJournal{
+public:
+    VoxelJournal();
+
+    // A cap of 0 disables the journal. Returns false if the voxels can't be indexed in 32 bits
+    bool init(const int a_voxelCount[3], size_t a_maxBytes);
+
+    bool isEnabled() const {return m_maxBytes > 0;}
+
+    inline void append(int a_x, int a_y, int a_z, const unsigned char a_color[4]){
+        JournalEntry entry;
+        entry.m_voxelIdx = uint32_t((size_t(a_z) * m_voxelCount[1] + a_y) * m_voxelCount[0] + a_x);
+        for (int i = 0 ; i < 4 ; i++){
+            entry.m_color[i] = a_color[i];
+        }
+        m_entries.push_back(entry);
+    }
+
+    // Seals the entries appended since the last call into the chunk of the tick at a_time, then
+    // drops the oldest chunks if the journal is over its cap
+    void commitTick(double a_time);
+
+    // Saves the current position as a checkpoint, returns the number of checkpoints
+    size_t createCheckpoint(double a_time);
+
+    // Position of the most recent checkpoint, false if there is none or it was dropped
+    bool getLastCheckpoint(uint64_t& a_position, double& a_time) const;
+
+    // Position of the volume at a_time, i.e. after the last tick sealed at or before a_time.
+    // Clamped to the oldest position still held by the journal
+    uint64_t getPositionAt(double a_time) const;
+
+    uint64_t getPosition() const {return m_basePosition + m_entries.size();}
+
+    uint64_t getOldestPosition() const {return m_basePosition;}
+
+    // Removes the entries past a_position from the most recent one, calling
+    // a_restore(x, y, z, bytes) for each, and returns their number. The checkpoints past
+    // a_position are removed, one at a_position is kept so that the drilling can branch from it
+    // again. The entries appended since the last commitTick() are restored as well
+    template <class F>
+    size_t rollback(uint64_t a_position, F a_restore){
+        if (a_position < m_basePosition){
+            a_position = m_basePosition;
+        }
+        size_t count = 0;
+        while (getPosition() > a_position){
+            const JournalEntry& entry = m_entries.back();
+            uint32_t idx = entry.m_voxelIdx;
+            int x = int(idx % uint32_t(m_voxelCount[0]));
+            idx /= uint32_t(m_voxelCount[0]);
+            a_restore(x, int(idx % uint32_t(m_voxelCount[1])), int(idx / uint32_t(m_voxelCount[1])), entry.m_color);
+            m_entries.pop_back();
+            count++;
+        }
+        bool popped = false;
+        JournalChunk last;
+        while (!m_chunks.empty() && m_chunks.back().m_end > a_position){
+            last = m_chunks.back();
+            m_chunks.pop_back();
+            popped = true;
+        }
+        uint64_t end = m_chunks.empty() ? m_basePosition : m_chunks.back().m_end;
+        if (popped && end < a_position){
+            // the rollback stopped in the middle of a tick, the rest of it is kept
+            last.m_end = a_position;
+            m_chunks.push_back(last);
+        }
+        while (!m_checkpoints.empty() && m_checkpoints.back().m_position > a_position){
+            m_checkpoints.pop_back();
+        }
+        m_rolledBackCount += count;
+        return count;
+    }
+
+    // Forgets all the entries, e.g. after the volume was reset
+    void clear();
+
+    size_t getMemoryUsage() const;
+
+    size_t getEntryCount() const {return m_entries.size();}
+
+    size_t getChunkCount() const {return m_chunks.size();}
+
+    // the volume can't be rolled back to before the tick at this time, 0 if no tick was dropped
+    double getOldestTime() const {return m_baseTime;}
+
+    // number of entries dropped to stay under the cap since init
+    unsigned long long getDroppedCount() const {return m_droppedCount;}
+
+    unsigned long long getRolledBackCount() const {return m_rolledBackCount;}
+
+private:
+    struct JournalChunk{
+        double m_time;
+        // position after the last entry of the tick
+        uint64_t m_end;
+    };
+
+    struct JournalCheckpoint{
+        double m_time;
+        uint64_t m_position;
+    };
+
+    // drops the oldest chunks until the journal is under its cap
+    void compact();
+
+    int m_voxelCount[3];
+    size_t m_maxBytes;
+
+    // the deques free their blocks as the oldest chunks are dropped, without moving the others
+    std::deque<JournalEntry> m_entries;
+    std::deque<JournalChunk> m_chunks;
+    std::vector<JournalCheckpoint> m_checkpoints;
+
+    // position of the first entry of m_entries
+    uint64_t m_basePosition;
+    // time of the last dropped chunk, the oldest time the journal can roll back to
+    double m_baseTime;
+
+    unsigned long long m_droppedCount;
+    unsigned long long m_rolledBackCount;
+};
+
+#endif // VOXEL_JOURNAL_H
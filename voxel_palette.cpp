@@ -0,0 +1,73 @@
+#include "voxel_palette.h"
+#include <stdint.h>
+#include <unordered_map>
+
+using namespace std;
+
+static inline uint32_t packColor(const unsigned char* a_rgb){
+    return uint32_t(a_rgb[0]) | (uint32_t(a_rgb[1]) << 8) | (uint32_t(a_rgb[2]) << 16);
+}
+
+VoxelPalette::VoxelPalette(){
+    m_colors.assign(4 * MAX_LABELS, 0);
+    m_labelCount = 0;
+}
+
+///
+/// \brief This method converts an RGBA volume to labels and densities. Neighbouring voxels
+/// usually share their color, so the label of the previous voxel is tried before the map.
+///
+bool VoxelPalette::convert(const unsigned char *a_rgba, size_t a_voxelCount, unsigned char *a_labelDensity){
+    m_colors.assign(4 * MAX_LABELS, 0);
+    m_labelCount = 0;
+
+    unordered_map<uint32_t, unsigned char> labels;
+    uint32_t lastColor = 0;
+    unsigned char lastLabel = 0;
+    bool hasLast = false;
+
+    for (size_t i = 0 ; i < a_voxelCount ; i++){
+        const unsigned char* voxel = a_rgba + 4 * i;
+        unsigned char* out = a_labelDensity + 2 * i;
+        if ((voxel[0] | voxel[1] | voxel[2] | voxel[3]) == 0){
+            out[0] = 0;
+            out[1] = 0;
+            continue;
+        }
+
+        uint32_t color = packColor(voxel);
+        if (!hasLast || color != lastColor){
+            auto it = labels.find(color);
+            if (it == labels.end()){
+                if (m_labelCount == MAX_LABELS - 1){
+                    m_colors.assign(4 * MAX_LABELS, 0);
+                    m_labelCount = 0;
+                    return false;
+                }
+                m_labelCount++;
+                unsigned char* entry = &m_colors[4 * m_labelCount];
+                entry[0] = voxel[0];
+                entry[1] = voxel[1];
+                entry[2] = voxel[2];
+                entry[3] = 255;
+                it = labels.insert(make_pair(color, (unsigned char)m_labelCount)).first;
+            }
+            lastColor = color;
+            lastLabel = it->second;
+            hasLast = true;
+        }
+        out[0] = lastLabel;
+        out[1] = voxel[3];
+    }
+    return true;
+}
+
+int VoxelPalette::findLabel(const unsigned char a_rgb[3]) const{
+    for (int label = 1 ; label <= m_labelCount ; label++){
+        const unsigned char* entry = &m_colors[4 * label];
+        if (entry[0] == a_rgb[0] && entry[1] == a_rgb[1] && entry[2] == a_rgb[2]){
+            return label;
+        }
+    }
+    return 0;
+}
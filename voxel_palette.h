@@ -0,0 +1,49 @@
+#ifndef VOXEL_PALETTE_H
+#define VOXEL_PALETTE_H
+
+#include <cstddef>
+#include <vector>
+
+///
+/// \brief Colors of the labels of a volume stored with two bytes per voxel, an 8 bit label and
+/// an 8 bit density, instead of an RGBA color. Label 0 is the empty voxel, the other labels are
+/// the distinct colors of the RGBA volume, so up to 255 colors can be converted. The density is
+/// the alpha of the voxel, which is what the volume shaders threshold, and the conversion back
+/// to RGBA is exact.
+///
+class VoxelPalette{
+public:
+    static const int MAX_LABELS = 256;
+
+    VoxelPalette();
+
+    // Assigns a label to each distinct color of an RGBA volume and writes the label and density
+    // of its a_voxelCount voxels to a_labelDensity. Fails if the volume has more than 255 colors
+    bool convert(const unsigned char* a_rgba, size_t a_voxelCount, unsigned char* a_labelDensity);
+
+    // Label of a color, 0 if it isn't in the palette
+    int findLabel(const unsigned char a_rgb[3]) const;
+
+    // The palette color of the label of a voxel, with its density as alpha
+    inline void toRGBA(const unsigned char a_voxel[2], unsigned char a_rgba[4]) const{
+        const unsigned char* color = &m_colors[4 * a_voxel[0]];
+        a_rgba[0] = color[0];
+        a_rgba[1] = color[1];
+        a_rgba[2] = color[2];
+        a_rgba[3] = a_voxel[1];
+    }
+
+    bool isEmpty() const {return m_labelCount == 0;}
+
+    // number of labels, not counting the empty one
+    int getLabelCount() const {return m_labelCount;}
+
+    // MAX_LABELS RGBA colors, the texture the volume shaders look the labels up in
+    const std::vector<unsigned char>& getColors() const {return m_colors;}
+
+private:
+    std::vector<unsigned char> m_colors;
+    int m_labelCount;
+};
+
+#endif // VOXEL_PALETTE_H
@@ -0,0 +1,215 @@
+#include "voxel_remover.h"
+#include <cstring>
+#include <stdint.h>
+
+using namespace std;
+using namespace chai3d;
+
+VoxelRemover::VoxelRemover(){
+    m_voxelObj = NULL;
+    m_occupancy = NULL;
+    m_dirtyBricks = NULL;
+    m_journal = NULL;
+    m_palette = NULL;
+    m_stencilPadding = 1.0;
+    m_bytesPerVoxel = 4;
+    m_insideKernel = &VoxelRemover::removeStencilRows<0, false>;
+    m_clippedKernel = &VoxelRemover::removeStencilRows<0, true>;
+    m_modified = false;
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = 0;
+    }
+}
+
+void VoxelRemover::init(cVoxelObject *a_voxelObj, const int a_voxelCount[3], BrickOccupancy *a_occupancy, DirtyBrickSet *a_dirtyBricks){
+    m_voxelObj = a_voxelObj;
+    for (int i = 0 ; i < 3 ; i++){
+        m_voxelCount[i] = a_voxelCount[i];
+    }
+    m_occupancy = a_occupancy;
+    m_dirtyBricks = a_dirtyBricks;
+
+    // the RGBA and the label volumes have their own kernels, other formats take the generic one
+    m_bytesPerVoxel = min(int(m_voxelObj->m_texture->m_image->getBytesPerPixel()), 4);
+    switch (m_bytesPerVoxel) {
+    case 4:
+        m_insideKernel = &VoxelRemover::removeStencilRows<4, false>;
+        m_clippedKernel = &VoxelRemover::removeStencilRows<4, true>;
+        break;
+    case 2:
+        m_insideKernel = &VoxelRemover::removeStencilRows<2, false>;
+        m_clippedKernel = &VoxelRemover::removeStencilRows<2, true>;
+        break;
+    default:
+        m_insideKernel = &VoxelRemover::removeStencilRows<0, false>;
+        m_clippedKernel = &VoxelRemover::removeStencilRows<0, true>;
+        break;
+    }
+}
+
+cVector3d VoxelRemover::getVoxelCoordinates(const cVector3d &a_globalPos) const{
+    cVector3d localPos = cTranspose(m_voxelObj->getGlobalRot()) * (a_globalPos - m_voxelObj->getGlobalPos());
+    cVector3d voxelPos;
+    for (int i = 0 ; i < 3 ; i++){
+        double range = m_voxelObj->m_maxCorner(i) - m_voxelObj->m_minCorner(i);
+        double texCoord = m_voxelObj->m_minTextureCoord(i) + (localPos(i) - m_voxelObj->m_minCorner(i)) / range
+                * (m_voxelObj->m_maxTextureCoord(i) - m_voxelObj->m_minTextureCoord(i));
+        voxelPos(i) = texCoord * m_voxelCount[i];
+    }
+    return voxelPos;
+}
+
+double VoxelRemover::getVoxelSize(int a_axis) const{
+    return (m_voxelObj->m_maxCorner(a_axis) - m_voxelObj->m_minCorner(a_axis)) /
+            ((m_voxelObj->m_maxTextureCoord(a_axis) - m_voxelObj->m_minTextureCoord(a_axis)) * m_voxelCount[a_axis]);
+}
+
+void VoxelRemover::buildStencil(double a_radius, BurrStencil &a_stencil) const{
+    double radiusInVoxels[3];
+    for (int i = 0 ; i < 3 ; i++){
+        radiusInVoxels[i] = a_radius / getVoxelSize(i) + m_stencilPadding;
+    }
+    a_stencil.build(radiusInVoxels[0], radiusInVoxels[1], radiusInVoxels[2]);
+}
+
+inline void VoxelRemover::growModifiedBox(int a_x, int a_y, int a_z){
+    int voxel[3] = {a_x, a_y, a_z};
+    for (int i = 0 ; i < 3 ; i++){
+        if (!m_modified){
+            m_modifiedBox.m_min[i] = voxel[i];
+            m_modifiedBox.m_max[i] = voxel[i] + 1;
+        }
+        else{
+            m_modifiedBox.m_min[i] = min(m_modifiedBox.m_min[i], voxel[i]);
+            m_modifiedBox.m_max[i] = max(m_modifiedBox.m_max[i], voxel[i] + 1);
+        }
+    }
+    m_modified = true;
+}
+
+template <int BPV>
+inline bool VoxelRemover::removeVoxelAt(int a_x, int a_y, int a_z, unsigned char *a_voxel, VoxelRemovalListener *a_listener, cColorb &a_color){
+    const int bytesPerVoxel = BPV > 0 ? BPV : m_bytesPerVoxel;
+    m_occupancy->clearOccupied(a_x, a_y, a_z);
+
+    // with a fixed format the copy and the test are single loads the compiler can fold
+    unsigned char bytes[4] = {0, 0, 0, 0};
+    memcpy(bytes, a_voxel, bytesPerVoxel);
+    uint32_t word;
+    memcpy(&word, bytes, sizeof(word));
+    if (word == 0){
+        return false;
+    }
+
+    memset(a_voxel, 0, bytesPerVoxel);
+    m_dirtyBricks->markVoxel(a_x, a_y, a_z);
+    growModifiedBox(a_x, a_y, a_z);
+
+    if (m_journal){
+        m_journal->append(a_x, a_y, a_z, bytes);
+    }
+
+    if (a_listener){
+        decodeVoxel(bytes, a_color);
+        a_listener->voxelRemoved(a_x, a_y, a_z, a_color, getLabel(bytes));
+    }
+    return true;
+}
+
+///
+/// \brief This method walks the rows of a stencil centered on a voxel. Most of the burr is
+/// usually in air, so the occupancy bit is tested before the image is read. A voxel is empty
+/// when all its bytes are zero, whatever the format of the image.
+///
+template <int BPV, bool CLIP>
+size_t VoxelRemover::removeStencilRows(const BurrStencil &a_stencil, const int a_center[3], VoxelRemovalListener *a_listener){
+    const int bytesPerVoxel = BPV > 0 ? BPV : m_bytesPerVoxel;
+    unsigned char* data = m_voxelObj->m_texture->m_image->getData();
+    const size_t rowStride = size_t(m_voxelCount[0]);
+    const size_t sliceStride = rowStride * m_voxelCount[1];
+    cColorb color;
+    size_t removedCount = 0;
+
+    const vector<BurrStencilRow>& rows = a_stencil.getRows();
+    for (size_t ri = 0 ; ri < rows.size() ; ri++){
+        const BurrStencilRow& row = rows[ri];
+        int y = a_center[1] + row.m_y;
+        int z = a_center[2] + row.m_z;
+        int xMin = a_center[0] + row.m_xMin;
+        int xMax = a_center[0] + row.m_xMax;
+        if (CLIP){
+            if (y < 0 || z < 0 || y >= m_voxelCount[1] || z >= m_voxelCount[2]){
+                continue;
+            }
+            xMin = max(xMin, 0);
+            xMax = min(xMax, m_voxelCount[0] - 1);
+        }
+
+        unsigned char* voxel = data + (size_t(z) * sliceStride + size_t(y) * rowStride + xMin) * bytesPerVoxel;
+        for (int x = xMin ; x <= xMax ; x++, voxel += bytesPerVoxel){
+            if (m_occupancy->isOccupied(x, y, z) && removeVoxelAt<BPV>(x, y, z, voxel, a_listener, color)){
+                removedCount++;
+            }
+        }
+    }
+    return removedCount;
+}
+
+///
+/// \brief This method removes every occupied voxel of the stencil in one pass, with the kernel
+/// of the format of the image. Only the stencils that cross a face of the volume pay for the
+/// bound checks.
+///
+size_t VoxelRemover::removeVoxels(const BurrStencil &a_stencil, const cVector3d &a_globalPos, VoxelRemovalListener *a_listener){
+    if (a_stencil.isEmpty()){
+        return 0;
+    }
+
+    cVector3d centerVoxel = getVoxelCoordinates(a_globalPos);
+    int center[3];
+    bool inside = true;
+    for (int i = 0 ; i < 3 ; i++){
+        center[i] = int(floor(centerVoxel(i)));
+        inside &= center[i] - a_stencil.getExtent(i) >= 0 && center[i] + a_stencil.getExtent(i) < m_voxelCount[i];
+    }
+
+    return (this->*(inside ? m_insideKernel : m_clippedKernel))(a_stencil, center, a_listener);
+}
+
+bool VoxelRemover::removeVoxel(int a_x, int a_y, int a_z, VoxelRemovalListener *a_listener){
+    if (!m_occupancy->isOccupied(a_x, a_y, a_z)){
+        return false;
+    }
+    unsigned char* voxel = m_voxelObj->m_texture->m_image->getData()
+            + ((size_t(a_z) * m_voxelCount[1] + a_y) * m_voxelCount[0] + a_x) * m_bytesPerVoxel;
+    cColorb color;
+    return removeVoxelAt<0>(a_x, a_y, a_z, voxel, a_listener, color);
+}
+
+void VoxelRemover::restoreVoxel(int a_x, int a_y, int a_z, const unsigned char a_bytes[4]){
+    cImagePtr image = m_voxelObj->m_texture->m_image;
+    int bytesPerVoxel = min(int(image->getBytesPerPixel()), 4);
+    unsigned char* voxel = image->getData() + ((size_t(a_z) * m_voxelCount[1] + a_y) * m_voxelCount[0] + a_x) * bytesPerVoxel;
+    memcpy(voxel, a_bytes, bytesPerVoxel);
+    m_occupancy->setOccupied(a_x, a_y, a_z);
+    m_dirtyBricks->markVoxel(a_x, a_y, a_z);
+    growModifiedBox(a_x, a_y, a_z);
+}
+
+bool VoxelRemover::takeModifiedBox(VoxelBox &a_box){
+    if (!m_modified){
+        return false;
+    }
+    a_box = m_modifiedBox;
+    m_modified = false;
+    return true;
+}
+
+void VoxelRemover::decodeVoxel(const unsigned char a_bytes[4], cColorb &a_color) const{
+    if (m_palette){
+        m_palette->toRGBA(a_bytes, a_color.m_color);
+    }
+    else{
+        a_color.set(a_bytes[0], a_bytes[1], a_bytes[2], a_bytes[3]);
+    }
+}
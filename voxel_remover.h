@@ -0,0 +1,111 @@
+#ifndef VOXEL_REMOVER_H
+#define VOXEL_REMOVER_H
+
+#include <chai3d.h>
+#include "brick_occupancy.h"
+#include "burr_stencil.h"
+#include "dirty_bricks.h"
+#include "voxel_journal.h"
+#include "voxel_palette.h"
+
+///
+/// \brief Receives the voxels removed by a VoxelRemover, on the thread that removes them
+///
+class VoxelRemovalListener{
+public:
+    virtual ~VoxelRemovalListener(){}
+
+    // a_color is the color of the voxel before it was cleared and a_label its label in a labeled
+    // volume, 0 in an RGBA one
+    virtual void voxelRemoved(int a_x, int a_y, int a_z, const chai3d::cColorb& a_color, int a_label) = 0;
+};
+
+///
+/// \brief The voxel removal of the drill, shared by the plugin and the benchmark. It maps
+/// points to the voxels of a cVoxelObject and clears the occupied voxels of a burr stencil
+/// in its image, keeping the sparse occupancy and the set of modified bricks up to date.
+/// The voxels are accessed as raw bytes, so the image may hold RGBA colors or the labels and
+/// densities of a VoxelPalette. It doesn't depend on any rendering state.
+///
+class VoxelRemover{
+public:
+    VoxelRemover();
+
+    // The occupancy and the dirty bricks must be initialized with the voxel count of the volume.
+    // Selects the removal kernels of the format of the image, which must not change afterwards
+    void init(chai3d::cVoxelObject* a_voxelObj, const int a_voxelCount[3], BrickOccupancy* a_occupancy, DirtyBrickSet* a_dirtyBricks);
+
+    // Continuous voxel coordinates of a point given in the world frame,
+    // voxel (i, j, k) spans [i, i+1) x [j, j+1) x [k, k+1)
+    chai3d::cVector3d getVoxelCoordinates(const chai3d::cVector3d& a_globalPos) const;
+
+    // Size of a voxel along an axis of the volume, in world units
+    double getVoxelSize(int a_axis) const;
+
+    // Builds the stencil of a burr. The radius is padded, by one voxel by default, so that the
+    // voxels touching the proxy, which rests just outside the surface, are included
+    void buildStencil(double a_radius, BurrStencil& a_stencil) const;
+
+    // Voxels the stencils are padded by, more than one when the proxy rests on a coarser
+    // level of the volume than the one voxels are removed from
+    void setStencilPadding(double a_voxels) {m_stencilPadding = a_voxels;}
+
+    // Removes the occupied voxels of the stencil centered on the voxel that contains
+    // a_globalPos. Returns the number of voxels removed
+    size_t removeVoxels(const BurrStencil& a_stencil, const chai3d::cVector3d& a_globalPos, VoxelRemovalListener* a_listener);
+
+    // Removes a voxel if it is occupied, returns true if it was
+    bool removeVoxel(int a_x, int a_y, int a_z, VoxelRemovalListener* a_listener);
+
+    // Writes the bytes of a voxel removed earlier back to the image and marks it occupied
+    void restoreVoxel(int a_x, int a_y, int a_z, const unsigned char a_bytes[4]);
+
+    // Color of the bytes of a voxel
+    void decodeVoxel(const unsigned char a_bytes[4], chai3d::cColorb& a_color) const;
+
+    // Label of the bytes of a voxel, 0 if the volume isn't labeled
+    int getLabel(const unsigned char a_bytes[4]) const {return m_palette ? a_bytes[0] : 0;}
+
+    // The removed voxels are appended to the journal if it isn't null
+    void setJournal(VoxelJournal* a_journal) {m_journal = a_journal;}
+
+    // The palette of a labeled volume, null for an RGBA one
+    void setPalette(const VoxelPalette* a_palette) {m_palette = a_palette;}
+
+    // Box of the voxels removed or restored since the last call, false if there are none
+    bool takeModifiedBox(VoxelBox& a_box);
+
+private:
+    typedef size_t (VoxelRemover::*RemovalKernel)(const BurrStencil& a_stencil, const int a_center[3], VoxelRemovalListener* a_listener);
+
+    // Removes the voxels of the rows of a stencil. BPV is the number of bytes per voxel, 0 for
+    // a format only known at runtime, and CLIP is false when the stencil is inside the volume,
+    // so that the rows are walked without any bound check
+    template <int BPV, bool CLIP>
+    size_t removeStencilRows(const BurrStencil& a_stencil, const int a_center[3], VoxelRemovalListener* a_listener);
+
+    // clears an occupied voxel whose bytes start at a_voxel, BPV as in removeStencilRows()
+    template <int BPV>
+    inline bool removeVoxelAt(int a_x, int a_y, int a_z, unsigned char* a_voxel, VoxelRemovalListener* a_listener, chai3d::cColorb& a_color);
+
+    inline void growModifiedBox(int a_x, int a_y, int a_z);
+
+    chai3d::cVoxelObject* m_voxelObj;
+    int m_voxelCount[3];
+    BrickOccupancy* m_occupancy;
+    DirtyBrickSet* m_dirtyBricks;
+    VoxelJournal* m_journal;
+    const VoxelPalette* m_palette;
+    double m_stencilPadding;
+
+    // bytes per voxel of the image and the kernels of that format, for the stencils inside the
+    // volume and for the ones crossing its faces
+    int m_bytesPerVoxel;
+    RemovalKernel m_insideKernel;
+    RemovalKernel m_clippedKernel;
+
+    VoxelBox m_modifiedBox;
+    bool m_modified;
+};
+
+#endif // VOXEL_REMOVER_H
@@ -0,0 +1,98 @@
+#include "worker_pool.h"
+
+using namespace std;
+
+ParallelForPool::ParallelForPool(){
+    m_generation = 0;
+    m_stop = false;
+    m_task = NULL;
+    m_count = 0;
+    m_nextIndex.store(0);
+    m_doneCount.store(0);
+    m_activeWorkers.store(0);
+}
+
+ParallelForPool::~ParallelForPool(){
+    stop();
+}
+
+void ParallelForPool::start(int a_numWorkers){
+    stop();
+    m_stop = false;
+    for (int i = 0 ; i < a_numWorkers ; i++){
+        m_workers.push_back(thread(&ParallelForPool::workerLoop, this));
+    }
+}
+
+void ParallelForPool::stop(){
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeCondition.notify_all();
+    for (size_t i = 0 ; i < m_workers.size() ; i++){
+        m_workers[i].join();
+    }
+    m_workers.clear();
+}
+
+void ParallelForPool::run(ParallelTask &a_task, size_t a_count){
+    if (a_count == 0){
+        return;
+    }
+
+    if (m_workers.empty() || a_count == 1){
+        for (size_t i = 0 ; i < a_count ; i++){
+            a_task.run(i);
+        }
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        // a worker that woke up late for the previous call may still be checking for indices
+        while (m_activeWorkers.load(memory_order_acquire) != 0){
+            this_thread::yield();
+        }
+        m_task = &a_task;
+        m_count = a_count;
+        m_nextIndex.store(1, memory_order_relaxed);
+        m_doneCount.store(0, memory_order_relaxed);
+        m_generation++;
+    }
+    m_wakeCondition.notify_all();
+
+    a_task.run(0);
+    work();
+
+    // the remaining indices are short, spin rather than sleep on a condition
+    while (m_doneCount.load(memory_order_acquire) < a_count - 1 ||
+           m_activeWorkers.load(memory_order_acquire) != 0){
+        this_thread::yield();
+    }
+}
+
+void ParallelForPool::workerLoop(){
+    unsigned long long seenGeneration = 0;
+    while (true){
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_wakeCondition.wait(lock, [&]{return m_stop || m_generation != seenGeneration;});
+            if (m_stop){
+                return;
+            }
+            seenGeneration = m_generation;
+            m_activeWorkers.fetch_add(1, memory_order_relaxed);
+        }
+        work();
+        m_activeWorkers.fetch_sub(1, memory_order_release);
+    }
+}
+
+void ParallelForPool::work(){
+    size_t idx;
+    while ((idx = m_nextIndex.fetch_add(1, memory_order_relaxed)) < m_count){
+        m_task->run(idx);
+        m_doneCount.fetch_add(1, memory_order_release);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+///
+/// \brief A unit of work run by the ParallelForPool for each index of a range
+///
+class ParallelTask{
+public:
+    virtual ~ParallelTask(){}
+    virtual void run(size_t a_index) = 0;
+};
+
+///
+/// \brief A small pool of persistent worker threads for the physics loop. run() hands the
+/// indices of a task to the workers and the calling thread, and returns once all of them are
+/// done. Index 0 always runs on the calling thread, first, which is where the work bound to the
+/// haptic device belongs. The other indices are claimed one by one from a shared counter, so
+/// uneven costs are balanced. Nothing is allocated per call.
+///
+class ParallelForPool{
+public:
+    ParallelForPool();
+    ~ParallelForPool();
+
+    // Starts the workers, with 0 workers run() executes everything on the calling thread
+    void start(int a_numWorkers);
+
+    void stop();
+
+    int getNumWorkers() const {return int(m_workers.size());}
+
+    // Runs a_task for every index in [0, a_count) and waits for all of them.
+    // Must only be called from one thread at a time
+    void run(ParallelTask& a_task, size_t a_count);
+
+private:
+    void workerLoop();
+
+    // Claims and runs indices until none are left
+    void work();
+
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeCondition;
+    unsigned long long m_generation;
+    bool m_stop;
+
+    // Written under the mutex while no worker is active
+    ParallelTask* m_task;
+    size_t m_count;
+
+    std::atomic<size_t> m_nextIndex;
+    std::atomic<size_t> m_doneCount;
+    std::atomic<int> m_activeWorkers;
+};
+
+#endif // WORKER_POOL_H